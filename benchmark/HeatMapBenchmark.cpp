@@ -0,0 +1,492 @@
+/**
+ * HeatMapCore benchmark
+ *
+ * Generates synthetic points and clusters and measures the throughput of the computations the
+ * plugin runs on every data change: cluster moments, distributions, payload encoding, the
+ * dendrogram and marker ranking. Results are written as JSON, so that they can be tracked
+ * across releases; a summary table goes to stderr.
+ *
+ * Usage: HeatMapBenchmark [--suite quick|full] [--points N --dimensions D --clusters K]
+ *                         [--element float|uint16|uint8] [--zeros fraction] [--repetitions R]
+ *                         [--memory-limit GiB] [--output results.json]
+ */
+
+#include "ClusterDistributions.h"
+#include "ClusterStatistics.h"
+#include "DimensionSeriation.h"
+#include "HeatMapPayload.h"
+#include "HierarchicalClustering.h"
+#include "MarkerRanking.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <numeric>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace
+{
+    /** Synthetic data set size */
+    struct Scenario
+    {
+        std::string     name;               /** Scenario name */
+        std::size_t     numPoints;          /** Number of points */
+        std::size_t     numDimensions;      /** Number of dimensions */
+        std::size_t     numClusters;        /** Number of clusters */
+    };
+
+    /** Measurement of one computation in one scenario */
+    struct Result
+    {
+        std::string     scenario;           /** Scenario name */
+        std::string     name;               /** Computation name */
+        double          seconds = 0.0;      /** Fastest repetition */
+        double          medianSeconds = 0.0;/** Median repetition */
+        double          work = 0.0;         /** Amount of work per repetition, in units */
+        std::string     unit;               /** Unit of the work (throughput is work per second) */
+    };
+
+    /** Command line options */
+    struct Options
+    {
+        std::string             suite = "quick";        /** Predefined scenarios */
+        std::vector<Scenario>   scenarios;              /** Scenarios given on the command line */
+        std::string             element = "float";      /** Element type of the point values */
+        double                  zeros = 0.0;            /** Fraction of point values that are zero (sparse data) */
+        std::size_t             repetitions = 3;        /** Number of runs per computation */
+        double                  memoryLimit = 8.0;      /** Scenarios needing more GiB are skipped */
+        std::string             output;                 /** JSON output file (stdout when empty) */
+    };
+
+    /** Scenarios that run in seconds, for continuous integration */
+    const std::vector<Scenario> quickSuite = {
+        { "quick-100k-500-20",      100'000,        500,        20 },
+        { "quick-1M-50-200",        1'000'000,      50,         200 },
+        { "quick-20k-10k-10",       20'000,         10'000,     10 },
+    };
+
+    /** Scenarios at the scale of real panels; the largest need a big machine */
+    const std::vector<Scenario> fullSuite = {
+        { "wide-100k-20k-50",       100'000,        20'000,     50 },
+        { "wide-200k-10k-1k",       200'000,        10'000,     1'000 },
+        { "deep-1M-2k-500",         1'000'000,      2'000,      500 },
+        { "deep-10M-200-1k",        10'000'000,     200,        1'000 },
+        { "deep-100M-16-5k",        100'000'000,    16,         5'000 },
+        { "clusters-200k-1k-5k",    200'000,        1'000,      5'000 },
+    };
+
+    /** SplitMix64 hash, used as a stateless random number generator */
+    inline std::uint64_t hash(std::uint64_t value)
+    {
+        value += 0x9e3779b97f4a7c15ull;
+        value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ull;
+        value = (value ^ (value >> 27)) * 0x94d049bb133111ebull;
+
+        return value ^ (value >> 31);
+    }
+
+    /** Uniform random number in [0, 1) derived from \p seed */
+    inline float uniform(std::uint64_t seed)
+    {
+        return static_cast<float>(hash(seed) >> 40) / static_cast<float>(1ull << 24);
+    }
+
+    /**
+     * Assign every point to one cluster with skewed cluster sizes, like real clusterings
+     * @param scenario Data set size
+     * @return Sorted point indices per cluster
+     */
+    std::vector<std::vector<std::uint32_t>> generateClusters(const Scenario& scenario)
+    {
+        std::vector<double> weights(scenario.numClusters);
+
+        for (std::size_t clusterIndex = 0; clusterIndex < weights.size(); ++clusterIndex)
+            weights[clusterIndex] = 0.1 + uniform(clusterIndex) * uniform(clusterIndex + 7919);
+
+        std::partial_sum(weights.begin(), weights.end(), weights.begin());
+
+        std::vector<std::vector<std::uint32_t>> clusterIndices(scenario.numClusters);
+
+        for (std::size_t pointIndex = 0; pointIndex < scenario.numPoints; ++pointIndex) {
+            const auto target       = uniform(pointIndex ^ 0x5bd1e995ull) * weights.back();
+            const auto clusterIndex = std::min<std::size_t>(std::upper_bound(weights.begin(), weights.end(), target) - weights.begin(), scenario.numClusters - 1);
+
+            clusterIndices[clusterIndex].push_back(static_cast<std::uint32_t>(pointIndex));
+        }
+
+        return clusterIndices;
+    }
+
+    /**
+     * Generate row-major point values: a per-cluster profile plus noise, with randomly placed zeros
+     * @param scenario Data set size
+     * @param clusterIndices Point indices per cluster
+     * @param scale Range of the values (e.g. 255 for 8-bit integers)
+     * @param zeros Fraction of values that are zero
+     * @return Point values (numPoints x numDimensions)
+     */
+    template <typename ElementType>
+    std::vector<ElementType> generateValues(const Scenario& scenario, const std::vector<std::vector<std::uint32_t>>& clusterIndices, float scale, double zeros)
+    {
+        std::vector<ElementType> values(scenario.numPoints * scenario.numDimensions);
+
+        heatmap::parallelFor(clusterIndices.size(), [&](std::size_t clusterIndex) -> void {
+            for (const auto pointIndex : clusterIndices[clusterIndex]) {
+                auto row = values.data() + static_cast<std::size_t>(pointIndex) * scenario.numDimensions;
+
+                for (std::size_t d = 0; d < scenario.numDimensions; ++d) {
+                    const auto profile  = uniform((clusterIndex << 20) ^ (d % 64));
+                    const auto noise    = uniform((static_cast<std::uint64_t>(pointIndex) << 24) ^ d);
+
+                    const auto isZero   = uniform((static_cast<std::uint64_t>(pointIndex) << 24) ^ d ^ 0x2545f491ull) < zeros;
+
+                    row[d] = isZero ? ElementType(0) : static_cast<ElementType>(scale * (0.75f * profile + 0.25f * noise));
+                }
+            }
+        });
+
+        return values;
+    }
+
+    /**
+     * Run \p function a number of times and record its fastest and median duration
+     * @param repetitions Number of runs
+     * @param function Computation
+     * @param result Receives the durations
+     */
+    void measure(std::size_t repetitions, const std::function<void()>& function, Result& result)
+    {
+        std::vector<double> durations;
+
+        for (std::size_t repetition = 0; repetition < std::max<std::size_t>(1, repetitions); ++repetition) {
+            const auto start = std::chrono::steady_clock::now();
+
+            function();
+
+            durations.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        }
+
+        std::sort(durations.begin(), durations.end());
+
+        result.seconds          = durations.front();
+        result.medianSeconds    = durations[durations.size() / 2];
+    }
+
+    /**
+     * Benchmark all computations on one synthetic data set
+     * @param scenario Data set size
+     * @param options Command line options
+     * @param scale Range of the values
+     * @param results Receives the measurements
+     */
+    template <typename ElementType>
+    void runScenario(const Scenario& scenario, const Options& options, float scale, std::vector<Result>& results)
+    {
+        std::cerr << "Generating " << scenario.name << "..." << std::endl;
+
+        const auto clusterIndices   = generateClusters(scenario);
+        const auto values           = generateValues<ElementType>(scenario, clusterIndices, scale, options.zeros);
+
+        const std::vector<std::span<const std::uint32_t>> clusterSpans(clusterIndices.begin(), clusterIndices.end());
+
+        const auto numValues    = static_cast<double>(scenario.numPoints) * scenario.numDimensions;
+        const auto numCells     = scenario.numClusters * scenario.numDimensions;
+
+        const auto addResult = [&](const std::string& name, double work, const std::string& unit) -> Result& {
+            return results.emplace_back(Result{ scenario.name, name, 0.0, 0.0, work, unit });
+        };
+
+        // Moments in both accumulation precisions
+        std::vector<heatmap::ClusterMoments> moments;
+
+        for (const auto precision : { heatmap::AccumulationPrecision::Double, heatmap::AccumulationPrecision::Single }) {
+            const heatmap::ClusterStatisticsEngine engine(precision);
+
+            measure(options.repetitions, [&]() {
+                moments = engine.compute(values.data(), scenario.numPoints, scenario.numDimensions, clusterSpans);
+            }, addResult(precision == heatmap::AccumulationPrecision::Double ? "moments-double" : "moments-single", numValues, "values"));
+        }
+
+        // Sparse data is detected and accumulated skipping zeros; a negative threshold forces the dense kernel for comparison
+        if (options.zeros > 0.0) {
+            const heatmap::ClusterStatisticsEngine denseEngine(heatmap::AccumulationPrecision::Single, -1.f);
+
+            measure(options.repetitions, [&]() {
+                denseEngine.compute(values.data(), scenario.numPoints, scenario.numDimensions, clusterSpans);
+            }, addResult("moments-single-dense", numValues, "values"));
+        }
+
+        // Distributions with the default settings of the plugin
+        heatmap::ClusterDistributions distributions;
+
+        const heatmap::ClusterDistributionEngine distributionEngine(32, { 0.25f, 0.75f });
+
+        measure(options.repetitions, [&]() {
+            distributions = distributionEngine.compute(values.data(), scenario.numPoints, scenario.numDimensions, clusterSpans);
+        }, addResult("distributions", numValues, "values"));
+
+        // Payload of the means, standard deviations and quantiles, as sent to the page
+        std::vector<float> means(numCells), stddevs(numCells);
+
+        for (std::size_t clusterIndex = 0; clusterIndex < scenario.numClusters; ++clusterIndex) {
+            for (std::size_t d = 0; d < scenario.numDimensions; ++d) {
+                means[clusterIndex * scenario.numDimensions + d]    = moments[clusterIndex].getMean(d);
+                stddevs[clusterIndex * scenario.numDimensions + d]  = moments[clusterIndex].getStandardDeviation(d);
+            }
+        }
+
+        std::vector<std::string> clusterNames, dimensionNames;
+        std::vector<std::uint64_t> clusterSizes;
+
+        for (std::size_t clusterIndex = 0; clusterIndex < scenario.numClusters; ++clusterIndex) {
+            clusterNames.push_back("Cluster " + std::to_string(clusterIndex));
+            clusterSizes.push_back(clusterIndices[clusterIndex].size());
+        }
+
+        for (std::size_t d = 0; d < scenario.numDimensions; ++d)
+            dimensionNames.push_back("Dimension " + std::to_string(d));
+
+        for (const auto floatType : { heatmap::HeatMapPayload::ValueType::Float32, heatmap::HeatMapPayload::ValueType::Float16 }) {
+            heatmap::HeatMapPayload payload(floatType);
+
+            payload.setClusters(clusterNames, clusterSizes);
+            payload.setDimensionNames(dimensionNames);
+            payload.addMatrix("mean", means.data(), means.size());
+            payload.addMatrix("stddev", stddevs.data(), stddevs.size());
+
+            for (std::size_t levelIndex = 0; levelIndex < distributions.levels.size(); ++levelIndex)
+                payload.addMatrix(heatmap::getQuantileName(distributions.levels[levelIndex]), distributions.getQuantiles(levelIndex), numCells);
+
+            payload.addMatrix("histogram", distributions.histograms.data(), distributions.histograms.size());
+
+            std::vector<char> encoded(payload.getEncodedSize());
+
+            measure(options.repetitions, [&]() {
+                payload.encode(encoded.data());
+            }, addResult(floatType == heatmap::HeatMapPayload::ValueType::Float32 ? "payload-float32" : "payload-float16", static_cast<double>(encoded.size()), "bytes"));
+        }
+
+        // Dendrogram of the clusters over all dimensions (as for a paged panel)
+        const auto numPairs = static_cast<double>(scenario.numClusters) * (scenario.numClusters - 1) / 2;
+
+        measure(options.repetitions, [&]() {
+            heatmap::clusterHierarchically(means.data(), scenario.numClusters, scenario.numDimensions, heatmap::Linkage::Average, heatmap::DistanceMetric::Euclidean);
+        }, addResult("dendrogram", numPairs, "pairs"));
+
+        // Row order by co-expression with the limits of the plugin: the correlations of the dimensions over the clusters, then their clustering and leaf order
+        const auto numClusteredDimensions   = std::min<std::size_t>(scenario.numDimensions, 8192);
+        const auto numDimensionPairs        = static_cast<double>(numClusteredDimensions) * (numClusteredDimensions - 1) / 2;
+
+        heatmap::DimensionCorrelations correlations;
+
+        measure(options.repetitions, [&]() {
+            correlations = heatmap::computeDimensionCorrelations(means.data(), scenario.numClusters, scenario.numDimensions, numClusteredDimensions);
+        }, addResult("correlations", numDimensionPairs, "pairs"));
+
+        measure(options.repetitions, [&]() {
+            heatmap::seriateDimensions(correlations, heatmap::Linkage::Average, 2048);
+        }, addResult("seriation", numDimensionPairs, "pairs"));
+
+        // One-vs-rest markers of the first cluster
+        std::vector<const heatmap::ClusterMoments*> momentPointers;
+
+        for (const auto& clusterMoments : moments)
+            momentPointers.push_back(&clusterMoments);
+
+        const std::vector<std::uint32_t> group = { 0 };
+
+        measure(options.repetitions, [&]() {
+            heatmap::rankMarkers(momentPointers, group, heatmap::MarkerRankingMetric::EffectSize, 20);
+        }, addResult("markers", static_cast<double>(numCells), "cells"));
+    }
+
+    /**
+     * Quote and escape \p text as JSON string
+     * @param text Text
+     */
+    std::string toJson(const std::string& text)
+    {
+        return heatmap::HeatMapPayload::toJsonString(text);
+    }
+
+    /**
+     * Write the results as JSON
+     * @param stream Output stream
+     * @param options Command line options
+     * @param scenarios All scenarios
+     * @param skipped Names of the scenarios that exceeded the memory limit
+     * @param results Measurements
+     */
+    void writeJson(std::ostream& stream, const Options& options, const std::vector<Scenario>& scenarios, const std::vector<std::string>& skipped, const std::vector<Result>& results)
+    {
+        stream << "{\n";
+        stream << "  \"benchmark\": \"HeatMapCore\",\n";
+        stream << "  \"format\": 1,\n";
+        stream << "  \"threads\": " << heatmap::getNumWorkerThreads() << ",\n";
+        stream << "  \"element\": " << toJson(options.element) << ",\n";
+        stream << "  \"zeros\": " << options.zeros << ",\n";
+        stream << "  \"repetitions\": " << options.repetitions << ",\n";
+
+        stream << "  \"scenarios\": [";
+
+        for (std::size_t index = 0; index < scenarios.size(); ++index) {
+            const auto& scenario = scenarios[index];
+
+            stream << (index > 0 ? "," : "") << "\n    { \"name\": " << toJson(scenario.name)
+                << ", \"points\": " << scenario.numPoints
+                << ", \"dimensions\": " << scenario.numDimensions
+                << ", \"clusters\": " << scenario.numClusters
+                << ", \"skipped\": " << (std::find(skipped.begin(), skipped.end(), scenario.name) != skipped.end() ? "true" : "false") << " }";
+        }
+
+        stream << "\n  ],\n";
+        stream << "  \"results\": [";
+
+        for (std::size_t index = 0; index < results.size(); ++index) {
+            const auto& result = results[index];
+
+            stream << (index > 0 ? "," : "") << "\n    { \"scenario\": " << toJson(result.scenario)
+                << ", \"name\": " << toJson(result.name)
+                << ", \"seconds\": " << result.seconds
+                << ", \"median_seconds\": " << result.medianSeconds
+                << ", \"throughput\": " << (result.seconds > 0.0 ? result.work / result.seconds : 0.0)
+                << ", \"unit\": " << toJson(result.unit + "/s") << " }";
+        }
+
+        stream << "\n  ]\n}\n";
+    }
+
+    /** Print the command line usage */
+    void printUsage()
+    {
+        std::cerr << "Usage: HeatMapBenchmark [--suite quick|full] [--points N --dimensions D --clusters K]\n"
+                     "                        [--element float|uint16|uint8] [--zeros fraction] [--repetitions R]\n"
+                     "                        [--memory-limit GiB] [--output results.json]\n";
+    }
+
+    /**
+     * Parse the command line
+     * @param argc Number of arguments
+     * @param argv Arguments
+     * @param options Receives the options
+     * @return Whether the command line is valid
+     */
+    bool parseOptions(int argc, char* argv[], Options& options)
+    {
+        Scenario custom{ "custom", 0, 0, 0 };
+
+        for (int index = 1; index < argc; ++index) {
+            const std::string argument = argv[index];
+
+            if (index + 1 >= argc)
+                return false;
+
+            const std::string value = argv[++index];
+
+            if (argument == "--suite")
+                options.suite = value;
+            else if (argument == "--points")
+                custom.numPoints = std::strtoull(value.c_str(), nullptr, 10);
+            else if (argument == "--dimensions")
+                custom.numDimensions = std::strtoull(value.c_str(), nullptr, 10);
+            else if (argument == "--clusters")
+                custom.numClusters = std::strtoull(value.c_str(), nullptr, 10);
+            else if (argument == "--element")
+                options.element = value;
+            else if (argument == "--zeros")
+                options.zeros = std::strtod(value.c_str(), nullptr);
+            else if (argument == "--repetitions")
+                options.repetitions = std::strtoull(value.c_str(), nullptr, 10);
+            else if (argument == "--memory-limit")
+                options.memoryLimit = std::strtod(value.c_str(), nullptr);
+            else if (argument == "--output")
+                options.output = value;
+            else
+                return false;
+        }
+
+        if (custom.numPoints > 0 || custom.numDimensions > 0 || custom.numClusters > 0) {
+            if (custom.numPoints == 0 || custom.numDimensions == 0 || custom.numClusters == 0)
+                return false;
+
+            custom.name = "custom-" + std::to_string(custom.numPoints) + "-" + std::to_string(custom.numDimensions) + "-" + std::to_string(custom.numClusters);
+
+            options.scenarios.push_back(custom);
+        }
+        else if (options.suite == "quick") {
+            options.scenarios = quickSuite;
+        }
+        else if (options.suite == "full") {
+            options.scenarios = fullSuite;
+        }
+        else {
+            return false;
+        }
+
+        if (options.zeros < 0.0 || options.zeros > 1.0)
+            return false;
+
+        return options.element == "float" || options.element == "uint16" || options.element == "uint8";
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    Options options;
+
+    if (!parseOptions(argc, argv, options)) {
+        printUsage();
+        return EXIT_FAILURE;
+    }
+
+    const auto elementSize = options.element == "float" ? sizeof(float) : (options.element == "uint16" ? sizeof(std::uint16_t) : sizeof(std::uint8_t));
+
+    std::vector<Result> results;
+    std::vector<std::string> skipped;
+
+    for (const auto& scenario : options.scenarios) {
+        // Point values and indices, plus the clusters x dimensions statistics matrices
+        const auto requiredBytes = static_cast<double>(scenario.numPoints) * (scenario.numDimensions * elementSize + 2 * sizeof(std::uint32_t)) + 8.0 * scenario.numClusters * scenario.numDimensions * sizeof(double);
+
+        if (requiredBytes > options.memoryLimit * (1ull << 30)) {
+            std::cerr << "Skipping " << scenario.name << ": needs " << requiredBytes / (1ull << 30) << " GiB" << std::endl;
+            skipped.push_back(scenario.name);
+            continue;
+        }
+
+        if (options.element == "float")
+            runScenario<float>(scenario, options, 10.f, results);
+        else if (options.element == "uint16")
+            runScenario<std::uint16_t>(scenario, options, 4095.f, results);
+        else
+            runScenario<std::uint8_t>(scenario, options, 255.f, results);
+    }
+
+    for (const auto& result : results) {
+        char line[256];
+
+        std::snprintf(line, sizeof(line), "%-24s %-16s %10.4f s %14.4g %s/s\n", result.scenario.c_str(), result.name.c_str(), result.seconds, result.seconds > 0.0 ? result.work / result.seconds : 0.0, result.unit.c_str());
+
+        std::cerr << line;
+    }
+
+    if (options.output.empty()) {
+        writeJson(std::cout, options, options.scenarios, skipped, results);
+    }
+    else {
+        std::ofstream file(options.output);
+
+        writeJson(file, options, options.scenarios, skipped, results);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -7,11 +7,16 @@ try {
 
         QtBridge = channel.objects.QtBridge;
 
-        QtBridge.qt_setData.connect(function () { setData(arguments[0]); });
+        QtBridge.qt_setData.connect(function () { setBinaryData(arguments[0]); });
         QtBridge.qt_setSelection.connect(function () { setSelection(arguments[0]); });
         QtBridge.qt_setHighlight.connect(function () { setHighlight(arguments[0]); });
         QtBridge.qt_addAvailableData.connect(function () { addAvailableData(arguments[0]); });
         QtBridge.qt_setMarkerSelection.connect(function () { initMarkerSelection(arguments[0]); });
+        QtBridge.qt_setDendrogram.connect(function () { setDendrogram(arguments[0]); });
+        QtBridge.qt_setMarkerRanking.connect(function () { setMarkerRanking(arguments[0]); });
+        QtBridge.qt_setTiles.connect(function () { setCellTiles(arguments[0], arguments[1]); });
+        QtBridge.qt_setSelectionOverlap.connect(function () { setSelectionOverlap(arguments[0]); });
+        QtBridge.qt_setSelectionStatistics.connect(function () { setSelectionStatistics(arguments[0], arguments[1], arguments[2], arguments[3]); });
 
         notifyBridgeAvailable();
     });
@@ -30,11 +35,16 @@ var _availableDataSets = [];
 
 var _markerRange = [0.0, 5.0];
 var _markerUserBounds = [-1.0, 99999999999.0];
+var _valueTransform = "none"; // transform the plugin applied to the statistics
+var _isDotPlot = false;         // cells are dots sized by the fraction of expressing points and colored by their mean
 
 var _selection = [];
 var _selectedBeforeMerge = -1;
 var _highlight = -1;
 
+var _selectionOverlap = [];     // fraction of the points of each cluster selected elsewhere, see src/SelectionOverlap.h
+var _selectionStatistics = null; // {numPoints, begin, means, stddevs} of the points selected elsewhere, see src/SelectionStatistics.h
+
 var _markerSelection = [];
 var _markerSelectionSAT = [];
 
@@ -45,6 +55,25 @@ var _sortBy = -1;
 
 var _dendrogramClusters = [];
 
+// paging ======================================================================
+// wide panels arrive in pages of rows around the visible ones, see HeatMapWidget::pagedDimensionThreshold;
+// the rows are the selected markers (all dimensions while choosing markers), kept in C++ by dimension;
+// the visible rows are the active markers of the page
+var _isPaged = false;
+var _pageBegin = 0;         // row of the first row in _data
+var _numDimensions = 0;     // number of rows the page scrolls through
+var _rowOffset = 0;         // first visible row
+var _pageMarkers = [];      // whether the dimension of each row in _data is a selected marker (header.markers)
+var _sortDimension = -1;    // dimension the clusters are sorted by, whose values every page carries (header.sort)
+var _pageRequest = 0;
+var _requestedRows = null;
+var _dataRevision = -1;
+
+var _rowDimensions = null;  // dimension shown in each row when the rows are ordered by co-expression (header.rows), null in dataset order
+var _rowDendrogram = null;  // flat [left, right, height] merges of the dimensions the rows are ordered by (header.rowDendrogram)
+
+const _pagedRowHeight = 16;
+
 // sizes =======================================================================
 const _legendUIWidth = 90;       // legendWidth
 const _subsetLabelUIHeight = 90; // colLabelHeight
@@ -53,8 +82,11 @@ var _svgWidth = width - _legendUIWidth;
 var _svgHeight = height - 20 ;//- _subsetLabelUIHeight;
 
 const _markerSelectionUIWidth = 30;
+const _selectionColumnUIWidth = 30;
+const _selectionColumnGap = 6;
 
 var _labelColumnWidth = 0;
+const _rowDendrogramWidth = 60;
 
 const _dendrogramHeight = 120;    // dendroHeight
 const _dendrogramTopMargin = 20;
@@ -73,6 +105,8 @@ var _isDendrogramLabelsActive = true;
 
 var _showVariation = false; // showStdDev
 
+var _isRasterized = false; // cells are image tiles rendered in C++
+
 var _sortLowToHigh = false;
 
 // scales ======================================================================
@@ -98,7 +132,12 @@ var _containerSvg = d3.select("body").select("#mainView").append("svg")
 	.attr("id", "container")
 	.attr("width", _svgWidth)
 	.attr("height", height)
-	.on("contextmenu", d3.contextMenu(_contextMenu));
+	.on("contextmenu", d3.contextMenu(_contextMenu))
+	.on("wheel", function () {
+		if (!_isPaged) return;
+		d3.event.preventDefault();
+		scrollRows(Math.sign(d3.event.deltaY) * 3);
+	});
 
 var _dendrogram = _containerSvg.append("g")  // dendroSVG
 	.attr("id", "dendrogramGroup") // dendroGroup
@@ -112,14 +151,23 @@ var _heatmapColumns = null;     // columnsSvg
 var _columns = null;
 var _columnLabels = null;
 var _columnLabelRects = null;
+var _selectionOverlapBars = null;
+var _selectionColumn = null;
 var _columnLabelsGroup = null;
 var _clickedColumeLabelId = 0;
 var _cells = null;
 var _cellPaint = null;
+var _cellGlyphs = null;
+var _cellTiles = null;
+var _cellTileLayout = { "x": 1.0, "y": 1.0 };
+var _cellTileRequest = 0;
+var _cellTileKey = "";
+const _numCellTileColors = 256;
 var _columnSelect = {left: null, right: null, top: null, bottom: null};
 var _columnSelectSorted = null;
 
 var _markerLabels = null;       // markerLabels
+var _rowDendrogramGroup = null;
 
 var _dataQueue = new HeatmapDataQueue(1, queueData);
 
@@ -135,6 +183,8 @@ function initHeatMapLayout() {
 
 	_heatmapColumns = _heatmap.append("g").attr("id", "columns");
 
+	_rowDendrogramGroup = _heatmapColumns.append("g").attr("class", "rowDendrogram");
+
     
     // =========================================================================
     // marker labels
@@ -178,26 +228,39 @@ function initHeatMapLayout() {
 
     // =========================================================================
     // heatmap
+	// image tiles replace the cell rects, see drawCellTiles
+	if (_isRasterized)
+	{
+		_cellTiles = _heatmapColumns.append("g")
+			.attr("id", "cellTiles")
+			.on("click", clickCellTiles)
+			.on("contextmenu", d3.contextMenu(_contextMenu));
+	}
+
 	_columns = _heatmapColumns.selectAll(".column")
 					.data(_data.nodes)
 					.enter().append("g")
 					.attr("class", "column")
 					.attr("id", function (d, i) { return "cluster" + i })
-					.on("contextmenu", d3.contextMenu(_contextMenu));
+					.on("contextmenu", d3.contextMenu(_contextMenu))
+					.on("dblclick", function (d, i) { expandColumn(i); });
 
 	var dat = _columns.data();
 
 	_cells = _columns.selectAll(".cell")
 				    .data(function(d, i)
                     {
+				        if (_isRasterized) return [];
+
 				        var e = dat[i].expression;
 						var s = dat[i].stddev;
 						if(!s) s = dat[i].expression;
+						var f = dat[i].fraction; // uint16, fraction x 65535
                         
                         var arr = [];
 						for(var l = 0; l < e.length; l++)
 						{
-						  arr[l] = { "expression": e[l], "stddev": s[l], "column": i };
+						  arr[l] = { "expression": e[l], "stddev": s[l], "fraction": f ? f[l] / 65535 : 1.0, "histogram": getCellHistogram(dat[i], l), "column": i };
 						}
 						return arr;
 				    })
@@ -216,6 +279,10 @@ function initHeatMapLayout() {
 			.attr("class", "cellPaint")
             .on("click", function (d, i) { leftClickColumn(d.column); });
 
+	// violins of the cell histograms (distribution mode), shown as the variation
+	_cellGlyphs = _cells.append("path")
+			.attr("class", "cellGlyph");
+
 	_columnLabelsGroup = _columns.append("g")
 	_columnLabelRects = _columnLabelsGroup.append("rect")
                         .attr("width", _subsetLabelUIHeight)
@@ -224,6 +291,12 @@ function initHeatMapLayout() {
 			            .attr("stroke", _bgcolor)
                         .on("click", function (d, i) { _clickedColumeLabelId = i; toggleSubsetNameModal(); });
 
+	// grows up from the bottom of the label with the selected fraction of the cluster
+	_selectionOverlapBars = _columnLabelsGroup.append("rect")
+			.attr("class", "selectionOverlap")
+			.attr("x", 0)
+			.attr("y", 0);
+
 	_columnLabels = _columnLabelsGroup.append("text")
 			.attr("class", "subsetLabelText")
 			.attr("id", function (d, i) { return "subsetLabel" + i; })
@@ -279,6 +352,11 @@ function initHeatMapLayout() {
         .attr("y2", 0);
 
 
+    // =========================================================================
+    // live column of the points selected in linked views
+    _selectionColumn = _heatmapColumns.append("g")
+        .attr("class", "selectionColumn");
+
     // =========================================================================
     // add variable properties
     drawHeatMap(0);
@@ -309,14 +387,14 @@ function drawMarkerLabelColumn(dur) {
 
 	var numDimensions = _data.nodes[0].expression.length;
     var numActiveMarkers = _markerSelection.reduce(function (a, b) { return a + b }, 0);
-    var rowHeight = _heatmapHeight / (_isMakerSelectionActive ? numDimensions : numActiveMarkers);
+    var rowHeight = _heatmapHeight / (isLayoutOfAllRows() ? numDimensions : numActiveMarkers);
     
     _markerCircle.x = _labelColumnWidth + _markerSelectionUIWidth / 2.5;
     
     _markerLabels.transition()
         .duration(dur)
         .attr("transform", function (d, i) {
-            if(_isMakerSelectionActive)
+            if(isLayoutOfAllRows())
               return "translate(0, " + ((i+0.5) * rowHeight) + ")";
             else
               return "translate(" + ((_markerSelection[i] > 0) ? 0 : -500) + ", " + ((_markerSelectionSAT[i]+0.5) * rowHeight) + ")";
@@ -330,7 +408,7 @@ function drawMarkerLabelColumn(dur) {
         .duration(dur)
         .attr("opacity", _isMakerSelectionActive ? 1.0 : 0.0 )
         .attr("cx", _markerCircle.x )
-        .attr("fill", function(d,i){ return (_markerSelection[i] == 1 ? "red" : "green");} );
+        .attr("fill", function(d,i){ return (isMarkerSelected(i) ? "red" : "green");} );
     
 	d3.selectAll(".markerSelectRectHor").transition()
         .duration(dur)
@@ -339,11 +417,75 @@ function drawMarkerLabelColumn(dur) {
     
 	d3.selectAll(".markerSelectRectVert").transition()
         .duration(dur)
-        .attr("width", function(d,i){return (_markerSelection[i] == 1 ? _markerRect.w : _markerRect.h);} )
-		.attr("height", function(d,i){return (_markerSelection[i] == 1 ? _markerRect.h : _markerRect.w );} )
-		.attr("x", function(d,i){return (_markerSelection[i] == 1 ? _markerCircle.x - _markerRect.w/2 : _markerCircle.x - _markerRect.h/2);} )
-		.attr("y", function(d,i){return (_markerSelection[i] == 1 ? _markerCircle.y - _markerRect.h/2 : _markerCircle.y - _markerRect.w/2);} )
+        .attr("width", function(d,i){return (isMarkerSelected(i) ? _markerRect.w : _markerRect.h);} )
+		.attr("height", function(d,i){return (isMarkerSelected(i) ? _markerRect.h : _markerRect.w );} )
+		.attr("x", function(d,i){return (isMarkerSelected(i) ? _markerCircle.x - _markerRect.w/2 : _markerCircle.x - _markerRect.h/2);} )
+		.attr("y", function(d,i){return (isMarkerSelected(i) ? _markerCircle.y - _markerRect.h/2 : _markerCircle.y - _markerRect.w/2);} )
         .attr("opacity", _isMakerSelectionActive ? 1.0 : 0.0 );
+
+    drawRowDendrogram(numActiveMarkers == numDimensions || _isMakerSelectionActive ? rowHeight : 0);
+}
+
+// all rows are laid out while choosing markers, otherwise the active markers; a paged panel always lays out
+// its visible rows, which are the active markers of the page
+function isLayoutOfAllRows() {
+
+    return _isMakerSelectionActive && !_isPaged;
+}
+
+// whether row i is a selected marker; the visible rows of a paged panel are its active markers instead
+function isMarkerSelected(i) {
+
+    return _isPaged ? _pageMarkers[i] == 1 : _markerSelection[i] == 1;
+}
+
+function getRowDendrogramWidth() {
+
+    return (_rowDendrogram && !_isPaged) ? _rowDendrogramWidth : 0;
+}
+
+// the dendrogram of the dimensions left of the marker labels, only while every row is shown;
+// merges number the dimensions 0 ... n - 1 and the node created by merge k n + k (see setDendrogram)
+function drawRowDendrogram(rowHeight) {
+
+    _rowDendrogramGroup.selectAll('*').remove();
+
+    var width = getRowDendrogramWidth() - 5;
+    var numRows = _data.names.length;
+
+    if (width <= 0 || rowHeight <= 0 || !_rowDimensions || _rowDimensions.length != numRows || _rowDendrogram.length != 3 * (numRows - 1)) return;
+
+    var maxHeight = 0;
+
+    for (var k = 2; k < _rowDendrogram.length; k += 3)
+        maxHeight = Math.max(maxHeight, _rowDendrogram[k]);
+
+    // leaves at the right, next to their labels, and the root at the left
+    var x = new Array(2 * numRows - 1);
+    var y = new Array(2 * numRows - 1);
+
+    for (var r = 0; r < numRows; r++)
+    {
+        x[_rowDimensions[r]] = width;
+        y[_rowDimensions[r]] = (r + 0.5) * rowHeight;
+    }
+
+    var path = "";
+
+    for (var k = 0, node = numRows; k < _rowDendrogram.length; k += 3, node++)
+    {
+        var left = _rowDendrogram[k];
+        var right = _rowDendrogram[k + 1];
+
+        x[node] = Math.round(maxHeight > 0 ? width * (1 - _rowDendrogram[k + 2] / maxHeight) : width);
+        y[node] = (y[left] + y[right]) / 2;
+
+        path += "M" + x[left] + "," + Math.round(y[left]) + "H" + x[node] + "V" + Math.round(y[right]) + "H" + x[right];
+    }
+
+    _rowDendrogramGroup.append("path")
+        .attr("class", "dendrogramLink")
+        .attr("d", path);
 }
 
 function drawColumns(dur) {
@@ -352,7 +494,7 @@ function drawColumns(dur) {
     var numActiveMarkers = _markerSelection.reduce(function (a, b) { return a + b }, 0);
     
     var offset = _labelColumnWidth + (_isMakerSelectionActive ? _markerSelectionUIWidth : 0);
-	var rectSize = {x: (_svgWidth - offset) / _data.nodes.length, y: _heatmapHeight / (_isMakerSelectionActive ? numDimensions : numActiveMarkers)};
+	var rectSize = {x: (_svgWidth - offset - getSelectionColumnWidth()) / _data.nodes.length, y: _heatmapHeight / (isLayoutOfAllRows() ? numDimensions : numActiveMarkers)};
 	var cellSize = {x: Math.max(0, rectSize.x - _cellBorder), y: Math.max(0, rectSize.y - _cellBorder)};
         
     var rectSizeHighlight = rectSize.x * _magnifier;
@@ -376,7 +518,7 @@ function drawColumns(dur) {
     _cells.transition()
         .duration(dur)
         .attr("transform", function (d, i) {
-            var scale = (_isMakerSelectionActive ? i : _markerSelectionSAT[i]);
+            var scale = (isLayoutOfAllRows() ? i : _markerSelectionSAT[i]);
             return "translate(0, " + (scale * rectSize.y) + ")";
         });
     
@@ -387,19 +529,57 @@ function drawColumns(dur) {
         })
 		.attr("height", cellSize.y);
     
-    _cellPaint.transition()
-        .duration(dur)
-        .attr("x", function (d) {
-            var sizeX = (_highlight == d.column) ? rectSizeHighlight : cellSize.x;
-            return _showVariation ? (sizeX * (1.0 - _variationScale(d.stddev)) / 2) : 0.0;
-        })
-		.attr("y", function (d) { return _showVariation ? (cellSize.y * (1.0 - _variationScale(d.stddev)) / 2) : 0.0; })
-		.attr("width",  function (d) {
+    if (_isDotPlot)
+    {
+        // dot area is proportional to the fraction of expressing points
+        var dotSize = function (d) {
             var sizeX = (_highlight == d.column) ? rectSizeHighlight : cellSize.x;
-            return (_showVariation ? (sizeX * _variationScale(d.stddev)) : sizeX);
-        })
-		.attr("height", function (d) { return _showVariation ? (cellSize.y * _variationScale(d.stddev)) : cellSize.y; })
-		.attr("fill", function (d) { return _color(d.expression); });
+            return Math.min(sizeX, cellSize.y) * Math.sqrt(d.fraction);
+        };
+
+        _cellPaint.transition()
+            .duration(dur)
+            .attr("x", function (d) {
+                var sizeX = (_highlight == d.column) ? rectSizeHighlight : cellSize.x;
+                return (sizeX - dotSize(d)) / 2;
+            })
+            .attr("y", function (d) { return (cellSize.y - dotSize(d)) / 2; })
+            .attr("width", dotSize)
+            .attr("height", dotSize)
+            .attr("rx", function (d) { return dotSize(d) / 2; })
+            .attr("ry", function (d) { return dotSize(d) / 2; })
+            .attr("fill", function (d) { return d.fraction > 0 ? _color(d.expression) : _bgcolor; });
+    }
+    else
+    {
+        // cells with a histogram show their variation as a violin, the others shrink with the standard deviation
+        var shrink = function (d) { return (_showVariation && !d.histogram) ? _variationScale(d.stddev) : 1.0; };
+
+        _cellPaint.transition()
+            .duration(dur)
+            .attr("x", function (d) {
+                var sizeX = (_highlight == d.column) ? rectSizeHighlight : cellSize.x;
+                return sizeX * (1.0 - shrink(d)) / 2;
+            })
+            .attr("y", function (d) { return cellSize.y * (1.0 - shrink(d)) / 2; })
+            .attr("width",  function (d) {
+                var sizeX = (_highlight == d.column) ? rectSizeHighlight : cellSize.x;
+                return sizeX * shrink(d);
+            })
+            .attr("height", function (d) { return cellSize.y * shrink(d); })
+            .attr("rx", 0)
+            .attr("ry", 0)
+            .attr("fill", function (d) { return _color(d.expression); });
+    }
+
+    _cellGlyphs.attr("d", function (d) {
+        if (_isDotPlot || !_showVariation || !d.histogram) return null;
+
+        var sizeX = (_highlight == d.column) ? rectSizeHighlight : cellSize.x;
+        return getViolinPath(d.histogram, sizeX, cellSize.y);
+    });
+
+    if (_isRasterized) drawCellTiles(offset, rectSize);
 
     _columnLabelsGroup.transition()
         .duration(dur)
@@ -423,6 +603,186 @@ function drawColumns(dur) {
             return ((_highlight == d.column) ? rectSizeHighlight : cellSize.x) / 2;
         });
 
+    _selectionOverlapBars.transition()
+        .duration(dur)
+        .attr("width", function (d, i) { return (_selectionOverlap[i] || 0) * _subsetLabelUIHeight; })
+        .attr("height", function (d, i) {
+            return ((_highlight == d.column) ? rectSizeHighlight : cellSize.x);
+        });
+
+    drawSelectionColumn(dur);
+}
+
+// violin of a cell histogram: the values run from left to right over the bins of the dimension,
+// the height at a value is the count of its bin relative to the fullest bin of the cell
+function getViolinPath(histogram, width, height) {
+
+    var numBins = histogram.length;
+    var upper = [];
+    var lower = [];
+
+    for (var bin = 0; bin < numBins; bin++) {
+        var x = (bin + 0.5) / numBins * width;
+        var halfHeight = histogram[bin] / 65535 * height / 2;
+
+        upper.push([x, height / 2 - halfHeight]);
+        lower.push([x, height / 2 + halfHeight]);
+    }
+
+    return d3.line()(upper.concat(lower.reverse())) + "Z";
+}
+
+// the selection column is only shown while points are selected in linked views
+function getSelectionColumnWidth() {
+
+    return (_selectionStatistics && _selectionStatistics.numPoints > 0) ? _selectionColumnUIWidth : 0;
+}
+
+// one cell per row with the mean of the selected points at the right of the clusters, sized by their stddev like the cells
+function drawSelectionColumn(dur) {
+
+    if (!_selectionColumn) return;
+
+    var columnWidth = getSelectionColumnWidth();
+
+    if (columnWidth == 0)
+    {
+        _selectionColumn.selectAll('*').remove();
+        return;
+    }
+
+	var numDimensions = _data.nodes[0].expression.length;
+    var numActiveMarkers = _markerSelection.reduce(function (a, b) { return a + b }, 0);
+    var rowHeight = _heatmapHeight / (isLayoutOfAllRows() ? numDimensions : numActiveMarkers);
+    var cellSize = {x: Math.max(0, columnWidth - _selectionColumnGap - _cellBorder), y: Math.max(0, rowHeight - _cellBorder)};
+
+    // rows of the page that the statistics cover
+    var rows = [];
+
+    for (var j = 0; j < _data.names.length; j++)
+    {
+        var index = _pageBegin + j - _selectionStatistics.begin;
+
+        if ((isLayoutOfAllRows() || _markerSelection[j] > 0) && index >= 0 && index < _selectionStatistics.means.length)
+            rows.push({ "row": j, "mean": _selectionStatistics.means[index], "stddev": _selectionStatistics.stddevs[index] });
+    }
+
+    _selectionColumn.attr("transform", "translate(" + (_svgWidth - columnWidth + _selectionColumnGap) + ", 0)");
+
+    var cells = _selectionColumn.selectAll(".selectionCell").data(rows);
+
+    cells.exit().remove();
+
+    cells.enter().append("rect")
+        .attr("class", "selectionCell")
+        .merge(cells)
+        .attr("x", function (d) { return _showVariation ? (cellSize.x * (1.0 - _variationScale(d.stddev)) / 2) : 0.0; })
+        .attr("y", function (d) {
+            var position = isLayoutOfAllRows() ? d.row : _markerSelectionSAT[d.row];
+            return position * rowHeight + (_showVariation ? (cellSize.y * (1.0 - _variationScale(d.stddev)) / 2) : 0.0);
+        })
+        .attr("width", function (d) { return _showVariation ? (cellSize.x * _variationScale(d.stddev)) : cellSize.x; })
+        .attr("height", function (d) { return _showVariation ? (cellSize.y * _variationScale(d.stddev)) : cellSize.y; })
+        .attr("fill", function (d) { return _color(d.mean); });
+
+    var label = _selectionColumn.selectAll(".selectionColumnLabel").data([_selectionStatistics.numPoints]);
+
+    label.enter().append("text")
+        .attr("class", "subsetLabelText selectionColumnLabel")
+        .merge(label)
+        .attr("x", _subsetLabelUIHeight - 10)
+        .attr("y", cellSize.x / 2)
+        .attr("transform", "translate(0, " + (_heatmapHeight + _subsetLabelUIHeight) + ")" + "rotate(-90)")
+        .text(function (d) { return "Selection (" + d + ")"; });
+}
+
+// the cells are drawn as image tiles with one pixel per cell, color mapped in C++ (see src/HeatMapRaster.h);
+// tiles are re-requested only when the order, rows or color map change, otherwise just laid out again
+function drawCellTiles(offset, rectSize) {
+
+    _cellTileLayout = { "x": rectSize.x, "y": rectSize.y };
+
+    requestCellTiles();
+
+    _cellTiles.attr("transform", "translate(" + offset + ", 0)");
+
+    _cellTiles.selectAll(".cellTile")
+        .attr("x", function (d) { return d.column * rectSize.x; })
+        .attr("y", function (d) { return d.row * rectSize.y; })
+        .attr("width", function (d) { return d.width * rectSize.x; })
+        .attr("height", function (d) { return d.height * rectSize.y; });
+}
+
+function requestCellTiles() {
+
+    var columns = getColumnOrder();
+    var rows = [];
+
+    for (var j = 0; j < _markerSelection.length; j++)
+    {
+        if (isLayoutOfAllRows() || _markerSelection[j] > 0)
+            rows.push(_pageBegin + j);
+    }
+
+    // sample the active color map at the centers of even bins, so the tiles use the colors of the cell rects
+    var domain = _color.domain ? _color.domain() : _markerUserBounds;
+    var minimum = domain[0];
+    var maximum = domain[domain.length - 1];
+    var colors = [];
+
+    for (var i = 0; i < _numCellTileColors; i++)
+    {
+        var c = d3.rgb(_color(minimum + (maximum - minimum) * (i + 0.5) / _numCellTileColors));
+        colors.push(((Math.round(c.r) << 24) | (Math.round(c.g) << 16) | (Math.round(c.b) << 8) | Math.round(c.opacity * 255)) >>> 0);
+    }
+
+    var key = JSON.stringify([columns, rows, colors, minimum, maximum]);
+
+    if (key == _cellTileKey) return;
+
+    _cellTileKey = key;
+
+    if (isQtAvailable) { QtBridge.js_requestTiles(++_cellTileRequest, columns, rows, colors, minimum, maximum); }
+}
+
+// tiles are {column, row, width, height, image} in cells, image is a png data url
+function setCellTiles(request, tiles) {
+
+    if (!_cellTiles || request != _cellTileRequest) return;
+
+    var images = _cellTiles.selectAll(".cellTile").data(tiles);
+
+    images.exit().remove();
+
+    images.enter().append("image")
+        .attr("class", "cellTile")
+        .attr("preserveAspectRatio", "none")
+        .merge(images)
+        .attr("href", function (d) { return d.image; })
+        .attr("x", function (d) { return d.column * _cellTileLayout.x; })
+        .attr("y", function (d) { return d.row * _cellTileLayout.y; })
+        .attr("width", function (d) { return d.width * _cellTileLayout.x; })
+        .attr("height", function (d) { return d.height * _cellTileLayout.y; });
+}
+
+function clickCellTiles() {
+
+    var position = Math.floor(d3.mouse(this)[0] / _cellTileLayout.x);
+    var columns = getColumnOrder();
+
+    if (position >= 0 && position < columns.length) leftClickColumn(columns[position]);
+}
+
+// cluster shown in each column, the inverse of _sorting
+function getColumnOrder() {
+
+    var columns = [];
+    columns.length = _sorting.length;
+
+    for (var i = 0; i < _sorting.length; i++)
+        columns[_sorting[i]] = i;
+
+    return columns;
 }
 
 function drawSelectionHighlights(dur) {
@@ -433,7 +793,7 @@ function drawSelectionHighlights(dur) {
     var numActiveMarkers = _markerSelection.reduce(function (a, b) { return a + b }, 0);
     
     var offset = _labelColumnWidth + (_isMakerSelectionActive ? _markerSelectionUIWidth : 0);
-	var rectSize = {x: (_svgWidth - offset) / _data.nodes.length, y: _heatmapHeight / (_isMakerSelectionActive ? numDimensions : numActiveMarkers)};
+	var rectSize = {x: (_svgWidth - offset - getSelectionColumnWidth()) / _data.nodes.length, y: _heatmapHeight / (isLayoutOfAllRows() ? numDimensions : numActiveMarkers)};
     
     var rectSizeHighlight = rectSize.x * _magnifier;
     if(_highlight >= 0)
@@ -566,7 +926,7 @@ function drawDendrogram(dur) {
     
 	if (_dendrogramClusters == undefined || _dendrogramClusters[0] == undefined) return;
     
-	var dendrogramWidth = _svgWidth - _labelColumnWidth - (_isMakerSelectionActive ? _markerSelectionUIWidth : 0);
+	var dendrogramWidth = _svgWidth - _labelColumnWidth - (_isMakerSelectionActive ? _markerSelectionUIWidth : 0) - getSelectionColumnWidth();
 
 	_dendrogramScale.domain([0, Math.round(_dendrogramClusters[0].dist + 0.49)]);
     
@@ -641,6 +1001,29 @@ function leftClickColumn(idx) {
     drawSelectionHighlights(500);
 }
 
+// super-clusters of over-clustered data, see src/ClusterHierarchy.h;
+// header.groups holds [number of clusters, expandable, collapsible] per column
+function getColumnGroup(idx) {
+
+    var groups = _data && _data.header ? _data.header.groups : null;
+
+    return (groups && idx >= 0 && idx < groups.length) ? groups[idx] : null;
+}
+
+function expandColumn(idx) {
+
+    var group = getColumnGroup(idx);
+
+    if (group && group[1] && isQtAvailable) { QtBridge.js_expandColumn(idx); }
+}
+
+function collapseColumn(idx) {
+
+    var group = getColumnGroup(idx);
+
+    if (group && group[2] && isQtAvailable) { QtBridge.js_collapseColumn(idx); }
+}
+
 function leftClickMarkerLabel(index, switchOrder) {
 
 	updateSorting(index, switchOrder);
@@ -662,6 +1045,9 @@ function toggleMarkerSelectionMode() {
 
 	_isMakerSelectionActive = !_isMakerSelectionActive;
 
+    // a paged panel scrolls through all rows while choosing markers, C++ answers with the rows around the same dimension
+    if (isQtAvailable) { QtBridge.js_setMarkerSelectionMode(_isPaged ? ++_pageRequest : 0, _isMakerSelectionActive, _rowOffset, _rowOffset + getNumVisibleRows()); }
+
     drawHeatMap(500);
 }
 
@@ -678,6 +1064,19 @@ function toggleVariation() {
 
 function toggleMarker( marker ) {
   
+    // the marker selection of a paged panel is kept in C++, the rows change when leaving the marker selection mode
+    if (_isPaged)
+    {
+        if (!_rowDimensions || marker >= _rowDimensions.length) return;
+
+        _pageMarkers[marker] = _pageMarkers[marker] ? 0 : 1;
+
+        if (isQtAvailable) { QtBridge.js_setMarkerSelected(_rowDimensions[marker], _pageMarkers[marker] == 1); }
+
+        drawMarkerLabelColumn(500);
+        return;
+    }
+
     _markerSelection[marker] = !_markerSelection[marker];
     
     refreshMarkerSelectionSAT();
@@ -780,36 +1179,93 @@ function computeDendrogram() {
 
 	if (!_isDendrogramActive) return;
 
-	var input = [];
-	input.length = _data.nodes.length;
+	// the clusters are clustered in C++ over the active markers, the merges arrive in setDendrogram
+	// a paged panel is clustered over the selected markers kept in C++, which the empty list stands for
+	var dimensions = [];
 
-	var numActiveMarkers = _markerSelection.reduce(function (a, b) { return a + b }, 0);
+	for (var j = 0; j < _markerSelection.length && !_isPaged; j++)
+	{
+		if (_markerSelection[j] > 0)
+			dimensions.push(j);
+	}
+
+	if (isQtAvailable) { QtBridge.js_requestDendrogram(dimensions); }
+}
+
+// merges is a flat list of [left, right, height] triplets in the numbering of SciPy's linkage matrix:
+// clusters are 0 ... n - 1 and the node created by merge k is n + k
+function setDendrogram(merges) {
+
+	if (!_data) return;
+
+	var numClusters = _data.nodes.length;
+
+	if (merges.length != 3 * Math.max(0, numClusters - 1)) return;
+
+	var nodes = [];
+
+	for (var i = 0; i < numClusters; i++)
+		nodes.push({ "key": i, "size": 1 });
 
-	for (var i = 0; i < input.length; i++)
+	for (var k = 0; k < merges.length; k += 3)
 	{
-		var shortExpression = [];
-		shortExpression.length = numActiveMarkers;
+		var left = nodes[merges[k]];
+		var right = nodes[merges[k + 1]];
 
-		var expression = _data.nodes[i].expression;
+		nodes.push({ "left": left, "right": right, "dist": merges[k + 2], "size": left.size + right.size });
+	}
 
-		var m = 0;
-		for(var j = 0; j < expression.length; j++)
-		{
-			if(_markerSelection[j] > 0)
-			{
-				shortExpression[m] = expression[j];
-				m += 1;
-			}
-		}
+	_dendrogramClusters = [nodes[nodes.length - 1]];
+
+	if (!_isDendrogramActive) return;
+
+	sortByDendrogram();
 
-		input[i] = shortExpression;
+	drawColumns(500);
+	drawSelectionHighlights(500);
+	drawDendrogram(500);
+}
+
+// =============================================================================
+// marker ranking
+// =============================================================================
+function rankMarkersOfSelection() {
+
+	if (isQtAvailable) { QtBridge.js_requestMarkerRanking(_selection); }
+}
+
+// the top ranked markers of the selected clusters versus the rest, best first (see src/MarkerRanking.h);
+// they become the marker selection and the clusters are sorted by the best one
+function setMarkerRanking(dimensions) {
+
+	if (!_data || dimensions.length == 0) return;
+
+	// C++ selected the markers of a paged panel and sorts by the best one; the page scrolls to it
+	if (_isPaged)
+	{
+		_rowOffset = dimensions[0];
+		_sortLowToHigh = false;
+		reloadPage();
+		return;
 	}
 
-	_dendrogramClusters = clusterfck.hcluster(input, clusterfck.EUCLIDEAN_DISTANCE);
-    
-    if (_dendrogramClusters != undefined) {
-		sortByDendrogram();
+	for (var j = 0; j < _markerSelection.length; j++)
+		_markerSelection[j] = 0;
+
+	for (var k = 0; k < dimensions.length; k++)
+	{
+		if (dimensions[k] < _markerSelection.length)
+			_markerSelection[dimensions[k]] = 1;
 	}
+
+	refreshMarkerSelectionSAT();
+	rebuildRangeSlider();
+
+	// high to low, so that the clusters with the highest values of the marker come first
+	_sortLowToHigh = false;
+	updateSorting(dimensions[0], false);
+
+	drawHeatMap(500);
 }
 
 function dendrogramElbow(d, i)
@@ -846,6 +1302,15 @@ function sortByMarker(index, switchOrder) {
 
 	_sortingMarker.length = _sorting.length;
 
+	// a paged panel sorts by a dimension, so that the order does not depend on the rows of the page
+	var sortValues = null;
+
+	if (_isPaged)
+	{
+		sortValues = getPagedSortValues(index, switchOrder);
+		index = sortValues ? 0 : -1;
+	}
+
 	// Sort selected first, then unselected
 	var numSelectedItems = _selection.reduce(function (a, b) { return a + b }, 0);
 	var sortSelectionFirst = (numSelectedItems > 1);
@@ -875,7 +1340,7 @@ function sortByMarker(index, switchOrder) {
 		return;
 	}
 
-	var values = _data.nodes.map(function (d, i) { return [d.expression[index], i, _selection[i]] });
+	var values = _data.nodes.map(function (d, i) { return [sortValues ? sortValues[i] : d.expression[index], i, _selection[i]] });
 	if (sortSelectionFirst) {
 		values.sort(function (a, b) {
 			var sel = a[2] - b[2];
@@ -890,11 +1355,11 @@ function sortByMarker(index, switchOrder) {
 
 	var tmp = values.map(function (d, i) { return d[1] });
 
-	if (switchOrder && _sortBy == index) // flip high -> low // low -> high
+	if (switchOrder && _sortBy == index && !_isPaged) // flip high -> low // low -> high
 	{
 		_sortLowToHigh = !_sortLowToHigh;
 	}
-	_sortBy = index;
+	_sortBy = _isPaged ? -1 : index;
 
 
 	if (_sortLowToHigh) {
@@ -921,6 +1386,33 @@ function sortByMarker(index, switchOrder) {
 	_sorting = _sortingMarker;
 }
 
+// values of the clusters to sort a paged panel by: of the row index when given, which becomes the sort
+// dimension reported to C++, otherwise of the sort dimension that the page carries (null without one)
+function getPagedSortValues(index, switchOrder) {
+
+	if (index >= 0 && _rowDimensions)
+	{
+		var dimension = _rowDimensions[index];
+
+		if (switchOrder && dimension == _sortDimension) // flip high -> low // low -> high
+			_sortLowToHigh = !_sortLowToHigh;
+
+		if (dimension != _sortDimension)
+		{
+			_sortDimension = dimension;
+			if (isQtAvailable) { QtBridge.js_setSortDimension(dimension); }
+		}
+
+		return _data.nodes.map(function (d) { return d.expression[index]; });
+	}
+
+	var sort = _data.header ? _data.header.sort : null;
+
+	if (!sort || sort.dimension != _sortDimension || sort.values.length != _data.nodes.length) return null;
+
+	return sort.values;
+}
+
 function sortByDendrogram() {
     
 	var dendrogramSorting = [];
@@ -979,21 +1471,69 @@ function addAvailableData(name) {
 	updateAvailableDataSelectionBox();
 }
 
-function queueData(d) {
+function queueData(message) {
 
-    //log(d);
+    //log(message.payload);
 
-    _data = JSON.parse(d);
+    var started = getWallClockTime();
 
-    //log(_data);
-    //log("setting data");
+    var data = message.decode(message.payload);
 
-    _labelColumnWidth = 0;
-    for (var i = 0; i < _data.names.length; i++)
+    if (!data) return;
+
+    var decoded = getWallClockTime();
+    var page = data.header ? data.header.page : null;
+
+    // answers to page requests only replace the rows of the shown data, outdated answers are dropped
+    if (page && page.request > 0)
     {
-        var l = _data.names[i].width() + 10;
-        _labelColumnWidth = Math.max(l, _labelColumnWidth);
+        if (page.request != _pageRequest) return;
+
+        if (_data && page.revision == _dataRevision && data.nodes.length == _data.nodes.length)
+        {
+            setPage(data);
+            reportTimings(page.revision, [["queue", message.received, started], ["decode", started, decoded], ["layout", decoded, getWallClockTime()]]);
+            return;
+        }
     }
+
+    var wasPaged = _isPaged;
+
+    _data = data;
+    _isRasterized = !!(_data.header && _data.header.rasterize);
+    _isDotPlot = !!(_data.header && _data.header.dotPlot);
+
+    // transformed statistics have another range, so the color bounds of the user start over
+    var transform = (_data.header && _data.header.transform) || "none";
+
+    if (transform != _valueTransform)
+    {
+        _valueTransform = transform;
+        _markerUserBounds = [-Number.MAX_VALUE, Number.MAX_VALUE];
+    }
+    _cellTiles = null;
+    _cellTileKey = "";
+
+    _isPaged = !!(page && page.paged);
+    _pageBegin = page ? page.begin : 0;
+    _pageMarkers = (_data.header && _data.header.markers) || [];
+    _sortDimension = (_isPaged && _data.header.sort) ? _data.header.sort.dimension : -1;
+    _numDimensions = page ? page.numDimensions : _data.names.length;
+    _dataRevision = page ? page.revision : -1;
+    _requestedRows = null;
+
+    var previousRows = _rowDimensions;
+
+    _rowDimensions = (_data.header && _data.header.rows) || null;
+    _rowDendrogram = (_data.header && _data.header.rowDendrogram) || null;
+
+    if (!_isPaged && !wasPaged)
+        remapRows(previousRows);
+
+    //log(_data);
+    //log("setting data");
+
+    updateLabelColumnWidth();
     
     _selection.length = _data.nodes.length;
     for (var i = 0; i < _selection.length; i++) _selection[i] = 0;
@@ -1004,7 +1544,28 @@ function queueData(d) {
         _selectedBeforeMerge = -1;
     }
     
-    if( _markerSelection.length < _data.names.length )
+    // the marker selection of a paged panel follows the visible rows
+    if (_isPaged)
+    {
+        _markerSelection.length = _data.names.length;
+        _markerSelection.fill(0);
+
+        // C++ keeps the marker selection mode of a paged panel
+        _isMakerSelectionActive = page.markerSelection;
+
+        if (_rowOffset < _pageBegin || _rowOffset >= _pageBegin + _data.names.length)
+            _rowOffset = _pageBegin;
+
+        updateVisibleRows();
+    }
+    else if (wasPaged)
+    {
+        _markerSelection.length = _data.names.length;
+        _markerSelection.fill(1);
+
+        refreshMarkerSelectionSAT();
+    }
+    else if( _markerSelection.length < _data.names.length )
     {
         var start = _markerSelection.length;
         _markerSelection.length = _data.names.length;
@@ -1022,14 +1583,183 @@ function queueData(d) {
     rebuildRangeSlider();
 	initHeatMapLayout();
 
+    if (page) reportTimings(page.revision, [["queue", message.received, started], ["decode", started, decoded], ["layout", decoded, getWallClockTime()]]);
+
 	//log("Data set.");
 }
 
+// wall clock time in milliseconds since the epoch, comparable to the clock of the plugin
+function getWallClockTime() {
+
+    return performance.timeOrigin + performance.now();
+}
+
+// report the stages of showing data to the plugin, the last stage lasts until the next frame is painted
+function reportTimings(revision, stages) {
+
+    if (!isQtAvailable) return;
+
+    var frameBegin = stages[stages.length - 1][2];
+
+    requestAnimationFrame(function () {
+        stages.push(["frame", frameBegin, getWallClockTime()]);
+        QtBridge.js_reportTimings(revision, stages);
+    });
+}
+
+function updateLabelColumnWidth() {
+
+    _labelColumnWidth = 0;
+    for (var i = 0; i < _data.names.length; i++)
+    {
+        var l = _data.names[i].width() + 10;
+        _labelColumnWidth = Math.max(l, _labelColumnWidth);
+    }
+
+    _labelColumnWidth += getRowDendrogramWidth();
+}
+
+// keep the marker selection and the sorting on the same dimensions when the rows are ordered differently
+function remapRows(previousRows) {
+
+    var numRows = _data.names.length;
+
+    if (previousRows == _rowDimensions || _markerSelection.length != numRows || (previousRows && previousRows.length != numRows)) return;
+
+    var dimensionRows = new Array(numRows);
+
+    for (var r = 0; r < numRows; r++)
+        dimensionRows[_rowDimensions ? _rowDimensions[r] : r] = r;
+
+    var markerSelection = new Array(numRows).fill(0);
+
+    for (var r = 0; r < numRows; r++)
+        markerSelection[dimensionRows[previousRows ? previousRows[r] : r]] = _markerSelection[r];
+
+    for (var r = 0; r < numRows; r++)
+        _markerSelection[r] = markerSelection[r];
+
+    if (_sortBy >= 0 && _sortBy < numRows)
+        _sortBy = dimensionRows[previousRows ? previousRows[_sortBy] : _sortBy];
+
+    refreshMarkerSelectionSAT();
+}
+
+// =============================================================================
+// paging
+// =============================================================================
+// only rows are paged, every page holds all columns; the clusters are sorted by a dimension whose
+// values every page carries, and C++ keeps the marker selection and pages over the selected markers
+function getNumVisibleRows() {
+
+    return Math.max(1, Math.floor(_heatmapHeight / _pagedRowHeight));
+}
+
+// replace the rows of the shown data by another page, keeping the cluster selection and order
+function setPage(data) {
+
+    var page = data.header.page;
+
+    _data = data;
+    _pageBegin = page.begin;
+    _numDimensions = page.numDimensions;
+    _pageMarkers = data.header.markers || [];
+    _cellTileKey = "";
+    _rowDimensions = data.header.rows || null;
+    _rowDendrogram = null;
+
+    // the rows changed (e.g. the marker selection mode), C++ tells where the previous first row went
+    if (page.offset !== undefined)
+        _rowOffset = page.offset;
+
+    if (data.header.sort)
+        _sortDimension = data.header.sort.dimension;
+
+    updateLabelColumnWidth();
+
+    _markerSelection.length = _data.names.length;
+    _markerSelection.fill(0);
+
+    updateVisibleRows();
+
+    if (!_isDendrogramActive)
+        sortByMarker(-1, false);
+
+    initHeatMapLayout();
+}
+
+// activate the markers of the visible rows and request the next page before the visible rows leave this one
+function updateVisibleRows() {
+
+    if (!_isPaged || !_data) return;
+
+    var numVisibleRows = getNumVisibleRows();
+
+    _rowOffset = Math.max(0, Math.min(_rowOffset, _numDimensions - numVisibleRows));
+
+    var rowEnd = Math.min(_numDimensions, _rowOffset + numVisibleRows);
+    var pageEnd = _pageBegin + _data.names.length;
+
+    // rows outside this page keep showing the previous rows until their page arrives
+    if (_rowOffset >= _pageBegin && _rowOffset < pageEnd)
+    {
+        for (var j = 0; j < _markerSelection.length; j++)
+        {
+            var dimension = _pageBegin + j;
+            _markerSelection[j] = (dimension >= _rowOffset && dimension < rowEnd) ? 1 : 0;
+        }
+
+        refreshMarkerSelectionSAT();
+    }
+
+    var margin = Math.floor(numVisibleRows / 2);
+
+    if ((_rowOffset - margin < _pageBegin && _pageBegin > 0) || (rowEnd + margin > pageEnd && pageEnd < _numDimensions))
+        requestPage(_rowOffset, rowEnd);
+}
+
+// request the visible rows again, after C++ changed the rows the page scrolls through
+function reloadPage() {
+
+    _requestedRows = null;
+
+    requestPage(_rowOffset, _rowOffset + getNumVisibleRows());
+}
+
+function requestPage(rowBegin, rowEnd) {
+
+    if (_requestedRows && _requestedRows[0] == rowBegin && _requestedRows[1] == rowEnd) return;
+
+    _requestedRows = [rowBegin, rowEnd];
+
+    if (isQtAvailable) { QtBridge.js_requestPage(++_pageRequest, rowBegin, rowEnd); }
+}
+
+function scrollRows(delta) {
+
+    if (!_isPaged || !_data) return;
+
+    _rowOffset += delta;
+
+    updateVisibleRows();
+    drawHeatMap(0);
+}
+
 function setData(d) {    
 
     log("setting data");
 
-    _dataQueue.addData(d);
+    _dataQueue.addData({ "payload": d, "decode": JSON.parse });
+    resize();
+
+    log("Data set.");
+}
+
+function setBinaryData(b) {
+
+    log("setting data");
+
+    _dataQueue.addData({ "payload": b, "decode": decodeBinaryData, "received": getWallClockTime() });
     resize();
 
     log("Data set.");
@@ -1051,6 +1781,34 @@ function setSelection(slct) {
     drawSelectionHighlights(500);
 }
 
+// the points selected in linked views as a fraction per cluster; arrives throttled while brushing
+function setSelectionOverlap(fractions) {
+
+    _selectionOverlap = fractions;
+
+    if (!_data || !_selectionOverlapBars) return;
+
+    _selectionOverlapBars.transition()
+        .duration(100)
+        .attr("width", function (d, i) { return (_selectionOverlap[i] || 0) * _subsetLabelUIHeight; });
+}
+
+// statistics of the points selected in linked views for dimensions [begin, begin + means.length); arrive throttled while brushing
+function setSelectionStatistics(numPoints, begin, means, stddevs) {
+
+    var wasShown = getSelectionColumnWidth() > 0;
+
+    _selectionStatistics = { "numPoints": numPoints, "begin": begin, "means": means, "stddevs": stddevs };
+
+    if (!_data) return;
+
+    // showing or hiding the column changes the width of the cluster columns
+    if (wasShown != (getSelectionColumnWidth() > 0))
+        drawHeatMap(250);
+    else
+        drawSelectionColumn(0);
+}
+
 function setHighlight(highlight) {
 
     return;
@@ -1102,6 +1860,8 @@ function resize() {
 
 	if (_containerSvg) _containerSvg.attr("width", _svgWidth).attr("height", _svgHeight);
 
+	updateVisibleRows();
+
 	drawHeatMap(0);
 	//drawDendrogram(dendroClusters);
 }
@@ -21,4 +21,12 @@ function keyDown( key ) {
   {
     moveSelection("first");
   }
+  else if( key == 33 ) // page up
+  {
+    scrollRows(-getNumVisibleRows());
+  }
+  else if( key == 34 ) // page down
+  {
+    scrollRows(getNumVisibleRows());
+  }
 }
\ No newline at end of file
@@ -0,0 +1,109 @@
+// =============================================================================
+// binary heatmap payload, see src/HeatMapPayload.h for the layout
+// =============================================================================
+
+var _float16Table = null;
+
+function decodeBinaryData(base64) {
+
+    var binary = atob(base64);
+    var bytes = new Uint8Array(binary.length);
+
+    for (var i = 0; i < binary.length; i++)
+        bytes[i] = binary.charCodeAt(i);
+
+    if (String.fromCharCode(bytes[0], bytes[1], bytes[2], bytes[3]) != "HMB1") {
+        log("Unknown heatmap payload");
+        return null;
+    }
+
+    var headerSize = new DataView(bytes.buffer).getUint32(4, true);
+    var header = JSON.parse(new TextDecoder("utf-8").decode(bytes.subarray(8, 8 + headerSize)));
+    var dataOffset = 8 + headerSize;
+
+    var matrices = {};
+    for (var i = 0; i < header.matrices.length; i++) {
+        var m = header.matrices[i];
+        matrices[m.name] = decodeMatrix(bytes.buffer, dataOffset + m.offset, m.type, m.count);
+    }
+
+    // clusters x dimensions matrices become per node views, without copying
+    var numDimensions = header.names.length;
+    var numCells = header.clusters.length * numDimensions;
+
+    // histograms are clusters x dimensions x bins, see getCellHistogram
+    var numBins = header.distributions ? header.distributions.bins : 0;
+
+    var nodes = header.clusters.map(function (cluster, i) {
+        var node = { "name": cluster.name, "size": cluster.size };
+        for (var name in matrices) {
+            if (matrices[name].length == numCells)
+                node[name] = matrices[name].subarray(i * numDimensions, (i + 1) * numDimensions);
+        }
+        if (numBins > 0 && matrices.histogram)
+            node.histogram = matrices.histogram.subarray(i * numDimensions * numBins, (i + 1) * numDimensions * numBins);
+
+        // the heatmap is colored by the statistic selected in the settings
+        node.expression = node[header.colorBy] || node.mean;
+        return node;
+    });
+
+    return { "nodes": nodes, "names": header.names, "header": header, "matrices": matrices };
+}
+
+// histogram of one cell as uint16 bins, drawn as a violin when the variation is shown (see getViolinPath);
+// each cell is scaled so that its fullest bin is 65535 and
+// the bins split [header.distributions.minimum[dimension], header.distributions.maximum[dimension]] evenly
+function getCellHistogram(node, dimension) {
+
+    if (!node.histogram || !_data.header.distributions) return null;
+
+    var numBins = _data.header.distributions.bins;
+
+    return node.histogram.subarray(dimension * numBins, (dimension + 1) * numBins);
+}
+
+function decodeMatrix(buffer, offset, type, count) {
+
+    if (type == "float32")
+        return new Float32Array(buffer, offset, count);
+
+    if (type == "uint16")
+        return new Uint16Array(buffer, offset, count);
+
+    if (type == "float16") {
+        var halfs = new Uint16Array(buffer, offset, count);
+        var table = float16Table();
+        var floats = new Float32Array(count);
+
+        for (var i = 0; i < count; i++)
+            floats[i] = table[halfs[i]];
+
+        return floats;
+    }
+
+    log("Unknown matrix type " + type);
+    return new Float32Array(count);
+}
+
+function float16Table() {
+
+    if (_float16Table) return _float16Table;
+
+    _float16Table = new Float32Array(65536);
+
+    for (var h = 0; h < 65536; h++) {
+        var sign = (h & 0x8000) ? -1 : 1;
+        var exponent = (h >> 10) & 0x1f;
+        var fraction = h & 0x3ff;
+
+        if (exponent == 0)
+            _float16Table[h] = sign * Math.pow(2, -14) * (fraction / 1024);
+        else if (exponent == 31)
+            _float16Table[h] = fraction ? NaN : sign * Infinity;
+        else
+            _float16Table[h] = sign * Math.pow(2, exponent - 15) * (1 + fraction / 1024);
+    }
+
+    return _float16Table;
+}
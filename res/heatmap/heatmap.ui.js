@@ -20,12 +20,18 @@ function rebuildRangeSlider() {
 
     _markerRangeSlider.noUiSlider.destroy();
         
-    _markerRange[0] = d3.min(_data.nodes, function(node) {
-        return d3.min(node.expression.filter(function(e, i){ return (_markerSelection[i] > 0); }));
-    });
-    _markerRange[1] = d3.max(_data.nodes, function(node) {
-        return d3.max(node.expression.filter(function(e, i){ return (_markerSelection[i] > 0); }));
-    });
+    // a page only holds some of the rows, so paged panels use the range of all of them
+    if (_isPaged && _data.header.range) {
+        _markerRange[0] = _data.header.range[0];
+        _markerRange[1] = _data.header.range[1];
+    } else {
+        _markerRange[0] = d3.min(_data.nodes, function(node) {
+            return d3.min(node.expression.filter(function(e, i){ return (_markerSelection[i] > 0); }));
+        });
+        _markerRange[1] = d3.max(_data.nodes, function(node) {
+            return d3.max(node.expression.filter(function(e, i){ return (_markerSelection[i] > 0); }));
+        });
+    }
     //log(_markerRange);
 
     _markerUserBounds[0] = Math.max(_markerRange[0], _markerUserBounds[0]);
@@ -39,13 +45,18 @@ function rebuildRangeSlider() {
 
     //log(_markerUserBounds);
 
+    // transformed statistics can be negative or lie within [0, 1], so their slider spans their range
+    var isTransformed = _valueTransform != "none";
+    var sliderMinimum = isTransformed ? _markerRange[0] : 0;
+    var sliderMaximum = isTransformed ? Math.max(_markerRange[1], sliderMinimum + 1e-6) : Math.max(_markerRange[1], 5.0);
+
     noUiSlider.create(_markerRangeSlider, {
         start:_markerUserBounds,
         behaviour: 'tap-drag',
         connect: true,
         range: {
-            'min': 0,
-            'max': Math.max(_markerRange[1], 5.0)
+            'min': sliderMinimum,
+            'max': sliderMaximum
         },
         pips: {
             mode: 'positions',
@@ -73,6 +84,49 @@ function initContextMenu() {
         var m = [];
 
         var numSelectedItems = _selection.reduce(function (a, b) { return a + b }, 0);
+
+        if (numSelectedItems > 0 && isQtAvailable) {
+            m.push({
+                title: "Rank Markers of Selection",
+                action: function () {
+                    d3.select('.d3-context-menu').style('display', 'none');
+                    rankMarkersOfSelection();
+                }
+            });
+
+            // divider
+            m.push({ divider: true });
+        }
+
+        var selectedColumn = numSelectedItems == 1 ? _selection.indexOf(1) : -1;
+        var selectedGroup = getColumnGroup(selectedColumn);
+
+        if (selectedGroup && (selectedGroup[1] || selectedGroup[2]) && isQtAvailable) {
+
+            if (selectedGroup[1]) {
+                m.push({
+                    title: "Expand Super-Cluster (" + selectedGroup[0] + " Clusters)",
+                    action: function () {
+                        d3.select('.d3-context-menu').style('display', 'none');
+                        expandColumn(selectedColumn);
+                    }
+                });
+            }
+
+            if (selectedGroup[2]) {
+                m.push({
+                    title: "Collapse into Parent Super-Cluster",
+                    action: function () {
+                        d3.select('.d3-context-menu').style('display', 'none');
+                        collapseColumn(selectedColumn);
+                    }
+                });
+            }
+
+            // divider
+            m.push({ divider: true });
+        }
+
         if (numSelectedItems > 1) {
 
             if (isQtAvailable) {
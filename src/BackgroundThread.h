@@ -0,0 +1,103 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <stop_token>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace heatmap
+{
+
+/**
+ * Background thread
+ *
+ * Runs one job at a time on a thread of its own. Starting a job asks the running job to stop and
+ * retires its thread instead of joining it, so the caller (the GUI thread) never waits for a job
+ * that cannot be interrupted right away, e.g. a proxy column extraction. Retired threads are
+ * joined once they finished, on a later start, or when the background thread is stopped.
+ */
+class BackgroundThread
+{
+public:
+
+    /** Construct without a job */
+    BackgroundThread() = default;
+
+    /** Stop and join all jobs */
+    ~BackgroundThread() {
+        stop();
+    }
+
+    BackgroundThread(const BackgroundThread&) = delete;
+    BackgroundThread& operator=(const BackgroundThread&) = delete;
+
+    /**
+     * Ask the running job to stop and run \p job on a new thread
+     * @param job Callable taking a std::stop_token, which is triggered when the job became stale
+     */
+    template <typename Job>
+    void start(Job&& job)
+    {
+        requestStop();
+
+        if (_current.thread.joinable())
+            _retired.push_back(std::move(_current));
+
+        // Threads that finished are joined right away, the others later
+        std::erase_if(_retired, [](Worker& worker) -> bool {
+            if (!worker.isFinished->load(std::memory_order_acquire))
+                return false;
+
+            worker.thread.join();
+
+            return true;
+        });
+
+        auto isFinished = std::make_shared<std::atomic<bool>>(false);
+
+        _current.isFinished = isFinished;
+        _current.thread     = std::jthread([job = std::forward<Job>(job), isFinished](std::stop_token stopToken) mutable -> void {
+            job(stopToken);
+
+            isFinished->store(true, std::memory_order_release);
+        });
+    }
+
+    /** Ask the running job to stop, without waiting for it */
+    void requestStop()
+    {
+        if (_current.thread.joinable())
+            _current.thread.request_stop();
+    }
+
+    /** Ask all jobs to stop and wait for them */
+    void stop()
+    {
+        requestStop();
+
+        for (auto& worker : _retired)
+            worker.thread.request_stop();
+
+        if (_current.thread.joinable())
+            _current.thread.join();
+
+        _retired.clear();
+    }
+
+private:
+
+    /** Thread of a job */
+    struct Worker
+    {
+        std::jthread                        thread;         /** Thread running the job */
+        std::shared_ptr<std::atomic<bool>>  isFinished;     /** Whether the job returned */
+    };
+
+private:
+    Worker              _current;       /** Thread of the latest job */
+    std::vector<Worker> _retired;       /** Threads of older jobs that were asked to stop */
+};
+
+}
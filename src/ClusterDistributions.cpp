@@ -0,0 +1,313 @@
+#include "ClusterDistributions.h"
+
+#include "Parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <numeric>
+
+namespace heatmap
+{
+
+namespace
+{
+    /** Number of dimensions processed by a single task */
+    constexpr std::size_t dimensionBlockSize = 16;
+
+    /** Number of points read at a time */
+    constexpr std::size_t pointChunkSize = 256;
+
+    /**
+     * Derive the quantiles and coarse histogram of one cell from its fine histogram
+     * @param fineCounts Fine histogram of the cell (fineBinCount bins)
+     * @param count Number of values in the cell
+     * @param minimum Lower edge of the histogram range
+     * @param maximum Upper edge of the histogram range
+     * @param levels Quantile levels (ascending)
+     * @param quantiles Receives the quantile of each level, strided by \p quantileStride
+     * @param quantileStride Distance between the quantiles of consecutive levels
+     * @param histogram Receives the coarse histogram (numBins bins)
+     * @param numBins Number of coarse bins
+     * @param coarseCounts Scratch space of numBins counts
+     */
+    void summarizeCell(const std::uint32_t* fineCounts, std::uint64_t count, float minimum, float maximum, const std::vector<float>& levels, float* quantiles, std::size_t quantileStride, std::uint16_t* histogram, std::size_t numBins, std::vector<std::uint64_t>& coarseCounts)
+    {
+        constexpr auto fineBinCount = ClusterDistributionEngine::fineBinCount;
+
+        if (count == 0) {
+            for (std::size_t levelIndex = 0; levelIndex < levels.size(); ++levelIndex)
+                quantiles[levelIndex * quantileStride] = 0.0f;
+
+            std::fill_n(histogram, numBins, std::uint16_t(0));
+
+            return;
+        }
+
+        // Order statistics are placed uniformly within their bin, quantiles interpolate linearly between them
+        const auto binWidth = (static_cast<double>(maximum) - minimum) / fineBinCount;
+
+        struct OrderStatistic
+        {
+            std::size_t     bin = 0;                /** Bin of the last requested order statistic */
+            std::uint64_t   cumulativeCount = 0;    /** Number of values in the bins before it */
+        };
+
+        // Levels are ascending, so each walker only moves forward
+        const auto getOrderStatistic = [&](OrderStatistic& walker, std::uint64_t order) -> double {
+            while (walker.bin < fineBinCount - 1 && walker.cumulativeCount + fineCounts[walker.bin] <= order)
+                walker.cumulativeCount += fineCounts[walker.bin++];
+
+            const auto binCount = std::max<std::uint32_t>(fineCounts[walker.bin], 1);
+            const auto fraction = (static_cast<double>(order - walker.cumulativeCount) + 0.5) / binCount;
+
+            return minimum + (static_cast<double>(walker.bin) + std::min(fraction, 1.0)) * binWidth;
+        };
+
+        OrderStatistic lower, upper;
+
+        for (std::size_t levelIndex = 0; levelIndex < levels.size(); ++levelIndex) {
+            const auto rank         = static_cast<double>(levels[levelIndex]) * static_cast<double>(count - 1);
+            const auto lowerOrder   = static_cast<std::uint64_t>(rank);
+            const auto upperOrder   = std::min(lowerOrder + 1, count - 1);
+            const auto lowerValue   = getOrderStatistic(lower, lowerOrder);
+            const auto upperValue   = getOrderStatistic(upper, upperOrder);
+            const auto quantile     = lowerValue + (rank - static_cast<double>(lowerOrder)) * (upperValue - lowerValue);
+
+            quantiles[levelIndex * quantileStride] = static_cast<float>(std::clamp(quantile, static_cast<double>(minimum), static_cast<double>(maximum)));
+        }
+
+        std::fill(coarseCounts.begin(), coarseCounts.end(), std::uint64_t(0));
+
+        for (std::size_t fineBin = 0; fineBin < fineBinCount; ++fineBin)
+            coarseCounts[fineBin * numBins / fineBinCount] += fineCounts[fineBin];
+
+        const auto fullestBin = static_cast<double>(*std::max_element(coarseCounts.begin(), coarseCounts.end()));
+
+        for (std::size_t coarseBin = 0; coarseBin < numBins; ++coarseBin)
+            histogram[coarseBin] = static_cast<std::uint16_t>(std::lround(65535.0 * static_cast<double>(coarseCounts[coarseBin]) / fullestBin));
+    }
+}
+
+std::string getQuantileName(float level)
+{
+    if (level == 0.5f)
+        return "median";
+
+    char name[32];
+
+    std::snprintf(name, sizeof(name), "q%g", static_cast<double>(level));
+
+    return name;
+}
+
+ClusterDistributionEngine::ClusterDistributionEngine(std::size_t numBins, std::vector<float> levels) :
+    _numBins(std::clamp<std::size_t>(numBins, 1, fineBinCount)),
+    _levels(std::move(levels))
+{
+    std::erase_if(_levels, [](float level) { return !(level > 0.0f && level < 1.0f); });
+
+    _levels.push_back(0.5f);
+
+    std::sort(_levels.begin(), _levels.end());
+
+    _levels.erase(std::unique(_levels.begin(), _levels.end()), _levels.end());
+}
+
+ClusterDistributions ClusterDistributionEngine::computeFromColumns(std::size_t numPoints, std::size_t numDimensions, const std::vector<std::span<const std::uint32_t>>& clusterIndices, const ColumnExtractor& extractColumn, std::size_t memoryBudget, std::stop_token stopToken, const ProgressCallback& progressCallback) const
+{
+    auto distributions = createDistributions(numDimensions, clusterIndices.size());
+
+    if (numPoints == 0 || numDimensions == 0)
+        return distributions;
+
+    const auto numChunkDimensions = std::clamp<std::size_t>(memoryBudget / (numPoints * sizeof(float)), 1, numDimensions);
+
+    std::vector<std::vector<float>> columns(numChunkDimensions);
+
+    for (std::size_t chunkBegin = 0; chunkBegin < numDimensions; chunkBegin += numChunkDimensions) {
+        const auto chunkEnd = std::min(chunkBegin + numChunkDimensions, numDimensions);
+
+        for (auto dimension = chunkBegin; dimension < chunkEnd; ++dimension) {
+            if (stopToken.stop_requested())
+                return distributions;
+
+            extractColumn(dimension, columns[dimension - chunkBegin]);
+
+            // Short columns are treated as missing values
+            columns[dimension - chunkBegin].resize(numPoints, std::numeric_limits<float>::quiet_NaN());
+        }
+
+        const auto read = [&columns, chunkBegin](std::span<const std::uint32_t> points, std::size_t dimensionBegin, std::size_t dimensionEnd, float* output) -> void {
+            for (const auto pointIndex : points)
+                for (auto dimension = dimensionBegin; dimension < dimensionEnd; ++dimension)
+                    *output++ = columns[dimension - chunkBegin][pointIndex];
+        };
+
+        accumulate(distributions, numPoints, clusterIndices, chunkBegin, chunkEnd, read, stopToken, {});
+
+        if (progressCallback)
+            progressCallback(static_cast<float>(chunkEnd) / static_cast<float>(numDimensions));
+    }
+
+    return distributions;
+}
+
+ClusterDistributions ClusterDistributionEngine::createDistributions(std::size_t numDimensions, std::size_t numClusters) const
+{
+    ClusterDistributions distributions;
+
+    distributions.numClusters   = numClusters;
+    distributions.numDimensions = numDimensions;
+    distributions.numBins       = _numBins;
+    distributions.levels        = _levels;
+
+    distributions.minimum.assign(numDimensions, 0.0f);
+    distributions.maximum.assign(numDimensions, 0.0f);
+    distributions.quantiles.assign(_levels.size() * numClusters * numDimensions, 0.0f);
+    distributions.histograms.assign(numClusters * numDimensions * _numBins, 0);
+
+    return distributions;
+}
+
+void ClusterDistributionEngine::accumulate(ClusterDistributions& distributions, std::size_t numPoints, const std::vector<std::span<const std::uint32_t>>& clusterIndices, std::size_t dimensionBegin, std::size_t dimensionEnd, const BlockReader& read, const std::stop_token& stopToken, const ProgressCallback& progressCallback) const
+{
+    const auto numClusters      = clusterIndices.size();
+    const auto numDimensions    = distributions.numDimensions;
+    const auto numBlocks        = (dimensionEnd - dimensionBegin + dimensionBlockSize - 1) / dimensionBlockSize;
+
+    if (numBlocks == 0 || numPoints == 0)
+        return;
+
+    // The histogram range of a dimension is shared by all clusters
+    parallelFor(numBlocks, [&](std::size_t blockIndex) -> void {
+        const auto blockBegin   = dimensionBegin + blockIndex * dimensionBlockSize;
+        const auto blockEnd     = std::min(blockBegin + dimensionBlockSize, dimensionEnd);
+        const auto blockSize    = blockEnd - blockBegin;
+
+        std::vector<float> minimum(blockSize, std::numeric_limits<float>::max()), maximum(blockSize, std::numeric_limits<float>::lowest());
+        std::vector<std::uint32_t> points(pointChunkSize);
+        std::vector<float> values(pointChunkSize * blockSize);
+
+        for (std::size_t pointBegin = 0; pointBegin < numPoints; pointBegin += pointChunkSize) {
+            if (stopToken.stop_requested())
+                return;
+
+            const auto numChunkPoints = std::min(pointChunkSize, numPoints - pointBegin);
+
+            std::iota(points.begin(), points.begin() + numChunkPoints, static_cast<std::uint32_t>(pointBegin));
+
+            read(std::span<const std::uint32_t>(points.data(), numChunkPoints), blockBegin, blockEnd, values.data());
+
+            for (std::size_t i = 0; i < numChunkPoints; ++i) {
+                for (std::size_t d = 0; d < blockSize; ++d) {
+                    const auto value = values[i * blockSize + d];
+
+                    if (!std::isfinite(value))
+                        continue;
+
+                    minimum[d] = std::min(minimum[d], value);
+                    maximum[d] = std::max(maximum[d], value);
+                }
+            }
+        }
+
+        for (std::size_t d = 0; d < blockSize; ++d) {
+            distributions.minimum[blockBegin + d] = minimum[d] <= maximum[d] ? minimum[d] : 0.0f;
+            distributions.maximum[blockBegin + d] = minimum[d] <= maximum[d] ? maximum[d] : 0.0f;
+        }
+    });
+
+    if (stopToken.stop_requested() || numClusters == 0)
+        return;
+
+    // Progress is measured in processed values so that large clusters weigh in accordingly
+    std::uint64_t totalWork = 0;
+
+    for (const auto& indices : clusterIndices)
+        totalWork += indices.size() * (dimensionEnd - dimensionBegin);
+
+    std::atomic<std::uint64_t> completedWork = 0;
+    std::atomic<int> reportedPercentage = 0;
+
+    const auto numCells = numClusters * numDimensions;
+
+    parallelFor(numClusters * numBlocks, [&](std::size_t taskIndex) -> void {
+        if (stopToken.stop_requested())
+            return;
+
+        const auto clusterIndex = taskIndex / numBlocks;
+        const auto blockBegin   = dimensionBegin + (taskIndex % numBlocks) * dimensionBlockSize;
+        const auto blockEnd     = std::min(blockBegin + dimensionBlockSize, dimensionEnd);
+        const auto blockSize    = blockEnd - blockBegin;
+        const auto indices      = clusterIndices[clusterIndex];
+
+        std::vector<std::uint32_t> fineCounts(blockSize * fineBinCount, 0);
+        std::vector<std::uint64_t> counts(blockSize, 0), coarseCounts(_numBins);
+        std::vector<float> binScales(blockSize);
+        std::vector<std::uint32_t> points;
+        std::vector<float> values(pointChunkSize * blockSize);
+
+        for (std::size_t d = 0; d < blockSize; ++d) {
+            const auto range = distributions.maximum[blockBegin + d] - distributions.minimum[blockBegin + d];
+
+            binScales[d] = range > 0.0f ? static_cast<float>(fineBinCount) / range : 0.0f;
+        }
+
+        points.reserve(pointChunkSize);
+
+        for (std::size_t chunkBegin = 0; chunkBegin < indices.size(); chunkBegin += pointChunkSize) {
+            if (stopToken.stop_requested())
+                return;
+
+            points.clear();
+
+            for (auto i = chunkBegin; i < std::min(chunkBegin + pointChunkSize, indices.size()); ++i)
+                if (indices[i] < numPoints)
+                    points.push_back(indices[i]);
+
+            read(points, blockBegin, blockEnd, values.data());
+
+            for (std::size_t i = 0; i < points.size(); ++i) {
+                for (std::size_t d = 0; d < blockSize; ++d) {
+                    const auto value = values[i * blockSize + d];
+
+                    if (!std::isfinite(value))
+                        continue;
+
+                    const auto bin = std::min(static_cast<std::size_t>((value - distributions.minimum[blockBegin + d]) * binScales[d]), fineBinCount - 1);
+
+                    ++fineCounts[d * fineBinCount + bin];
+                    ++counts[d];
+                }
+            }
+        }
+
+        for (std::size_t d = 0; d < blockSize; ++d) {
+            const auto dimension    = blockBegin + d;
+            const auto cellIndex    = clusterIndex * numDimensions + dimension;
+
+            summarizeCell(fineCounts.data() + d * fineBinCount, counts[d], distributions.minimum[dimension], distributions.maximum[dimension], _levels, distributions.quantiles.data() + cellIndex, numCells, distributions.histograms.data() + cellIndex * _numBins, _numBins, coarseCounts);
+        }
+
+        if (!progressCallback || totalWork == 0)
+            return;
+
+        const auto taskWork     = indices.size() * blockSize;
+        const auto work         = completedWork.fetch_add(taskWork) + taskWork;
+        const auto percentage   = static_cast<int>(100 * work / totalWork);
+
+        auto previousPercentage = reportedPercentage.load();
+
+        while (percentage > previousPercentage) {
+            if (reportedPercentage.compare_exchange_weak(previousPercentage, percentage)) {
+                progressCallback(static_cast<float>(percentage) / 100.0f);
+                break;
+            }
+        }
+    });
+}
+
+}
@@ -0,0 +1,163 @@
+#pragma once
+
+#include "ClusterStatistics.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <stop_token>
+#include <string>
+#include <vector>
+
+namespace heatmap
+{
+
+/**
+ * Get the name under which the statistic of quantile \p level is sent to the web page
+ * @param level Quantile level in (0, 1)
+ * @return "median" for 0.5, otherwise "q" followed by the level (e.g. "q0.25")
+ */
+std::string getQuantileName(float level);
+
+/**
+ * Cluster distributions
+ *
+ * Per cluster and dimension the quantiles and a fixed-bin histogram of the values. All clusters
+ * share the histogram range of a dimension, which is the range of the (finite) values of all points.
+ */
+struct ClusterDistributions
+{
+    /**
+     * Get the clusters x dimensions matrix of quantile \p levelIndex
+     * @param levelIndex Index in levels
+     */
+    const float* getQuantiles(std::size_t levelIndex) const {
+        return quantiles.data() + levelIndex * numClusters * numDimensions;
+    }
+
+    std::size_t                 numClusters = 0;    /** Number of clusters */
+    std::size_t                 numDimensions = 0;  /** Number of dimensions */
+    std::size_t                 numBins = 0;        /** Number of histogram bins per cluster and dimension */
+    std::vector<float>          levels;             /** Quantile levels in ascending order, always including the median (0.5) */
+    std::vector<float>          minimum;            /** Per dimension, the lower edge of the histogram range */
+    std::vector<float>          maximum;            /** Per dimension, the upper edge of the histogram range */
+    std::vector<float>          quantiles;          /** Per level, a clusters x dimensions matrix */
+    std::vector<std::uint16_t>  histograms;         /** Clusters x dimensions x bins; each cell is scaled so that its fullest bin is 65535 */
+};
+
+/**
+ * Cluster distribution engine
+ *
+ * Computes the distributions of a set of (possibly overlapping) clusters without sorting: after a
+ * pass for the per-dimension value range, every cluster and dimension block is binned into a fine
+ * histogram, from which the quantiles (accurate to about one fine bin, i.e. range / fineBinCount)
+ * and the coarse histogram that is sent to the web page are derived. The work is split over
+ * clusters and dimension blocks on the worker threads, like the moments.
+ */
+class ClusterDistributionEngine
+{
+public:
+
+    /** Number of bins of the histograms the quantiles are derived from */
+    static constexpr std::size_t fineBinCount = 2048;
+
+    /** Callback receiving the fraction [0, 1] of completed work; may be invoked from any worker thread */
+    using ProgressCallback = ClusterStatisticsEngine::ProgressCallback;
+
+    /** Extracts the values of one dimension for all points into the given vector */
+    using ColumnExtractor = ClusterStatisticsEngine::ColumnExtractor;
+
+    /** Writes the values of \p points for dimensions [dimensionBegin, dimensionEnd) as row-major floats to \p values */
+    using BlockReader = std::function<void(std::span<const std::uint32_t> points, std::size_t dimensionBegin, std::size_t dimensionEnd, float* values)>;
+
+    /**
+     * Construct with the number of histogram bins and quantile levels
+     * @param numBins Number of histogram bins per cluster and dimension (clamped to [1, fineBinCount])
+     * @param levels Quantile levels; levels outside (0, 1) are ignored and the median is always added
+     */
+    ClusterDistributionEngine(std::size_t numBins, std::vector<float> levels);
+
+    /** Get the number of histogram bins */
+    std::size_t getNumBins() const {
+        return _numBins;
+    }
+
+    /** Get the quantile levels (ascending, including the median) */
+    const std::vector<float>& getLevels() const {
+        return _levels;
+    }
+
+    /**
+     * Compute the distributions of each cluster
+     * @param values Row-major point values (numPoints x numDimensions) in their stored element type
+     * @param numPoints Number of points
+     * @param numDimensions Number of dimensions
+     * @param clusterIndices Point indices per cluster (out of range indices are ignored)
+     * @param stopToken Token to cancel the computation with; the result is incomplete when stop was requested
+     * @param progressCallback Invoked whenever another percent of the work is done
+     * @return Distributions of all clusters
+     */
+    template <typename ElementType>
+    ClusterDistributions compute(const ElementType* values, std::size_t numPoints, std::size_t numDimensions, const std::vector<std::span<const std::uint32_t>>& clusterIndices, std::stop_token stopToken = {}, const ProgressCallback& progressCallback = {}) const
+    {
+        auto distributions = createDistributions(numDimensions, clusterIndices.size());
+
+        if (values == nullptr)
+            return distributions;
+
+        const auto read = [values, numDimensions](std::span<const std::uint32_t> points, std::size_t dimensionBegin, std::size_t dimensionEnd, float* output) -> void {
+            for (const std::size_t pointIndex : points) {
+                const auto row = values + pointIndex * numDimensions;
+
+                for (auto dimension = dimensionBegin; dimension < dimensionEnd; ++dimension)
+                    *output++ = static_cast<float>(kernels::widen(row[dimension]));
+            }
+        };
+
+        accumulate(distributions, numPoints, clusterIndices, 0, numDimensions, read, stopToken, progressCallback);
+
+        return distributions;
+    }
+
+    /**
+     * Compute the distributions of each cluster by streaming chunks of dimensions (columns), for proxies
+     * @param numPoints Number of points
+     * @param numDimensions Number of dimensions
+     * @param clusterIndices Point indices per cluster (out of range indices are ignored)
+     * @param extractColumn Extracts the values of one dimension
+     * @param memoryBudget Maximum number of bytes of extracted values held at a time
+     * @param stopToken Token to cancel the computation with; the result is incomplete when stop was requested
+     * @param progressCallback Invoked after every chunk of dimensions
+     * @return Distributions of all clusters
+     */
+    ClusterDistributions computeFromColumns(std::size_t numPoints, std::size_t numDimensions, const std::vector<std::span<const std::uint32_t>>& clusterIndices, const ColumnExtractor& extractColumn, std::size_t memoryBudget, std::stop_token stopToken = {}, const ProgressCallback& progressCallback = {}) const;
+
+private:
+
+    /**
+     * Create distributions with all quantiles and bins zero
+     * @param numDimensions Number of dimensions
+     * @param numClusters Number of clusters
+     */
+    ClusterDistributions createDistributions(std::size_t numDimensions, std::size_t numClusters) const;
+
+    /**
+     * Compute the range, quantiles and histograms of dimensions [dimensionBegin, dimensionEnd)
+     * @param distributions Distributions to write the dimension range of
+     * @param numPoints Number of points
+     * @param clusterIndices Point indices per cluster (out of range indices are ignored)
+     * @param dimensionBegin First dimension
+     * @param dimensionEnd One past the last dimension
+     * @param read Reads the values of a set of points for a block of dimensions
+     * @param stopToken Token to cancel the computation with
+     * @param progressCallback Invoked whenever another percent of the work is done
+     */
+    void accumulate(ClusterDistributions& distributions, std::size_t numPoints, const std::vector<std::span<const std::uint32_t>>& clusterIndices, std::size_t dimensionBegin, std::size_t dimensionEnd, const BlockReader& read, const std::stop_token& stopToken, const ProgressCallback& progressCallback) const;
+
+private:
+    std::size_t         _numBins;   /** Number of histogram bins per cluster and dimension */
+    std::vector<float>  _levels;    /** Quantile levels (ascending, including the median) */
+};
+
+}
@@ -0,0 +1,339 @@
+#include "ClusterHierarchy.h"
+
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <queue>
+#include <utility>
+
+namespace heatmap
+{
+
+namespace
+{
+    /** Number of dimensions whose variance over the clusters is accumulated by a single task */
+    constexpr std::size_t varianceBlockSize = 256;
+
+    /**
+     * Merge the moments of \p clusters
+     * @param clusters Indices of the clusters
+     * @param clusterMoments Moments per cluster
+     * @return Merged moments (those of the cluster itself for a single cluster)
+     */
+    HierarchyCut::MomentsPointer mergeClusterMoments(std::span<const std::uint32_t> clusters, const std::vector<HierarchyCut::MomentsPointer>& clusterMoments)
+    {
+        if (clusters.size() == 1)
+            return clusterMoments[clusters.front()];
+
+        std::shared_ptr<ClusterMoments> merged;
+
+        for (const auto cluster : clusters) {
+            const auto& moments = clusterMoments[cluster];
+
+            if (moments == nullptr)
+                continue;
+
+            if (merged == nullptr)
+                merged = std::make_shared<ClusterMoments>(*moments);
+            else
+                merged->merge(*moments);
+        }
+
+        return merged;
+    }
+}
+
+ClusterHierarchy::ClusterHierarchy(std::size_t numClusters, const std::vector<DendrogramMerge>& merges)
+{
+    if (numClusters == 0 || merges.size() != numClusters - 1)
+        return;
+
+    const auto numNodes = 2 * numClusters - 1;
+
+    _numClusters = numClusters;
+    _merges = merges;
+
+    _parents.assign(numNodes, noNode);
+
+    std::vector<std::uint32_t> sizes(numNodes, 1);
+
+    // Children are numbered before their parents, so one pass in merge order gives the sizes
+    for (std::size_t mergeIndex = 0; mergeIndex < merges.size(); ++mergeIndex) {
+        const auto& merge   = merges[mergeIndex];
+        const auto node     = static_cast<std::uint32_t>(numClusters + mergeIndex);
+
+        _parents[merge.left]    = node;
+        _parents[merge.right]   = node;
+
+        sizes[node] = sizes[merge.left] + sizes[merge.right];
+    }
+
+    _leafBegin.assign(numNodes, 0);
+    _leafEnd.assign(numNodes, 0);
+    _leafOrder.resize(numClusters);
+
+    // Parents before children: the left child starts where its parent does, the right child after the left one
+    for (auto node = numNodes; node-- > 0;) {
+        _leafEnd[node] = _leafBegin[node] + sizes[node];
+
+        if (isLeaf(static_cast<std::uint32_t>(node))) {
+            _leafOrder[_leafBegin[node]] = static_cast<std::uint32_t>(node);
+            continue;
+        }
+
+        const auto& merge = _merges[node - numClusters];
+
+        _leafBegin[merge.left]  = _leafBegin[node];
+        _leafBegin[merge.right] = _leafBegin[node] + sizes[merge.left];
+    }
+}
+
+std::vector<std::uint32_t> ClusterHierarchy::cut(std::size_t maxNodes) const
+{
+    if (_parents.empty())
+        return {};
+
+    const auto isLower = [this](std::uint32_t lhs, std::uint32_t rhs) -> bool {
+        return getHeight(lhs) < getHeight(rhs);
+    };
+
+    std::priority_queue<std::uint32_t, std::vector<std::uint32_t>, decltype(isLower)> candidates(isLower);
+    std::vector<bool> isSplit(getNumNodes(), false);
+
+    std::size_t numNodes = 1;
+
+    if (!isLeaf(getRoot()))
+        candidates.push(getRoot());
+
+    // Every split replaces one node by two
+    while (!candidates.empty() && numNodes < maxNodes) {
+        const auto node = candidates.top();
+
+        candidates.pop();
+
+        isSplit[node] = true;
+        ++numNodes;
+
+        for (const auto child : { getLeft(node), getRight(node) })
+            if (!isLeaf(child))
+                candidates.push(child);
+    }
+
+    std::vector<std::uint32_t> nodes;
+    std::vector<std::uint32_t> stack = { getRoot() };
+
+    nodes.reserve(numNodes);
+
+    while (!stack.empty()) {
+        const auto node = stack.back();
+
+        stack.pop_back();
+
+        if (!isSplit[node]) {
+            nodes.push_back(node);
+            continue;
+        }
+
+        stack.push_back(getRight(node));
+        stack.push_back(getLeft(node));
+    }
+
+    return nodes;
+}
+
+HierarchyCut::HierarchyCut(std::shared_ptr<const ClusterHierarchy> hierarchy, std::vector<MomentsPointer> clusterMoments, std::size_t maxColumns) :
+    _hierarchy(std::move(hierarchy)),
+    _clusterMoments(std::move(clusterMoments)),
+    _maxColumns(std::max<std::size_t>(maxColumns, 1)),
+    _nodes(_hierarchy->cut((_maxColumns + 1) / 2)),
+    _moments(_nodes.size())
+{
+    // Every cluster is merged into exactly one column, so this is a single O(clusters x dimensions) pass
+    parallelFor(_nodes.size(), [this](std::size_t column) -> void {
+        _moments[column] = mergeClusterMoments(_hierarchy->getClusters(_nodes[column]), _clusterMoments);
+    });
+
+    for (std::size_t column = 0; column < _nodes.size(); ++column)
+        _nodeMoments.emplace(_nodes[column], _moments[column]);
+}
+
+std::vector<ColumnGroup> HierarchyCut::getColumnGroups() const
+{
+    std::vector<ColumnGroup> groups;
+
+    groups.reserve(_nodes.size());
+
+    for (const auto node : _nodes) {
+        groups.push_back({
+            static_cast<std::uint32_t>(_hierarchy->getClusters(node).size()),
+            !_hierarchy->isLeaf(node) && _nodes.size() < _maxColumns,
+            _hierarchy->getParent(node) != ClusterHierarchy::noNode
+        });
+    }
+
+    return groups;
+}
+
+std::vector<std::uint32_t> HierarchyCut::getClusterColumns() const
+{
+    std::vector<std::uint32_t> columns(empty() ? 0 : _hierarchy->getNumClusters(), 0);
+
+    for (std::size_t column = 0; column < _nodes.size(); ++column)
+        for (const auto cluster : _hierarchy->getClusters(_nodes[column]))
+            columns[cluster] = static_cast<std::uint32_t>(column);
+
+    return columns;
+}
+
+bool HierarchyCut::expand(std::size_t column)
+{
+    if (empty() || column >= _nodes.size() || _nodes.size() >= _maxColumns)
+        return false;
+
+    const auto node = _nodes[column];
+
+    if (_hierarchy->isLeaf(node))
+        return false;
+
+    const std::uint32_t children[] = { _hierarchy->getLeft(node), _hierarchy->getRight(node) };
+
+    MomentsPointer childMoments[2];
+
+    parallelFor(2, [&](std::size_t childIndex) -> void {
+        const auto it = _nodeMoments.find(children[childIndex]);
+
+        childMoments[childIndex] = it != _nodeMoments.end() ? it->second : mergeClusterMoments(_hierarchy->getClusters(children[childIndex]), _clusterMoments);
+    });
+
+    for (std::size_t childIndex = 0; childIndex < 2; ++childIndex)
+        _nodeMoments.emplace(children[childIndex], childMoments[childIndex]);
+
+    _nodes[column] = children[0];
+    _nodes.insert(_nodes.begin() + column + 1, children[1]);
+
+    _moments[column] = childMoments[0];
+    _moments.insert(_moments.begin() + column + 1, childMoments[1]);
+
+    return true;
+}
+
+bool HierarchyCut::collapse(std::size_t column)
+{
+    if (empty() || column >= _nodes.size())
+        return false;
+
+    const auto parent = _hierarchy->getParent(_nodes[column]);
+
+    if (parent == ClusterHierarchy::noNode)
+        return false;
+
+    // The columns below the parent are adjacent, since the columns are in leaf order
+    auto begin  = column;
+    auto end    = column + 1;
+
+    while (begin > 0 && _hierarchy->isBelow(_nodes[begin - 1], parent))
+        --begin;
+
+    while (end < _nodes.size() && _hierarchy->isBelow(_nodes[end], parent))
+        ++end;
+
+    auto& parentMoments = _nodeMoments[parent];
+
+    // The replaced columns cover the clusters of the parent once, so their moments merge into those of the parent
+    if (parentMoments == nullptr) {
+        auto merged = std::make_shared<ClusterMoments>(0);
+
+        for (auto replaced = begin; replaced < end; ++replaced)
+            if (_moments[replaced] != nullptr)
+                merged->merge(*_moments[replaced]);
+
+        parentMoments = std::move(merged);
+    }
+
+    _nodes.erase(_nodes.begin() + begin + 1, _nodes.begin() + end);
+    _moments.erase(_moments.begin() + begin + 1, _moments.begin() + end);
+
+    _nodes[begin]   = parent;
+    _moments[begin] = parentMoments;
+
+    return true;
+}
+
+ClusterHierarchy buildClusterHierarchy(const StatisticsMatrix& means, std::size_t numFeatures, std::stop_token stopToken)
+{
+    const auto numClusters      = means.getNumRows();
+    const auto numDimensions    = means.getNumColumns();
+
+    if (numClusters == 0)
+        return {};
+
+    // Variance of the means of every dimension over the clusters
+    std::vector<double> variances(numDimensions, 0.0);
+
+    const auto numBlocks = (numDimensions + varianceBlockSize - 1) / varianceBlockSize;
+
+    parallelFor(numBlocks, [&](std::size_t blockIndex) -> void {
+        const auto dimensionBegin   = blockIndex * varianceBlockSize;
+        const auto dimensionEnd     = std::min(dimensionBegin + varianceBlockSize, numDimensions);
+
+        std::vector<double> sums(dimensionEnd - dimensionBegin, 0.0), squaredSums(dimensionEnd - dimensionBegin, 0.0), counts(dimensionEnd - dimensionBegin, 0.0);
+
+        // Non-finite means do not count towards the variance, so every variance stays comparable
+        for (std::size_t cluster = 0; cluster < numClusters; ++cluster) {
+            const auto row = means.getRow(cluster);
+
+            for (auto dimension = dimensionBegin; dimension < dimensionEnd; ++dimension) {
+                const auto value = row[dimension];
+
+                if (!std::isfinite(value))
+                    continue;
+
+                sums[dimension - dimensionBegin]        += value;
+                squaredSums[dimension - dimensionBegin] += static_cast<double>(value) * value;
+                counts[dimension - dimensionBegin]      += 1.0;
+            }
+        }
+
+        for (auto dimension = dimensionBegin; dimension < dimensionEnd; ++dimension) {
+            const auto count = counts[dimension - dimensionBegin];
+
+            if (count == 0.0)
+                continue;
+
+            const auto mean = sums[dimension - dimensionBegin] / count;
+
+            variances[dimension] = squaredSums[dimension - dimensionBegin] / count - mean * mean;
+        }
+    });
+
+    std::vector<std::uint32_t> features(numDimensions);
+
+    std::iota(features.begin(), features.end(), 0);
+
+    if (numFeatures < numDimensions) {
+        std::nth_element(features.begin(), features.begin() + numFeatures, features.end(), [&variances](std::uint32_t lhs, std::uint32_t rhs) {
+            return variances[lhs] > variances[rhs];
+        });
+
+        features.resize(numFeatures);
+
+        std::sort(features.begin(), features.end());
+    }
+
+    std::vector<float> values(numClusters * features.size());
+
+    for (std::size_t cluster = 0; cluster < numClusters; ++cluster)
+        for (std::size_t featureIndex = 0; featureIndex < features.size(); ++featureIndex)
+            values[cluster * features.size() + featureIndex] = means(cluster, features[featureIndex]);
+
+    auto merges = clusterHierarchically(values.data(), numClusters, features.size(), Linkage::Ward, DistanceMetric::Euclidean, stopToken);
+
+    if (stopToken.stop_requested())
+        return {};
+
+    return ClusterHierarchy(numClusters, merges);
+}
+
+}
@@ -0,0 +1,221 @@
+#pragma once
+
+#include "ClusterStatistics.h"
+#include "HierarchicalClustering.h"
+#include "StatisticsMatrix.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <stop_token>
+#include <unordered_map>
+#include <vector>
+
+namespace heatmap
+{
+
+/**
+ * Cluster hierarchy
+ *
+ * Binary tree over the clusters of a clustering, used to show over-clustered data as a bounded
+ * number of super-clusters. Nodes are numbered like the merges of a dendrogram: the clusters
+ * (leaves) are 0 ... n - 1 and the node created by merge k is n + k. The leaves of every node
+ * form a contiguous range in the left to right leaf order, so a node's leaves and whether one
+ * node lies below another are known in constant time.
+ */
+class ClusterHierarchy
+{
+public:
+
+    /** Node without parent (the parent of the root) */
+    static constexpr std::uint32_t noNode = 0xFFFFFFFFu;
+
+public:
+
+    /** Construct an empty hierarchy */
+    ClusterHierarchy() = default;
+
+    /**
+     * Construct from the merges of a hierarchical clustering of \p numClusters clusters
+     * @param numClusters Number of clusters (leaves)
+     * @param merges numClusters - 1 merges (see DendrogramMerge)
+     */
+    ClusterHierarchy(std::size_t numClusters, const std::vector<DendrogramMerge>& merges);
+
+    /** Get the number of clusters (leaves) */
+    std::size_t getNumClusters() const {
+        return _numClusters;
+    }
+
+    /** Get the number of nodes, leaves included */
+    std::size_t getNumNodes() const {
+        return _parents.size();
+    }
+
+    /** Get the root node (noNode when empty) */
+    std::uint32_t getRoot() const {
+        return _parents.empty() ? noNode : static_cast<std::uint32_t>(_parents.size() - 1);
+    }
+
+    /** Get whether \p node is a cluster */
+    bool isLeaf(std::uint32_t node) const {
+        return node < _numClusters;
+    }
+
+    /** Get the first child of internal \p node */
+    std::uint32_t getLeft(std::uint32_t node) const {
+        return _merges[node - _numClusters].left;
+    }
+
+    /** Get the second child of internal \p node */
+    std::uint32_t getRight(std::uint32_t node) const {
+        return _merges[node - _numClusters].right;
+    }
+
+    /** Get the parent of \p node (noNode for the root) */
+    std::uint32_t getParent(std::uint32_t node) const {
+        return _parents[node];
+    }
+
+    /** Get the linkage height of \p node (zero for clusters) */
+    float getHeight(std::uint32_t node) const {
+        return isLeaf(node) ? 0.f : _merges[node - _numClusters].height;
+    }
+
+    /** Get the clusters below \p node, in leaf order */
+    std::span<const std::uint32_t> getClusters(std::uint32_t node) const {
+        return std::span<const std::uint32_t>(_leafOrder).subspan(_leafBegin[node], _leafEnd[node] - _leafBegin[node]);
+    }
+
+    /** Get the position of the first cluster below \p node in the leaf order */
+    std::uint32_t getLeafBegin(std::uint32_t node) const {
+        return _leafBegin[node];
+    }
+
+    /** Get whether \p node is \p ancestor or lies below it */
+    bool isBelow(std::uint32_t node, std::uint32_t ancestor) const {
+        return _leafBegin[ancestor] <= _leafBegin[node] && _leafEnd[node] <= _leafEnd[ancestor];
+    }
+
+    /**
+     * Get the coarsest cut of at most \p maxNodes nodes, found by splitting the highest node first
+     * @param maxNodes Maximum number of nodes (at least one)
+     * @return Nodes of the cut in leaf order, together covering every cluster once
+     */
+    std::vector<std::uint32_t> cut(std::size_t maxNodes) const;
+
+private:
+    std::size_t                     _numClusters = 0;   /** Number of clusters (leaves) */
+    std::vector<DendrogramMerge>    _merges;            /** Merge that created every internal node */
+    std::vector<std::uint32_t>      _parents;           /** Parent per node */
+    std::vector<std::uint32_t>      _leafOrder;         /** Clusters in left to right order */
+    std::vector<std::uint32_t>      _leafBegin;         /** First position in the leaf order per node */
+    std::vector<std::uint32_t>      _leafEnd;           /** One past the last position in the leaf order per node */
+};
+
+/** Super-cluster shown in a heatmap column */
+struct ColumnGroup
+{
+    std::uint32_t   numClusters;    /** Number of clusters merged into the column */
+    bool            isExpandable;   /** Whether the column can be split into its two child super-clusters */
+    bool            isCollapsible;  /** Whether the column can be merged into its parent super-cluster */
+};
+
+/**
+ * Hierarchy cut
+ *
+ * The nodes of a cluster hierarchy shown as heatmap columns, with their moments. The moments of a
+ * super-cluster are merged from moments that are known already (ClusterMoments::merge, O(dimensions)
+ * per merge), so expanding and collapsing never reads point values: collapsing merges the columns
+ * it replaces and expanding merges the clusters below each child. The moments of every node shown
+ * so far are kept, so returning to a node is free.
+ */
+class HierarchyCut
+{
+public:
+
+    using MomentsPointer = std::shared_ptr<const ClusterMoments>;
+
+public:
+
+    /** Construct an empty cut (every cluster is a column of its own) */
+    HierarchyCut() = default;
+
+    /**
+     * Construct the coarsest cut of \p hierarchy with at most half of \p maxColumns columns, leaving room to expand
+     * @param hierarchy Cluster hierarchy
+     * @param clusterMoments Moments per cluster
+     * @param maxColumns Maximum number of columns
+     */
+    HierarchyCut(std::shared_ptr<const ClusterHierarchy> hierarchy, std::vector<MomentsPointer> clusterMoments, std::size_t maxColumns);
+
+    /** Get whether there is no hierarchy */
+    bool empty() const {
+        return _hierarchy == nullptr;
+    }
+
+    /** Get the hierarchy */
+    const ClusterHierarchy& getHierarchy() const {
+        return *_hierarchy;
+    }
+
+    /** Get the maximum number of columns */
+    std::size_t getMaxColumns() const {
+        return _maxColumns;
+    }
+
+    /** Get the node shown in every column */
+    const std::vector<std::uint32_t>& getNodes() const {
+        return _nodes;
+    }
+
+    /** Get the moments of every column */
+    const std::vector<MomentsPointer>& getMoments() const {
+        return _moments;
+    }
+
+    /** Get the super-cluster of every column */
+    std::vector<ColumnGroup> getColumnGroups() const;
+
+    /** Get the column every cluster is merged into */
+    std::vector<std::uint32_t> getClusterColumns() const;
+
+    /**
+     * Replace \p column by the two children of its node, unless that exceeds the maximum number of columns
+     * @param column Column index
+     * @return Whether the cut changed
+     */
+    bool expand(std::size_t column);
+
+    /**
+     * Replace \p column, and the other columns below the parent of its node, by the parent
+     * @param column Column index
+     * @return Whether the cut changed
+     */
+    bool collapse(std::size_t column);
+
+private:
+    std::shared_ptr<const ClusterHierarchy>             _hierarchy;         /** Cluster hierarchy */
+    std::vector<MomentsPointer>                         _clusterMoments;    /** Moments per cluster */
+    std::size_t                                         _maxColumns = 0;    /** Maximum number of columns */
+    std::vector<std::uint32_t>                          _nodes;             /** Node per column, in leaf order */
+    std::vector<MomentsPointer>                         _moments;           /** Moments per column */
+    std::unordered_map<std::uint32_t, MomentsPointer>   _nodeMoments;       /** Moments of the super-clusters shown so far */
+};
+
+/**
+ * Build a hierarchy of \p numClusters clusters from their means
+ *
+ * Clustering all pairs of clusters over all dimensions would dominate the update for wide panels,
+ * so the clusters are clustered over the \p numFeatures dimensions whose means vary most between
+ * the clusters (Ward linkage, Euclidean distance). Time O(n d + n^2 numFeatures), memory O(n^2).
+ *
+ * @param means Clusters x dimensions means
+ * @param numFeatures Maximum number of dimensions to cluster over
+ * @param stopToken Token to cancel the computation with; the hierarchy is empty when stop was requested
+ * @return Cluster hierarchy
+ */
+ClusterHierarchy buildClusterHierarchy(const StatisticsMatrix& means, std::size_t numFeatures, std::stop_token stopToken = {});
+
+}
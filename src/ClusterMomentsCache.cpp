@@ -0,0 +1,227 @@
+#include "ClusterMomentsCache.h"
+
+#include <algorithm>
+#include <limits>
+#include <unordered_set>
+
+namespace heatmap
+{
+
+namespace
+{
+    /** Owner values for points that are in no vanished cluster and in more than one vanished cluster */
+    constexpr std::uint32_t noOwner         = std::numeric_limits<std::uint32_t>::max();
+    constexpr std::uint32_t ambiguousOwner  = noOwner - 1;
+
+    /** Marks points that were already visited while checking a merge */
+    constexpr std::uint32_t visitedFlag     = 0x80000000u;
+
+    /** SplitMix64 finalizer */
+    std::uint64_t mix(std::uint64_t value)
+    {
+        value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ull;
+        value = (value ^ (value >> 27)) * 0x94d049bb133111ebull;
+
+        return value ^ (value >> 31);
+    }
+
+    /** Seed of the second hash that verifies a cache hit, independent of the key's seed */
+    std::uint64_t getCheckSeed(std::uint64_t contextKey)
+    {
+        return mix(contextKey ^ 0x9e3779b97f4a7c15ull);
+    }
+}
+
+std::uint64_t hashIndices(std::span<const std::uint32_t> indices, std::uint64_t seed)
+{
+    // Sum and xor of the mixed indices are both independent of the index order
+    std::uint64_t sum = 0, exclusiveOr = 0;
+
+    for (const auto index : indices) {
+        const auto hash = mix(seed + index);
+
+        sum         += hash;
+        exclusiveOr ^= mix(hash);
+    }
+
+    return mix(sum ^ mix(exclusiveOr + indices.size()) ^ seed);
+}
+
+std::vector<ClusterMomentsCache::MomentsPointer> ClusterMomentsCache::update(std::uint64_t contextKey, std::size_t numPoints, const std::vector<std::span<const std::uint32_t>>& clusterIndices, const ComputeFunction& compute, std::stop_token stopToken)
+{
+    if (contextKey != _contextKey) {
+        _entries.clear();
+        _contextKey = contextKey;
+    }
+
+    const auto numClusters = clusterIndices.size();
+
+    UpdateSummary summary;
+
+    std::vector<std::uint64_t> keys(numClusters);
+    std::vector<std::uint64_t> checks(numClusters);
+    std::vector<MomentsPointer> moments(numClusters);
+
+    const auto checkSeed = getCheckSeed(contextKey);
+
+    // Clusters with an unchanged index set reuse their cached moments; a key collision is a changed cluster
+    std::unordered_map<std::uint64_t, std::size_t> firstClusterByKey;
+    std::vector<std::size_t> dirtyClusters;
+
+    for (std::size_t clusterIndex = 0; clusterIndex < numClusters; ++clusterIndex) {
+        const auto& indices = clusterIndices[clusterIndex];
+
+        keys[clusterIndex]      = hashIndices(indices, contextKey);
+        checks[clusterIndex]    = hashIndices(indices, checkSeed);
+
+        if (const auto it = _entries.find(keys[clusterIndex]); it != _entries.end() && it->second.holds(indices, checks[clusterIndex])) {
+            moments[clusterIndex] = it->second.moments;
+            ++summary.numReused;
+
+            continue;
+        }
+
+        const auto [first, isFirst] = firstClusterByKey.emplace(keys[clusterIndex], clusterIndex);
+
+        if (isFirst || clusterIndices[first->second].size() != indices.size() || checks[first->second] != checks[clusterIndex])
+            dirtyClusters.push_back(clusterIndex);
+    }
+
+    // Changed clusters that are the exact union of vanished clusters merge their moments
+    if (!dirtyClusters.empty()) {
+        const std::unordered_set<std::uint64_t> requestedKeys(keys.begin(), keys.end());
+
+        std::vector<const Entry*> vanished;
+
+        for (const auto& [key, entry] : _entries)
+            if (!requestedKeys.contains(key))
+                vanished.push_back(&entry);
+
+        if (!vanished.empty()) {
+            std::vector<std::uint32_t> owners(numPoints, noOwner);
+
+            for (std::uint32_t vanishedIndex = 0; vanishedIndex < vanished.size(); ++vanishedIndex)
+                for (const auto pointIndex : vanished[vanishedIndex]->indices)
+                    if (pointIndex < numPoints)
+                        owners[pointIndex] = owners[pointIndex] == noOwner ? vanishedIndex : ambiguousOwner;
+
+            std::erase_if(dirtyClusters, [&](std::size_t clusterIndex) -> bool {
+                moments[clusterIndex] = tryMerge(clusterIndices[clusterIndex], owners, vanished);
+
+                if (moments[clusterIndex])
+                    ++summary.numMerged;
+
+                return moments[clusterIndex] != nullptr;
+            });
+        }
+    }
+
+    // The remaining clusters are computed from the point values
+    if (!dirtyClusters.empty()) {
+        std::vector<std::span<const std::uint32_t>> dirtyIndices;
+
+        dirtyIndices.reserve(dirtyClusters.size());
+
+        for (const auto clusterIndex : dirtyClusters)
+            dirtyIndices.push_back(clusterIndices[clusterIndex]);
+
+        auto computedMoments = compute(dirtyIndices);
+
+        if (stopToken.stop_requested())
+            return moments;
+
+        for (std::size_t dirtyIndex = 0; dirtyIndex < dirtyClusters.size(); ++dirtyIndex)
+            moments[dirtyClusters[dirtyIndex]] = std::make_shared<const ClusterMoments>(std::move(computedMoments[dirtyIndex]));
+
+        summary.numComputed = dirtyClusters.size();
+    }
+
+    // Duplicate index sets share the moments of their first occurrence
+    for (std::size_t clusterIndex = 0; clusterIndex < numClusters; ++clusterIndex)
+        if (!moments[clusterIndex])
+            moments[clusterIndex] = moments[firstClusterByKey[keys[clusterIndex]]];
+
+    // Only the current clusters are kept
+    std::unordered_map<std::uint64_t, Entry> entries;
+
+    for (std::size_t clusterIndex = 0; clusterIndex < numClusters; ++clusterIndex) {
+        if (entries.contains(keys[clusterIndex]))
+            continue;
+
+        const auto& indices = clusterIndices[clusterIndex];
+
+        if (auto node = _entries.extract(keys[clusterIndex]); !node.empty() && node.mapped().holds(indices, checks[clusterIndex]))
+            entries.insert(std::move(node));
+        else
+            entries.emplace(keys[clusterIndex], Entry{ std::vector<std::uint32_t>(indices.begin(), indices.end()), checks[clusterIndex], moments[clusterIndex] });
+    }
+
+    _entries            = std::move(entries);
+    _lastUpdateSummary  = summary;
+
+    return moments;
+}
+
+void ClusterMomentsCache::assign(std::uint64_t contextKey, const std::vector<std::span<const std::uint32_t>>& clusterIndices, const std::vector<MomentsPointer>& moments)
+{
+    _entries.clear();
+    _contextKey = contextKey;
+
+    const auto checkSeed = getCheckSeed(contextKey);
+
+    for (std::size_t clusterIndex = 0; clusterIndex < std::min(clusterIndices.size(), moments.size()); ++clusterIndex) {
+        if (!moments[clusterIndex])
+            continue;
+
+        const auto& indices = clusterIndices[clusterIndex];
+
+        _entries.try_emplace(hashIndices(indices, contextKey), Entry{ std::vector<std::uint32_t>(indices.begin(), indices.end()), hashIndices(indices, checkSeed), moments[clusterIndex] });
+    }
+}
+
+void ClusterMomentsCache::clear()
+{
+    _entries.clear();
+    _lastUpdateSummary = {};
+}
+
+ClusterMomentsCache::MomentsPointer ClusterMomentsCache::tryMerge(std::span<const std::uint32_t> indices, std::vector<std::uint32_t>& owners, const std::vector<const Entry*>& vanished)
+{
+    std::unordered_map<std::uint32_t, std::uint64_t> countsPerOwner;
+
+    std::size_t numVisited = 0;
+    bool isUnion = !indices.empty();
+
+    for (; isUnion && numVisited < indices.size(); ++numVisited) {
+        const auto pointIndex = indices[numVisited];
+
+        if (pointIndex >= owners.size() || owners[pointIndex] >= ambiguousOwner || (owners[pointIndex] & visitedFlag)) {
+            isUnion = false;
+            break;
+        }
+
+        ++countsPerOwner[owners[pointIndex]];
+
+        owners[pointIndex] |= visitedFlag;
+    }
+
+    for (std::size_t visitedIndex = 0; visitedIndex < numVisited; ++visitedIndex)
+        owners[indices[visitedIndex]] &= ~visitedFlag;
+
+    if (!isUnion)
+        return nullptr;
+
+    // Every vanished cluster that is touched has to be contained completely
+    for (const auto& [owner, count] : countsPerOwner)
+        if (count != vanished[owner]->moments->count)
+            return nullptr;
+
+    auto merged = std::make_shared<ClusterMoments>();
+
+    for (const auto& [owner, count] : countsPerOwner)
+        merged->merge(*vanished[owner]->moments);
+
+    return merged;
+}
+
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include "ClusterStatistics.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <span>
+#include <stop_token>
+#include <unordered_map>
+#include <vector>
+
+namespace heatmap
+{
+
+/**
+ * Compute an order-independent hash of a set of point indices
+ * @param indices Point indices
+ * @param seed Seed mixed into the hash (e.g. identifying the source data)
+ * @return Hash of the index set
+ */
+std::uint64_t hashIndices(std::span<const std::uint32_t> indices, std::uint64_t seed = 0);
+
+/**
+ * Cluster moments cache
+ *
+ * Keeps the moments of the most recently computed clusters, keyed by a hash of their index
+ * set and verified with the set size and a second, independent hash, so that a change to a clusters dataset only requires scanning the clusters that
+ * actually changed. A changed cluster that is the exact union of clusters which disappeared
+ * (i.e. a merge) is answered by merging their moments in O(dimensions), without reading any
+ * point values.
+ *
+ * The cache is not thread-safe; it is meant to be used by one computation at a time.
+ */
+class ClusterMomentsCache
+{
+public:
+
+    /** Shared, immutable cluster moments */
+    using MomentsPointer = std::shared_ptr<const ClusterMoments>;
+
+    /** Computes the moments of the given clusters from the point values */
+    using ComputeFunction = std::function<std::vector<ClusterMoments>(const std::vector<std::span<const std::uint32_t>>&)>;
+
+    /** Number of clusters that were resolved in each way by the last update */
+    struct UpdateSummary
+    {
+        std::size_t     numReused   = 0;    /** Clusters whose index set did not change */
+        std::size_t     numMerged   = 0;    /** Clusters merged from the moments of vanished clusters */
+        std::size_t     numComputed = 0;    /** Clusters computed from the point values */
+    };
+
+public:
+
+    /**
+     * Get the moments of \p clusterIndices, computing only the clusters that are not cached and cannot be merged
+     *
+     * When the computation is stopped the cache is left unchanged and the result is incomplete.
+     *
+     * @param contextKey Identifies the source data and computation settings; a different key invalidates all entries
+     * @param numPoints Number of points in the source data
+     * @param clusterIndices Point indices per cluster
+     * @param compute Computes the moments of the clusters that need a scan
+     * @param stopToken Token to cancel the update with
+     * @return Moments per cluster
+     */
+    std::vector<MomentsPointer> update(std::uint64_t contextKey, std::size_t numPoints, const std::vector<std::span<const std::uint32_t>>& clusterIndices, const ComputeFunction& compute, std::stop_token stopToken = {});
+
+    /**
+     * Replace all entries by the known moments of \p clusterIndices, e.g. moments restored from a saved project
+     * @param contextKey Identifies the source data and computation settings the moments belong to
+     * @param clusterIndices Point indices per cluster
+     * @param moments Moments per cluster (clusters without moments are skipped)
+     */
+    void assign(std::uint64_t contextKey, const std::vector<std::span<const std::uint32_t>>& clusterIndices, const std::vector<MomentsPointer>& moments);
+
+    /** Remove all entries */
+    void clear();
+
+    /** Get how the clusters were resolved by the last update */
+    const UpdateSummary& getLastUpdateSummary() const {
+        return _lastUpdateSummary;
+    }
+
+private:
+
+    /** Cached moments of one cluster together with its index set */
+    struct Entry
+    {
+        std::vector<std::uint32_t>  indices;    /** Point indices of the cluster */
+        std::uint64_t               check;      /** Second hash of the index set, which a colliding key does not share */
+        MomentsPointer              moments;    /** Moments of the cluster */
+
+        /** Get whether the entry holds \p indices, whose second hash is \p check */
+        bool holds(std::span<const std::uint32_t> indices, std::uint64_t check) const {
+            return this->indices.size() == indices.size() && this->check == check;
+        }
+    };
+
+    /**
+     * Try to express a cluster as the union of vanished clusters
+     * @param indices Point indices of the cluster
+     * @param owners Per point, the index of the vanished entry that contains it (or none); restored before returning
+     * @param vanished Vanished entries
+     * @return Merged moments, or nullptr if the cluster is not an exact union of vanished clusters
+     */
+    static MomentsPointer tryMerge(std::span<const std::uint32_t> indices, std::vector<std::uint32_t>& owners, const std::vector<const Entry*>& vanished);
+
+private:
+    std::uint64_t                               _contextKey = 0;        /** Context the entries were computed in */
+    std::unordered_map<std::uint64_t, Entry>    _entries;               /** Cached entries by index set hash */
+    UpdateSummary                               _lastUpdateSummary;     /** How the clusters were resolved by the last update */
+};
+
+}
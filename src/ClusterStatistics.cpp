@@ -0,0 +1,262 @@
+#include "ClusterStatistics.h"
+
+#include "Parallel.h"
+#include "PointClusterLabels.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <numeric>
+
+namespace heatmap
+{
+
+namespace
+{
+    /** Largest and smallest number of dimensions processed by a single task */
+    constexpr std::size_t maxDimensionBlockSize = 256;
+    constexpr std::size_t minDimensionBlockSize = 16;
+
+    /**
+     * Create empty moments for every cluster, with the number of (valid) points already counted
+     * @param numPoints Number of points
+     * @param numDimensions Number of dimensions
+     * @param clusterIndices Point indices per cluster
+     * @return Moments per cluster
+     */
+    std::vector<ClusterMoments> createMoments(std::size_t numPoints, std::size_t numDimensions, const std::vector<std::span<const std::uint32_t>>& clusterIndices)
+    {
+        std::vector<ClusterMoments> moments;
+
+        moments.reserve(clusterIndices.size());
+
+        for (const auto& indices : clusterIndices) {
+            auto& clusterMoments = moments.emplace_back(numDimensions);
+
+            clusterMoments.count = std::count_if(indices.begin(), indices.end(), [numPoints](std::uint32_t index) { return index < numPoints; });
+        }
+
+        return moments;
+    }
+}
+
+ClusterMoments::ClusterMoments(std::size_t numDimensions) :
+    count(0),
+    mean(numDimensions, 0.0),
+    m2(numDimensions, 0.0),
+    positive(numDimensions, 0),
+    positiveSum(numDimensions, 0.0)
+{
+}
+
+float ClusterMoments::getMean(std::size_t dimension) const
+{
+    return count > 0 ? static_cast<float>(mean[dimension]) : 0.0f;
+}
+
+float ClusterMoments::getStandardDeviation(std::size_t dimension) const
+{
+    return count > 0 ? static_cast<float>(std::sqrt(m2[dimension] / static_cast<double>(count))) : 0.0f;
+}
+
+float ClusterMoments::getPositiveFraction(std::size_t dimension) const
+{
+    return count > 0 ? static_cast<float>(static_cast<double>(positive[dimension]) / static_cast<double>(count)) : 0.0f;
+}
+
+float ClusterMoments::getExpressingMean(std::size_t dimension) const
+{
+    return positive[dimension] > 0 ? static_cast<float>(positiveSum[dimension] / static_cast<double>(positive[dimension])) : 0.0f;
+}
+
+void ClusterMoments::merge(const ClusterMoments& other)
+{
+    if (other.count == 0)
+        return;
+
+    if (count == 0) {
+        *this = other;
+        return;
+    }
+
+    const auto runningN = static_cast<double>(count);
+    const auto otherN   = static_cast<double>(other.count);
+    const auto totalN   = runningN + otherN;
+
+    for (std::size_t d = 0; d < mean.size(); ++d) {
+        const auto delta = other.mean[d] - mean[d];
+
+        mean[d] += delta * otherN / totalN;
+        m2[d]   += other.m2[d] + delta * delta * runningN * otherN / totalN;
+
+        positive[d]     += other.positive[d];
+        positiveSum[d]  += other.positiveSum[d];
+    }
+
+    count += other.count;
+}
+
+ClusterStatisticsEngine::ClusterStatisticsEngine(AccumulationPrecision precision, float expressionThreshold) :
+    _precision(precision),
+    _expressionThreshold(expressionThreshold)
+{
+}
+
+std::vector<ClusterMoments> ClusterStatisticsEngine::computeBlocks(std::size_t numPoints, std::size_t numDimensions, const std::vector<std::span<const std::uint32_t>>& clusterIndices, const BlockKernel& kernel, std::stop_token stopToken, const ProgressCallback& progressCallback) const
+{
+    const auto numClusters = clusterIndices.size();
+
+    auto moments = createMoments(numPoints, numDimensions, clusterIndices);
+
+    if (!kernel || numDimensions == 0 || numClusters == 0)
+        return moments;
+
+    // Use smaller dimension blocks when there are too few tasks to keep all workers busy
+    auto dimensionBlockSize = maxDimensionBlockSize;
+
+    const auto numBlocks = [&numDimensions](std::size_t blockSize) { return (numDimensions + blockSize - 1) / blockSize; };
+
+    while (dimensionBlockSize > minDimensionBlockSize && numClusters * numBlocks(dimensionBlockSize) < 4 * getNumWorkerThreads())
+        dimensionBlockSize /= 2;
+
+    const auto numDimensionBlocks = numBlocks(dimensionBlockSize);
+
+    // Schedule the largest clusters first so that the tail of the work consists of small tasks
+    std::vector<std::size_t> clusterOrder(numClusters);
+
+    std::iota(clusterOrder.begin(), clusterOrder.end(), 0);
+    std::stable_sort(clusterOrder.begin(), clusterOrder.end(), [&clusterIndices](std::size_t lhs, std::size_t rhs) {
+        return clusterIndices[lhs].size() > clusterIndices[rhs].size();
+    });
+
+    const auto numTasks = numClusters * numDimensionBlocks;
+
+    // Progress is measured in processed values so that large clusters weigh in accordingly
+    std::uint64_t totalWork = 0;
+
+    for (const auto& indices : clusterIndices)
+        totalWork += indices.size() * numDimensions;
+
+    std::atomic<std::uint64_t> completedWork = 0;
+    std::atomic<int> reportedPercentage = 0;
+
+    parallelFor(numTasks, [&](std::size_t taskIndex) -> void {
+        if (stopToken.stop_requested())
+            return;
+
+        const auto clusterIndex     = clusterOrder[taskIndex / numDimensionBlocks];
+        const auto dimensionBegin   = (taskIndex % numDimensionBlocks) * dimensionBlockSize;
+        const auto dimensionEnd     = std::min(dimensionBegin + dimensionBlockSize, numDimensions);
+
+        kernel(clusterIndices[clusterIndex], dimensionBegin, dimensionEnd, moments[clusterIndex]);
+
+        if (!progressCallback || totalWork == 0)
+            return;
+
+        const auto taskWork     = clusterIndices[clusterIndex].size() * (dimensionEnd - dimensionBegin);
+        const auto work         = completedWork.fetch_add(taskWork) + taskWork;
+        const auto percentage   = static_cast<int>(100 * work / totalWork);
+
+        auto previousPercentage = reportedPercentage.load();
+
+        while (percentage > previousPercentage) {
+            if (reportedPercentage.compare_exchange_weak(previousPercentage, percentage)) {
+                progressCallback(static_cast<float>(percentage) / 100.0f);
+                break;
+            }
+        }
+    });
+
+    return moments;
+}
+
+std::vector<ClusterMoments> ClusterStatisticsEngine::computeFromColumns(std::size_t numPoints, std::size_t numDimensions, const std::vector<std::span<const std::uint32_t>>& clusterIndices, const ColumnExtractor& extractColumn, std::size_t memoryBudget, std::stop_token stopToken, const ProgressCallback& progressCallback) const
+{
+    const auto numClusters = clusterIndices.size();
+
+    auto moments = createMoments(numPoints, numDimensions, clusterIndices);
+
+    if (numPoints == 0 || numDimensions == 0 || numClusters == 0)
+        return moments;
+
+    const PointClusterLabels labels(numPoints, clusterIndices);
+
+    const auto threshold = _expressionThreshold;
+
+    const auto numChunkDimensions = std::clamp<std::size_t>(memoryBudget / (numPoints * sizeof(float)), 1, numDimensions);
+
+    std::vector<std::vector<float>> columns(numChunkDimensions);
+
+    for (std::size_t dimensionBegin = 0; dimensionBegin < numDimensions; dimensionBegin += numChunkDimensions) {
+        const auto dimensionEnd = std::min(dimensionBegin + numChunkDimensions, numDimensions);
+
+        for (auto dimension = dimensionBegin; dimension < dimensionEnd; ++dimension) {
+            if (stopToken.stop_requested())
+                return moments;
+
+            extractColumn(dimension, columns[dimension - dimensionBegin]);
+        }
+
+        parallelFor(dimensionEnd - dimensionBegin, [&](std::size_t columnIndex) -> void {
+            const auto& column      = columns[columnIndex];
+            const auto dimension    = dimensionBegin + columnIndex;
+
+            if (column.size() < numPoints || stopToken.stop_requested())
+                return;
+
+            std::vector<double> means(numClusters, 0.0), m2(numClusters, 0.0), positiveSums(numClusters, 0.0);
+            std::vector<std::uint64_t> positive(numClusters, 0), nonZero(numClusters, 0);
+
+            // Zeros add nothing to the sums, so only the non-zero values are routed to their clusters
+            for (std::size_t pointIndex = 0; pointIndex < numPoints; ++pointIndex) {
+                const auto value = column[pointIndex];
+
+                if (value == 0.0f)
+                    continue;
+
+                const auto expressing = value > threshold;
+
+                labels.forEachCluster(pointIndex, [&](std::uint32_t clusterIndex) {
+                    means[clusterIndex]         += value;
+                    positive[clusterIndex]      += expressing;
+                    positiveSums[clusterIndex]  += expressing ? value : 0.0f;
+                    nonZero[clusterIndex]       += 1;
+                });
+            }
+
+            for (std::size_t clusterIndex = 0; clusterIndex < numClusters; ++clusterIndex)
+                if (moments[clusterIndex].count > 0)
+                    means[clusterIndex] /= static_cast<double>(moments[clusterIndex].count);
+
+            for (std::size_t pointIndex = 0; pointIndex < numPoints; ++pointIndex) {
+                const auto value = column[pointIndex];
+
+                if (value == 0.0f)
+                    continue;
+
+                labels.forEachCluster(pointIndex, [&](std::uint32_t clusterIndex) {
+                    const auto deviation = value - means[clusterIndex];
+
+                    m2[clusterIndex] += deviation * deviation;
+                });
+            }
+
+            for (std::size_t clusterIndex = 0; clusterIndex < numClusters; ++clusterIndex) {
+                const auto numZeros = moments[clusterIndex].count - nonZero[clusterIndex];
+
+                // Every zero deviates by the mean (and is expressing under a negative threshold)
+                moments[clusterIndex].mean[dimension]           = means[clusterIndex];
+                moments[clusterIndex].m2[dimension]             = m2[clusterIndex] + static_cast<double>(numZeros) * means[clusterIndex] * means[clusterIndex];
+                moments[clusterIndex].positive[dimension]       = positive[clusterIndex] + (threshold < 0.0f ? numZeros : 0);
+                moments[clusterIndex].positiveSum[dimension]    = positiveSums[clusterIndex];
+            }
+        });
+
+        if (progressCallback)
+            progressCallback(static_cast<float>(dimensionEnd) / static_cast<float>(numDimensions));
+    }
+
+    return moments;
+}
+
+}
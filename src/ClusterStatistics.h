@@ -0,0 +1,201 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <stop_token>
+#include <vector>
+
+namespace heatmap
+{
+
+/** Numeric type used to accumulate values inside the statistics kernels */
+enum class AccumulationPrecision
+{
+    Single,     /** Accumulate in float; fastest, adequate for most expression data */
+    Double      /** Accumulate in double; slower, but robust for large clusters and wide value ranges */
+};
+
+/**
+ * Cluster moments
+ *
+ * Mergeable per-dimension sufficient statistics (Welford/Chan state) of a set of points:
+ * the number of points and, per dimension, the mean, the sum of squared deviations
+ * from the mean and the number and sum of the values above the expression threshold
+ * (expressing values, zero by default). Two moments objects of disjoint point sets can be
+ * merged in O(dimensions).
+ */
+struct ClusterMoments
+{
+    ClusterMoments() = default;
+
+    /**
+     * Construct empty moments for \p numDimensions dimensions
+     * @param numDimensions Number of dimensions
+     */
+    explicit ClusterMoments(std::size_t numDimensions);
+
+    /** Get the number of dimensions */
+    std::size_t getNumDimensions() const {
+        return mean.size();
+    }
+
+    /**
+     * Get the mean of dimension \p dimension (zero for empty clusters)
+     * @param dimension Dimension index
+     */
+    float getMean(std::size_t dimension) const;
+
+    /**
+     * Get the (population) standard deviation of dimension \p dimension
+     * @param dimension Dimension index
+     */
+    float getStandardDeviation(std::size_t dimension) const;
+
+    /**
+     * Get the fraction of points with a positive value in dimension \p dimension (zero for empty clusters)
+     * @param dimension Dimension index
+     */
+    float getPositiveFraction(std::size_t dimension) const;
+
+    /**
+     * Get the mean of the positive (expressing) values of dimension \p dimension (zero without such values)
+     * @param dimension Dimension index
+     */
+    float getExpressingMean(std::size_t dimension) const;
+
+    /**
+     * Merge the moments of a disjoint set of points into these moments
+     * @param other Moments to merge (must have the same number of dimensions)
+     */
+    void merge(const ClusterMoments& other);
+
+    std::uint64_t               count = 0;      /** Number of points */
+    std::vector<double>         mean;           /** Per-dimension mean */
+    std::vector<double>         m2;             /** Per-dimension sum of squared deviations from the mean */
+    std::vector<std::uint64_t>  positive;       /** Per-dimension number of points with a value above the expression threshold */
+    std::vector<double>         positiveSum;    /** Per-dimension sum of the values above the expression threshold */
+};
+
+/**
+ * Cluster statistics engine
+ *
+ * Computes the per-dimension moments of a set of (possibly overlapping) clusters over
+ * row-major point data. Each point row is read once per dimension block; the work is split
+ * over clusters and dimension blocks on the worker threads. Within a block, values are
+ * accumulated in chunks of points relative to a per-chunk shift (vectorizable, no divisions)
+ * and the chunks are merged with Chan's update formula, which keeps single precision
+ * accumulation numerically well behaved.
+ *
+ * Mostly zero (sparse) data, like single-cell expression matrices, is detected from a sample
+ * of the values and accumulated relative to zero instead, so that runs of zeros are skipped
+ * after a cheap test. Values above the expression threshold are counted and summed in the same
+ * pass, for the fraction of expressing points and their mean (dot plots).
+ */
+class ClusterStatisticsEngine
+{
+public:
+
+    /** Callback receiving the fraction [0, 1] of completed work; may be invoked from any worker thread */
+    using ProgressCallback = std::function<void(float)>;
+
+    /** Extracts the values of one dimension for all points into the given vector */
+    using ColumnExtractor = std::function<void(std::size_t dimension, std::vector<float>& column)>;
+
+    /** Accumulates dimensions [dimensionBegin, dimensionEnd) of the points in indices into moments */
+    using BlockKernel = std::function<void(std::span<const std::uint32_t> indices, std::size_t dimensionBegin, std::size_t dimensionEnd, ClusterMoments& moments)>;
+
+    /**
+     * Construct with accumulation \p precision
+     * @param precision Accumulation precision
+     * @param expressionThreshold Values above this threshold count as expressing
+     */
+    explicit ClusterStatisticsEngine(AccumulationPrecision precision = AccumulationPrecision::Double, float expressionThreshold = 0.f);
+
+    /** Get the accumulation precision */
+    AccumulationPrecision getPrecision() const {
+        return _precision;
+    }
+
+    /**
+     * Set the accumulation precision
+     * @param precision Accumulation precision
+     */
+    void setPrecision(AccumulationPrecision precision) {
+        _precision = precision;
+    }
+
+    /** Get the threshold above which values count as expressing */
+    float getExpressionThreshold() const {
+        return _expressionThreshold;
+    }
+
+    /**
+     * Set the threshold above which values count as expressing
+     * @param expressionThreshold Expression threshold
+     */
+    void setExpressionThreshold(float expressionThreshold) {
+        _expressionThreshold = expressionThreshold;
+    }
+
+    /**
+     * Compute the moments of each cluster
+     *
+     * The values are read in their stored element type (float, bfloat16 or 8/16-bit integers) and
+     * widened inside the kernel. Integer values are summed exactly within each chunk, independent
+     * of the precision setting.
+     *
+     * @param values Row-major point values (numPoints x numDimensions)
+     * @param numPoints Number of points
+     * @param numDimensions Number of dimensions
+     * @param clusterIndices Point indices per cluster (out of range indices are ignored)
+     * @param stopToken Token to cancel the computation with; the result is incomplete when stop was requested
+     * @param progressCallback Invoked whenever another percent of the work is done
+     * @return Moments per cluster
+     */
+    template <typename ElementType>
+    std::vector<ClusterMoments> compute(const ElementType* values, std::size_t numPoints, std::size_t numDimensions, const std::vector<std::span<const std::uint32_t>>& clusterIndices, std::stop_token stopToken = {}, const ProgressCallback& progressCallback = {}) const;
+
+    /**
+     * Compute the moments of each cluster by streaming chunks of dimensions (columns)
+     *
+     * For sources that provide their values per dimension, like proxies. At most \p memoryBudget
+     * bytes of column values are held at a time and every non-zero value is routed to its cluster(s)
+     * through a point to cluster label map; zeros are accounted for per cluster afterwards. Columns
+     * are accumulated exactly (two passes over the column in memory, double precision) regardless
+     * of the precision setting.
+     *
+     * @param numPoints Number of points
+     * @param numDimensions Number of dimensions
+     * @param clusterIndices Point indices per cluster (out of range indices are ignored)
+     * @param extractColumn Extracts the values of one dimension
+     * @param memoryBudget Maximum number of bytes of extracted values held at a time
+     * @param stopToken Token to cancel the computation with; the result is incomplete when stop was requested
+     * @param progressCallback Invoked after every chunk of dimensions
+     * @return Moments per cluster
+     */
+    std::vector<ClusterMoments> computeFromColumns(std::size_t numPoints, std::size_t numDimensions, const std::vector<std::span<const std::uint32_t>>& clusterIndices, const ColumnExtractor& extractColumn, std::size_t memoryBudget, std::stop_token stopToken = {}, const ProgressCallback& progressCallback = {}) const;
+
+private:
+
+    /**
+     * Run \p kernel for every combination of cluster and dimension block on the worker threads
+     * @param numPoints Number of points
+     * @param numDimensions Number of dimensions
+     * @param clusterIndices Point indices per cluster (out of range indices are ignored)
+     * @param kernel Accumulates one block
+     * @param stopToken Token to cancel the computation with
+     * @param progressCallback Invoked whenever another percent of the work is done
+     * @return Moments per cluster
+     */
+    std::vector<ClusterMoments> computeBlocks(std::size_t numPoints, std::size_t numDimensions, const std::vector<std::span<const std::uint32_t>>& clusterIndices, const BlockKernel& kernel, std::stop_token stopToken, const ProgressCallback& progressCallback) const;
+
+private:
+    AccumulationPrecision   _precision;             /** Accumulation precision */
+    float                   _expressionThreshold;   /** Values above this threshold count as expressing */
+};
+
+}
+
+#include "ClusterStatisticsKernels.h"
@@ -0,0 +1,352 @@
+#pragma once
+
+#include "ClusterStatistics.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <span>
+#include <stop_token>
+#include <type_traits>
+#include <vector>
+
+/**
+ * Cluster statistics kernels
+ *
+ * The accumulation kernels are templated on the element type of the point values, so that
+ * the native storage of a dataset (float, bfloat16, 16- and 8-bit integers) is read in place
+ * and widened per value inside the inner loop, instead of being converted to float first.
+ */
+namespace heatmap::kernels
+{
+
+/** Number of points accumulated relative to one shift before merging into the running moments */
+constexpr std::size_t pointChunkSize = 4096;
+
+/** Number of bytes of a row tested for zero at once by the sparse kernel (two 64-bit words) */
+constexpr std::size_t zeroRunBytes = 16;
+
+/** Number of values sampled to detect sparse data */
+constexpr std::size_t numSparsitySamples = 65536;
+
+/**
+ * Fraction of zero values from which the sparse kernel is used
+ *
+ * Below it, too few runs are all zero to pay for the test (measured on randomly placed zeros).
+ */
+constexpr double sparseZeroFraction = 0.9;
+
+/**
+ * Accumulator of integer elements whose chunk sums are exact
+ *
+ * Shifted 8-bit values are at most 255 in magnitude, so a chunk of squares fits 32-bit integers.
+ * Shifted 16-bit values and their squares are integers below 2^53 for a whole chunk, so doubles
+ * sum them without rounding. Wider integers are summed in doubles too, which round their squares
+ * like those of float values at double precision.
+ */
+template <typename ElementType>
+using IntegerAccumulator = std::conditional_t<sizeof(ElementType) == 1, std::int32_t, double>;
+
+/** Whether the chunk sums of \p ElementType are exact (see IntegerAccumulator) */
+template <typename ElementType>
+constexpr bool hasExactChunkSums = std::is_integral_v<ElementType> && sizeof(ElementType) <= 2;
+
+static_assert(pointChunkSize * 255 * 255 <= std::numeric_limits<std::int32_t>::max(), "Chunks of 8-bit squares must fit the 32-bit accumulator");
+
+/**
+ * Widen a stored element to the type it is accumulated from
+ * @param value Stored element
+ * @return 8- and 16-bit integers as 32-bit integer, wider integers as double (32-bit integers would wrap), everything else (float, bfloat16) as float
+ */
+template <typename ElementType>
+inline auto widen(ElementType value)
+{
+    if constexpr (hasExactChunkSums<ElementType>)
+        return static_cast<std::int32_t>(value);
+    else if constexpr (std::is_integral_v<ElementType>)
+        return static_cast<double>(value);
+    else
+        return static_cast<float>(value);
+}
+
+/**
+ * Estimate the fraction of zeros of \p values from evenly spread samples
+ * @param values Values
+ * @param numValues Number of values
+ * @return Fraction of sampled values that are zero (zero without values)
+ */
+template <typename ElementType>
+double sampleZeroFraction(const ElementType* values, std::size_t numValues)
+{
+    if (values == nullptr || numValues == 0)
+        return 0.0;
+
+    const auto numSamples   = std::min(numValues, numSparsitySamples);
+    const auto stride       = numValues / numSamples;
+
+    std::size_t numZeros = 0;
+
+    for (std::size_t sample = 0; sample < numSamples; ++sample)
+        numZeros += widen(values[sample * stride]) == 0;
+
+    return static_cast<double>(numZeros) / static_cast<double>(numSamples);
+}
+
+/**
+ * Get whether the zeroRunBytes bytes at \p run are all zero
+ * @param run First element of the run
+ */
+template <typename ElementType>
+inline bool isZeroRun(const ElementType* run)
+{
+    static_assert(zeroRunBytes % sizeof(ElementType) == 0, "Runs must hold whole elements");
+
+    std::uint64_t words[zeroRunBytes / sizeof(std::uint64_t)];
+
+    std::memcpy(words, run, zeroRunBytes);
+
+    return (words[0] | words[1]) == 0;
+}
+
+/**
+ * Merge chunk sums into running moments with Chan's parallel update
+ * @param count Number of points already in the running moments
+ * @param chunkCount Number of points in the chunk
+ * @param shift Per-dimension value the chunk sums are relative to
+ * @param sum Per-dimension sum of shifted values
+ * @param sumOfSquares Per-dimension sum of squared shifted values
+ * @param mean Running means (block range)
+ * @param m2 Running sums of squared deviations (block range)
+ * @param blockSize Number of dimensions in the block
+ */
+template <typename Accumulator>
+void mergeChunk(std::uint64_t count, std::uint64_t chunkCount, const Accumulator* shift, const Accumulator* sum, const Accumulator* sumOfSquares, double* mean, double* m2, std::size_t blockSize)
+{
+    const auto chunkN   = static_cast<double>(chunkCount);
+    const auto runningN = static_cast<double>(count);
+    const auto totalN   = runningN + chunkN;
+
+    for (std::size_t d = 0; d < blockSize; ++d) {
+        const auto chunkSum     = static_cast<double>(sum[d]);
+        const auto chunkMean    = static_cast<double>(shift[d]) + chunkSum / chunkN;
+        const auto chunkM2      = std::max(0.0, static_cast<double>(sumOfSquares[d]) - chunkSum * chunkSum / chunkN);
+
+        if (count == 0) {
+            mean[d] = chunkMean;
+            m2[d]   = chunkM2;
+        }
+        else {
+            const auto delta = chunkMean - mean[d];
+
+            mean[d] += delta * chunkN / totalN;
+            m2[d]   += chunkM2 + delta * delta * runningN * chunkN / totalN;
+        }
+    }
+}
+
+/**
+ * Accumulate the moments (and expressing counts and sums) of one cluster for dimensions [dimensionBegin, dimensionEnd)
+ * @param values Row-major point values
+ * @param numPoints Number of points
+ * @param numDimensions Number of dimensions
+ * @param indices Point indices of the cluster
+ * @param dimensionBegin First dimension of the block
+ * @param dimensionEnd One past the last dimension of the block
+ * @param threshold Values above this threshold count as expressing
+ * @param moments Cluster moments to write the block range of
+ * @param stopToken Checked between chunks to abandon the block early
+ */
+template <typename ElementType, typename Accumulator>
+void accumulateBlock(const ElementType* values, std::size_t numPoints, std::size_t numDimensions, std::span<const std::uint32_t> indices, std::size_t dimensionBegin, std::size_t dimensionEnd, float threshold, ClusterMoments& moments, const std::stop_token& stopToken)
+{
+    const auto blockSize = dimensionEnd - dimensionBegin;
+
+    std::vector<Accumulator> shift(blockSize), sum(blockSize), sumOfSquares(blockSize), positiveSum(blockSize);
+
+    auto mean       = moments.mean.data() + dimensionBegin;
+    auto m2         = moments.m2.data() + dimensionBegin;
+    auto positive   = moments.positive.data() + dimensionBegin;
+
+    std::uint64_t count = 0;
+
+    for (std::size_t chunkBegin = 0; chunkBegin < indices.size(); chunkBegin += pointChunkSize) {
+        if (stopToken.stop_requested())
+            return;
+
+        const auto chunkEnd = std::min(chunkBegin + pointChunkSize, indices.size());
+
+        std::uint64_t chunkCount = 0;
+
+        std::fill(sum.begin(), sum.end(), Accumulator(0));
+        std::fill(sumOfSquares.begin(), sumOfSquares.end(), Accumulator(0));
+        std::fill(positiveSum.begin(), positiveSum.end(), Accumulator(0));
+
+        for (auto i = chunkBegin; i < chunkEnd; ++i) {
+            const std::size_t pointIndex = indices[i];
+
+            if (pointIndex >= numPoints)
+                continue;
+
+            const auto row = values + pointIndex * numDimensions + dimensionBegin;
+
+            if (chunkCount == 0)
+                std::transform(row, row + blockSize, shift.begin(), [](ElementType value) { return static_cast<Accumulator>(widen(value)); });
+
+            for (std::size_t d = 0; d < blockSize; ++d) {
+                const auto value        = widen(row[d]);
+                const auto x            = static_cast<Accumulator>(value) - shift[d];
+                const auto expressing   = value > threshold;
+
+                sum[d]          += x;
+                sumOfSquares[d] += x * x;
+                positive[d]     += expressing;
+                positiveSum[d]  += expressing ? static_cast<Accumulator>(value) : Accumulator(0);
+            }
+
+            ++chunkCount;
+        }
+
+        if (chunkCount == 0)
+            continue;
+
+        mergeChunk(count, chunkCount, shift.data(), sum.data(), sumOfSquares.data(), mean, m2, blockSize);
+
+        for (std::size_t d = 0; d < blockSize; ++d)
+            moments.positiveSum[dimensionBegin + d] += static_cast<double>(positiveSum[d]);
+
+        count += chunkCount;
+    }
+}
+
+/**
+ * Accumulate a block of mostly zero (sparse) values
+ *
+ * Like accumulateBlock, but the chunk sums are taken relative to zero instead of a shift, so
+ * zeros add nothing: each row is tested zeroRunBytes at a time on its raw bytes and runs of
+ * zeros are skipped (negative zeros are accumulated as values). Only valid for non-negative thresholds, under
+ * which zeros are not expressing either. Sparse data has means close to zero relative to its
+ * spread, so summing relative to zero does not lose the precision the shift protects.
+ *
+ * @see accumulateBlock
+ */
+template <typename ElementType, typename Accumulator>
+void accumulateSparseBlock(const ElementType* values, std::size_t numPoints, std::size_t numDimensions, std::span<const std::uint32_t> indices, std::size_t dimensionBegin, std::size_t dimensionEnd, float threshold, ClusterMoments& moments, const std::stop_token& stopToken)
+{
+    constexpr auto runSize = zeroRunBytes / sizeof(ElementType);
+
+    const auto blockSize = dimensionEnd - dimensionBegin;
+
+    std::vector<Accumulator> zero(blockSize, Accumulator(0)), sum(blockSize), sumOfSquares(blockSize), positiveSum(blockSize);
+
+    auto mean       = moments.mean.data() + dimensionBegin;
+    auto m2         = moments.m2.data() + dimensionBegin;
+    auto positive   = moments.positive.data() + dimensionBegin;
+
+    std::uint64_t count = 0;
+
+    for (std::size_t chunkBegin = 0; chunkBegin < indices.size(); chunkBegin += pointChunkSize) {
+        if (stopToken.stop_requested())
+            return;
+
+        const auto chunkEnd = std::min(chunkBegin + pointChunkSize, indices.size());
+
+        std::uint64_t chunkCount = 0;
+
+        std::fill(sum.begin(), sum.end(), Accumulator(0));
+        std::fill(sumOfSquares.begin(), sumOfSquares.end(), Accumulator(0));
+        std::fill(positiveSum.begin(), positiveSum.end(), Accumulator(0));
+
+        for (auto i = chunkBegin; i < chunkEnd; ++i) {
+            const std::size_t pointIndex = indices[i];
+
+            if (pointIndex >= numPoints)
+                continue;
+
+            const auto row = values + pointIndex * numDimensions + dimensionBegin;
+
+            for (std::size_t runBegin = 0; runBegin < blockSize; runBegin += runSize) {
+                const auto runEnd = std::min(runBegin + runSize, blockSize);
+
+                if (runEnd - runBegin == runSize && isZeroRun(row + runBegin))
+                    continue;
+
+                for (auto d = runBegin; d < runEnd; ++d) {
+                    const auto value        = widen(row[d]);
+                    const auto x            = static_cast<Accumulator>(value);
+                    const auto expressing   = value > threshold;
+
+                    sum[d]          += x;
+                    sumOfSquares[d] += x * x;
+                    positive[d]     += expressing;
+                    positiveSum[d]  += expressing ? x : Accumulator(0);
+                }
+            }
+
+            ++chunkCount;
+        }
+
+        if (chunkCount == 0)
+            continue;
+
+        mergeChunk(count, chunkCount, zero.data(), sum.data(), sumOfSquares.data(), mean, m2, blockSize);
+
+        for (std::size_t d = 0; d < blockSize; ++d)
+            moments.positiveSum[dimensionBegin + d] += static_cast<double>(positiveSum[d]);
+
+        count += chunkCount;
+    }
+}
+
+/**
+ * Accumulate a block with the accumulator suited to \p ElementType
+ *
+ * Integer elements use exact integer (or integer-valued double) chunk sums; floating point
+ * elements use the requested \p precision.
+ *
+ * @param precision Accumulation precision of floating point elements
+ * @param sparse Whether to use the sparse kernel
+ * @see accumulateBlock
+ */
+template <typename ElementType>
+void dispatchBlock(AccumulationPrecision precision, bool sparse, const ElementType* values, std::size_t numPoints, std::size_t numDimensions, std::span<const std::uint32_t> indices, std::size_t dimensionBegin, std::size_t dimensionEnd, float threshold, ClusterMoments& moments, const std::stop_token& stopToken)
+{
+    const auto accumulate = [&]<typename Accumulator>() -> void {
+        if (sparse)
+            accumulateSparseBlock<ElementType, Accumulator>(values, numPoints, numDimensions, indices, dimensionBegin, dimensionEnd, threshold, moments, stopToken);
+        else
+            accumulateBlock<ElementType, Accumulator>(values, numPoints, numDimensions, indices, dimensionBegin, dimensionEnd, threshold, moments, stopToken);
+    };
+
+    if constexpr (std::is_integral_v<ElementType>)
+        accumulate.template operator()<IntegerAccumulator<ElementType>>();
+    else if (precision == AccumulationPrecision::Single)
+        accumulate.template operator()<float>();
+    else
+        accumulate.template operator()<double>();
+}
+
+}
+
+namespace heatmap
+{
+
+template <typename ElementType>
+std::vector<ClusterMoments> ClusterStatisticsEngine::compute(const ElementType* values, std::size_t numPoints, std::size_t numDimensions, const std::vector<std::span<const std::uint32_t>>& clusterIndices, std::stop_token stopToken, const ProgressCallback& progressCallback) const
+{
+    if (values == nullptr)
+        return computeBlocks(numPoints, numDimensions, clusterIndices, {}, stopToken, progressCallback);
+
+    const auto precision    = _precision;
+    const auto threshold    = _expressionThreshold;
+
+    // Zeros are skipped only when they cannot be expressing
+    const auto sparse = threshold >= 0.f && kernels::sampleZeroFraction(values, numPoints * numDimensions) >= kernels::sparseZeroFraction;
+
+    return computeBlocks(numPoints, numDimensions, clusterIndices, [=, &stopToken](std::span<const std::uint32_t> indices, std::size_t dimensionBegin, std::size_t dimensionEnd, ClusterMoments& moments) -> void {
+        kernels::dispatchBlock(precision, sparse, values, numPoints, numDimensions, indices, dimensionBegin, dimensionEnd, threshold, moments, stopToken);
+    }, stopToken, progressCallback);
+}
+
+}
@@ -0,0 +1,588 @@
+#include "DimensionSeriation.h"
+
+#include "ClusterHierarchy.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <utility>
+
+namespace heatmap
+{
+
+namespace
+{
+    /** Number of dimensions normalized by a single task */
+    constexpr std::size_t normalizationBlockSize = 256;
+
+    /** Number of dimensions per side of a tile of the correlation matrix */
+    constexpr std::size_t tileSize = 64;
+
+    /** Minimum number of leaf pairs of a node for its optimal orders to be computed in parallel */
+    constexpr std::size_t minParallelLeafPairs = 4096;
+
+    /** Index of d(i, j), i < j, in a condensed distance matrix of \p numItems items */
+    inline std::size_t condensedIndex(std::size_t numItems, std::size_t i, std::size_t j)
+    {
+        return numItems * i - i * (i + 1) / 2 + j - i - 1;
+    }
+
+    /** Distance between items \p i and \p j in a condensed distance matrix of \p numItems items */
+    inline float getDistance(const std::vector<float>& distances, std::size_t numItems, std::size_t i, std::size_t j)
+    {
+        if (i == j)
+            return 0.f;
+
+        return i < j ? distances[condensedIndex(numItems, i, j)] : distances[condensedIndex(numItems, j, i)];
+    }
+
+    /**
+     * Center \p dimensions of a statistics matrix over its rows and scale them to unit length, so that their correlations are dot products
+     * @param values Row-major statistics (numRows x numDimensions), non-finite values count as the mean
+     * @param numRows Number of rows
+     * @param numDimensions Number of dimensions
+     * @param dimensions Dimensions to normalize
+     * @param dimensionsMajor Receives the normalized dimensions one after the other (dimensions x numRows)
+     * @param rowsMajor Receives the normalized dimensions row by row (numRows x dimensions), unless nullptr
+     */
+    void normalizeDimensions(const float* values, std::size_t numRows, std::size_t numDimensions, const std::vector<std::uint32_t>& dimensions, float* dimensionsMajor, float* rowsMajor)
+    {
+        const auto numNormalized    = dimensions.size();
+        const auto numBlocks        = (numNormalized + normalizationBlockSize - 1) / normalizationBlockSize;
+
+        parallelFor(numBlocks, [&](std::size_t blockIndex) -> void {
+            const auto begin    = blockIndex * normalizationBlockSize;
+            const auto end      = std::min(begin + normalizationBlockSize, numNormalized);
+
+            std::vector<double> sums(end - begin, 0.0), counts(end - begin, 0.0), squaredSums(end - begin, 0.0);
+
+            // Rows are read once per pass, so the matrix is traversed in memory order
+            for (std::size_t row = 0; row < numRows; ++row) {
+                const auto rowValues = values + row * numDimensions;
+
+                for (auto index = begin; index < end; ++index) {
+                    const auto value = rowValues[dimensions[index]];
+
+                    if (!std::isfinite(value))
+                        continue;
+
+                    sums[index - begin]     += value;
+                    counts[index - begin]   += 1.0;
+                }
+            }
+
+            for (auto index = begin; index < end; ++index)
+                sums[index - begin] = counts[index - begin] > 0.0 ? sums[index - begin] / counts[index - begin] : 0.0;
+
+            for (std::size_t row = 0; row < numRows; ++row) {
+                const auto rowValues = values + row * numDimensions;
+
+                for (auto index = begin; index < end; ++index) {
+                    const auto value = rowValues[dimensions[index]];
+
+                    if (std::isfinite(value))
+                        squaredSums[index - begin] += (value - sums[index - begin]) * (value - sums[index - begin]);
+                }
+            }
+
+            for (std::size_t row = 0; row < numRows; ++row) {
+                const auto rowValues = values + row * numDimensions;
+
+                for (auto index = begin; index < end; ++index) {
+                    const auto value    = rowValues[dimensions[index]];
+                    const auto scale    = squaredSums[index - begin] > 0.0 ? 1.0 / std::sqrt(squaredSums[index - begin]) : 0.0;
+
+                    // Constant dimensions become zero vectors, which are uncorrelated with everything
+                    const auto normalized = std::isfinite(value) ? static_cast<float>((value - sums[index - begin]) * scale) : 0.f;
+
+                    dimensionsMajor[index * numRows + row] = normalized;
+
+                    if (rowsMajor != nullptr)
+                        rowsMajor[row * numNormalized + index] = normalized;
+                }
+            }
+        });
+    }
+
+    /**
+     * Accumulate the dot products of normalized dimension \p dimension with the dimensions of a tile
+     * @param dimension Normalized dimension (numRows values)
+     * @param rowsMajor Normalized dimensions row by row (numRows x numColumns)
+     * @param numRows Number of rows
+     * @param numColumns Number of dimensions per row of \p rowsMajor
+     * @param tileBegin First dimension of the tile
+     * @param tileEnd One past the last dimension of the tile
+     * @param dotProducts Receives the dot product per dimension of the tile
+     */
+    inline void accumulateTile(const float* dimension, const float* rowsMajor, std::size_t numRows, std::size_t numColumns, std::size_t tileBegin, std::size_t tileEnd, std::array<float, tileSize>& dotProducts)
+    {
+        const auto width = tileEnd - tileBegin;
+
+        std::fill_n(dotProducts.begin(), width, 0.f);
+
+        // A row of the tile is contiguous, so the inner loop vectorizes like the one of a matrix product
+        for (std::size_t row = 0; row < numRows; ++row) {
+            const auto value = dimension[row];
+
+            if (value == 0.f)
+                continue;
+
+            const auto tileRow = rowsMajor + row * numColumns + tileBegin;
+
+            for (std::size_t column = 0; column < width; ++column)
+                dotProducts[column] += value * tileRow[column];
+        }
+    }
+
+    /** Range [begin, end) of positions in a leaf order */
+    struct LeafRange
+    {
+        std::size_t begin;  /** First position */
+        std::size_t end;    /** One past the last position */
+
+        bool contains(std::size_t position) const {
+            return begin <= position && position < end;
+        }
+    };
+
+    /**
+     * Order the leaves of the subtree of \p root optimally (Bar-Joseph et al., 2001)
+     *
+     * For every pair of leaves (i, j) of a node whose lowest common ancestor it is, M(i, j) is the
+     * smallest summed distance of adjacent leaves of an order of the node that starts with i and
+     * ends with j. With left child L (holding i) and right child R (holding j), the order runs
+     * from i to a leaf k of L, from which it continues with a leaf m of R, so
+     *
+     *   M(i, j) = min over k, m of M(i, k) + d(k, m) + M(m, j),
+     *
+     * where k lies in the child of L that does not hold i (k = i when L is a leaf) and likewise
+     * for m. Minimizing over k first for all m makes this O(|L| |R| (|L| + |R|)) per node.
+     *
+     * @param tree Hierarchy of the items
+     * @param root Root of the subtree
+     * @param distances Condensed distance matrix of the items
+     * @param stopToken Token to cancel the computation with; the result is empty when stop was requested
+     * @return Items of the subtree in leaf order
+     */
+    std::vector<std::uint32_t> orderSubtreeOptimally(const ClusterHierarchy& tree, std::uint32_t root, const std::vector<float>& distances, std::stop_token stopToken)
+    {
+        const auto leaves       = tree.getClusters(root);
+        const auto numLeaves    = leaves.size();
+        const auto base         = static_cast<std::size_t>(tree.getLeafBegin(root));
+        const auto numItems     = tree.getNumClusters();
+
+        if (numLeaves == 1)
+            return { leaves.front() };
+
+        const auto getRange = [&](std::uint32_t node) -> LeafRange {
+            const auto begin = tree.getLeafBegin(node) - base;
+
+            return { begin, begin + tree.getClusters(node).size() };
+        };
+
+        // Positions an order of child \p node can continue from, when it starts (or ends) at \p position
+        const auto getOuterRange = [&](std::uint32_t node, std::size_t position) -> LeafRange {
+            if (tree.isLeaf(node))
+                return { position, position + 1 };
+
+            const auto left = getRange(tree.getLeft(node));
+
+            return left.contains(position) ? getRange(tree.getRight(node)) : left;
+        };
+
+        // Distances between the leaves in leaf order positions, and the costs M
+        std::vector<float> local(numLeaves * numLeaves), costs(numLeaves * numLeaves, 0.f);
+
+        parallelFor(numLeaves, [&](std::size_t position) -> void {
+            for (std::size_t other = 0; other < numLeaves; ++other)
+                local[position * numLeaves + other] = getDistance(distances, numItems, leaves[position], leaves[other]);
+        });
+
+        std::vector<std::uint32_t> nodes, stack = { root };
+
+        while (!stack.empty()) {
+            const auto node = stack.back();
+
+            stack.pop_back();
+
+            if (tree.isLeaf(node))
+                continue;
+
+            nodes.push_back(node);
+            stack.push_back(tree.getLeft(node));
+            stack.push_back(tree.getRight(node));
+        }
+
+        // Children are numbered before their parents
+        std::sort(nodes.begin(), nodes.end());
+
+        for (const auto node : nodes) {
+            if (stopToken.stop_requested())
+                return {};
+
+            const auto leftChild    = tree.getLeft(node);
+            const auto rightChild   = tree.getRight(node);
+            const auto left         = getRange(leftChild);
+            const auto right        = getRange(rightChild);
+
+            const auto computeCosts = [&](std::size_t first) -> void {
+                const auto firstRow = costs.data() + first * numLeaves;
+
+                // Cheapest order of the left child from first to any k, followed by the step to m
+                std::vector<float> toRight(right.end - right.begin, std::numeric_limits<float>::infinity());
+
+                const auto outerLeft = getOuterRange(leftChild, first);
+
+                for (auto k = outerLeft.begin; k < outerLeft.end; ++k) {
+                    const auto cost         = firstRow[k];
+                    const auto distanceRow  = local.data() + k * numLeaves + right.begin;
+
+                    for (std::size_t m = 0; m < toRight.size(); ++m)
+                        toRight[m] = std::min(toRight[m], cost + distanceRow[m]);
+                }
+
+                // M is symmetric, so M(m, last) is read from the contiguous row of last
+                for (auto last = right.begin; last < right.end; ++last) {
+                    const auto outerRight   = getOuterRange(rightChild, last);
+                    const auto lastRow      = costs.data() + last * numLeaves;
+
+                    auto cost = std::numeric_limits<float>::infinity();
+
+                    for (auto m = outerRight.begin; m < outerRight.end; ++m)
+                        cost = std::min(cost, toRight[m - right.begin] + lastRow[m]);
+
+                    firstRow[last]  = cost;
+                    lastRow[first]  = cost;
+                }
+            };
+
+            const auto numFirst = left.end - left.begin;
+
+            if (numFirst * (right.end - right.begin) >= minParallelLeafPairs) {
+                parallelFor(numFirst, [&](std::size_t index) -> void {
+                    computeCosts(left.begin + index);
+                });
+            }
+            else {
+                for (auto first = left.begin; first < left.end; ++first)
+                    computeCosts(first);
+            }
+        }
+
+        // The cheapest order of the root, followed down the tree by finding the k and m that gave each cost
+        const auto rootLeft     = getRange(tree.getLeft(root));
+        const auto rootRight    = getRange(tree.getRight(root));
+
+        std::pair<std::size_t, std::size_t> ends = { rootLeft.begin, rootRight.begin };
+
+        for (auto first = rootLeft.begin; first < rootLeft.end; ++first)
+            for (auto last = rootRight.begin; last < rootRight.end; ++last)
+                if (costs[first * numLeaves + last] < costs[ends.first * numLeaves + ends.second])
+                    ends = { first, last };
+
+        struct Segment
+        {
+            std::uint32_t   node;   /** Node whose leaves the segment holds */
+            std::size_t     first;  /** Position of the first leaf */
+            std::size_t     last;   /** Position of the last leaf */
+        };
+
+        std::vector<std::uint32_t> order;
+        std::vector<Segment> segments = { { root, ends.first, ends.second } };
+
+        order.reserve(numLeaves);
+
+        while (!segments.empty()) {
+            const auto segment = segments.back();
+
+            segments.pop_back();
+
+            if (tree.isLeaf(segment.node)) {
+                order.push_back(leaves[segment.first]);
+                continue;
+            }
+
+            const auto isLeftFirst  = getRange(tree.getLeft(segment.node)).contains(segment.first);
+            const auto firstChild   = isLeftFirst ? tree.getLeft(segment.node) : tree.getRight(segment.node);
+            const auto lastChild    = isLeftFirst ? tree.getRight(segment.node) : tree.getLeft(segment.node);
+            const auto outerFirst   = getOuterRange(firstChild, segment.first);
+            const auto outerLast    = getOuterRange(lastChild, segment.last);
+
+            std::pair<std::size_t, std::size_t> junction = { outerFirst.begin, outerLast.begin };
+
+            auto junctionCost = std::numeric_limits<float>::infinity();
+
+            for (auto k = outerFirst.begin; k < outerFirst.end; ++k) {
+                for (auto m = outerLast.begin; m < outerLast.end; ++m) {
+                    const auto cost = costs[segment.first * numLeaves + k] + local[k * numLeaves + m] + costs[m * numLeaves + segment.last];
+
+                    if (cost < junctionCost) {
+                        junction        = { k, m };
+                        junctionCost    = cost;
+                    }
+                }
+            }
+
+            segments.push_back({ lastChild, junction.second, segment.last });
+            segments.push_back({ firstChild, segment.first, junction.first });
+        }
+
+        return order;
+    }
+}
+
+DimensionCorrelations computeDimensionCorrelations(const float* values, std::size_t numRows, std::size_t numDimensions, std::size_t maxClusteredDimensions, std::stop_token stopToken)
+{
+    DimensionCorrelations correlations;
+
+    correlations.numDimensions = numDimensions;
+    correlations.dimensions.resize(numDimensions);
+
+    std::iota(correlations.dimensions.begin(), correlations.dimensions.end(), 0);
+
+    std::vector<std::uint32_t> attached;
+
+    // Only the most variable dimensions are clustered
+    if (numDimensions > maxClusteredDimensions) {
+        std::vector<double> variances(numDimensions, 0.0);
+
+        parallelFor((numDimensions + normalizationBlockSize - 1) / normalizationBlockSize, [&](std::size_t blockIndex) -> void {
+            const auto begin    = blockIndex * normalizationBlockSize;
+            const auto end      = std::min(begin + normalizationBlockSize, numDimensions);
+
+            std::vector<double> sums(end - begin, 0.0), squaredSums(end - begin, 0.0), counts(end - begin, 0.0);
+
+            for (std::size_t row = 0; row < numRows; ++row) {
+                for (auto dimension = begin; dimension < end; ++dimension) {
+                    const auto value = values[row * numDimensions + dimension];
+
+                    if (!std::isfinite(value))
+                        continue;
+
+                    sums[dimension - begin]         += value;
+                    squaredSums[dimension - begin]  += static_cast<double>(value) * value;
+                    counts[dimension - begin]       += 1.0;
+                }
+            }
+
+            for (auto dimension = begin; dimension < end; ++dimension) {
+                const auto count = counts[dimension - begin];
+
+                if (count == 0.0)
+                    continue;
+
+                const auto mean = sums[dimension - begin] / count;
+
+                variances[dimension] = squaredSums[dimension - begin] / count - mean * mean;
+            }
+        });
+
+        auto& dimensions = correlations.dimensions;
+
+        std::nth_element(dimensions.begin(), dimensions.begin() + maxClusteredDimensions, dimensions.end(), [&variances](std::uint32_t lhs, std::uint32_t rhs) {
+            return variances[lhs] > variances[rhs];
+        });
+
+        attached.assign(dimensions.begin() + maxClusteredDimensions, dimensions.end());
+        dimensions.resize(maxClusteredDimensions);
+
+        std::sort(dimensions.begin(), dimensions.end());
+        std::sort(attached.begin(), attached.end());
+    }
+
+    if (stopToken.stop_requested())
+        return correlations;
+
+    const auto numClustered = correlations.dimensions.size();
+
+    std::vector<float> dimensionsMajor(numClustered * numRows), rowsMajor(numRows * numClustered);
+
+    normalizeDimensions(values, numRows, numDimensions, correlations.dimensions, dimensionsMajor.data(), rowsMajor.data());
+
+    correlations.distances.resize(numClustered > 1 ? numClustered * (numClustered - 1) / 2 : 0);
+
+    const auto numTiles = (numClustered + tileSize - 1) / tileSize;
+
+    // Tiles on and above the diagonal; a row of tiles is one task, handed out dynamically since the rows get shorter
+    parallelFor(numTiles, [&](std::size_t tileRow) -> void {
+        const auto rowBegin = tileRow * tileSize;
+        const auto rowEnd   = std::min(rowBegin + tileSize, numClustered);
+
+        std::array<float, tileSize> dotProducts;
+
+        for (auto tileColumn = tileRow; tileColumn < numTiles; ++tileColumn) {
+            if (stopToken.stop_requested())
+                return;
+
+            const auto columnBegin  = tileColumn * tileSize;
+            const auto columnEnd    = std::min(columnBegin + tileSize, numClustered);
+
+            for (auto i = rowBegin; i < rowEnd; ++i) {
+                if (columnEnd <= i + 1)
+                    continue;
+
+                accumulateTile(dimensionsMajor.data() + i * numRows, rowsMajor.data(), numRows, numClustered, columnBegin, columnEnd, dotProducts);
+
+                auto output = correlations.distances.data() + condensedIndex(numClustered, i, std::max(columnBegin, i + 1));
+
+                for (auto j = std::max(columnBegin, i + 1); j < columnEnd; ++j)
+                    *output++ = std::max(0.f, 1.f - dotProducts[j - columnBegin]);
+            }
+        }
+    });
+
+    if (attached.empty() || numClustered == 0 || stopToken.stop_requested())
+        return correlations;
+
+    // Every other dimension goes next to the clustered dimension it correlates with most
+    std::vector<float> attachedMajor(attached.size() * numRows);
+
+    normalizeDimensions(values, numRows, numDimensions, attached, attachedMajor.data(), nullptr);
+
+    correlations.attached.resize(attached.size());
+
+    parallelFor(attached.size(), [&](std::size_t index) -> void {
+        if (stopToken.stop_requested())
+            return;
+
+        std::array<float, tileSize> dotProducts;
+
+        AttachedDimension attachment = { attached[index], 0, std::numeric_limits<float>::infinity() };
+
+        for (std::size_t tileColumn = 0; tileColumn < numTiles; ++tileColumn) {
+            const auto columnBegin  = tileColumn * tileSize;
+            const auto columnEnd    = std::min(columnBegin + tileSize, numClustered);
+
+            accumulateTile(attachedMajor.data() + index * numRows, rowsMajor.data(), numRows, numClustered, columnBegin, columnEnd, dotProducts);
+
+            for (auto j = columnBegin; j < columnEnd; ++j) {
+                const auto distance = std::max(0.f, 1.f - dotProducts[j - columnBegin]);
+
+                if (distance < attachment.distance)
+                    attachment = { attached[index], static_cast<std::uint32_t>(j), distance };
+            }
+        }
+
+        correlations.attached[index] = attachment;
+    });
+
+    return correlations;
+}
+
+std::vector<std::uint32_t> orderLeavesOptimally(const std::vector<DendrogramMerge>& merges, const std::vector<float>& distances, std::size_t numItems, std::size_t maxOptimalLeaves, std::stop_token stopToken)
+{
+    if (numItems == 0 || merges.size() != numItems - 1 || distances.size() != numItems * (numItems - 1) / 2)
+        return {};
+
+    if (numItems == 1)
+        return { 0 };
+
+    const ClusterHierarchy tree(numItems, merges);
+
+    const auto getNumLeaves = [&tree](std::uint32_t node) -> std::size_t {
+        return tree.getClusters(node).size();
+    };
+
+    std::vector<std::vector<std::uint32_t>> orders(tree.getNumNodes());
+
+    // The largest subtrees that are small enough are ordered optimally
+    for (std::uint32_t node = 0; node < tree.getNumNodes(); ++node) {
+        const auto parent = tree.getParent(node);
+
+        if (getNumLeaves(node) > maxOptimalLeaves || (parent != ClusterHierarchy::noNode && getNumLeaves(parent) <= maxOptimalLeaves))
+            continue;
+
+        orders[node] = orderSubtreeOptimally(tree, node, distances, stopToken);
+
+        if (stopToken.stop_requested())
+            return {};
+    }
+
+    // Above them every node puts its children in the orientation that brings their nearest ends together
+    for (auto node = static_cast<std::uint32_t>(numItems); node < tree.getNumNodes(); ++node) {
+        if (getNumLeaves(node) <= maxOptimalLeaves)
+            continue;
+
+        auto first  = std::move(orders[tree.getLeft(node)]);
+        auto second = std::move(orders[tree.getRight(node)]);
+
+        const std::array<float, 4> gaps = {
+            getDistance(distances, numItems, first.back(), second.front()),
+            getDistance(distances, numItems, first.front(), second.front()),
+            getDistance(distances, numItems, first.back(), second.back()),
+            getDistance(distances, numItems, first.front(), second.back())
+        };
+
+        const auto orientation = std::distance(gaps.begin(), std::min_element(gaps.begin(), gaps.end()));
+
+        if (orientation == 1 || orientation == 3)
+            std::reverse(first.begin(), first.end());
+
+        if (orientation == 2 || orientation == 3)
+            std::reverse(second.begin(), second.end());
+
+        first.insert(first.end(), second.begin(), second.end());
+
+        orders[node] = std::move(first);
+    }
+
+    return std::move(orders[tree.getRoot()]);
+}
+
+DimensionSeriation seriateDimensions(const DimensionCorrelations& correlations, Linkage linkage, std::size_t maxOptimalLeaves, std::stop_token stopToken)
+{
+    const auto& dimensions  = correlations.dimensions;
+    const auto numClustered = dimensions.size();
+
+    DimensionSeriation seriation;
+
+    std::vector<std::uint32_t> items;
+
+    if (numClustered > 1) {
+        // The clustering overwrites its distances, the leaf ordering needs the original ones
+        auto merges = clusterDistanceMatrix(correlations.distances, numClustered, linkage, stopToken);
+
+        if (stopToken.stop_requested())
+            return {};
+
+        items = orderLeavesOptimally(merges, correlations.distances, numClustered, maxOptimalLeaves, stopToken);
+
+        if (stopToken.stop_requested())
+            return {};
+
+        // Without attached dimensions the clustered dimensions are all dimensions, in their own numbering
+        if (correlations.attached.empty())
+            seriation.merges = std::move(merges);
+    }
+    else {
+        items.resize(numClustered);
+        std::iota(items.begin(), items.end(), 0);
+    }
+
+    // Attached dimensions follow their nearest clustered dimension, the most correlated first
+    std::vector<AttachedDimension> attached = correlations.attached;
+
+    std::stable_sort(attached.begin(), attached.end(), [](const AttachedDimension& lhs, const AttachedDimension& rhs) {
+        return lhs.nearest < rhs.nearest || (lhs.nearest == rhs.nearest && lhs.distance < rhs.distance);
+    });
+
+    seriation.order.reserve(correlations.numDimensions);
+
+    for (const auto item : items) {
+        seriation.order.push_back(dimensions[item]);
+
+        const auto range = std::equal_range(attached.begin(), attached.end(), AttachedDimension{ 0, item, 0.f }, [](const AttachedDimension& lhs, const AttachedDimension& rhs) {
+            return lhs.nearest < rhs.nearest;
+        });
+
+        for (auto it = range.first; it != range.second; ++it)
+            seriation.order.push_back(it->dimension);
+    }
+
+    return seriation;
+}
+
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "HierarchicalClustering.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <stop_token>
+#include <vector>
+
+namespace heatmap
+{
+
+/** Order of the heatmap rows (dimensions) */
+enum class RowOrder
+{
+    Dataset,        /** Order of the dimensions in the points dataset */
+    Coexpression    /** Dimensions with correlated statistics over the clusters next to each other (see seriateDimensions) */
+};
+
+/** Dimension that is placed next to its most correlated clustered dimension instead of being clustered */
+struct AttachedDimension
+{
+    std::uint32_t   dimension;  /** Dimension index */
+    std::uint32_t   nearest;    /** Index of the most correlated clustered dimension (in DimensionCorrelations::dimensions) */
+    float           distance;   /** Correlation distance to it */
+};
+
+/**
+ * Correlation distances between dimensions
+ *
+ * One minus the Pearson correlation of the statistics of two dimensions over the clusters. Only
+ * the distances of the clustered dimensions are kept (a condensed matrix takes O(n^2) memory);
+ * beyond the maximum number of clustered dimensions the most variable ones are clustered and the
+ * others are attached to their most correlated clustered dimension.
+ */
+struct DimensionCorrelations
+{
+    std::size_t                     numDimensions = 0;  /** Number of dimensions */
+    std::vector<std::uint32_t>      dimensions;         /** Clustered dimensions, ascending */
+    std::vector<float>              distances;          /** Condensed correlation distances of the clustered dimensions (see computeDistanceMatrix) */
+    std::vector<AttachedDimension>  attached;           /** The other dimensions, ascending */
+};
+
+/** Row order of the dimensions */
+struct DimensionSeriation
+{
+    std::vector<std::uint32_t>      order;      /** Dimension shown in every row */
+    std::vector<DendrogramMerge>    merges;     /** Hierarchical clustering of the dimensions in their numbering (empty when dimensions were attached) */
+};
+
+/**
+ * Compute the correlation distances between the columns (dimensions) of a statistics matrix
+ *
+ * The dimensions are centered and normalized over the rows once, after which the correlations are
+ * the dot products of all pairs. These are computed in parallel in square tiles of dimensions that
+ * stay in cache, with a vectorizable inner loop over the second dimension of the tile (like a
+ * matrix product). Time O(n^2 rows / threads), memory O(n^2) for n clustered dimensions.
+ *
+ * @param values Row-major statistics (numRows x numDimensions), e.g. the means of the clusters
+ * @param numRows Number of rows (clusters)
+ * @param numDimensions Number of dimensions
+ * @param maxClusteredDimensions Maximum number of clustered dimensions
+ * @param stopToken Token to cancel the computation with; the result is incomplete when stop was requested
+ * @return Correlation distances
+ */
+DimensionCorrelations computeDimensionCorrelations(const float* values, std::size_t numRows, std::size_t numDimensions, std::size_t maxClusteredDimensions, std::stop_token stopToken = {});
+
+/**
+ * Order the leaves of a hierarchical clustering so that the summed distance of adjacent leaves is minimal
+ *
+ * Optimal leaf ordering (Bar-Joseph et al., 2001) picks one of the 2^(n - 1) orders of the leaves
+ * that the dendrogram allows, in O(n^3) time and O(n^2) memory. Subtrees of up to
+ * \p maxOptimalLeaves leaves are ordered optimally; the children of larger nodes are flipped so
+ * that the leaves where they meet are closest (Gruvaeus and Wainer, 1972).
+ *
+ * @param merges numItems - 1 merges of the items
+ * @param distances Condensed distance matrix of the items
+ * @param numItems Number of items
+ * @param maxOptimalLeaves Maximum number of leaves of an optimally ordered subtree
+ * @param stopToken Token to cancel the computation with; the result is empty when stop was requested
+ * @return Items in leaf order
+ */
+std::vector<std::uint32_t> orderLeavesOptimally(const std::vector<DendrogramMerge>& merges, const std::vector<float>& distances, std::size_t numItems, std::size_t maxOptimalLeaves, std::stop_token stopToken = {});
+
+/**
+ * Order the dimensions by co-expression: cluster the clustered dimensions by \p linkage, order the
+ * leaves optimally and put every attached dimension right after its most correlated dimension
+ * @param correlations Correlation distances between the dimensions
+ * @param linkage Linkage
+ * @param maxOptimalLeaves Maximum number of leaves of an optimally ordered subtree (see orderLeavesOptimally)
+ * @param stopToken Token to cancel the computation with; the result is empty when stop was requested
+ * @return Row order
+ */
+DimensionSeriation seriateDimensions(const DimensionCorrelations& correlations, Linkage linkage, std::size_t maxOptimalLeaves, std::stop_token stopToken = {});
+
+}
@@ -0,0 +1,308 @@
+#include "HeatMapPayload.h"
+
+#include <cstdio>
+#include <cstring>
+
+namespace heatmap
+{
+
+namespace
+{
+    /** Alignment of the header end and of every matrix */
+    constexpr std::size_t payloadAlignment = 8;
+
+    /** Size of the magic and the header length */
+    constexpr std::size_t preambleSize = 8;
+
+    std::size_t alignUp(std::size_t size)
+    {
+        return (size + payloadAlignment - 1) / payloadAlignment * payloadAlignment;
+    }
+
+    const char* getValueTypeName(HeatMapPayload::ValueType type)
+    {
+        switch (type)
+        {
+            case HeatMapPayload::ValueType::Float32:
+                return "float32";
+
+            case HeatMapPayload::ValueType::Float16:
+                return "float16";
+
+            case HeatMapPayload::ValueType::UInt16:
+                return "uint16";
+        }
+
+        return "";
+    }
+
+    std::size_t getValueTypeSize(HeatMapPayload::ValueType type)
+    {
+        return type == HeatMapPayload::ValueType::Float32 ? 4 : 2;
+    }
+}
+
+HeatMapPayload::HeatMapPayload(ValueType floatType) :
+    _floatType(floatType == ValueType::Float16 ? ValueType::Float16 : ValueType::Float32),
+    _clusterNames(),
+    _clusterSizes(),
+    _dimensionNames(),
+    _metadata(),
+    _matrices(),
+    _header()
+{
+}
+
+void HeatMapPayload::setClusters(const std::vector<std::string>& names, const std::vector<std::uint64_t>& sizes)
+{
+    _header.clear();
+    _clusterNames = names;
+    _clusterSizes = sizes;
+}
+
+void HeatMapPayload::setDimensionNames(const std::vector<std::string>& names)
+{
+    _header.clear();
+    _dimensionNames = names;
+}
+
+void HeatMapPayload::setMetadata(const std::string& key, const std::string& json)
+{
+    _header.clear();
+    _metadata.emplace_back(key, json);
+}
+
+void HeatMapPayload::addMatrix(const std::string& name, const float* values, std::size_t count)
+{
+    _header.clear();
+    _matrices.push_back({ name, _floatType, values, count });
+}
+
+void HeatMapPayload::addMatrix(const std::string& name, const std::uint16_t* values, std::size_t count)
+{
+    _header.clear();
+    _matrices.push_back({ name, ValueType::UInt16, values, count });
+}
+
+std::size_t HeatMapPayload::getEncodedSize() const
+{
+    auto size = preambleSize + alignUp(getHeader().size());
+
+    for (const auto& matrix : _matrices)
+        size += getEncodedSize(matrix);
+
+    return size;
+}
+
+void HeatMapPayload::encode(char* destination) const
+{
+    const auto& header      = getHeader();
+    const auto headerSize   = static_cast<std::uint32_t>(alignUp(header.size()));
+
+    std::memcpy(destination, "HMB1", 4);
+
+    for (int byteIndex = 0; byteIndex < 4; ++byteIndex)
+        destination[4 + byteIndex] = static_cast<char>((headerSize >> (8 * byteIndex)) & 0xff);
+
+    auto output = destination + preambleSize;
+
+    std::memcpy(output, header.data(), header.size());
+    std::memset(output + header.size(), ' ', headerSize - header.size());
+
+    output += headerSize;
+
+    for (const auto& matrix : _matrices) {
+        const auto encodedSize = getEncodedSize(matrix);
+
+        switch (matrix.type)
+        {
+            case ValueType::Float32:
+            case ValueType::UInt16:
+                std::memcpy(output, matrix.values, matrix.count * getValueTypeSize(matrix.type));
+                break;
+
+            case ValueType::Float16:
+            {
+                const auto values = static_cast<const float*>(matrix.values);
+
+                for (std::size_t index = 0; index < matrix.count; ++index) {
+                    const auto half = toFloat16(values[index]);
+
+                    std::memcpy(output + 2 * index, &half, 2);
+                }
+
+                break;
+            }
+        }
+
+        const auto usedSize = matrix.count * getValueTypeSize(matrix.type);
+
+        std::memset(output + usedSize, 0, encodedSize - usedSize);
+
+        output += encodedSize;
+    }
+}
+
+std::uint16_t HeatMapPayload::toFloat16(float value)
+{
+    std::uint32_t bits;
+
+    std::memcpy(&bits, &value, 4);
+
+    const std::uint32_t sign        = (bits >> 16) & 0x8000;
+    const std::uint32_t exponent    = (bits >> 23) & 0xff;
+    std::uint32_t mantissa          = bits & 0x7fffff;
+
+    // Infinity and NaN
+    if (exponent == 0xff)
+        return static_cast<std::uint16_t>(sign | 0x7c00 | (mantissa ? 0x200 : 0));
+
+    const int halfExponent = static_cast<int>(exponent) - 127 + 15;
+
+    // Overflow to infinity
+    if (halfExponent >= 31)
+        return static_cast<std::uint16_t>(sign | 0x7c00);
+
+    // Subnormal half or zero
+    if (halfExponent <= 0) {
+        if (halfExponent < -10)
+            return static_cast<std::uint16_t>(sign);
+
+        mantissa |= 0x800000;
+
+        const auto shift        = static_cast<std::uint32_t>(14 - halfExponent);
+        const auto remainder    = mantissa & ((1u << shift) - 1);
+        const auto halfway      = 1u << (shift - 1);
+
+        auto half = mantissa >> shift;
+
+        if (remainder > halfway || (remainder == halfway && (half & 1)))
+            ++half;
+
+        return static_cast<std::uint16_t>(sign | half);
+    }
+
+    auto half = sign | (static_cast<std::uint32_t>(halfExponent) << 10) | (mantissa >> 13);
+
+    // Round to nearest even; a carry into the exponent is still correct
+    const auto remainder = mantissa & 0x1fff;
+
+    if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1)))
+        ++half;
+
+    return static_cast<std::uint16_t>(half);
+}
+
+std::string HeatMapPayload::toJsonString(const std::string& text)
+{
+    std::string json;
+
+    json.reserve(text.size() + 2);
+    json.push_back('"');
+
+    for (const auto character : text) {
+        switch (character)
+        {
+            case '"':
+                json += "\\\"";
+                break;
+
+            case '\\':
+                json += "\\\\";
+                break;
+
+            default:
+            {
+                if (static_cast<unsigned char>(character) < 0x20) {
+                    char escaped[8];
+
+                    std::snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned int>(character));
+
+                    json += escaped;
+                }
+                else {
+                    json.push_back(character);
+                }
+
+                break;
+            }
+        }
+    }
+
+    json.push_back('"');
+
+    return json;
+}
+
+const std::string& HeatMapPayload::getHeader() const
+{
+    if (!_header.empty())
+        return _header;
+
+    // Appended in place, the header of a wide panel holds tens of thousands of names
+    std::size_t capacity = 64 + 48 * (_clusterNames.size() + _matrices.size()) + 4 * _dimensionNames.size();
+
+    for (const auto& name : _clusterNames)
+        capacity += name.size();
+
+    for (const auto& name : _dimensionNames)
+        capacity += name.size();
+
+    for (const auto& [key, json] : _metadata)
+        capacity += key.size() + json.size() + 4;
+
+    auto& header = _header;
+
+    header.reserve(capacity);
+    header.append("{\"clusters\":[");
+
+    for (std::size_t clusterIndex = 0; clusterIndex < _clusterNames.size(); ++clusterIndex) {
+        if (clusterIndex > 0)
+            header.push_back(',');
+
+        const auto size = clusterIndex < _clusterSizes.size() ? _clusterSizes[clusterIndex] : 0;
+
+        header.append("{\"name\":").append(toJsonString(_clusterNames[clusterIndex])).append(",\"size\":").append(std::to_string(size)).push_back('}');
+    }
+
+    header.append("],\"names\":[");
+
+    for (std::size_t dimensionIndex = 0; dimensionIndex < _dimensionNames.size(); ++dimensionIndex) {
+        if (dimensionIndex > 0)
+            header.push_back(',');
+
+        header.append(toJsonString(_dimensionNames[dimensionIndex]));
+    }
+
+    header.append("],\"matrices\":[");
+
+    std::size_t offset = 0;
+
+    for (std::size_t matrixIndex = 0; matrixIndex < _matrices.size(); ++matrixIndex) {
+        const auto& matrix = _matrices[matrixIndex];
+
+        if (matrixIndex > 0)
+            header.push_back(',');
+
+        header.append("{\"name\":").append(toJsonString(matrix.name)).append(",\"type\":\"").append(getValueTypeName(matrix.type));
+        header.append("\",\"count\":").append(std::to_string(matrix.count)).append(",\"offset\":").append(std::to_string(offset)).push_back('}');
+
+        offset += getEncodedSize(matrix);
+    }
+
+    header.push_back(']');
+
+    for (const auto& [key, json] : _metadata)
+        header.append(",").append(toJsonString(key)).append(":").append(json);
+
+    header.push_back('}');
+
+    return header;
+}
+
+std::size_t HeatMapPayload::getEncodedSize(const Matrix& matrix)
+{
+    return alignUp(matrix.count * getValueTypeSize(matrix.type));
+}
+
+}
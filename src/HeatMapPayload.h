@@ -0,0 +1,132 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace heatmap
+{
+
+/**
+ * Heatmap payload
+ *
+ * Binary message carrying the heatmap data to the web page. The layout is:
+ *
+ *   bytes [0, 4)   magic "HMB1"
+ *   bytes [4, 8)   little-endian uint32 length of the header
+ *   header         UTF-8 JSON, padded with spaces to a multiple of eight bytes
+ *   data           the matrices, each starting at a multiple of eight bytes
+ *
+ * The header holds the cluster names and sizes, the dimension names, any additional metadata
+ * fields and, per matrix, its name, element type, element count and byte offset relative to the
+ * start of the data section. The page views the matrices as typed arrays without parsing them.
+ */
+class HeatMapPayload
+{
+public:
+
+    /** Element type of a matrix in the payload */
+    enum class ValueType
+    {
+        Float32,    /** IEEE single precision */
+        Float16,    /** IEEE half precision (floats converted with round to nearest even) */
+        UInt16      /** Unsigned 16-bit integers */
+    };
+
+    /**
+     * Construct with the element type used for floating point matrices
+     * @param floatType Float32 or Float16
+     */
+    explicit HeatMapPayload(ValueType floatType = ValueType::Float32);
+
+    /**
+     * Set the clusters (columns) of the heatmap
+     * @param names Cluster names (UTF-8)
+     * @param sizes Number of points per cluster
+     */
+    void setClusters(const std::vector<std::string>& names, const std::vector<std::uint64_t>& sizes);
+
+    /**
+     * Set the dimension (row) names of the heatmap
+     * @param names Dimension names (UTF-8)
+     */
+    void setDimensionNames(const std::vector<std::string>& names);
+
+    /**
+     * Add a header field
+     * @param key Field name
+     * @param json Field value as JSON text
+     */
+    void setMetadata(const std::string& key, const std::string& json);
+
+    /**
+     * Add a floating point matrix, encoded with the float type of the payload (the values are referenced, not copied)
+     * @param name Matrix name
+     * @param values Pointer to the values
+     * @param count Number of values
+     */
+    void addMatrix(const std::string& name, const float* values, std::size_t count);
+
+    /**
+     * Add an unsigned 16-bit integer matrix (the values are referenced, not copied)
+     * @param name Matrix name
+     * @param values Pointer to the values
+     * @param count Number of values
+     */
+    void addMatrix(const std::string& name, const std::uint16_t* values, std::size_t count);
+
+    /** Get the number of bytes the encoded payload takes */
+    std::size_t getEncodedSize() const;
+
+    /**
+     * Encode the payload
+     * @param destination Buffer of at least getEncodedSize() bytes
+     */
+    void encode(char* destination) const;
+
+    /**
+     * Convert a float to IEEE half precision
+     * @param value Float value
+     * @return Half precision bits
+     */
+    static std::uint16_t toFloat16(float value);
+
+    /**
+     * Quote and escape \p text as JSON string
+     * @param text UTF-8 text
+     * @return JSON string literal
+     */
+    static std::string toJsonString(const std::string& text);
+
+private:
+
+    /** Matrix referenced by the payload */
+    struct Matrix
+    {
+        std::string     name;       /** Matrix name */
+        ValueType       type;       /** Encoded element type */
+        const void*     values;     /** Source values (float or uint16) */
+        std::size_t     count;      /** Number of values */
+    };
+
+    /** Get the JSON header (without padding), built once for getEncodedSize and encode */
+    const std::string& getHeader() const;
+
+    /**
+     * Get the number of encoded bytes of \p matrix, including padding
+     * @param matrix Matrix
+     */
+    static std::size_t getEncodedSize(const Matrix& matrix);
+
+private:
+    ValueType                                           _floatType;         /** Element type of floating point matrices */
+    std::vector<std::string>                            _clusterNames;      /** Cluster names */
+    std::vector<std::uint64_t>                          _clusterSizes;      /** Number of points per cluster */
+    std::vector<std::string>                            _dimensionNames;    /** Dimension names */
+    std::vector<std::pair<std::string, std::string>>    _metadata;          /** Additional header fields */
+    std::vector<Matrix>                                 _matrices;          /** Matrices in payload order */
+    mutable std::string                                 _header;            /** JSON header, built on first use and cleared by every change */
+};
+
+}
@@ -7,53 +7,107 @@
 #include <PointData/PointData.h>
 
 #include <actions/PluginTriggerAction.h>
+#include <util/Serialization.h>
 
+#include <QFile>
+#include <QFileDialog>
+#include <QLoggingCategory>
 #include <QtCore>
 #include <QtDebug>
-#include <QWebEnginePage>
 
-#include <cmath>
+#include <algorithm>
+#include <bit>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <span>
+#include <string>
+#include <type_traits>
 
 Q_PLUGIN_METADATA(IID "studio.manivault.HeatMapPlugin")
 
 using namespace mv;
 using namespace mv::gui;
 
+namespace
+{
+    // What each update computes and how the moments were resolved; enable with QT_LOGGING_RULES="heatmap.statistics.debug=true"
+    Q_LOGGING_CATEGORY(statisticsLog, "heatmap.statistics", QtInfoMsg)
+}
+
 // =============================================================================
 // View
 // =============================================================================
 
 HeatMapPlugin::HeatMapPlugin(const PluginFactory* factory) :
     ViewPlugin(factory),
-    _datasetsDeferredLoad(),
-    _deferredLoadTimer(),
     _points(),
-    _clusters()
+    _clusters(),
+    _settingsAction(this, "Settings"),
+    _updateTimer(),
+    _pointSelectionTimer(),
+    _generation(0),
+    _sourceRevision(0),
+    _momentsCache(),
+    _momentsCacheMutex(),
+    _statisticsTask(this, "Compute cluster statistics"),
+    _taskGeneration(0),
+    _statisticsThread(),
+    _statisticsSource(),
+    _observedDatasets(),
+    _publishedResult(),
+    _hierarchyCut(),
+    _columns(),
+    _dendrogramDimensions(),
+    _dendrogramGeneration(0),
+    _dendrogramThread(),
+    _seriationGeneration(0),
+    _seriationThread(),
+    _selectionStatistics(),
+    _selectionStatisticsRevision(0),
+    _stageTrace(std::make_shared<heatmap::StageTrace>()),
+    _restoredStatistics(),
+    _statisticsDatasets(),
+    _statisticsDatasetsParentId()
 {
     _heatmap = new HeatMapWidget();
+    _heatmap->setStageTrace(_stageTrace);
     _dropWidget = new gui::DropWidget(_heatmap);
 
-    _deferredLoadTimer.setInterval(250);
+    _updateTimer.setSingleShot(true);
+    _updateTimer.setInterval(50);
 
-    connect(&_deferredLoadTimer, &QTimer::timeout, this, [this]() -> void {
-        if (_heatmap->getPage()->isLoading())
-            return;
+    connect(&_updateTimer, &QTimer::timeout, this, &HeatMapPlugin::updateData);
 
-        _deferredLoadTimer.stop();
+    _pointSelectionTimer.setSingleShot(true);
+    _pointSelectionTimer.setInterval(30);
 
-		if (_datasetsDeferredLoad.count() >= 1 && _datasetsDeferredLoad.first()->getDataType() != PointType)
-			return;
+    connect(&_pointSelectionTimer, &QTimer::timeout, this, [this]() -> void {
+        updateSelectionOverlap();
+        updateSelectionStatistics();
+    });
+
+    _statisticsTask.setMayKill(true);
 
-		_points = Dataset<Points>(_datasetsDeferredLoad.first());
+    connect(&_statisticsTask, &Task::requestAbort, this, [this]() -> void {
+        ++_generation;
 
-		if (_datasetsDeferredLoad.count() == 2 && _datasetsDeferredLoad[1]()->getDataType() == ClusterType)
-			_clusters = Dataset<Clusters>(_datasetsDeferredLoad[1]);
+        _updateTimer.stop();
+        releaseStatisticsSource();
+
+        _statisticsTask.setAborted();
     });
 }
 
 HeatMapPlugin::~HeatMapPlugin(void)
 {
-    
+    // The background threads post results to this object, so they have to finish before the members go
+    for (auto thread : { &_dendrogramThread, &_seriationThread })
+        thread->stop();
+
+    releaseStatisticsSource();
+
+    observeDatasets({});
 }
 
 void HeatMapPlugin::init()
@@ -119,8 +173,19 @@ void HeatMapPlugin::init()
                 }
                 else {
                     dropRegions << new gui::DropWidget::DropRegion(this, "Clusters", description, "th-large", true, [this, candidateDataset]() {
+                        // The dropped clusters replace the shown ones, also in the clusterings computed together
+                        std::erase_if(_clusterings, [this](const auto& clustering) -> bool {
+                            return clustering->isValid() && _clusters.isValid() && (*clustering)->getId() == _clusters->getId();
+                        });
+
                         _clusters = candidateDataset;
                     });
+
+                    if (_clusters.isValid()) {
+                        dropRegions << new gui::DropWidget::DropRegion(this, "Compare", QString("Compute %1 together with the shown clusters, to switch between them").arg(candidateDataset->getGuiName()), "layer-group", true, [this, candidateDataset]() {
+                            addClustering(candidateDataset);
+                        });
+                    }
                 }
             }
         }
@@ -140,18 +205,55 @@ void HeatMapPlugin::init()
         //loadPoints(newDatasetName);
         _dropWidget->setShowDropIndicator(false);
         updateWindowTitle();
+
+        // Clusterings of the previous points index other points; only those of the new points (and the shown clusters) are kept
+        std::erase_if(_clusterings, [this](const auto& clustering) -> bool {
+            if (!clustering->isValid() || (_clusters.isValid() && (*clustering)->getId() == _clusters->getId()))
+                return false;
+
+            const auto parent = (*clustering)->getParent();
+
+            return !_points.isValid() || !parent.isValid() || parent->getId() != _points->getId();
+        });
+
+        updateClusteringOptions();
+
+        _selectionStatistics.reset(0, 0);
+        requestPointSelectionUpdate();
+    });
+
+    // Cached cluster statistics become invalid when the point values change
+    connect(&_points, &Dataset<Points>::dataChanged, this, [this]() {
+        ++_sourceRevision;
+        advanceContentGeneration(_points->getSourceDataset<Points>()->getId());
+        requestUpdate();
+        requestPointSelectionUpdate();
     });
 
+    // The statistics thread reads the source points without holding them, so they may only go once it has left them
+    connect(&_statisticsSource, &Dataset<Points>::aboutToBeRemoved, this, &HeatMapPlugin::releaseStatisticsSource);
+
+    // Values that changed under the statistics thread are not read any further; the update that follows recomputes them
+    connect(&_statisticsSource, &Dataset<Points>::dataChanged, this, [this]() {
+        _statisticsThread.stop();
+    });
+
+    // Show which part of every cluster is selected in linked views, and the statistics of the selected points
+    connect(&_points, &Dataset<Points>::dataSelectionChanged, this, &HeatMapPlugin::requestPointSelectionUpdate);
+
     // Load clusters when the dataset name of the clusters dataset reference changes
     connect(&_clusters, &Dataset<Clusters>::changed, this, [this, updateWindowTitle]() {
         //loadPoints(newDatasetName);
         updateWindowTitle();
-        updateData();
+        addClustering(_clusters);
+        updateClusteringOptions();
+        requestUpdate();
         });
 
     // Load clusters when the dataset name of the clusters dataset reference changes
-    connect(&_clusters, &Dataset<Clusters>::dataChanged, this, [this, updateWindowTitle]() {
-        updateData();
+    connect(&_clusters, &Dataset<Clusters>::dataChanged, this, [this]() {
+        advanceContentGeneration(_clusters->getId());
+        requestUpdate();
     });
 
     // Load clusters when the dataset name of the clusters dataset reference changes
@@ -159,6 +261,77 @@ void HeatMapPlugin::init()
 
     connect(_heatmap, &HeatMapWidget::clusterSelectionChanged, this, &HeatMapPlugin::clusterSelected);
     connect(_heatmap, &HeatMapWidget::dataSetPicked, this, &HeatMapPlugin::dataSetPicked);
+    connect(_heatmap, &HeatMapWidget::dendrogramRequested, this, &HeatMapPlugin::computeDendrogram);
+    connect(_heatmap, &HeatMapWidget::markerRankingRequested, this, &HeatMapPlugin::rankMarkers);
+    connect(_heatmap, &HeatMapWidget::pageTimingsReported, this, &HeatMapPlugin::showTimings);
+    connect(_heatmap, &HeatMapWidget::columnExpansionRequested, this, &HeatMapPlugin::expandColumn);
+    connect(_heatmap, &HeatMapWidget::columnCollapseRequested, this, &HeatMapPlugin::collapseColumn);
+
+    connect(&_settingsAction.getExportTraceAction(), &TriggerAction::triggered, this, &HeatMapPlugin::exportTrace);
+
+    // The statistics of all clusterings are cached, so switching only publishes them
+    connect(&_settingsAction.getClusteringAction(), &OptionAction::currentIndexChanged, this, [this](int index) {
+        if (index < 0 || static_cast<std::size_t>(index) >= _clusterings.size() || !_clusterings[index]->isValid())
+            return;
+
+        if (!_clusters.isValid() || (*_clusterings[index])->getId() != _clusters->getId())
+            _clusters = *_clusterings[index];
+    });
+
+    // The budget applies to the statistics of all views; the view whose budget changed last sets it
+    connect(&_settingsAction.getSharedCacheBudgetAction(), &IntegralAction::valueChanged, this, [this]() {
+        getSharedStatistics().setMemoryBudget(_settingsAction.getSharedCacheBudget());
+        getSharedCorrelations().setMemoryBudget(_settingsAction.getSharedCacheBudget());
+        getSharedSeriations().setMemoryBudget(_settingsAction.getSharedCacheBudget());
+    });
+
+    connect(&_settingsAction.getPrecisionAction(), &OptionAction::currentIndexChanged, this, &HeatMapPlugin::requestUpdate);
+    connect(&_settingsAction.getExpressionThresholdAction(), &DecimalAction::valueChanged, this, &HeatMapPlugin::requestUpdate);
+
+    // Cached moments make re-sending with another transfer precision cheap
+    connect(&_settingsAction.getTransferPrecisionAction(), &OptionAction::currentIndexChanged, this, [this]() {
+        _heatmap->setPayloadFloatType(_settingsAction.getTransferFloatType());
+        requestUpdate();
+    });
+
+    connect(&_settingsAction.getPublishStatisticsAction(), &ToggleAction::toggled, this, &HeatMapPlugin::publishDatasets);
+
+    connect(&_settingsAction.getDistributionsAction(), &ToggleAction::toggled, this, &HeatMapPlugin::requestUpdate);
+    connect(&_settingsAction.getNumHistogramBinsAction(), &IntegralAction::valueChanged, this, &HeatMapPlugin::requestUpdate);
+    connect(&_settingsAction.getQuantilesAction(), &StringAction::stringChanged, this, &HeatMapPlugin::requestUpdate);
+
+    // All statistics are sent to the page already, so a different color by statistic only needs re-sending
+    connect(&_settingsAction.getColorByAction(), &OptionAction::currentIndexChanged, this, [this]() {
+        _heatmap->setColorBy(_settingsAction.getColorBy());
+        showStatistics();
+    });
+
+    // Transformed statistics are cached in the widget, so switching transforms only re-sends them
+    connect(&_settingsAction.getTransformAction(), &OptionAction::currentIndexChanged, this, [this]() {
+        _heatmap->setValueTransform(_settingsAction.getValueTransform());
+        computeRowOrder();
+    });
+
+    connect(&_settingsAction.getCellRenderingAction(), &OptionAction::currentIndexChanged, this, [this]() {
+        _heatmap->setCellRendering(_settingsAction.getCellRendering());
+        showStatistics();
+    });
+
+    // The cached moments make rebuilding the super-clusters cheap
+    connect(&_settingsAction.getMaxColumnsAction(), &IntegralAction::valueChanged, this, &HeatMapPlugin::requestUpdate);
+
+    const auto updateDendrogram = [this]() -> void {
+        if (!_dendrogramDimensions.empty())
+            computeDendrogram(_dendrogramDimensions);
+    };
+
+    connect(&_settingsAction.getLinkageAction(), &OptionAction::currentIndexChanged, this, updateDendrogram);
+    connect(&_settingsAction.getDistanceMetricAction(), &OptionAction::currentIndexChanged, this, updateDendrogram);
+
+    connect(&_settingsAction.getRowOrderAction(), &OptionAction::currentIndexChanged, this, &HeatMapPlugin::computeRowOrder);
+    connect(&_settingsAction.getRowLinkageAction(), &OptionAction::currentIndexChanged, this, &HeatMapPlugin::computeRowOrder);
+
+    getPrimaryToolbarAction().addAction(&_settingsAction);
 
     // Add widgets to plugin layout
     auto layout = new QVBoxLayout();
@@ -171,9 +344,32 @@ void HeatMapPlugin::init()
 
 void HeatMapPlugin::loadData(const mv::Datasets& datasets)
 {
-    _datasetsDeferredLoad = datasets;
+    if (datasets.isEmpty() || datasets.first()->getDataType() != PointType)
+        return;
+
+    // The widget keeps the statistics until its web page is loaded, so they are computed while the page loads
+    _points = Dataset<Points>(datasets.first());
+
+    // The first clusters dataset is shown, further ones are computed in the same pass
+    bool isFirstClusters = true;
+
+    for (qsizetype datasetIndex = 1; datasetIndex < datasets.count(); ++datasetIndex) {
+        if (datasets[datasetIndex]->getDataType() != ClusterType)
+            continue;
+
+        if (isFirstClusters)
+            _clusters = Dataset<Clusters>(datasets[datasetIndex]);
+        else
+            addClustering(Dataset<Clusters>(datasets[datasetIndex]));
 
-    _deferredLoadTimer.start();
+        isFirstClusters = false;
+    }
+
+    // Start right away instead of waiting for the coalescing interval
+    if (_updateTimer.isActive()) {
+        _updateTimer.stop();
+        updateData();
+    }
 }
 
 // TODO: remove this, it is not connected and does nothing
@@ -187,18 +383,107 @@ void HeatMapPlugin::onDataEvent(mv::DatasetEvent* dataEvent)
     // Event which gets triggered when the data contained in a dataset changes.
     if (dataEvent->getType() == EventType::DatasetDataChanged)
     {
-        updateData();
+        requestUpdate();
     }
 }
 
+void HeatMapPlugin::fromVariantMap(const QVariantMap& variantMap)
+{
+    ViewPlugin::fromVariantMap(variantMap);
+
+    _settingsAction.fromParentVariantMap(variantMap);
+
+    // The statistics are only used once the fingerprint of the loaded data matches
+    if (variantMap.contains("ClusterStatistics") && variantMap.contains("ClusterStatisticsSize")) {
+        auto archive = std::make_shared<std::vector<char>>(variantMap["ClusterStatisticsSize"].toULongLong());
+
+        populateDataBufferFromVariantMap(variantMap["ClusterStatistics"].toMap(), archive->data());
+
+        _restoredStatistics = std::move(archive);
+    }
+
+    if (variantMap.contains("PointsDatasetId"))
+        _points = mv::data().getDataset<Points>(variantMap["PointsDatasetId"].toString());
+
+    if (variantMap.contains("ClustersDatasetId"))
+        _clusters = mv::data().getDataset<Clusters>(variantMap["ClustersDatasetId"].toString());
+
+    for (const auto& clusteringId : variantMap.value("ClusteringDatasetIds").toStringList())
+        addClustering(mv::data().getDataset<Clusters>(clusteringId));
+
+    // Statistics datasets saved with the project are updated instead of created again
+    const auto statisticsDatasetIds = variantMap.value("StatisticsDatasetIds").toStringList();
+
+    for (qsizetype statisticIndex = 0; statisticIndex < statisticsDatasetIds.size() && statisticIndex < static_cast<qsizetype>(_statisticsDatasets.size()); ++statisticIndex)
+        if (!statisticsDatasetIds[statisticIndex].isEmpty())
+            _statisticsDatasets[statisticIndex] = mv::data().getDataset<Points>(statisticsDatasetIds[statisticIndex]);
+
+    _statisticsDatasetsParentId = variantMap.value("StatisticsDatasetsParentId").toString();
+}
+
+QVariantMap HeatMapPlugin::toVariantMap() const
+{
+    auto variantMap = ViewPlugin::toVariantMap();
+
+    _settingsAction.insertIntoVariantMap(variantMap);
+
+    if (_points.isValid())
+        variantMap.insert("PointsDatasetId", _points->getId());
+
+    if (_clusters.isValid())
+        variantMap.insert("ClustersDatasetId", _clusters->getId());
+
+    QStringList clusteringIds;
+
+    for (const auto& clustering : _clusterings)
+        if (clustering->isValid())
+            clusteringIds << (*clustering)->getId();
+
+    variantMap.insert("ClusteringDatasetIds", clusteringIds);
+
+    QStringList statisticsDatasetIds;
+
+    for (const auto& statisticsDataset : _statisticsDatasets)
+        statisticsDatasetIds << (statisticsDataset.isValid() ? statisticsDataset->getId() : QString());
+
+    variantMap.insert("StatisticsDatasetIds", statisticsDatasetIds);
+    variantMap.insert("StatisticsDatasetsParentId", _statisticsDatasetsParentId);
+
+    // Saved as a binary block of the project; statistics restored but not yet used are saved as they were
+    const auto archive = _publishedResult ? heatmap::encodeStatisticsArchive(_publishedResult->fingerprint, _publishedResult->moments) : (_restoredStatistics ? *_restoredStatistics : std::vector<char>());
+
+    if (!archive.empty()) {
+        variantMap.insert("ClusterStatistics", rawDataToVariantMap(archive.data(), archive.size(), true));
+        variantMap.insert("ClusterStatisticsSize", QVariant::fromValue(static_cast<qulonglong>(archive.size())));
+    }
+
+    return variantMap;
+}
+
 void HeatMapPlugin::dataSetPicked(const QString& name)
 {
-    updateData();
+    requestUpdate();
 }
 
 void HeatMapPlugin::clusterSelected(const std::vector<std::uint32_t>& selectedClusters)
 {
-    _clusters->setSelectionIndices(selectedClusters);
+    // The heatmap selects columns, a selected super-cluster selects all of its clusters
+    if (_hierarchyCut.empty()) {
+        _clusters->setSelectionIndices(selectedClusters);
+    }
+    else {
+        const auto& hierarchy   = _hierarchyCut.getHierarchy();
+        const auto& nodes       = _hierarchyCut.getNodes();
+
+        std::vector<std::uint32_t> clusters;
+
+        for (const auto column : selectedClusters)
+            if (column < nodes.size())
+                std::ranges::copy(hierarchy.getClusters(nodes[column]), std::back_inserter(clusters));
+
+        _clusters->setSelectionIndices(clusters);
+    }
+
     events().notifyDatasetDataSelectionChanged(_clusters);
 }
 
@@ -206,99 +491,941 @@ void HeatMapPlugin::selectClusters()
 {
     const auto& selectionIndices = _clusters->getSelectionIndices();
 
-    QList<int> selection(_clusters->getClusters().size(), 0);
+    const auto numClusters = static_cast<std::size_t>(_clusters->getClusters().size());
+
+    // A super-cluster is selected when any of its clusters is
+    const auto clusterColumns = _hierarchyCut.getClusterColumns();
+
+    if (!_hierarchyCut.empty() && clusterColumns.size() != numClusters)
+        return;
+
+    QList<int> selection(_hierarchyCut.empty() ? numClusters : _hierarchyCut.getNodes().size(), 0);
     for (const auto& selectionIndex : selectionIndices)
-        selection[selectionIndex] = 1;
+        if (selectionIndex < numClusters)
+            selection[_hierarchyCut.empty() ? selectionIndex : clusterColumns[selectionIndex]] = 1;
 
     _heatmap->setSelection(selection);
 }
 
+heatmap::SharedCache<HeatMapPlugin::StatisticsResult>& HeatMapPlugin::getSharedStatistics()
+{
+    static heatmap::SharedCache<StatisticsResult> sharedStatistics([](const StatisticsResult& result) -> std::size_t {
+        // Moments hold three doubles and a 64-bit count per dimension
+        std::size_t memorySize = (result.moments.size() + result.clusteringMoments.size()) * result.numDimensions * 4 * sizeof(double);
+
+        for (const auto& matrix : { result.means, result.standardDeviations, result.fractions, result.expressingMeans })
+            if (matrix != nullptr)
+                memorySize += matrix->size() * sizeof(float);
+
+        if (result.distributions != nullptr)
+            memorySize += result.distributions->quantiles.size() * sizeof(float) + result.distributions->histograms.size() * sizeof(std::uint16_t);
+
+        if (result.pointLabels != nullptr)
+            memorySize += result.pointLabels->getNumPoints() * sizeof(std::uint32_t);
+
+        return memorySize;
+    }, std::size_t{ 2048 } * 1024 * 1024);
+
+    return sharedStatistics;
+}
+
+heatmap::SharedCache<heatmap::DimensionCorrelations>& HeatMapPlugin::getSharedCorrelations()
+{
+    static heatmap::SharedCache<heatmap::DimensionCorrelations> sharedCorrelations([](const heatmap::DimensionCorrelations& correlations) -> std::size_t {
+        return correlations.distances.size() * sizeof(float) + correlations.dimensions.size() * sizeof(std::uint32_t) + correlations.attached.size() * sizeof(heatmap::AttachedDimension);
+    }, std::size_t{ 2048 } * 1024 * 1024);
+
+    return sharedCorrelations;
+}
+
+heatmap::SharedCache<heatmap::DimensionSeriation>& HeatMapPlugin::getSharedSeriations()
+{
+    static heatmap::SharedCache<heatmap::DimensionSeriation> sharedSeriations([](const heatmap::DimensionSeriation& seriation) -> std::size_t {
+        return seriation.order.size() * sizeof(std::uint32_t) + seriation.merges.size() * sizeof(heatmap::DendrogramMerge);
+    }, std::size_t{ 2048 } * 1024 * 1024);
+
+    return sharedSeriations;
+}
+
+std::uint64_t& HeatMapPlugin::getContentGeneration(const QString& datasetId)
+{
+    // Only used on the GUI thread, where the data change notifications arrive
+    static QHash<QString, std::uint64_t> contentGenerations;
+
+    return contentGenerations[datasetId];
+}
+
+void HeatMapPlugin::advanceContentGeneration(const QString& datasetId)
+{
+    ++getContentGeneration(datasetId);
+
+    // Every shared key names the datasets it was computed from, and results of an old generation are never asked for again
+    const auto id = datasetId.toStdString();
+
+    const auto isStale = [&id](const std::string& key) -> bool {
+        return key.find(id) != std::string::npos;
+    };
+
+    getSharedStatistics().removeIf(isStale);
+    getSharedCorrelations().removeIf(isStale);
+    getSharedSeriations().removeIf(isStale);
+}
+
+void HeatMapPlugin::observeDatasets(const QSet<QString>& datasetIds)
+{
+    // Number of views observing every dataset
+    static QHash<QString, std::size_t> numObservers;
+
+    for (const auto& datasetId : datasetIds)
+        if (!_observedDatasets.contains(datasetId))
+            ++numObservers[datasetId];
+
+    for (const auto& datasetId : _observedDatasets) {
+        if (datasetIds.contains(datasetId) || --numObservers[datasetId] > 0)
+            continue;
+
+        // Changes from now on go unseen, so a view observing the dataset later has to compute its results anew
+        numObservers.remove(datasetId);
+        advanceContentGeneration(datasetId);
+    }
+
+    _observedDatasets = datasetIds;
+}
+
+void HeatMapPlugin::requestUpdate()
+{
+    // Results of computations that are still running are stale from now on
+    ++_generation;
+
+    cancelUpdate();
+
+    _updateTimer.start();
+}
+
+void HeatMapPlugin::cancelUpdate()
+{
+    _statisticsThread.requestStop();
+}
+
+void HeatMapPlugin::releaseStatisticsSource()
+{
+    _statisticsThread.stop();
+
+    if (_statisticsSource.isValid())
+        _statisticsSource->unlock();
+
+    _statisticsSource = Dataset<Points>();
+}
+
+void HeatMapPlugin::abortStatisticsTask(std::uint64_t generation)
+{
+    if (generation == _taskGeneration && _statisticsTask.isRunning())
+        _statisticsTask.setAborted();
+}
+
 void HeatMapPlugin::updateData()
 {
-    if (!_points.isValid() || !_clusters.isValid())
+    // The computation that was cancelled for this update is not followed by another one
+    if (!_points.isValid() || !_clusters.isValid()) {
+        releaseStatisticsSource();
+        observeDatasets({});
+        abortStatisticsTask(_taskGeneration);
         return;
+    }
 
     const auto source = _points->getSourceDataset<Points>();
 
-    const int numDimensions = source->getNumDimensions();
-    const int numPoints = source->getNumPoints();
-    QVector<Cluster>& clusters = _clusters->getClusters();  // NOT const
-    const int numClusters = clusters.size();
+    // Computations of other points have to leave those before they are unlocked; the source is locked while it is read
+    if (_statisticsSource.isValid() && _statisticsSource->getId() != source->getId())
+        releaseStatisticsSource();
+
+    if (!_statisticsSource.isValid()) {
+        _statisticsSource = source;
+        _statisticsSource->lock();
+    }
+
+    const auto update       = _stageTrace->beginUpdate();
+    const auto snapshotBegin = _stageTrace->now();
+
+    StatisticsInput input;
+
+    input.traceUpdate = update;
+    input.restoredStatistics = _restoredStatistics;
+
+    input.source    = source.get();
+    input.precision = _settingsAction.getAccumulationPrecision();
+    input.expressionThreshold = _settingsAction.getExpressionThreshold();
+    input.memoryBudget = _settingsAction.getMemoryBudget();
+    input.computeDistributions = _settingsAction.getComputeDistributions();
+    input.numHistogramBins = _settingsAction.getNumHistogramBins();
+    input.quantileLevels = _settingsAction.getQuantileLevels();
+    input.maxColumns = _settingsAction.getMaxColumns();
+
+    // The content generations of the data computed from are kept current while this view observes it
+    QSet<QString> datasetIds = { source->getId(), _clusters->getId() };
+
+    for (const auto& clustering : _clusterings)
+        if (clustering->isValid())
+            datasetIds.insert((*clustering)->getId());
+
+    observeDatasets(datasetIds);
+
+    // Cached cluster statistics are only valid for the same source data (revision and content generation), precision and expression threshold
+    input.contextKey = std::hash<std::string>{}(QString("%1:%2:%3:%4:%5").arg(source->getId(), QString::number(_sourceRevision), QString::number(getContentGeneration(source->getId())), QString::number(static_cast<int>(input.precision)), QString::number(input.expressionThreshold)).toStdString());
+
+    // Views of the same data with the same result settings share one computation and its result
+    QStringList sharedKey = { source->getId(), _clusters->getId(), QString::number(getContentGeneration(source->getId())), QString::number(getContentGeneration(_clusters->getId())) };
+
+    sharedKey << QString::number(static_cast<int>(input.precision)) << QString::number(input.expressionThreshold) << QString::number(input.maxColumns);
+
+    if (input.computeDistributions) {
+        sharedKey << QString::number(input.numHistogramBins);
+
+        for (const auto level : input.quantileLevels)
+            sharedKey << QString::number(level);
+    }
+
+    for (const auto& cluster : _clusters->getClusters())
+        input.clusterIndices.push_back(cluster.getIndices());
+
+    input.numShownClusters = input.clusterIndices.size();
+
+    // The other clusterings share the pass over the point values and stay cached for switching
+    for (const auto& clustering : _clusterings) {
+        if (!clustering->isValid() || (*clustering)->getId() == _clusters->getId())
+            continue;
+
+        for (const auto& cluster : (*clustering)->getClusters())
+            input.clusterIndices.push_back(cluster.getIndices());
+
+        sharedKey << (*clustering)->getId() << QString::number(getContentGeneration((*clustering)->getId()));
+    }
+
+    input.sharedKey = sharedKey.join(":").toStdString();
+
+    if (source->getDimensionNames().size() == source->getNumDimensions())
+        input.dimensionNames = source->getDimensionNames();
+
+    input.clusterNames = _clusters->getClusterNames();
+
+    qCDebug(statisticsLog) << "Heatmap: Calculating data...";
+
+    qCDebug(statisticsLog) << "Point data: " << source->getGuiName();
+    qCDebug(statisticsLog) << "Point data: " << _clusters->getGuiName();
+    qCDebug(statisticsLog) << "Num dimensions: " << source->getNumDimensions();
+    qCDebug(statisticsLog) << "Num clusters: " << input.numShownClusters << "with other clusterings:" << input.clusterIndices.size();
+
+    const auto generation = _generation;
+
+    _stageTrace->addSpan("snapshot", "plugin", update, snapshotBegin, _stageTrace->now());
+
+    _taskGeneration = generation;
+
+    _statisticsTask.setRunning();
+    _statisticsTask.setProgress(0.0f);
+
+    // The previous computation has been asked to stop already and finishes on its own
+    _statisticsThread.start([this, generation, input = std::move(input)](std::stop_token stopToken) -> void {
+        const auto reportProgress = [this, generation](float progress) -> void {
+            QMetaObject::invokeMethod(this, [this, generation, progress]() -> void {
+                if (generation == _generation)
+                    _statisticsTask.setProgress(progress);
+            }, Qt::QueuedConnection);
+        };
+
+        // Another view computing the same statistics is waited for instead of computing them twice
+        bool isComputed = false;
+
+        const auto result = getSharedStatistics().get(input.sharedKey, [&]() -> std::shared_ptr<const StatisticsResult> {
+            isComputed = true;
+
+            auto computed = std::make_shared<const StatisticsResult>(computeStatistics(input, stopToken, reportProgress));
+
+            return stopToken.stop_requested() ? nullptr : computed;
+        }, stopToken);
+
+        if (stopToken.stop_requested() || result == nullptr) {
+            QMetaObject::invokeMethod(this, [this, generation]() -> void {
+                abortStatisticsTask(generation);
+            }, Qt::QueuedConnection);
+
+            return;
+        }
+
+        // Moments computed by another view seed the cache of this view, so that its next update only scans changed clusters
+        if (!isComputed) {
+            const std::vector<std::span<const std::uint32_t>> clusterIndices(input.clusterIndices.begin(), input.clusterIndices.end());
+
+            auto moments = result->moments;
+
+            moments.insert(moments.end(), result->clusteringMoments.begin(), result->clusteringMoments.end());
+
+            const std::lock_guard momentsCacheLock(_momentsCacheMutex);
+
+            _momentsCache.assign(input.contextKey, clusterIndices, moments);
+        }
+
+        QMetaObject::invokeMethod(this, [this, generation, result]() -> void {
+            // The source stays locked for the computation of a newer generation
+            if (generation == _generation)
+                releaseStatisticsSource();
+
+            publishStatistics(generation, result);
+        }, Qt::QueuedConnection);
+    });
+}
 
-    const bool sourceIsProxy = source->isProxy();
+void HeatMapPlugin::addClustering(const mv::Dataset<Clusters>& clusters)
+{
+    if (!clusters.isValid())
+        return;
+
+    for (const auto& clustering : _clusterings)
+        if (clustering->isValid() && (*clustering)->getId() == clusters->getId())
+            return;
+
+    auto& clustering = _clusterings.emplace_back(std::make_unique<Dataset<Clusters>>(clusters));
+
+    connect(clustering.get(), &Dataset<Clusters>::dataChanged, this, [this, clusteringId = clusters->getId()]() {
+        advanceContentGeneration(clusteringId);
+        requestUpdate();
+    });
+
+    updateClusteringOptions();
+    requestUpdate();
+}
+
+void HeatMapPlugin::updateClusteringOptions()
+{
+    // Clusterings that were removed from the data hierarchy are dropped
+    std::erase_if(_clusterings, [](const auto& clustering) -> bool {
+        return !clustering->isValid();
+    });
+
+    QStringList options;
+
+    int currentIndex = -1;
+
+    for (std::size_t clusteringIndex = 0; clusteringIndex < _clusterings.size(); ++clusteringIndex) {
+        const auto& clustering = *_clusterings[clusteringIndex];
+
+        options << clustering->getGuiName();
+
+        if (_clusters.isValid() && clustering->getId() == _clusters->getId())
+            currentIndex = static_cast<int>(clusteringIndex);
+    }
+
+    auto& clusteringAction = _settingsAction.getClusteringAction();
+
+    // Setting the options must not switch the shown clusters
+    const QSignalBlocker signalBlocker(&clusteringAction);
+
+    clusteringAction.setOptions(options);
+    clusteringAction.setCurrentIndex(currentIndex);
+}
+
+HeatMapPlugin::StatisticsResult HeatMapPlugin::computeStatistics(const StatisticsInput& input, std::stop_token stopToken, const heatmap::ClusterStatisticsEngine::ProgressCallback& progressCallback)
+{
+    const auto source = input.source;
+
+    const std::size_t numDimensions = source->getNumDimensions();
+    const std::size_t numPoints = source->getNumPoints();
+
+    // Proxies only provide their values per dimension, so they are streamed in chunks of dimensions
+    const auto extractColumn = [source](std::size_t dimension, std::vector<float>& column) -> void {
+        source->extractDataForDimension(column, static_cast<int>(dimension));
+    };
+
+    // In distribution mode the moments take the first half of the progress
+    const heatmap::ClusterStatisticsEngine::ProgressCallback reportMomentsProgress = [&](float progress) -> void {
+        progressCallback(input.computeDistributions ? 0.5f * progress : progress);
+    };
 
-    std::vector<float> groupedValues;
-    groupedValues.resize(static_cast<size_t>(numDimensions) * numPoints);
+    // Only the clusters that are not cached (and cannot be merged from cached clusters) are computed from the point values
+    const auto computeMoments = [&](const std::vector<std::span<const std::uint32_t>>& clusterIndices) -> std::vector<heatmap::ClusterMoments> {
+        const heatmap::ClusterStatisticsEngine engine(input.precision, input.expressionThreshold);
 
-    if (sourceIsProxy) {
-        std::vector<float> dimValues;
+        if (source->isProxy())
+            return engine.computeFromColumns(numPoints, numDimensions, clusterIndices, extractColumn, input.memoryBudget, stopToken, reportMomentsProgress);
 
-        for (int dim = 0; dim < numDimensions; dim++) {
-            source->extractDataForDimension(dimValues, dim);
+        // Other data is read in place in its stored element type; the kernel is selected once per dataset
+        std::vector<heatmap::ClusterMoments> moments;
 
-            for (size_t i = 0; i < numPoints; ++i) {
-                groupedValues[i * dim] = dimValues[i];
+        source->constVisitFromBeginToEnd([&](auto begin, auto end) -> void {
+            using ElementType = std::remove_cvref_t<decltype(*begin)>;
+
+            const ElementType* values = begin != end ? std::to_address(begin) : nullptr;
+
+            moments = engine.compute(values, numPoints, numDimensions, clusterIndices, stopToken, reportMomentsProgress);
+        });
+
+        return moments;
+    };
+
+    // The other clusterings are only part of the moments pass; everything else is about the shown clusters
+    const std::vector<std::span<const std::uint32_t>> allClusterIndices(input.clusterIndices.begin(), input.clusterIndices.end());
+    const std::vector<std::span<const std::uint32_t>> clusterIndices(allClusterIndices.begin(), allClusterIndices.begin() + input.numShownClusters);
+
+    StatisticsResult result;
+
+    result.sharedKey = input.sharedKey;
+
+    // Sampled point values and hashed index sets identify the input without reading all point values
+    {
+        heatmap::StageTrace::Scope fingerprintScope(*_stageTrace, "fingerprint", input.traceUpdate);
+
+        const auto sample = heatmap::getFingerprintSample(numPoints, numDimensions);
+
+        std::vector<float> sampleValues;
+
+        if (source->isProxy()) {
+            std::vector<float> column;
+
+            for (const auto dimension : sample.dimensions) {
+                extractColumn(dimension, column);
+
+                for (const auto point : sample.points)
+                    sampleValues.push_back(point < column.size() ? column[point] : 0.f);
             }
         }
+        else {
+            source->constVisitFromBeginToEnd([&](auto begin, auto end) -> void {
+                using ElementType = std::remove_cvref_t<decltype(*begin)>;
+
+                const ElementType* values = begin != end ? std::to_address(begin) : nullptr;
+
+                sampleValues = heatmap::readFingerprintSample(values, numDimensions, sample);
+            });
+        }
+
+        const auto seed = static_cast<std::uint64_t>(input.precision) | (static_cast<std::uint64_t>(std::bit_cast<std::uint32_t>(input.expressionThreshold)) << 32);
+
+        result.fingerprint = heatmap::fingerprintStatisticsInput(numPoints, numDimensions, sampleValues, clusterIndices, seed);
     }
 
-    auto getSourceValue = [&source, &groupedValues, sourceIsProxy](int index, int numDimensions, int d) -> float {
-        const size_t pos = static_cast<size_t>(index) * numDimensions + d;
-        if (sourceIsProxy)
-            return groupedValues[pos];
-        else
-            return source->getValueAt(pos);
-        };
+    // A retired computation that could not be interrupted may still be using the cache
+    std::unique_lock momentsCacheLock(_momentsCacheMutex);
+
+    // Statistics saved with the project seed the cache, so none of the clusters are computed again
+    heatmap::StatisticsArchiveHeader archiveHeader;
+
+    if (input.restoredStatistics && heatmap::readStatisticsArchiveHeader(*input.restoredStatistics, archiveHeader) && archiveHeader.fingerprint == result.fingerprint && archiveHeader.numDimensions == numDimensions) {
+        std::vector<heatmap::ClusterMomentsCache::MomentsPointer> restoredMoments;
+
+        if (heatmap::decodeStatisticsArchive(*input.restoredStatistics, restoredMoments)) {
+            _momentsCache.assign(input.contextKey, clusterIndices, restoredMoments);
+
+            qCDebug(statisticsLog) << "Using the cluster statistics saved with the project";
+        }
+    }
+
+    {
+        heatmap::StageTrace::Scope momentsScope(*_stageTrace, "moments", input.traceUpdate);
+
+        result.moments = _momentsCache.update(input.contextKey, numPoints, allClusterIndices, computeMoments, stopToken);
+
+        if (result.moments.size() > input.numShownClusters)
+            result.clusteringMoments.assign(result.moments.begin() + input.numShownClusters, result.moments.end());
+
+        result.moments.resize(input.numShownClusters);
+    }
+
+    const auto summary = _momentsCache.getLastUpdateSummary();
+
+    momentsCacheLock.unlock();
+
+    // The widget colors, sorts, transforms and encodes these matrices in place
+    {
+        heatmap::StageTrace::Scope matricesScope(*_stageTrace, "matrices", input.traceUpdate);
+
+        result.means                = std::make_shared<const heatmap::StatisticsMatrix>(heatmap::gatherMomentStatistic(result.moments, numDimensions, heatmap::MomentStatistic::Mean));
+        result.standardDeviations   = std::make_shared<const heatmap::StatisticsMatrix>(heatmap::gatherMomentStatistic(result.moments, numDimensions, heatmap::MomentStatistic::StandardDeviation));
+        result.fractions            = std::make_shared<const heatmap::StatisticsMatrix>(heatmap::gatherMomentStatistic(result.moments, numDimensions, heatmap::MomentStatistic::PositiveFraction));
+        result.expressingMeans      = std::make_shared<const heatmap::StatisticsMatrix>(heatmap::gatherMomentStatistic(result.moments, numDimensions, heatmap::MomentStatistic::ExpressingMean));
+
+        for (const auto& indices : clusterIndices)
+            result.clusterSizes.push_back(indices.size());
+    }
+
+    // Over-clustered data is shown as super-clusters, merged from the moments of their clusters
+    if (input.maxColumns > 0 && input.numShownClusters > input.maxColumns && !stopToken.stop_requested()) {
+        heatmap::StageTrace::Scope hierarchyScope(*_stageTrace, "hierarchy", input.traceUpdate);
+
+        auto hierarchy = std::make_shared<const heatmap::ClusterHierarchy>(heatmap::buildClusterHierarchy(*result.means, numHierarchyDimensions, stopToken));
+
+        if (hierarchy->getNumClusters() == input.numShownClusters)
+            result.hierarchyCut = heatmap::HierarchyCut(std::move(hierarchy), result.moments, input.maxColumns);
+    }
+
+    {
+        heatmap::StageTrace::Scope labelsScope(*_stageTrace, "labels", input.traceUpdate);
+
+        result.pointLabels = std::make_shared<const heatmap::PointClusterLabels>(numPoints, clusterIndices);
+    }
+
+    result.numDimensions    = numDimensions;
+    result.dimensionNames   = input.dimensionNames;
+    result.clusterNames     = input.clusterNames;
+
+    qCDebug(statisticsLog) << "Cluster statistics reused:" << summary.numReused << "merged:" << summary.numMerged << "computed:" << summary.numComputed;
+
+    if (!input.computeDistributions || stopToken.stop_requested())
+        return result;
+
+    // Distributions are not cached, all clusters are binned in one parallel pass
+    const heatmap::ClusterDistributionEngine distributionEngine(input.numHistogramBins, input.quantileLevels);
+
+    const heatmap::ClusterDistributionEngine::ProgressCallback reportDistributionProgress = [&](float progress) -> void {
+        progressCallback(0.5f + 0.5f * progress);
+    };
+
+    heatmap::StageTrace::Scope distributionsScope(*_stageTrace, "distributions", input.traceUpdate);
+
+    if (source->isProxy()) {
+        result.distributions = std::make_shared<const heatmap::ClusterDistributions>(distributionEngine.computeFromColumns(numPoints, numDimensions, clusterIndices, extractColumn, input.memoryBudget, stopToken, reportDistributionProgress));
+    }
+    else {
+        source->constVisitFromBeginToEnd([&](auto begin, auto end) -> void {
+            using ElementType = std::remove_cvref_t<decltype(*begin)>;
 
-    qDebug() << "Heatmap: Calculating data...";
+            const ElementType* values = begin != end ? std::to_address(begin) : nullptr;
 
-    qDebug() << "Point data: " << source->getGuiName();
-    qDebug() << "Point data: " << _clusters->getGuiName();
-    qDebug() << "Num dimensions: " << numDimensions;
-    qDebug() << "Num clusters: " << numClusters;
+            result.distributions = std::make_shared<const heatmap::ClusterDistributions>(distributionEngine.compute(values, numPoints, numDimensions, clusterIndices, stopToken, reportDistributionProgress));
+        });
+    }
+
+    return result;
+}
+
+void HeatMapPlugin::publishStatistics(std::uint64_t generation, std::shared_ptr<const StatisticsResult> result)
+{
+    // Discard results of data that changed while computing
+    if (generation != _generation || !_clusters.isValid()) {
+        abortStatisticsTask(generation);
+        return;
+    }
+
+    // The statistics are shown from the result; the clusters dataset is left untouched
+    if (static_cast<std::size_t>(_clusters->getClusters().size()) != result->moments.size()) {
+        abortStatisticsTask(generation);
+        return;
+    }
+
+    const auto publishBegin = _stageTrace->now();
+
+    qCDebug(statisticsLog) << "Done calculating data.";
+
+    _publishedResult = std::move(result);
+    _restoredStatistics.reset();
+
+    _hierarchyCut = _publishedResult->hierarchyCut;
+
+    updateColumns();
+
+    // Dendrograms of the previous statistics are stale; the page requests a new one with the data
+    ++_dendrogramGeneration;
+
+    showStatistics();
+    computeRowOrder();
+    updateSelectionOverlap();
+    publishDatasets();
+
+    _stageTrace->addSpan("publish", "plugin", _stageTrace->getCurrentUpdate(), publishBegin, _stageTrace->now());
+
+    showTimings();
+
+    _statisticsTask.setFinished();
+}
+
+void HeatMapPlugin::updateColumns()
+{
+    if (!_publishedResult)
+        return;
+
+    ColumnStatistics columns;
+
+    // Without super-clusters the columns share the statistics of the clusters
+    if (_hierarchyCut.empty()) {
+        columns.moments             = _publishedResult->moments;
+        columns.means               = _publishedResult->means;
+        columns.standardDeviations  = _publishedResult->standardDeviations;
+        columns.fractions           = _publishedResult->fractions;
+        columns.expressingMeans     = _publishedResult->expressingMeans;
+        columns.sizes               = _publishedResult->clusterSizes;
+        columns.names               = _publishedResult->clusterNames;
+        columns.distributions       = _publishedResult->distributions;
+
+        _columns = std::move(columns);
+        return;
+    }
 
-    // For every cluster initialize the median, mean, and stddev vectors with the number of dimensions
-    for (int i = 0; i < numClusters; i++) {
-        Cluster& cluster = clusters[i];
+    const auto& hierarchy       = _hierarchyCut.getHierarchy();
+    const auto& clusterSizes    = _publishedResult->clusterSizes;
+    const auto& clusterNames    = _publishedResult->clusterNames;
+    const auto numDimensions    = _publishedResult->numDimensions;
 
-        // Cluster statistics
-        auto& means = cluster.getMean();
-        auto& stddevs = cluster.getStandardDeviation();
-        auto& indices = cluster.getIndices();
+    // Only as many rows as there are columns, so this stays cheap for any number of clusters
+    columns.moments             = _hierarchyCut.getMoments();
+    columns.means               = std::make_shared<const heatmap::StatisticsMatrix>(heatmap::gatherMomentStatistic(columns.moments, numDimensions, heatmap::MomentStatistic::Mean));
+    columns.standardDeviations  = std::make_shared<const heatmap::StatisticsMatrix>(heatmap::gatherMomentStatistic(columns.moments, numDimensions, heatmap::MomentStatistic::StandardDeviation));
+    columns.fractions           = std::make_shared<const heatmap::StatisticsMatrix>(heatmap::gatherMomentStatistic(columns.moments, numDimensions, heatmap::MomentStatistic::PositiveFraction));
+    columns.expressingMeans     = std::make_shared<const heatmap::StatisticsMatrix>(heatmap::gatherMomentStatistic(columns.moments, numDimensions, heatmap::MomentStatistic::ExpressingMean));
+    columns.groups              = _hierarchyCut.getColumnGroups();
 
-        means.resize(numDimensions);
-        stddevs.resize(numDimensions);
+    // Super-clusters are named after their largest cluster
+    for (const auto node : _hierarchyCut.getNodes()) {
+        const auto clusters = hierarchy.getClusters(node);
 
-        for (int d = 0; d < numDimensions; d++)
-        {
-            // Mean calculation
-            float mean = 0;
+        std::uint64_t size = 0;
 
-            for (int index : indices)
-                mean += getSourceValue(index, numDimensions, d);
+        for (const auto cluster : clusters)
+            size += clusterSizes[cluster];
+
+        const auto largest  = *std::ranges::max_element(clusters, {}, [&clusterSizes](std::uint32_t cluster) { return clusterSizes[cluster]; });
+        const auto name     = largest < clusterNames.size() ? clusterNames[largest] : QString("Cluster %1").arg(largest);
+
+        columns.sizes.push_back(size);
+        columns.names.push_back(clusters.size() > 1 ? QString("%1 + %2 more").arg(name).arg(clusters.size() - 1) : name);
+    }
+
+    _columns = std::move(columns);
+}
+
+void HeatMapPlugin::showStatistics()
+{
+    if (!_publishedResult || !_clusters.isValid())
+        return;
+
+    if (static_cast<std::size_t>(_clusters->getClusters().size()) != _publishedResult->moments.size())
+        return;
+
+    _heatmap->setColumnGroups(_columns.groups);
+    _heatmap->setData(_columns.means, _columns.standardDeviations, _columns.fractions, _columns.expressingMeans, _columns.sizes, _publishedResult->dimensionNames, _columns.names, _columns.distributions);
+}
+
+void HeatMapPlugin::expandColumn(std::size_t column)
+{
+    // Only the two new columns are merged, from moments that are cached already
+    if (!_hierarchyCut.expand(column))
+        return;
+
+    // Dendrograms of the previous columns are stale; the page requests a new one with the data
+    ++_dendrogramGeneration;
+
+    updateColumns();
+    showStatistics();
+    computeRowOrder();
+    updateSelectionOverlap();
+}
+
+void HeatMapPlugin::collapseColumn(std::size_t column)
+{
+    // The parent is merged from the moments of the columns it replaces
+    if (!_hierarchyCut.collapse(column))
+        return;
+
+    ++_dendrogramGeneration;
+
+    updateColumns();
+    showStatistics();
+    computeRowOrder();
+    updateSelectionOverlap();
+}
+
+void HeatMapPlugin::computeDendrogram(const std::vector<std::uint32_t>& dimensions)
+{
+    _dendrogramDimensions = dimensions;
+
+    const auto generation = ++_dendrogramGeneration;
+
+    if (!_publishedResult)
+        return;
 
-            mean /= indices.size();
+    const auto numClusters      = _columns.moments.size();
+    const auto numDimensions    = _publishedResult->numDimensions;
 
-            // Standard deviation calculation
-            float variance = 0;
+    // Cluster on the statistic the heatmap is colored by
+    const auto colorBy          = _settingsAction.getColorBy().toStdString();
+    const auto& distributions   = _columns.distributions;
 
-            for (int index : indices)
-                variance += pow(getSourceValue(index, numDimensions, d) - mean, 2);
+    const float* quantiles = nullptr;
 
-            float stddev = sqrt(variance / indices.size());
+    for (std::size_t levelIndex = 0; distributions && levelIndex < distributions->levels.size(); ++levelIndex)
+        if (heatmap::getQuantileName(distributions->levels[levelIndex]) == colorBy)
+            quantiles = distributions->getQuantiles(levelIndex);
 
-            means[d] = mean;
-            stddevs[d] = stddev;
+    std::vector<std::uint32_t> features;
+
+    std::copy_if(dimensions.begin(), dimensions.end(), std::back_inserter(features), [numDimensions](std::uint32_t dimension) { return dimension < numDimensions; });
+
+    std::vector<float> values(numClusters * features.size());
+
+    for (std::size_t clusterIndex = 0; clusterIndex < numClusters; ++clusterIndex)
+        for (std::size_t featureIndex = 0; featureIndex < features.size(); ++featureIndex)
+            values[clusterIndex * features.size() + featureIndex] = quantiles ? quantiles[clusterIndex * numDimensions + features[featureIndex]] : (*_columns.means)(clusterIndex, features[featureIndex]);
+
+    const auto linkage  = _settingsAction.getLinkage();
+    const auto metric   = _settingsAction.getDistanceMetric();
+
+    // The previous clustering has been asked to stop and finishes on its own
+    _dendrogramThread.start([this, generation, values = std::move(values), numClusters, numFeatures = features.size(), linkage, metric](std::stop_token stopToken) -> void {
+        auto merges = heatmap::clusterHierarchically(values.data(), numClusters, numFeatures, linkage, metric, stopToken);
+
+        if (stopToken.stop_requested())
+            return;
+
+        QMetaObject::invokeMethod(this, [this, generation, merges = std::move(merges)]() -> void {
+            if (generation == _dendrogramGeneration)
+                _heatmap->setDendrogram(merges);
+        }, Qt::QueuedConnection);
+    });
+}
+
+void HeatMapPlugin::computeRowOrder()
+{
+    const auto generation = ++_seriationGeneration;
+
+    if (!_publishedResult || _columns.means == nullptr)
+        return;
+
+    if (_settingsAction.getRowOrder() == heatmap::RowOrder::Dataset) {
+        _heatmap->setRowOrder({}, {});
+        return;
+    }
+
+    // The per-dimension transforms are affine and leave the correlations as they are; only log1p changes them
+    const auto isLogarithmic = _settingsAction.getValueTransform() == heatmap::ValueTransform::Log1p;
+
+    // Super-clusters change the columns the dimensions are correlated over
+    auto correlationsKey = _publishedResult->sharedKey + (isLogarithmic ? ":log1p" : ":linear");
+
+    for (const auto node : _hierarchyCut.getNodes())
+        correlationsKey += ":" + std::to_string(node);
+
+    const auto linkage          = _settingsAction.getRowLinkage();
+    const auto seriationKey     = correlationsKey + ":" + std::to_string(static_cast<int>(linkage));
+    const auto update           = _stageTrace->getCurrentUpdate();
+
+    // The previous ordering has been asked to stop and finishes on its own
+    _seriationThread.start([this, generation, means = _columns.means, isLogarithmic, linkage, correlationsKey, seriationKey, update](std::stop_token stopToken) -> void {
+        // Views of the same statistics share the correlations, which every linkage orders again
+        const auto seriation = getSharedSeriations().get(seriationKey, [&]() -> std::shared_ptr<const heatmap::DimensionSeriation> {
+            const auto correlations = getSharedCorrelations().get(correlationsKey, [&]() -> std::shared_ptr<const heatmap::DimensionCorrelations> {
+                heatmap::StageTrace::Scope correlationsScope(*_stageTrace, "correlations", update);
+
+                const auto numRows          = means->getNumRows();
+                const auto numDimensions    = means->getNumColumns();
+
+                std::vector<float> logValues;
+
+                if (isLogarithmic) {
+                    logValues.resize(means->size());
+
+                    heatmap::ValueTransformer(heatmap::ValueTransform::Log1p, means->data(), numRows, numDimensions).transformValues(means->data(), logValues.data(), numRows, numDimensions);
+                }
+
+                auto computed = std::make_shared<const heatmap::DimensionCorrelations>(heatmap::computeDimensionCorrelations(isLogarithmic ? logValues.data() : means->data(), numRows, numDimensions, maxSeriatedDimensions, stopToken));
+
+                return stopToken.stop_requested() ? nullptr : computed;
+            }, stopToken);
+
+            if (correlations == nullptr)
+                return nullptr;
+
+            heatmap::StageTrace::Scope seriationScope(*_stageTrace, "seriation", update);
+
+            auto computed = std::make_shared<const heatmap::DimensionSeriation>(heatmap::seriateDimensions(*correlations, linkage, maxOptimalLeafOrdering, stopToken));
+
+            return stopToken.stop_requested() ? nullptr : computed;
+        }, stopToken);
+
+        if (stopToken.stop_requested() || seriation == nullptr)
+            return;
+
+        QMetaObject::invokeMethod(this, [this, generation, seriation]() -> void {
+            if (generation == _seriationGeneration)
+                _heatmap->setRowOrder(seriation->order, seriation->merges);
+        }, Qt::QueuedConnection);
+    });
+}
+
+void HeatMapPlugin::rankMarkers(const std::vector<std::uint32_t>& columns)
+{
+    if (!_publishedResult || columns.empty())
+        return;
+
+    std::vector<const heatmap::ClusterMoments*> moments;
+
+    moments.reserve(_columns.moments.size());
+
+    for (const auto& columnMoments : _columns.moments)
+        moments.push_back(columnMoments.get());
+
+    // Only merges the cached moments, which takes milliseconds even for wide panels
+    _heatmap->setMarkerRanking(heatmap::rankMarkers(moments, columns, _settingsAction.getMarkerRankingMetric(), _settingsAction.getNumRankedMarkers()));
+}
+
+void HeatMapPlugin::publishDatasets()
+{
+    if (!_publishedResult || !_clusters.isValid() || !_settingsAction.getPublishStatistics())
+        return;
+
+    // Per cluster, also when super-clusters are shown, so that other views can aggregate as they like
+    const std::array<std::pair<QString, std::shared_ptr<const heatmap::StatisticsMatrix>>, 4> statistics = {{
+        { "means", _publishedResult->means },
+        { "standard deviations", _publishedResult->standardDeviations },
+        { "expressing fractions", _publishedResult->fractions },
+        { "expressing means", _publishedResult->expressingMeans }
+    }};
+
+    // The statistics datasets belong to the clusters they describe; those of the previous clusters are removed, not left orphaned
+    if (_statisticsDatasetsParentId != _clusters->getId()) {
+        for (auto& statisticsDataset : _statisticsDatasets) {
+            if (statisticsDataset.isValid())
+                mv::data().removeDataset(statisticsDataset);
+
+            statisticsDataset = Dataset<Points>();
         }
+
+        _statisticsDatasetsParentId = _clusters->getId();
     }
 
-    qDebug() << "Done calculating data.";
-    std::vector<QString> dimensionNames;
-    if (source->getDimensionNames().size() == numDimensions)
-        dimensionNames = source->getDimensionNames();
+    QStringList clusterNames;
+
+    for (const auto& clusterName : _publishedResult->clusterNames)
+        clusterNames << clusterName;
 
-    const std::vector<QString> clusterNames = _clusters->getClusterNames();
-    _heatmap->setData(clusters, dimensionNames, clusterNames, numDimensions);
+    for (std::size_t statisticIndex = 0; statisticIndex < statistics.size(); ++statisticIndex) {
+        const auto& [name, matrix] = statistics[statisticIndex];
+
+        auto& statisticsDataset = _statisticsDatasets[statisticIndex];
+
+        // Datasets are only created once (or again after they were removed), later statistics replace their values
+        if (!statisticsDataset.isValid())
+            statisticsDataset = mv::data().createDataset<Points>("Points", QString("%1 %2").arg(_clusters->getGuiName(), name), _clusters);
+
+        statisticsDataset->setData(matrix->data(), matrix->getNumRows(), matrix->getNumColumns());
+
+        if (_publishedResult->dimensionNames.size() == matrix->getNumColumns())
+            statisticsDataset->setDimensionNames(_publishedResult->dimensionNames);
+
+        statisticsDataset->setProperty("ClusterNames", clusterNames);
+
+        events().notifyDatasetDataChanged(statisticsDataset);
+    }
+}
+
+void HeatMapPlugin::requestPointSelectionUpdate()
+{
+    // Unlike the statistics updates, a running timer is not restarted, so that brushing updates at a steady rate
+    if (!_pointSelectionTimer.isActive())
+        _pointSelectionTimer.start();
+}
+
+void HeatMapPlugin::updateSelectionOverlap()
+{
+    if (!_publishedResult || !_publishedResult->pointLabels || !_points.isValid())
+        return;
+
+    std::vector<std::uint64_t> clusterSizes;
+
+    clusterSizes.reserve(_publishedResult->moments.size());
+
+    for (const auto& clusterMoments : _publishedResult->moments)
+        clusterSizes.push_back(clusterMoments->count);
+
+    // Selection indices refer to the source points, like the cluster indices
+    const auto fractions = heatmap::computeSelectionOverlap(*_publishedResult->pointLabels, clusterSizes, _points->getSelectionIndices());
+
+    if (_hierarchyCut.empty()) {
+        _heatmap->setSelectionOverlap(fractions);
+        return;
+    }
+
+    const auto& hierarchy = _hierarchyCut.getHierarchy();
+
+    std::vector<float> columnFractions;
+
+    // The selected points of a super-cluster are those of its clusters
+    for (const auto node : _hierarchyCut.getNodes()) {
+        double numSelected = 0.0;
+        std::uint64_t size = 0;
+
+        for (const auto cluster : hierarchy.getClusters(node)) {
+            numSelected += static_cast<double>(fractions[cluster]) * static_cast<double>(clusterSizes[cluster]);
+            size        += clusterSizes[cluster];
+        }
+
+        columnFractions.push_back(size > 0 ? static_cast<float>(numSelected / static_cast<double>(size)) : 0.f);
+    }
+
+    _heatmap->setSelectionOverlap(columnFractions);
+}
+
+void HeatMapPlugin::updateSelectionStatistics()
+{
+    if (!_points.isValid())
+        return;
+
+    const auto source = _points->getSourceDataset<Points>();
+
+    const std::size_t numDimensions = source->getNumDimensions();
+    const std::size_t numPoints = source->getNumPoints();
+
+    // Proxies only provide their values per dimension, which is too slow to follow a brush
+    if (source->isProxy()) {
+        _heatmap->setSelectionStatistics(0, {}, {});
+        return;
+    }
+
+    if (_selectionStatisticsRevision != _sourceRevision || _selectionStatistics.getNumPoints() != numPoints || _selectionStatistics.getNumDimensions() != numDimensions) {
+        _selectionStatistics.reset(numPoints, numDimensions);
+
+        _selectionStatisticsRevision = _sourceRevision;
+    }
+
+    // Only the points added to or removed from the selection since the last update are read
+    source->constVisitFromBeginToEnd([&](auto begin, auto end) -> void {
+        using ElementType = std::remove_cvref_t<decltype(*begin)>;
+
+        const ElementType* values = begin != end ? std::to_address(begin) : nullptr;
+
+        _selectionStatistics.update(values, _points->getSelectionIndices());
+    });
+
+    std::vector<float> means(numDimensions);
+    std::vector<float> stddevs(numDimensions);
+
+    for (std::size_t d = 0; d < numDimensions; d++) {
+        means[d] = _selectionStatistics.getMean(d);
+        stddevs[d] = _selectionStatistics.getStandardDeviation(d);
+    }
+
+    _heatmap->setSelectionStatistics(_selectionStatistics.getCount(), std::move(means), std::move(stddevs));
+}
+
+void HeatMapPlugin::showTimings()
+{
+    const auto summary = QString::fromStdString(_stageTrace->getSummary(_stageTrace->getCurrentUpdate()));
+
+    _settingsAction.getTimingsAction().setString(summary);
+}
+
+void HeatMapPlugin::exportTrace()
+{
+    const auto fileName = QFileDialog::getSaveFileName(nullptr, "Export heatmap trace", "heatmap-trace.json", "Chrome trace (*.json)");
+
+    if (fileName.isEmpty())
+        return;
+
+    QFile file(fileName);
+
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "Heatmap: cannot write trace to" << fileName;
+        return;
+    }
+
+    file.write(QByteArray::fromStdString(_stageTrace->toChromeTrace()));
 }
 
 // =============================================================================
@@ -333,8 +1460,13 @@ PluginTriggerActions HeatMapPluginFactory::getPluginTriggerActions(const mv::Dat
 
 	const auto numberOfDatasets = datasets.count();
 
-	if (numberOfDatasets == 2 && datasets[0]->getDataType() == PointType && datasets[1]->getDataType() == ClusterType) {
-		auto pluginTriggerAction = new PluginTriggerAction(const_cast<HeatMapPluginFactory*>(this), this, "Heatmap", "View clusters in heatmap", icon(), [this, getPluginInstance, datasets](PluginTriggerAction& pluginTriggerAction) -> void {
+	// Several clusters datasets of the same points are computed together and can be switched between
+	const auto isPointsWithClusters = numberOfDatasets >= 2 && datasets[0]->getDataType() == PointType && std::all_of(datasets.begin() + 1, datasets.end(), [](const auto& dataset) {
+		return dataset->getDataType() == ClusterType;
+	});
+
+	if (isPointsWithClusters) {
+		auto pluginTriggerAction = new PluginTriggerAction(const_cast<HeatMapPluginFactory*>(this), this, "Heatmap", numberOfDatasets > 2 ? "Compare clusterings in heatmap" : "View clusters in heatmap", icon(), [this, getPluginInstance, datasets](PluginTriggerAction& pluginTriggerAction) -> void {
             getPluginInstance()->loadData(datasets);
         });
 
@@ -2,14 +2,40 @@
 
 #include <ViewPlugin.h>
 
+#include "BackgroundTask.h"
+#include "BackgroundThread.h"
 #include "Dataset.h"
 
+#include "ClusterDistributions.h"
+#include "ClusterHierarchy.h"
+#include "ClusterMomentsCache.h"
+#include "ClusterStatistics.h"
+#include "DimensionSeriation.h"
 #include "HeatMapWidget.h"
+#include "HierarchicalClustering.h"
+#include "PointClusterLabels.h"
+#include "SelectionOverlap.h"
+#include "SelectionStatistics.h"
+#include "SettingsAction.h"
+#include "SharedCache.h"
+#include "StageTrace.h"
+#include "StatisticsArchive.h"
+#include "StatisticsMatrix.h"
 #include "widgets/DropWidget.h"
 
 #include <QList>
+#include <QSet>
+#include <QString>
 #include <QTimer>
 
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <stop_token>
+#include <string>
+#include <vector>
+
 using namespace mv::plugin;
 using namespace mv::util;
 
@@ -34,6 +60,15 @@ class HeatMapPlugin : public ViewPlugin
     Q_OBJECT
     
 public:
+    /** Number of dimensions (those with the most variable means) the hierarchy of over-clustered data is built over */
+    static constexpr std::size_t numHierarchyDimensions = 64;
+
+    /** Number of dimensions (those with the most variable means) clustered to order the rows by co-expression; the others are placed next to their most correlated one */
+    static constexpr std::size_t maxSeriatedDimensions = 8192;
+
+    /** Maximum number of leaves of a subtree of the row dendrogram whose leaves are ordered optimally */
+    static constexpr std::size_t maxOptimalLeafOrdering = 2048;
+
     HeatMapPlugin(const PluginFactory* factory);
     ~HeatMapPlugin(void) override;
     
@@ -47,6 +82,20 @@ public:
 
     // TODO: remove this, it is not connected and does nothing
     void onDataEvent(mv::DatasetEvent* dataEvent);
+
+public: // Serialization
+
+    /**
+     * Load plugin from variant map
+     * @param variantMap Variant map representation of the plugin
+     */
+    void fromVariantMap(const QVariantMap& variantMap) override;
+
+    /**
+     * Save plugin to variant map
+     * @return Variant map representation of the plugin
+     */
+    QVariantMap toVariantMap() const override;
     
 protected slots:
     void dataSetPicked(const QString& name);
@@ -54,14 +103,218 @@ protected slots:
     void selectClusters();
 
 private:
+
+    /** Input of a statistics computation, snapshotted on the GUI thread */
+    struct StatisticsInput
+    {
+        Points*                                 source = nullptr;   /** Source points, read on the background thread while _statisticsSource holds them */
+        std::vector<std::vector<std::uint32_t>> clusterIndices;     /** Point indices per cluster, of the shown clusters followed by those of the other clusterings */
+        std::size_t                             numShownClusters = 0;   /** Number of clusters of the shown clusters dataset */
+        std::vector<QString>                    dimensionNames;     /** Dimension names of the source */
+        std::vector<QString>                    clusterNames;       /** Cluster names */
+        heatmap::AccumulationPrecision          precision = heatmap::AccumulationPrecision::Double;  /** Accumulation precision */
+        float                                   expressionThreshold = 0.f;  /** Values above this threshold count as expressing */
+        std::size_t                             maxColumns = 0;     /** Shown clusters beyond this number are merged into super-clusters */
+        std::uint64_t                           contextKey = 0;     /** Identifies source data and settings for the moments cache */
+        std::string                             sharedKey;          /** Identifies the source and clusters data and the settings for the shared statistics */
+        std::size_t                             memoryBudget = 0;   /** Maximum number of bytes of extracted proxy values held at a time */
+        bool                                    computeDistributions = false;   /** Whether to compute quantiles and histograms as well */
+        std::size_t                             numHistogramBins = 0;   /** Number of histogram bins per cluster and dimension */
+        std::vector<float>                      quantileLevels;     /** Quantile levels (the median is always computed) */
+        std::uint64_t                           traceUpdate = 0;    /** Update the stage timings are traced under */
+        std::shared_ptr<const std::vector<char>> restoredStatistics;    /** Statistics archive saved with the project, used if its fingerprint matches */
+    };
+
+    /** Output of a statistics computation */
+    struct StatisticsResult
+    {
+        std::size_t                             numDimensions = 0;  /** Number of dimensions */
+        std::vector<heatmap::ClusterMomentsCache::MomentsPointer> moments;  /** Moments per cluster */
+        std::vector<heatmap::ClusterMomentsCache::MomentsPointer> clusteringMoments;    /** Moments of the clusters of the other clusterings, computed in the same pass */
+        std::shared_ptr<const heatmap::StatisticsMatrix> means;     /** Clusters x dimensions means, shared with the heatmap widget */
+        std::shared_ptr<const heatmap::StatisticsMatrix> standardDeviations;   /** Clusters x dimensions standard deviations, shared with the heatmap widget */
+        std::shared_ptr<const heatmap::StatisticsMatrix> fractions;         /** Clusters x dimensions fractions of expressing points (dot plot sizes) */
+        std::shared_ptr<const heatmap::StatisticsMatrix> expressingMeans;   /** Clusters x dimensions means of the expressing values (dot plot colors) */
+        std::vector<std::uint64_t>              clusterSizes;       /** Number of points per cluster */
+        std::vector<QString>                    dimensionNames;     /** Dimension names of the source */
+        std::vector<QString>                    clusterNames;       /** Cluster names */
+        std::shared_ptr<const heatmap::ClusterDistributions> distributions;    /** Quantiles and histograms (only in distribution mode) */
+        std::shared_ptr<const heatmap::PointClusterLabels> pointLabels;        /** Clusters of every source point, for the selection overlap */
+        heatmap::HierarchyCut                   hierarchyCut;       /** Initial super-clusters (empty when every cluster gets a column) */
+        std::uint64_t                           fingerprint = 0;    /** Fingerprint of the input, saved with the statistics in the project */
+        std::string                             sharedKey;          /** Key of the statistics in the shared statistics cache */
+    };
+
+    /** Statistics of the heatmap columns: those of the clusters, or of the super-clusters of the hierarchy cut */
+    struct ColumnStatistics
+    {
+        std::vector<heatmap::ClusterMomentsCache::MomentsPointer> moments;  /** Moments per column */
+        std::shared_ptr<const heatmap::StatisticsMatrix> means;     /** Columns x dimensions means */
+        std::shared_ptr<const heatmap::StatisticsMatrix> standardDeviations;   /** Columns x dimensions standard deviations */
+        std::shared_ptr<const heatmap::StatisticsMatrix> fractions;         /** Columns x dimensions fractions of expressing points */
+        std::shared_ptr<const heatmap::StatisticsMatrix> expressingMeans;   /** Columns x dimensions means of the expressing values */
+        std::vector<std::uint64_t>              sizes;              /** Number of points per column */
+        std::vector<QString>                    names;              /** Column names */
+        std::vector<heatmap::ColumnGroup>       groups;             /** Super-cluster per column (empty when every cluster gets a column) */
+        std::shared_ptr<const heatmap::ClusterDistributions> distributions;    /** Quantiles and histograms (only per cluster) */
+    };
+
+    /** Get the statistics cache shared by all heatmap views of the process */
+    static heatmap::SharedCache<StatisticsResult>& getSharedStatistics();
+
+    /** Get the correlations between the dimensions shared by all heatmap views of the process */
+    static heatmap::SharedCache<heatmap::DimensionCorrelations>& getSharedCorrelations();
+
+    /** Get the row orders shared by all heatmap views of the process */
+    static heatmap::SharedCache<heatmap::DimensionSeriation>& getSharedSeriations();
+
+    /**
+     * Get the content generation of dataset \p datasetId, shared by all heatmap views (GUI thread only)
+     * @param datasetId Dataset identifier
+     * @return Generation, incremented when the data of the dataset changed
+     */
+    static std::uint64_t& getContentGeneration(const QString& datasetId);
+
+    /**
+     * Advance the content generation of dataset \p datasetId and drop the shared results computed from its previous content (GUI thread only)
+     * @param datasetId Dataset identifier
+     */
+    static void advanceContentGeneration(const QString& datasetId);
+
+    /**
+     * Observe the datasets \p datasetIds instead of the ones observed before (GUI thread only)
+     *
+     * Content generations only advance for data changes an open view sees, so the shared results of a
+     * dataset are dropped (and its generation advanced) when the last view observing it lets go of it.
+     * @param datasetIds Identifiers of the datasets the statistics of this view are computed from
+     */
+    void observeDatasets(const QSet<QString>& datasetIds);
+
+    /** Schedule a recomputation of the cluster statistics; bursts of requests are coalesced into one computation */
+    void requestUpdate();
+
+    /** Snapshot the loaded data and start computing the cluster statistics on a background thread */
     void updateData();
 
-    mv::Datasets                _datasetsDeferredLoad;      /** Datasets cannot be loaded straight after the plugin is loaded because the web page needs to load first */
-    QTimer                      _deferredLoadTimer;         /** Wait for the web page to load before loading the datasets */
+    /**
+     * Add \p clusters to the clusterings whose statistics are computed in the same pass as the shown clusters
+     * @param clusters Clusters dataset of the loaded points
+     */
+    void addClustering(const mv::Dataset<Clusters>& clusters);
+
+    /** Offer the added clusterings in the settings, with the shown clusters selected */
+    void updateClusteringOptions();
+
+    /** Cancel the running statistics computation (if any) without waiting for it */
+    void cancelUpdate();
+
+    /** Wait for the statistics computations to leave the source points, and unlock them */
+    void releaseStatisticsSource();
+
+    /**
+     * Mark the statistics task aborted when computation \p generation ended without publishing, unless a newer computation reports on it
+     * @param generation Generation of the computation
+     */
+    void abortStatisticsTask(std::uint64_t generation);
+
+    /**
+     * Compute the cluster statistics of \p input, reusing cached moments where possible (runs on the background thread)
+     * @param input Snapshot of the data to compute the statistics of
+     * @param stopToken Token which is triggered when the computation became stale
+     * @param progressCallback Receives the fraction of completed work
+     * @return Cluster statistics
+     */
+    StatisticsResult computeStatistics(const StatisticsInput& input, std::stop_token stopToken, const heatmap::ClusterStatisticsEngine::ProgressCallback& progressCallback);
+
+    /**
+     * Show the statistics of computation \p generation in the heatmap, unless the data changed in the meantime
+     * @param generation Generation of the data the statistics were computed from
+     * @param result Cluster statistics
+     */
+    void publishStatistics(std::uint64_t generation, std::shared_ptr<const StatisticsResult> result);
+
+    /** Gather the statistics of the columns from the published statistics and the hierarchy cut */
+    void updateColumns();
+
+    /** Send the column statistics to the heatmap (again), e.g. after the color by statistic changed */
+    void showStatistics();
+
+    /**
+     * Split the super-cluster of \p column into its children and show the new columns
+     * @param column Column index
+     */
+    void expandColumn(std::size_t column);
+
+    /**
+     * Merge the super-cluster of \p column into its parent and show the new columns
+     * @param column Column index
+     */
+    void collapseColumn(std::size_t column);
+
+    /**
+     * Cluster the columns over \p dimensions of the shown statistic on a background thread and send the dendrogram to the heatmap
+     * @param dimensions Dimensions (active markers) to cluster over
+     */
+    void computeDendrogram(const std::vector<std::uint32_t>& dimensions);
+
+    /** Order the rows as set in the settings (by co-expression over the columns on a background thread) and send the order to the heatmap */
+    void computeRowOrder();
+
+    /**
+     * Rank the markers of \p columns versus the other columns from their moments and send the top markers to the heatmap
+     * @param columns Indices of the columns to find markers for
+     */
+    void rankMarkers(const std::vector<std::uint32_t>& columns);
+
+    /** Copy the published cluster statistics into the statistics datasets, creating those that do not exist (yet) */
+    void publishDatasets();
+
+    /** Schedule an update of the selection overlap and statistics; updates are throttled to one per interval while brushing */
+    void requestPointSelectionUpdate();
+
+    /** Send the fraction of every cluster that is in the point selection to the heatmap */
+    void updateSelectionOverlap();
+
+    /** Apply the changes of the point selection to the selection statistics and send them to the heatmap as the selection column */
+    void updateSelectionStatistics();
+
+    /** Show the stage durations of the current update in the settings */
+    void showTimings();
+
+    /** Ask for a file name and save the stage trace there in the Chrome trace event format */
+    void exportTrace();
+
     mv::Dataset<Points>         _points;                    /** Currently loaded points dataset */
     mv::Dataset<Clusters>       _clusters;                  /** Currently loaded clusters dataset */
+    std::vector<std::unique_ptr<mv::Dataset<Clusters>>> _clusterings;  /** Clusters datasets computed together (the shown clusters included) */
     HeatMapWidget*              _heatmap;                   /** Heatmap widget displaying cluster data */
     mv::gui::DropWidget*        _dropWidget;                /** Widget allowing users to drop in data */
+    SettingsAction              _settingsAction;            /** Settings of the statistics computation */
+    QTimer                      _updateTimer;               /** Coalesces bursts of change notifications into a single recomputation */
+    QTimer                      _pointSelectionTimer;       /** Throttles point selection updates while points are brushed */
+    std::uint64_t               _generation;                /** Incremented on every data change; results of older generations are discarded */
+    std::uint64_t               _sourceRevision;            /** Incremented when the point values change */
+    heatmap::ClusterMomentsCache _momentsCache;             /** Moments of the clusters last computed; only used by the statistics threads */
+    std::mutex                  _momentsCacheMutex;         /** Guards the moments cache, which a retired statistics thread may still use */
+    mv::BackgroundTask          _statisticsTask;            /** Reports the progress of the statistics computation */
+    std::uint64_t               _taskGeneration;            /** Generation of the computation the statistics task reports on */
+    heatmap::BackgroundThread   _statisticsThread;          /** Background thread computing the cluster statistics */
+    mv::Dataset<Points>         _statisticsSource;          /** Source points the statistics thread reads, locked until it has left them */
+    QSet<QString>               _observedDatasets;          /** Datasets whose content generations this view keeps current (see observeDatasets) */
+    std::shared_ptr<const StatisticsResult> _publishedResult;   /** Statistics shown in the heatmap */
+    heatmap::HierarchyCut       _hierarchyCut;              /** Super-clusters shown as columns (empty when every cluster gets a column) */
+    ColumnStatistics            _columns;                   /** Statistics of the columns sent to the heatmap */
+    std::vector<std::uint32_t>  _dendrogramDimensions;      /** Dimensions the last dendrogram was requested for */
+    std::uint64_t               _dendrogramGeneration;      /** Incremented on every dendrogram request; older results are discarded */
+    heatmap::BackgroundThread   _dendrogramThread;          /** Background thread computing the dendrogram */
+    std::uint64_t               _seriationGeneration;       /** Incremented on every row order request; older results are discarded */
+    heatmap::BackgroundThread   _seriationThread;           /** Background thread ordering the rows */
+    heatmap::SelectionStatistics _selectionStatistics;      /** Running statistics of the selected points */
+    std::uint64_t               _selectionStatisticsRevision;   /** Source revision the selection statistics were accumulated from */
+    std::shared_ptr<heatmap::StageTrace> _stageTrace;       /** Timings of the update stages, shared with the heatmap widget */
+    std::shared_ptr<const std::vector<char>> _restoredStatistics;   /** Statistics archive loaded with the project, until statistics are published */
+    std::array<mv::Dataset<Points>, 4> _statisticsDatasets;  /** Published means, standard deviations, expressing fractions and expressing means */
+    QString                     _statisticsDatasetsParentId;    /** Clusters dataset the statistics datasets were created below */
 };
 
 // =============================================================================
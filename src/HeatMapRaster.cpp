@@ -0,0 +1,64 @@
+#include "HeatMapRaster.h"
+
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace heatmap
+{
+
+std::vector<HeatMapTile> rasterizeHeatMap(const float* values, std::size_t numDimensions, std::span<const std::uint32_t> columns, std::span<const std::uint32_t> rows, const ColorMap& colorMap, std::size_t tileSize)
+{
+    tileSize = std::max<std::size_t>(1, tileSize);
+
+    const auto numTileColumns   = (columns.size() + tileSize - 1) / tileSize;
+    const auto numTileRows      = (rows.size() + tileSize - 1) / tileSize;
+
+    std::vector<HeatMapTile> tiles(numTileColumns * numTileRows);
+
+    for (std::size_t tileIndex = 0; tileIndex < tiles.size(); ++tileIndex) {
+        auto& tile = tiles[tileIndex];
+
+        tile.column = (tileIndex % numTileColumns) * tileSize;
+        tile.row    = (tileIndex / numTileColumns) * tileSize;
+        tile.width  = std::min(tileSize, columns.size() - tile.column);
+        tile.height = std::min(tileSize, rows.size() - tile.row);
+
+        tile.pixels.resize(tile.width * tile.height);
+    }
+
+    if (values == nullptr || colorMap.colors.empty())
+        return tiles;
+
+    const auto numColors    = colorMap.colors.size();
+    const auto range        = static_cast<double>(colorMap.maximum) - colorMap.minimum;
+    const auto scale        = range > 0.0 ? static_cast<double>(numColors) / range : 0.0;
+
+    // Every display row of every tile column is an independent task
+    parallelFor(numTileColumns * rows.size(), [&](std::size_t task) -> void {
+        const auto tileColumn   = task % numTileColumns;
+        const auto row          = task / numTileColumns;
+        auto& tile              = tiles[(row / tileSize) * numTileColumns + tileColumn];
+        const auto dimension    = rows[row];
+
+        auto pixel = tile.pixels.data() + (row - tile.row) * tile.width;
+
+        for (auto column = tile.column; column < tile.column + tile.width; ++column) {
+            const auto value = values[static_cast<std::size_t>(columns[column]) * numDimensions + dimension];
+
+            if (!std::isfinite(value)) {
+                *pixel++ = Rgba();
+                continue;
+            }
+
+            const auto bin = std::floor((value - colorMap.minimum) * scale);
+
+            *pixel++ = colorMap.colors[static_cast<std::size_t>(std::clamp(bin, 0.0, static_cast<double>(numColors - 1)))];
+        }
+    });
+
+    return tiles;
+}
+
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace heatmap
+{
+
+/** How the heatmap cells are drawn in the web page */
+enum class CellRendering
+{
+    Automatic,  /** Image tiles from rasterCellThreshold cells on, vector shapes below */
+    Vector,     /** One SVG rectangle per cell (animated, shows variation) */
+    Raster,     /** Image tiles color mapped in C++ */
+    DotPlot     /** One SVG dot per cell, sized by the expressing fraction and colored by the expressing mean */
+};
+
+/** Number of cells from which automatic cell rendering switches to image tiles */
+constexpr std::size_t rasterCellThreshold = 20000;
+
+/**
+ * Get whether the cells of a heatmap are drawn as image tiles
+ * @param rendering Cell rendering setting
+ * @param numCells Number of cells (clusters x dimensions)
+ */
+inline bool isRasterized(CellRendering rendering, std::size_t numCells)
+{
+    return rendering == CellRendering::Raster || (rendering == CellRendering::Automatic && numCells >= rasterCellThreshold);
+}
+
+/** 8-bit RGBA color, laid out like QImage::Format_RGBA8888 */
+struct Rgba
+{
+    std::uint8_t    r = 0;
+    std::uint8_t    g = 0;
+    std::uint8_t    b = 0;
+    std::uint8_t    a = 0;
+};
+
+/**
+ * Color map lookup table
+ *
+ * The web page samples its active (d3) color map at the centers of colors.size() even bins of
+ * [minimum, maximum], so the tiles use exactly the colors of the vector cells. The maps are only
+ * defined as d3 interpolators and schemes in res/jstools/colormaps.js; sampling the active scale
+ * keeps that the single definition, including the discrete maps and the current domain.
+ */
+struct ColorMap
+{
+    std::vector<Rgba>   colors;         /** Colors of even bins of [minimum, maximum] */
+    float               minimum = 0.f;  /** Value of the lower edge of the first color */
+    float               maximum = 1.f;  /** Value of the upper edge of the last color */
+};
+
+/** Rectangle of heatmap cells as an image with one pixel per cell */
+struct HeatMapTile
+{
+    std::size_t         column = 0;     /** First column (cluster position) of the tile */
+    std::size_t         row = 0;        /** First row (dimension position) of the tile */
+    std::size_t         width = 0;      /** Number of columns */
+    std::size_t         height = 0;     /** Number of rows */
+    std::vector<Rgba>   pixels;         /** Row-major pixels (height x width) */
+};
+
+/**
+ * Color map a clusters x dimensions statistics matrix into image tiles
+ *
+ * Clusters become columns and dimensions rows, in the given display orders. Values outside
+ * the color map range get the first or last color, non-finite values are transparent. Tile
+ * rows are color mapped in parallel.
+ *
+ * @param values Row-major statistics (clusters x numDimensions)
+ * @param numDimensions Number of dimensions of the matrix
+ * @param columns Cluster shown in each column
+ * @param rows Dimension shown in each row
+ * @param colorMap Color map lookup table (without colors all pixels are transparent)
+ * @param tileSize Maximum width and height of a tile in cells
+ * @return Tiles covering all columns x rows, row of tiles by row of tiles
+ */
+std::vector<HeatMapTile> rasterizeHeatMap(const float* values, std::size_t numDimensions, std::span<const std::uint32_t> columns, std::span<const std::uint32_t> rows, const ColorMap& colorMap, std::size_t tileSize = 256);
+
+}
@@ -1,8 +1,17 @@
 #include "HeatMapWidget.h"
 
-#include "ClusterData/ClusterData.h"
+#include "Parallel.h"
 
+#include <QBuffer>
+#include <QByteArray>
+#include <QImage>
+
+#include <algorithm>
 #include <cassert>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <string>
 
 HeatMapCommunicationObject::HeatMapCommunicationObject(HeatMapWidget* parent) :
     _parent(parent)
@@ -20,11 +29,93 @@ void HeatMapCommunicationObject::js_selectionUpdated(const QVariantList& selecte
     _parent->js_selectionUpdated(selectedClusters);
 }
 
+void HeatMapCommunicationObject::js_requestDendrogram(const QVariantList& dimensions)
+{
+    _parent->js_requestDendrogram(dimensions);
+}
+
+void HeatMapCommunicationObject::js_requestMarkerRanking(const QVariantList& selectedClusters)
+{
+    _parent->js_requestMarkerRanking(selectedClusters);
+}
+
+void HeatMapCommunicationObject::js_requestPage(int request, int rowBegin, int rowEnd)
+{
+    _parent->js_requestPage(request, rowBegin, rowEnd);
+}
+
+void HeatMapCommunicationObject::js_setMarkerSelected(int dimension, bool selected)
+{
+    _parent->js_setMarkerSelected(dimension, selected);
+}
+
+void HeatMapCommunicationObject::js_setMarkerSelectionMode(int request, bool active, int rowBegin, int rowEnd)
+{
+    _parent->js_setMarkerSelectionMode(request, active, rowBegin, rowEnd);
+}
+
+void HeatMapCommunicationObject::js_setSortDimension(int dimension)
+{
+    _parent->js_setSortDimension(dimension);
+}
+
+void HeatMapCommunicationObject::js_requestTiles(int request, const QVariantList& columns, const QVariantList& rows, const QVariantList& colors, double minimum, double maximum)
+{
+    _parent->js_requestTiles(request, columns, rows, colors, minimum, maximum);
+}
+
+void HeatMapCommunicationObject::js_reportTimings(int revision, const QVariantList& stages)
+{
+    _parent->js_reportTimings(revision, stages);
+}
+
+void HeatMapCommunicationObject::js_expandColumn(int column)
+{
+    _parent->js_expandColumn(column);
+}
+
+void HeatMapCommunicationObject::js_collapseColumn(int column)
+{
+    _parent->js_collapseColumn(column);
+}
+
 HeatMapWidget::HeatMapWidget() :
     mv::gui::WebWidget(),
     _communicationObject(nullptr),
     loaded(false),
     _numClusters(0),
+    _payloadFloatType(heatmap::HeatMapPayload::ValueType::Float32),
+    _colorBy("mean"),
+    _cellRendering(heatmap::CellRendering::Automatic),
+    _clusterNames(),
+    _clusterSizes(),
+    _columnGroups(),
+    _dimensionNames(),
+    _rowDimensions(),
+    _dimensionRows(),
+    _rowMerges(),
+    _means(std::make_shared<const heatmap::StatisticsMatrix>()),
+    _stddevs(_means),
+    _fractions(_means),
+    _expressingMeans(_means),
+    _distributions(),
+    _valueTransform(heatmap::ValueTransform::None),
+    _transformedStatistics(),
+    _valueRange(0.f, 0.f),
+    _rasterize(false),
+    _pageBegin(0),
+    _pageEnd(0),
+    _markerSelection(),
+    _isMarkerSelectionActive(false),
+    _pagedDimensions(),
+    _sortDimension(-1),
+    _dataRevision(0),
+    _selectionCount(0),
+    _selectionMeans(),
+    _selectionStddevs(),
+    _stageTrace(std::make_shared<heatmap::StageTrace>()),
+    _dataSentAt(0),
+    _selectionOverlap(),
     dataOptionBuffer()
 {
     Q_INIT_RESOURCE(heatmap_resources);
@@ -49,57 +140,576 @@ void HeatMapWidget::addDataOption(const QString option)
         dataOptionBuffer.append(option);
 }
 
-void HeatMapWidget::setData(const QVector<Cluster>& clusters, const std::vector<QString>& dimNames, const std::vector<QString>& clusterNames, const int numDimensions)
+void HeatMapWidget::setData(std::shared_ptr<const heatmap::StatisticsMatrix> means, std::shared_ptr<const heatmap::StatisticsMatrix> stddevs, std::shared_ptr<const heatmap::StatisticsMatrix> fractions, std::shared_ptr<const heatmap::StatisticsMatrix> expressingMeans, const std::vector<std::uint64_t>& clusterSizes, const std::vector<QString>& dimNames, const std::vector<QString>& clusterNames, std::shared_ptr<const heatmap::ClusterDistributions> distributions)
 {
-    std::string _jsonObject = "";
+    const auto setDataBegin = _stageTrace->now();
 
-    _numClusters = clusters.size();
-    qDebug() << "Setting data";
-    //// Nodes
-    std::string nodes = "\"nodes\":[\n";
-    for (int i = 0; i < _numClusters; i++)
-    {
-        if(clusterNames.size() == _numClusters)
-            nodes = nodes + "{\"name\":\"" + clusterNames[i].toStdString() + "\", ";
-        else
-            nodes = nodes + "{\"name\":\"" + "Cluster name " + std::to_string(i) + "\", ";
-        nodes = nodes + "\"size\":" + std::to_string(clusters[i].getNumberOfIndices()) + ", ";
-        nodes = nodes + "\"expression\":[";
+    const auto hasShapeOfMeans = [&means](const std::shared_ptr<const heatmap::StatisticsMatrix>& matrix) -> bool {
+        return matrix != nullptr && matrix->getNumRows() == means->getNumRows() && matrix->getNumColumns() == means->getNumColumns();
+    };
 
-        for (int j = 0; j < numDimensions; j++)
-        {
-            nodes = nodes + std::to_string(clusters[i].getMean()[j]);
+    if (means == nullptr || !hasShapeOfMeans(stddevs) || !hasShapeOfMeans(fractions) || !hasShapeOfMeans(expressingMeans) || clusterSizes.size() != means->getNumRows())
+        return;
 
-            if (j < numDimensions - 1) nodes = nodes + ",";
-        }
-        nodes = nodes + "], \"stddev\":[";
-        for (int j = 0; j < numDimensions; j++)
-        {
-            nodes = nodes + std::to_string(clusters[i].getStandardDeviation()[j]);
+    _numClusters = static_cast<unsigned int>(means->getNumRows());
 
-            if (j < numDimensions - 1) nodes = nodes + ",";
-        }
-        if (i < _numClusters - 1) nodes = nodes + "]},\n";
-        else nodes = nodes + "]}\n]";
+    const auto numDimensions = static_cast<int>(means->getNumColumns());
+
+    // The statistics are shared with the plugin, not copied
+    _means              = std::move(means);
+    _stddevs            = std::move(stddevs);
+    _fractions          = std::move(fractions);
+    _expressingMeans    = std::move(expressingMeans);
+    _clusterSizes       = clusterSizes;
+
+    _clusterNames.resize(_numClusters);
+
+    for (unsigned int i = 0; i < _numClusters; i++)
+    {
+        if (clusterNames.size() == _numClusters)
+            _clusterNames[i] = clusterNames[i].toStdString();
+        else
+            _clusterNames[i] = "Cluster name " + std::to_string(i);
     }
 
     // TODO: multi files
-    std::string names = ",\n\"names\":[";
+    _dimensionNames.resize(numDimensions);
     for (int i = 0; i < numDimensions; i++) {
         if (dimNames.size() > i)
-            names = names + "\"" + dimNames[i].toStdString() + "\"";
+            _dimensionNames[i] = dimNames[i].toStdString();
         else
-            names = names + "\"" + "dimension " + std::to_string(i) + "\"";
+            _dimensionNames[i] = "dimension " + std::to_string(i);
+    }
+
+    // An order of other dimensions is stale; the plugin orders the new dimensions
+    if (_rowDimensions.size() != _dimensionNames.size()) {
+        _rowDimensions.clear();
+        _dimensionRows.clear();
+        _rowMerges.clear();
+    }
+
+    // Markers of other dimensions are stale; all dimensions start out selected
+    if (_markerSelection.size() != _dimensionNames.size()) {
+        _markerSelection.assign(_dimensionNames.size(), 1);
+        _sortDimension = -1;
+    }
+
+    updatePagedDimensions();
+
+    // Distributions of other clusters or dimensions (e.g. of a previous computation) are not sent
+    const auto isMatching = distributions != nullptr && distributions->numClusters == _numClusters && distributions->numDimensions == static_cast<std::size_t>(numDimensions);
+
+    _distributions = isMatching ? std::move(distributions) : nullptr;
+
+    // Transforms of the previous statistics are stale
+    _transformedStatistics.clear();
+
+    updateTransformedStatistics();
+    updateValueRange();
+
+    _rasterize = heatmap::isRasterized(_cellRendering, _means->size());
+
+    // Keep the rows the page shows when only the statistics changed
+    if (_pageEnd == 0 || _pageEnd > getNumPageRows()) {
+        _pageBegin  = 0;
+        _pageEnd    = std::min(initialPageSize, getNumPageRows());
+    }
+
+    ++_dataRevision;
+
+    _stageTrace->addSpan("setData", "plugin", _stageTrace->getCurrentUpdate(), setDataBegin, _stageTrace->now());
+
+    sendData(0);
+
+    // The selection column follows the transform refitted to the new statistics; pages send it with their rows
+    if (!isPaged())
+        sendSelectionStatistics();
+}
+
+bool HeatMapWidget::isPaged() const
+{
+    return _dimensionNames.size() > pagedDimensionThreshold;
+}
+
+std::size_t HeatMapWidget::getNumPageRows() const
+{
+    return isPaged() ? _pagedDimensions.size() : _dimensionNames.size();
+}
+
+std::uint32_t HeatMapWidget::getPageRowDimension(std::size_t row) const
+{
+    return isPaged() ? _pagedDimensions[row] : getRowDimension(row);
+}
+
+void HeatMapWidget::updatePagedDimensions()
+{
+    _pagedDimensions.clear();
+
+    if (!isPaged() || _markerSelection.size() != _dimensionNames.size())
+        return;
+
+    // Without selected markers the page scrolls through all rows, as while choosing markers
+    const auto isShowingAllRows = _isMarkerSelectionActive || std::ranges::find(_markerSelection, 1) == _markerSelection.end();
+
+    for (std::size_t row = 0; row < _dimensionNames.size(); ++row) {
+        const auto dimension = getRowDimension(row);
+
+        if (isShowingAllRows || _markerSelection[dimension] != 0)
+            _pagedDimensions.push_back(dimension);
+    }
+}
+
+void HeatMapWidget::setPageRows(int rowBegin, int rowEnd)
+{
+    const auto numRows = static_cast<int>(getNumPageRows());
+
+    // The visible rows plus read-ahead on both sides, so that scrolling a bit needs no new page
+    _pageBegin  = static_cast<std::size_t>(std::clamp(rowBegin - static_cast<int>(pageReadAhead), 0, numRows));
+    _pageEnd    = static_cast<std::size_t>(std::clamp(rowEnd + static_cast<int>(pageReadAhead), static_cast<int>(_pageBegin), numRows));
+}
+
+const float* HeatMapWidget::getCellValues() const
+{
+    if (isDotPlot())
+        return getExpressingMeans();
+
+    for (std::size_t levelIndex = 0; _distributions != nullptr && levelIndex < _distributions->levels.size(); ++levelIndex)
+        if (heatmap::getQuantileName(_distributions->levels[levelIndex]) == _colorBy.toStdString())
+            return getQuantiles(levelIndex);
+
+    return getMeans();
+}
+
+const HeatMapWidget::TransformedStatistics* HeatMapWidget::getTransformedStatistics() const
+{
+    const auto it = _transformedStatistics.find(_valueTransform);
+
+    return it != _transformedStatistics.end() ? &it->second : nullptr;
+}
+
+const float* HeatMapWidget::getMeans() const
+{
+    const auto transformed = getTransformedStatistics();
+
+    return transformed ? transformed->means.data() : _means->data();
+}
 
-        if (i < numDimensions - 1) names = names + ",";
-        else names = names + "]";
+const float* HeatMapWidget::getStandardDeviations() const
+{
+    const auto transformed = getTransformedStatistics();
+
+    return transformed ? transformed->stddevs.data() : _stddevs->data();
+}
+
+const float* HeatMapWidget::getExpressingMeans() const
+{
+    const auto transformed = getTransformedStatistics();
+
+    return transformed ? transformed->expressingMeans.data() : _expressingMeans->data();
+}
+
+bool HeatMapWidget::isDotPlot() const
+{
+    return _cellRendering == heatmap::CellRendering::DotPlot;
+}
+
+const float* HeatMapWidget::getQuantiles(std::size_t levelIndex) const
+{
+    const auto transformed = getTransformedStatistics();
+
+    return transformed ? transformed->quantiles.data() + levelIndex * _means->size() : _distributions->getQuantiles(levelIndex);
+}
+
+void HeatMapWidget::updateTransformedStatistics()
+{
+    if (_valueTransform == heatmap::ValueTransform::None || _transformedStatistics.contains(_valueTransform))
+        return;
+
+    const auto numDimensions = _dimensionNames.size();
+
+    TransformedStatistics transformed;
+
+    // Fitted to the means, so that the quantiles and the selection column share the scale of the mean
+    transformed.transformer = heatmap::ValueTransformer(_valueTransform, _means->data(), _numClusters, numDimensions);
+
+    transformed.means.resize(_means->size());
+    transformed.stddevs.resize(_stddevs->size());
+    transformed.expressingMeans.resize(_expressingMeans->size());
+
+    transformed.transformer.transformValues(_means->data(), transformed.means.data(), _numClusters, numDimensions);
+    transformed.transformer.transformSpreads(_means->data(), _stddevs->data(), transformed.stddevs.data(), _numClusters, numDimensions);
+    transformed.transformer.transformValues(_expressingMeans->data(), transformed.expressingMeans.data(), _numClusters, numDimensions);
+
+    if (_distributions != nullptr) {
+        transformed.quantiles.resize(_distributions->levels.size() * _means->size());
+
+        for (std::size_t levelIndex = 0; levelIndex < _distributions->levels.size(); ++levelIndex)
+            transformed.transformer.transformValues(_distributions->getQuantiles(levelIndex), transformed.quantiles.data() + levelIndex * _means->size(), _numClusters, numDimensions);
     }
 
-    _jsonObject = "{\n" + nodes + names + "\n}";
+    _transformedStatistics.emplace(_valueTransform, std::move(transformed));
+}
+
+void HeatMapWidget::updateValueRange()
+{
+    // The color range of the whole panel, so that the colors do not change from page to page
+    const auto cellValues = getCellValues();
 
-    qDebug() << _jsonObject.c_str();
+    _valueRange = { std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity() };
+
+    for (std::size_t cellIndex = 0; cellIndex < _means->size(); ++cellIndex) {
+        if (!std::isfinite(cellValues[cellIndex]))
+            continue;
+
+        _valueRange.first   = std::min(_valueRange.first, cellValues[cellIndex]);
+        _valueRange.second  = std::max(_valueRange.second, cellValues[cellIndex]);
+    }
 
-    emit _communicationObject->qt_setData(QString(_jsonObject.c_str()));
+    if (_valueRange.first > _valueRange.second)
+        _valueRange = { 0.f, 0.f };
+}
+
+void HeatMapWidget::sendData(int request, int rowOffset)
+{
+    // The data is kept and sent once the page is loaded
+    if (!loaded)
+        return;
+
+    const auto payloadBegin = _stageTrace->now();
+
+    const auto numDimensions    = _dimensionNames.size();
+    const auto numRows          = getNumPageRows();
+    const auto pageEnd          = isPaged() ? std::min(_pageEnd, numRows) : numRows;
+    const auto pageBegin        = isPaged() ? std::min(_pageBegin, pageEnd) : 0;
+    const auto pageSize         = pageEnd - pageBegin;
+
+    // The rows of a paged panel are a selection of the dimensions
+    const auto isOrdered = isPaged() || !_rowDimensions.empty();
+
+    // Rows [pageBegin, pageEnd) of the clusters x dimensions matrices (the whole matrix is referenced as is in dataset order)
+    std::vector<std::vector<float>> slices;
+
+    // Means and standard deviations, fractions and expressing means of the dot plot, and the quantiles
+    slices.reserve(2 + (isDotPlot() ? 2 : 0) + (_distributions ? _distributions->levels.size() : 0));
+
+    const auto getPage = [&](const float* values) -> const float* {
+        if (pageSize == numDimensions && !isOrdered)
+            return values;
+
+        auto& slice = slices.emplace_back(static_cast<std::size_t>(_numClusters) * pageSize);
+
+        for (std::size_t clusterIndex = 0; clusterIndex < _numClusters; ++clusterIndex) {
+            const auto clusterValues = values + clusterIndex * numDimensions;
+
+            if (isOrdered) {
+                for (auto row = pageBegin; row < pageEnd; ++row)
+                    slice[clusterIndex * pageSize + row - pageBegin] = clusterValues[getPageRowDimension(row)];
+            }
+            else {
+                std::copy_n(clusterValues + pageBegin, pageSize, slice.begin() + clusterIndex * pageSize);
+            }
+        }
+
+        return slice.data();
+    };
+
+    std::vector<std::string> rowNames;
+
+    rowNames.reserve(pageSize);
+
+    for (auto row = pageBegin; row < pageEnd; ++row)
+        rowNames.push_back(_dimensionNames[getPageRowDimension(row)]);
+
+    const auto numCells = static_cast<std::size_t>(_numClusters) * pageSize;
+
+    heatmap::HeatMapPayload payload(_payloadFloatType);
+
+    payload.setClusters(_clusterNames, _clusterSizes);
+    payload.setDimensionNames(rowNames);
+    payload.addMatrix("mean", getPage(getMeans()), numCells);
+    payload.addMatrix("stddev", getPage(getStandardDeviations()), numCells);
+
+    std::vector<std::uint16_t> fractions;
+
+    // Dot sizes only need about four digits, so the fractions travel as compact uint16 (fraction x 65535)
+    if (isDotPlot()) {
+        fractions.resize(numCells);
+
+        const auto pageFractions = getPage(_fractions->data());
+
+        std::transform(pageFractions, pageFractions + numCells, fractions.begin(), [](float fraction) -> std::uint16_t {
+            return static_cast<std::uint16_t>(std::lround(std::clamp(fraction, 0.f, 1.f) * 65535.f));
+        });
+
+        payload.addMatrix("fraction", fractions.data(), fractions.size());
+        payload.addMatrix("expressingMean", getPage(getExpressingMeans()), numCells);
+    }
+
+    std::vector<std::uint16_t> histograms;
+
+    // Quantiles are views into the distributions, the histograms travel as compact uint16 bins
+    if (_distributions != nullptr) {
+        const auto numBins = _distributions->numBins;
+
+        const auto toJsonArray = [](auto begin, auto end, const auto& toJson) -> std::string {
+            std::string json = "[";
+
+            for (auto it = begin; it != end; ++it)
+                json += (it != begin ? "," : "") + toJson(*it);
+
+            return json + "]";
+        };
+
+        const auto toJsonNumber = [](float value) -> std::string { return QString::number(value).toStdString(); };
+        const auto toJsonName   = [](float level) -> std::string { return heatmap::HeatMapPayload::toJsonString(heatmap::getQuantileName(level)); };
+
+        for (std::size_t levelIndex = 0; levelIndex < _distributions->levels.size(); ++levelIndex)
+            payload.addMatrix(heatmap::getQuantileName(_distributions->levels[levelIndex]), getPage(getQuantiles(levelIndex)), numCells);
+
+        if (pageSize == numDimensions && !isOrdered) {
+            payload.addMatrix("histogram", _distributions->histograms.data(), _distributions->histograms.size());
+        }
+        else {
+            histograms.resize(numCells * numBins);
+
+            for (std::size_t clusterIndex = 0; clusterIndex < _numClusters; ++clusterIndex)
+                for (auto row = pageBegin; row < pageEnd; ++row)
+                    std::copy_n(_distributions->histograms.begin() + (clusterIndex * numDimensions + getPageRowDimension(row)) * numBins, numBins, histograms.begin() + (clusterIndex * pageSize + row - pageBegin) * numBins);
+
+            payload.addMatrix("histogram", histograms.data(), histograms.size());
+        }
+
+        const auto& levels = _distributions->levels;
+
+        std::vector<float> minimum, maximum;
+
+        for (auto row = pageBegin; row < pageEnd; ++row) {
+            minimum.push_back(_distributions->minimum[getPageRowDimension(row)]);
+            maximum.push_back(_distributions->maximum[getPageRowDimension(row)]);
+        }
+
+        payload.setMetadata("distributions", "{\"bins\":" + std::to_string(numBins) +
+            ",\"levels\":" + toJsonArray(levels.begin(), levels.end(), toJsonNumber) +
+            ",\"quantiles\":" + toJsonArray(levels.begin(), levels.end(), toJsonName) +
+            ",\"minimum\":" + toJsonArray(minimum.begin(), minimum.end(), toJsonNumber) +
+            ",\"maximum\":" + toJsonArray(maximum.begin(), maximum.end(), toJsonNumber) + "}");
+    }
+
+    payload.setMetadata("colorBy", heatmap::HeatMapPayload::toJsonString(isDotPlot() ? "expressingMean" : _colorBy.toStdString()));
+    payload.setMetadata("dotPlot", isDotPlot() ? "true" : "false");
+    payload.setMetadata("transform", heatmap::HeatMapPayload::toJsonString(heatmap::getValueTransformName(_valueTransform)));
+    payload.setMetadata("rasterize", _rasterize ? "true" : "false");
+
+    // Super-clusters as [number of clusters, expandable, collapsible] per column
+    if (_columnGroups.size() == _numClusters) {
+        std::string groups = "[";
+
+        for (const auto& group : _columnGroups)
+            groups += (groups.size() > 1 ? ",[" : "[") + std::to_string(group.numClusters) + (group.isExpandable ? ",true" : ",false") + (group.isCollapsible ? ",true]" : ",false]");
+
+        payload.setMetadata("groups", groups + "]");
+    }
+
+    // Dimension shown in every row of the page, so that the page can keep its marker selection on the same dimensions
+    if (isOrdered) {
+        std::string rows = "[";
+
+        for (auto row = pageBegin; row < pageEnd; ++row)
+            rows += (row > pageBegin ? "," : "") + std::to_string(getPageRowDimension(row));
+
+        payload.setMetadata("rows", rows + "]");
+    }
+
+    if (isPaged()) {
+        // Whether the dimension of every row of the page is a selected marker
+        std::string markers = "[";
+
+        for (auto row = pageBegin; row < pageEnd; ++row)
+            markers += (row > pageBegin ? "," : "") + std::to_string(_markerSelection[getPageRowDimension(row)]);
+
+        payload.setMetadata("markers", markers + "]");
+
+        // Values of the dimension the clusters are sorted by, so that the order does not depend on the rows of the page
+        if (_sortDimension >= 0 && static_cast<std::size_t>(_sortDimension) < numDimensions) {
+            const auto cellValues = getCellValues();
+
+            std::string values = "[";
+
+            for (std::size_t clusterIndex = 0; clusterIndex < _numClusters; ++clusterIndex) {
+                const auto value = cellValues[clusterIndex * numDimensions + _sortDimension];
+
+                values += (clusterIndex > 0 ? "," : "") + (std::isfinite(value) ? QString::number(value).toStdString() : std::string("null"));
+            }
+
+            payload.setMetadata("sort", "{\"dimension\":" + std::to_string(_sortDimension) + ",\"values\":" + values + "]}");
+        }
+    }
+
+    // Flat [left, right, height] merges of the dimensions (see heatmap::DendrogramMerge), drawn next to the rows of an unpaged panel
+    if (!isPaged() && !_rowMerges.empty()) {
+        std::string merges = "[";
+
+        for (const auto& merge : _rowMerges)
+            merges += (merges.size() > 1 ? "," : "") + std::to_string(merge.left) + "," + std::to_string(merge.right) + "," + QString::number(merge.height).toStdString();
+
+        payload.setMetadata("rowDendrogram", merges + "]");
+    }
+
+    payload.setMetadata("range", "[" + QString::number(_valueRange.first).toStdString() + "," + QString::number(_valueRange.second).toStdString() + "]");
+
+    // The names and matrices hold rows [begin, end) of the numDimensions rows the page scrolls through
+    payload.setMetadata("page", "{\"paged\":" + std::string(isPaged() ? "true" : "false") +
+        ",\"begin\":" + std::to_string(pageBegin) +
+        ",\"end\":" + std::to_string(pageEnd) +
+        ",\"numDimensions\":" + std::to_string(numRows) +
+        ",\"markerSelection\":" + std::string(_isMarkerSelectionActive ? "true" : "false") +
+        (rowOffset >= 0 ? ",\"offset\":" + std::to_string(rowOffset) : std::string()) +
+        ",\"request\":" + std::to_string(request) +
+        ",\"revision\":" + std::to_string(_dataRevision) + "}");
+
+    QByteArray encodedPayload(static_cast<qsizetype>(payload.getEncodedSize()), Qt::Uninitialized);
+
+    payload.encode(encodedPayload.data());
+
+    const auto payloadEnd = _stageTrace->now();
+
+    // The web channel transfers text, so the binary payload travels base64 encoded
+    const auto message = QString::fromLatin1(encodedPayload.toBase64());
+
+    _dataSentAt = _stageTrace->now();
+
+    emit _communicationObject->qt_setData(message);
+
+    const auto update = _stageTrace->getCurrentUpdate();
+
+    _stageTrace->addSpan("payload", "plugin", update, payloadBegin, payloadEnd);
+    _stageTrace->addSpan("base64", "plugin", update, payloadEnd, _dataSentAt);
+    _stageTrace->addSpan("channel", "plugin", update, _dataSentAt, _stageTrace->now());
+
+    // The selection column of a paged page covers the rows of the page only
+    if (isPaged())
+        sendSelectionStatistics();
+}
+
+void HeatMapWidget::sendSelectionStatistics()
+{
+    if (!loaded)
+        return;
+
+    const auto numDimensions    = _selectionMeans.size();
+    const auto isOrdered        = numDimensions == _dimensionNames.size();
+    const auto numRows          = isOrdered ? getNumPageRows() : numDimensions;
+    const auto end              = isPaged() ? std::min(_pageEnd, numRows) : numRows;
+    const auto begin            = isPaged() ? std::min(_pageBegin, end) : 0;
+
+    QVariantList means, stddevs;
+
+    means.reserve(static_cast<qsizetype>(end - begin));
+    stddevs.reserve(static_cast<qsizetype>(end - begin));
+
+    // The selection column shares the transform and the row order of the clusters
+    std::vector<float> transformedMeans(end - begin), transformedStddevs(end - begin);
+
+    const auto transformed  = isOrdered ? getTransformedStatistics() : nullptr;
+
+    for (auto row = begin; row < end; ++row) {
+        const auto dimension    = isOrdered ? getPageRowDimension(row) : static_cast<std::uint32_t>(row);
+        const auto index        = row - begin;
+
+        if (transformed != nullptr) {
+            transformed->transformer.transformValues(&_selectionMeans[dimension], &transformedMeans[index], 1, 1, dimension);
+            transformed->transformer.transformSpreads(&_selectionMeans[dimension], &_selectionStddevs[dimension], &transformedStddevs[index], 1, 1, dimension);
+        }
+        else {
+            transformedMeans[index]     = _selectionMeans[dimension];
+            transformedStddevs[index]   = _selectionStddevs[dimension];
+        }
+    }
+
+    for (std::size_t index = 0; index < transformedMeans.size(); ++index) {
+        means << transformedMeans[index];
+        stddevs << transformedStddevs[index];
+    }
+
+    // A double holds any point count exactly up to 2^53, an int wraps beyond 2^31
+    emit _communicationObject->qt_setSelectionStatistics(static_cast<double>(_selectionCount), static_cast<int>(begin), means, stddevs);
+}
+
+void HeatMapWidget::setPayloadFloatType(heatmap::HeatMapPayload::ValueType floatType)
+{
+    _payloadFloatType = floatType;
+}
+
+void HeatMapWidget::setColorBy(const QString& name)
+{
+    _colorBy = name;
+}
+
+void HeatMapWidget::setCellRendering(heatmap::CellRendering cellRendering)
+{
+    _cellRendering = cellRendering;
+}
+
+void HeatMapWidget::setValueTransform(heatmap::ValueTransform transform)
+{
+    if (transform == _valueTransform)
+        return;
+
+    _valueTransform = transform;
+
+    if (_dataRevision == 0)
+        return;
+
+    updateTransformedStatistics();
+    updateValueRange();
+
+    ++_dataRevision;
+
+    sendData(0);
+
+    if (!isPaged())
+        sendSelectionStatistics();
+}
+
+void HeatMapWidget::setColumnGroups(std::vector<heatmap::ColumnGroup> groups)
+{
+    _columnGroups = std::move(groups);
+}
+
+void HeatMapWidget::setRowOrder(std::vector<std::uint32_t> rows, std::vector<heatmap::DendrogramMerge> merges)
+{
+    if (rows.size() != _dimensionNames.size()) {
+        rows.clear();
+        merges.clear();
+    }
+
+    const auto isSameMerge = [](const heatmap::DendrogramMerge& lhs, const heatmap::DendrogramMerge& rhs) -> bool {
+        return lhs.left == rhs.left && lhs.right == rhs.right && lhs.height == rhs.height;
+    };
+
+    // A cached order that is shown already (e.g. after another affine transform) is not sent again
+    if (rows == _rowDimensions && std::ranges::equal(merges, _rowMerges, isSameMerge))
+        return;
+
+    _rowDimensions  = std::move(rows);
+    _rowMerges      = std::move(merges);
+
+    _dimensionRows.assign(_rowDimensions.size(), 0);
+
+    for (std::size_t row = 0; row < _rowDimensions.size(); ++row)
+        _dimensionRows[_rowDimensions[row]] = static_cast<std::uint32_t>(row);
+
+    updatePagedDimensions();
+
+    if (_dataRevision == 0)
+        return;
+
+    ++_dataRevision;
+
+    sendData(0);
+
+    if (!isPaged())
+        sendSelectionStatistics();
 }
 
 void HeatMapWidget::setSelection(QList<int> selection)
@@ -107,6 +717,80 @@ void HeatMapWidget::setSelection(QList<int> selection)
     emit _communicationObject->qt_setSelection(selection);
 }
 
+void HeatMapWidget::setStageTrace(std::shared_ptr<heatmap::StageTrace> stageTrace)
+{
+    if (stageTrace != nullptr)
+        _stageTrace = std::move(stageTrace);
+}
+
+void HeatMapWidget::setDendrogram(const std::vector<heatmap::DendrogramMerge>& merges)
+{
+    QVariantList flatMerges;
+
+    flatMerges.reserve(static_cast<qsizetype>(3 * merges.size()));
+
+    for (const auto& merge : merges)
+        flatMerges << merge.left << merge.right << merge.height;
+
+    emit _communicationObject->qt_setDendrogram(flatMerges);
+}
+
+void HeatMapWidget::setMarkerRanking(const std::vector<heatmap::MarkerScore>& markers)
+{
+    QVariantList dimensions;
+
+    dimensions.reserve(static_cast<qsizetype>(markers.size()));
+
+    // A paged page holds only some rows: the ranked markers become the marker selection here, the clusters are
+    // sorted by the best one, and the page scrolls to it
+    if (isPaged() && !markers.empty() && _markerSelection.size() == _dimensionNames.size()) {
+        std::ranges::fill(_markerSelection, 0);
+
+        for (const auto& marker : markers)
+            if (marker.dimension < _markerSelection.size())
+                _markerSelection[marker.dimension] = 1;
+
+        _sortDimension = static_cast<int>(markers.front().dimension);
+
+        updatePagedDimensions();
+    }
+
+    const auto getRowOfDimension = [this](std::uint32_t dimension) -> std::uint32_t {
+        return getDimensionRow(dimension);
+    };
+
+    // The page knows rows, not dimensions
+    for (const auto& marker : markers) {
+        if (isPaged())
+            dimensions << static_cast<quint32>(std::ranges::lower_bound(_pagedDimensions, getDimensionRow(marker.dimension), {}, getRowOfDimension) - _pagedDimensions.begin());
+        else
+            dimensions << getDimensionRow(marker.dimension);
+    }
+
+    emit _communicationObject->qt_setMarkerRanking(dimensions);
+}
+
+void HeatMapWidget::setSelectionOverlap(const std::vector<float>& fractions)
+{
+    _selectionOverlap.clear();
+    _selectionOverlap.reserve(static_cast<qsizetype>(fractions.size()));
+
+    for (const auto fraction : fractions)
+        _selectionOverlap << fraction;
+
+    if (loaded)
+        emit _communicationObject->qt_setSelectionOverlap(_selectionOverlap);
+}
+
+void HeatMapWidget::setSelectionStatistics(std::uint64_t numPoints, std::vector<float> means, std::vector<float> stddevs)
+{
+    _selectionCount     = numPoints;
+    _selectionMeans     = std::move(means);
+    _selectionStddevs   = std::move(stddevs);
+
+    sendSelectionStatistics();
+}
+
 void HeatMapWidget::mousePressEvent(QMouseEvent *event)
 {
     // UNUSED
@@ -140,6 +824,18 @@ void HeatMapWidget::initWebPage()
         emit _communicationObject->qt_addAvailableData(option);
     }
     dataOptionBuffer.clear();
+
+    // Statistics computed while the page was loading are shown straight away
+    if (_dataRevision == 0)
+        return;
+
+    sendData(0);
+
+    if (!isPaged())
+        sendSelectionStatistics();
+
+    if (!_selectionOverlap.isEmpty())
+        emit _communicationObject->qt_setSelectionOverlap(_selectionOverlap);
 }
 
 void HeatMapWidget::js_selectData(const QString& name)
@@ -156,3 +852,192 @@ void HeatMapWidget::js_selectionUpdated(const QVariantList& selectedClusters)
 
     emit clusterSelectionChanged(selectedIndices);
 }
+
+void HeatMapWidget::js_requestDendrogram(const QVariantList& dimensions)
+{
+    std::vector<std::uint32_t> dimensionIndices;
+
+    dimensionIndices.reserve(dimensions.size());
+
+    // The page sends the rows of the active markers
+    for (const auto& row : dimensions)
+        if (row.toUInt() < getNumPageRows())
+            dimensionIndices.push_back(getPageRowDimension(row.toUInt()));
+
+    // A paged page does not hold all rows and requests the clustering over the selected markers kept here
+    if (dimensions.isEmpty()) {
+        for (std::uint32_t dimension = 0; dimension < _markerSelection.size(); ++dimension)
+            if (_markerSelection[dimension] != 0)
+                dimensionIndices.push_back(dimension);
+    }
+
+    if (dimensionIndices.empty()) {
+        dimensionIndices.resize(_dimensionNames.size());
+        std::iota(dimensionIndices.begin(), dimensionIndices.end(), 0);
+    }
+
+    emit dendrogramRequested(dimensionIndices);
+}
+
+void HeatMapWidget::js_requestTiles(int request, const QVariantList& columns, const QVariantList& rows, const QVariantList& colors, double minimum, double maximum)
+{
+    if (!_rasterize || _means->empty())
+        return;
+
+    std::vector<std::uint32_t> columnClusters, rowDimensions;
+
+    columnClusters.reserve(columns.size());
+    rowDimensions.reserve(rows.size());
+
+    for (const auto& column : columns)
+        if (column.toUInt() < _numClusters)
+            columnClusters.push_back(column.toUInt());
+
+    for (const auto& row : rows)
+        if (row.toUInt() < getNumPageRows())
+            rowDimensions.push_back(getPageRowDimension(row.toUInt()));
+
+    heatmap::ColorMap colorMap;
+
+    colorMap.minimum = static_cast<float>(minimum);
+    colorMap.maximum = static_cast<float>(maximum);
+
+    colorMap.colors.reserve(colors.size());
+
+    for (const auto& color : colors) {
+        const auto rgba = static_cast<std::uint32_t>(color.toDouble());
+
+        colorMap.colors.push_back({ static_cast<std::uint8_t>(rgba >> 24), static_cast<std::uint8_t>(rgba >> 16), static_cast<std::uint8_t>(rgba >> 8), static_cast<std::uint8_t>(rgba) });
+    }
+
+    const auto tiles = heatmap::rasterizeHeatMap(getCellValues(), _dimensionNames.size(), columnClusters, rowDimensions, colorMap);
+
+    // One pixel per cell: the page scales the tiles up without smoothing
+    std::vector<QByteArray> images(tiles.size());
+
+    heatmap::parallelFor(tiles.size(), [&tiles, &images](std::size_t tileIndex) -> void {
+        const auto& tile = tiles[tileIndex];
+
+        const QImage image(reinterpret_cast<const uchar*>(tile.pixels.data()), static_cast<int>(tile.width), static_cast<int>(tile.height), static_cast<qsizetype>(tile.width * sizeof(heatmap::Rgba)), QImage::Format_RGBA8888);
+
+        QBuffer buffer(&images[tileIndex]);
+
+        buffer.open(QIODevice::WriteOnly);
+        image.save(&buffer, "PNG");
+    });
+
+    QVariantList tileList;
+
+    tileList.reserve(static_cast<qsizetype>(tiles.size()));
+
+    for (std::size_t tileIndex = 0; tileIndex < tiles.size(); ++tileIndex) {
+        const auto& tile = tiles[tileIndex];
+
+        tileList << QVariantMap({
+            { "column", static_cast<qulonglong>(tile.column) },
+            { "row", static_cast<qulonglong>(tile.row) },
+            { "width", static_cast<qulonglong>(tile.width) },
+            { "height", static_cast<qulonglong>(tile.height) },
+            { "image", QString("data:image/png;base64,") + QString::fromLatin1(images[tileIndex].toBase64()) }
+        });
+    }
+
+    emit _communicationObject->qt_setTiles(request, tileList);
+}
+
+void HeatMapWidget::js_requestMarkerRanking(const QVariantList& selectedClusters)
+{
+    std::vector<std::uint32_t> clusters;
+
+    for (std::uint32_t i = 0; i < selectedClusters.size(); ++i)
+        if (selectedClusters[i].toInt() > 0)
+            clusters.push_back(i);
+
+    emit markerRankingRequested(clusters);
+}
+
+void HeatMapWidget::js_requestPage(int request, int rowBegin, int rowEnd)
+{
+    setPageRows(rowBegin, rowEnd);
+
+    sendData(request);
+}
+
+void HeatMapWidget::js_setMarkerSelected(int dimension, bool selected)
+{
+    if (dimension < 0 || static_cast<std::size_t>(dimension) >= _markerSelection.size())
+        return;
+
+    _markerSelection[dimension] = selected ? 1 : 0;
+
+    // Only changes the rows outside of choosing markers, when the page scrolls through the selected ones
+    updatePagedDimensions();
+}
+
+void HeatMapWidget::js_setMarkerSelectionMode(int request, bool active, int rowBegin, int rowEnd)
+{
+    _isMarkerSelectionActive = active;
+
+    if (!isPaged() || _pagedDimensions.empty())
+        return;
+
+    // The first visible dimension stays at the top, or else the next row that is still shown
+    const auto numRows  = static_cast<int>(_pagedDimensions.size());
+    const auto firstRow = getDimensionRow(_pagedDimensions[std::clamp(rowBegin, 0, numRows - 1)]);
+
+    updatePagedDimensions();
+
+    const auto getRowOfDimension = [this](std::uint32_t dimension) -> std::uint32_t {
+        return getDimensionRow(dimension);
+    };
+
+    const auto rowOffset = static_cast<int>(std::ranges::lower_bound(_pagedDimensions, firstRow, {}, getRowOfDimension) - _pagedDimensions.begin());
+
+    setPageRows(rowOffset, rowOffset + std::max(rowEnd - rowBegin, 1));
+
+    sendData(request, rowOffset);
+}
+
+void HeatMapWidget::js_setSortDimension(int dimension)
+{
+    _sortDimension = dimension >= 0 && static_cast<std::size_t>(dimension) < _dimensionNames.size() ? dimension : -1;
+}
+
+void HeatMapWidget::js_reportTimings(int revision, const QVariantList& stages)
+{
+    // Reports of data that has been replaced in the meantime would end up in the wrong update
+    if (revision != static_cast<int>(_dataRevision) || stages.isEmpty())
+        return;
+
+    const auto update = _stageTrace->getCurrentUpdate();
+
+    for (qsizetype stageIndex = 0; stageIndex < stages.size(); ++stageIndex) {
+        const auto fields = stages[stageIndex].toList();
+
+        if (fields.size() != 3)
+            continue;
+
+        const auto begin    = _stageTrace->fromSystemTime(fields[1].toDouble());
+        const auto end      = _stageTrace->fromSystemTime(fields[2].toDouble());
+
+        // From handing the data to the web channel until the page received it
+        if (stageIndex == 0 && begin > _dataSentAt)
+            _stageTrace->addSpan("transfer", "page", update, _dataSentAt, begin);
+
+        _stageTrace->addSpan(fields[0].toString().toStdString(), "page", update, begin, end);
+    }
+
+    emit pageTimingsReported();
+}
+
+void HeatMapWidget::js_expandColumn(int column)
+{
+    if (column >= 0 && static_cast<std::size_t>(column) < _columnGroups.size() && _columnGroups[column].isExpandable)
+        emit columnExpansionRequested(static_cast<std::size_t>(column));
+}
+
+void HeatMapWidget::js_collapseColumn(int column)
+{
+    if (column >= 0 && static_cast<std::size_t>(column) < _columnGroups.size() && _columnGroups[column].isCollapsible)
+        emit columnCollapseRequested(static_cast<std::size_t>(column));
+}
@@ -2,7 +2,22 @@
 
 #include "widgets/WebWidget.h"
 
+#include "ClusterDistributions.h"
+#include "ClusterHierarchy.h"
+#include "HeatMapPayload.h"
+#include "HeatMapRaster.h"
+#include "HierarchicalClustering.h"
+#include "MarkerRanking.h"
+#include "StageTrace.h"
+#include "StatisticsMatrix.h"
+#include "ValueTransform.h"
+
 #include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include <QList>
 #include <QMouseEvent>
@@ -12,8 +27,6 @@ class QWebEngineView;
 class QWebEnginePage;
 class QWebChannel;
 
-class Cluster;
-
 class HeatMapWidget;
 
 class HeatMapCommunicationObject : public mv::gui::WebCommunicationObject
@@ -23,15 +36,30 @@ public:
     HeatMapCommunicationObject(HeatMapWidget* parent);
 
 signals:
-    void qt_setData(QString data);
+    void qt_setData(QString data);          /** Base64 encoded binary heatmap payload (see heatmap::HeatMapPayload) */
     void qt_addAvailableData(QString name);
     void qt_setSelection(QList<int> selection);
     void qt_setHighlight(int highlightId);
     void qt_setMarkerSelection(QList<int> selection);
+    void qt_setDendrogram(QVariantList merges);    /** Flat list of [left, right, height] merges (see heatmap::DendrogramMerge) */
+    void qt_setMarkerRanking(QVariantList dimensions);  /** Top ranked markers of the selected clusters, best first */
+    void qt_setTiles(int request, QVariantList tiles);  /** Image tiles of the cells as {column, row, width, height, image} with a PNG data URL image */
+    void qt_setSelectionOverlap(QVariantList fractions);    /** Fraction of the points of each cluster that is selected */
+    void qt_setSelectionStatistics(double numPoints, int begin, QVariantList means, QVariantList stddevs);    /** Statistics of the selected points for dimensions [begin, begin + means.size()) */
 
 public slots:
     void js_selectData(QString text);
     void js_selectionUpdated(const QVariantList& selectedClusters);
+    void js_requestDendrogram(const QVariantList& dimensions);
+    void js_requestMarkerRanking(const QVariantList& selectedClusters);
+    void js_requestPage(int request, int rowBegin, int rowEnd);
+    void js_setMarkerSelected(int dimension, bool selected);
+    void js_setMarkerSelectionMode(int request, bool active, int rowBegin, int rowEnd);
+    void js_setSortDimension(int dimension);
+    void js_requestTiles(int request, const QVariantList& columns, const QVariantList& rows, const QVariantList& colors, double minimum, double maximum);
+    void js_reportTimings(int revision, const QVariantList& stages);
+    void js_expandColumn(int column);
+    void js_collapseColumn(int column);
 
 private:
     HeatMapWidget* _parent;
@@ -41,13 +69,121 @@ class HeatMapWidget : public mv::gui::WebWidget
 {
     Q_OBJECT
 public:
+    /**
+     * Panels with more dimensions than this are sent to the page in pages of rows
+     *
+     * Only rows are paged: every page holds all columns, whose number the super-clusters bound
+     * (see the "Max columns" setting). The marker selection and the dimension the clusters are
+     * sorted by are kept here, so the page scrolls through the selected markers (or through all
+     * rows while choosing markers) and every page carries the values to sort the clusters by.
+     */
+    static constexpr std::size_t pagedDimensionThreshold = 1000;
+
+    /** Number of rows sent before the page reported its visible rows */
+    static constexpr std::size_t initialPageSize = 128;
+
+    /** Number of rows sent above and below the visible rows of a page */
+    static constexpr std::size_t pageReadAhead = 64;
+
     HeatMapWidget();
     ~HeatMapWidget() override;
 
     void addDataOption(const QString option);
-    void setData(const QVector<Cluster>& data, const std::vector<QString>& dimNames, const std::vector<QString>& clusterNames, const int numDimensions);
+
+    /**
+     * Show the statistics of a set of clusters
+     *
+     * The matrices are shared with the caller rather than copied, so they must not be modified afterwards.
+     * @param means Clusters x dimensions means
+     * @param stddevs Clusters x dimensions standard deviations (same shape as \p means)
+     * @param fractions Clusters x dimensions fractions of expressing points (same shape as \p means)
+     * @param expressingMeans Clusters x dimensions means of the expressing values (same shape as \p means)
+     * @param clusterSizes Number of points per cluster
+     * @param dimNames Dimension names
+     * @param clusterNames Cluster names
+     * @param distributions Quantiles and histograms (if computed)
+     */
+    void setData(std::shared_ptr<const heatmap::StatisticsMatrix> means, std::shared_ptr<const heatmap::StatisticsMatrix> stddevs, std::shared_ptr<const heatmap::StatisticsMatrix> fractions, std::shared_ptr<const heatmap::StatisticsMatrix> expressingMeans, const std::vector<std::uint64_t>& clusterSizes, const std::vector<QString>& dimNames, const std::vector<QString>& clusterNames, std::shared_ptr<const heatmap::ClusterDistributions> distributions = nullptr);
+
+    /**
+     * Set the element type of the floating point matrices sent to the web page
+     * @param floatType Float32 or Float16 (half the transfer size, about three significant digits)
+     */
+    void setPayloadFloatType(heatmap::HeatMapPayload::ValueType floatType);
+
+    /**
+     * Set the statistic the heatmap is colored by (applies to the next setData)
+     * @param name "mean", or the name of a quantile (see heatmap::getQuantileName)
+     */
+    void setColorBy(const QString& name);
+
+    /**
+     * Set how the cells are drawn (applies to the next setData)
+     * @param cellRendering Vector shapes, image tiles rendered here, automatic by the number of cells, or a dot plot
+     */
+    void setCellRendering(heatmap::CellRendering cellRendering);
+
+    /**
+     * Set the transform applied to the statistics before they are color mapped, and re-send the data
+     *
+     * Transformed statistics are cached per transform until the next setData, so switching back
+     * and forth only re-sends them.
+     *
+     * @param transform Value transform
+     */
+    void setValueTransform(heatmap::ValueTransform transform);
+
+    /**
+     * Set the super-cluster shown in every column (applies to the next setData)
+     * @param groups Super-cluster per column (empty when every column is a cluster)
+     */
+    void setColumnGroups(std::vector<heatmap::ColumnGroup> groups);
+
+    /**
+     * Set the dimension shown in every row, and re-send the data
+     *
+     * The rows are ordered here, so pages, image tiles and the selection column follow the order
+     * and the page only sees rows. An order of other dimensions (e.g. of previous data) is dropped.
+     *
+     * @param rows Dimension per row (empty for the order of the dataset)
+     * @param merges Hierarchical clustering of the dimensions, shown as row dendrogram when the panel is not paged (may be empty)
+     */
+    void setRowOrder(std::vector<std::uint32_t> rows, std::vector<heatmap::DendrogramMerge> merges);
+
     void setSelection(QList<int> selection);
 
+    /**
+     * Send the hierarchical clustering of the clusters to the web page
+     * @param merges Merges in order of increasing height
+     */
+    void setDendrogram(const std::vector<heatmap::DendrogramMerge>& merges);
+
+    /**
+     * Send the top ranked markers to the web page, which selects them and sorts the clusters by the best one
+     * @param markers Marker scores, best first
+     */
+    void setMarkerRanking(const std::vector<heatmap::MarkerScore>& markers);
+
+    /**
+     * Send the selected fraction of every cluster to the web page, which shows it as a bar per column
+     * @param fractions Selected fraction per cluster (empty to clear)
+     */
+    void setSelectionOverlap(const std::vector<float>& fractions);
+
+    /**
+     * Set the statistics of the points selected in linked views, which the web page shows as an extra column
+     * @param numPoints Number of selected points (zero hides the column)
+     * @param means Per-dimension means of the selected points
+     * @param stddevs Per-dimension standard deviations of the selected points
+     */
+    void setSelectionStatistics(std::uint64_t numPoints, std::vector<float> means, std::vector<float> stddevs);
+
+    /**
+     * Set the trace that the widget and the page add the stages of their updates to
+     * @param stageTrace Stage trace (shared with the plugin)
+     */
+    void setStageTrace(std::shared_ptr<heatmap::StageTrace> stageTrace);
+
 protected:
     void mousePressEvent(QMouseEvent *event)   Q_DECL_OVERRIDE;
     void mouseMoveEvent(QMouseEvent *event)    Q_DECL_OVERRIDE;
@@ -56,13 +192,178 @@ protected:
     void onSelection(QRectF selection);
     void cleanup();
 
+    /** Get whether the panel is too wide to send at once */
+    bool isPaged() const;
+
+    /**
+     * Get the dimension shown in \p row
+     * @param row Row index
+     */
+    std::uint32_t getRowDimension(std::size_t row) const {
+        return _rowDimensions.empty() ? static_cast<std::uint32_t>(row) : _rowDimensions[row];
+    }
+
+    /**
+     * Get the row of dimension \p dimension
+     * @param dimension Dimension index
+     */
+    std::uint32_t getDimensionRow(std::uint32_t dimension) const {
+        return _dimensionRows.empty() ? dimension : _dimensionRows[dimension];
+    }
+
+    /** Get the number of rows in the numbering of the page: the paged dimensions of a paged panel, otherwise all rows */
+    std::size_t getNumPageRows() const;
+
+    /**
+     * Get the dimension shown in \p row in the numbering of the page (see getNumPageRows)
+     * @param row Row index of the page
+     */
+    std::uint32_t getPageRowDimension(std::size_t row) const;
+
+    /** Collect the dimensions a paged page scrolls through, from the marker selection and the row order */
+    void updatePagedDimensions();
+
+    /**
+     * Set the rows sent to a paged page to the visible rows [\p rowBegin, \p rowEnd) plus read-ahead
+     * @param rowBegin First visible row
+     * @param rowEnd One past the last visible row
+     */
+    void setPageRows(int rowBegin, int rowEnd);
+
+    /** Cluster statistics after a value transform */
+    struct TransformedStatistics
+    {
+        heatmap::ValueTransformer   transformer;    /** Transform fitted to the means */
+        std::vector<float>          means;          /** Transformed means */
+        std::vector<float>          stddevs;        /** Transformed standard deviations */
+        std::vector<float>          expressingMeans;    /** Transformed means of the expressing values */
+        std::vector<float>          quantiles;      /** Transformed quantiles, level after level (levels x clusters x dimensions) */
+    };
+
+    /** Get the clusters x dimensions matrix of the statistic the heatmap is colored by (transformed; the expressing means in a dot plot) */
+    const float* getCellValues() const;
+
+    /** Get the statistics transformed by the current value transform, or nullptr without transform */
+    const TransformedStatistics* getTransformedStatistics() const;
+
+    /** Get the (transformed) clusters x dimensions means */
+    const float* getMeans() const;
+
+    /** Get the (transformed) clusters x dimensions standard deviations */
+    const float* getStandardDeviations() const;
+
+    /** Get the (transformed) clusters x dimensions means of the expressing values */
+    const float* getExpressingMeans() const;
+
+    /** Get whether the cells are drawn as a dot plot */
+    bool isDotPlot() const;
+
+    /**
+     * Get the (transformed) clusters x dimensions quantiles of level \p levelIndex of the distributions
+     * @param levelIndex Index of the quantile level
+     */
+    const float* getQuantiles(std::size_t levelIndex) const;
+
+    /** Transform the statistics with the current value transform, unless they are cached already */
+    void updateTransformedStatistics();
+
+    /** Compute the range of the colored statistics of all cells */
+    void updateValueRange();
+
+    /**
+     * Send the rows of the current page (all rows when not paged) to the web page
+     * @param request Page request that is answered, zero for new data
+     * @param rowOffset First row the page should show, when the rows it scrolls through changed (-1 to keep its own)
+     */
+    void sendData(int request, int rowOffset = -1);
+
+    /** Send the selection statistics of the dimensions of the current page (all dimensions when not paged) to the web page */
+    void sendSelectionStatistics();
+
 signals:
     void clusterSelectionChanged(const std::vector<std::uint32_t>& selectedClusters);
     void dataSetPicked(const QString& name);
 
+    /** Emitted when the page needs the clusters to be clustered over \p dimensions (the active markers, or all dimensions when paged) */
+    void dendrogramRequested(const std::vector<std::uint32_t>& dimensions);
+
+    /** Emitted when the page asks for the markers of the clusters in \p clusters versus the other clusters */
+    void markerRankingRequested(const std::vector<std::uint32_t>& clusters);
+
+    /** Emitted when the page reported how long it took to show the last data */
+    void pageTimingsReported();
+
+    /** Emitted when the page asks to split the super-cluster of \p column into its children */
+    void columnExpansionRequested(std::size_t column);
+
+    /** Emitted when the page asks to merge the super-cluster of \p column into its parent */
+    void columnCollapseRequested(std::size_t column);
+
 public:
     void js_selectData(const QString& text);
     void js_selectionUpdated(const QVariantList& selectedClusters);
+    void js_requestDendrogram(const QVariantList& dimensions);
+    void js_requestMarkerRanking(const QVariantList& selectedClusters);
+
+    /**
+     * Send the rows [\p rowBegin, \p rowEnd) visible in a paged page, plus read-ahead
+     * @param request Request number, echoed so that the page can drop outdated pages
+     * @param rowBegin First visible row
+     * @param rowEnd One past the last visible row
+     */
+    void js_requestPage(int request, int rowBegin, int rowEnd);
+
+    /**
+     * Select or deselect the marker \p dimension of a paged panel, whose marker selection is kept here
+     * @param dimension Dimension index
+     * @param selected Whether the dimension is a selected marker
+     */
+    void js_setMarkerSelected(int dimension, bool selected);
+
+    /**
+     * Let a paged page scroll through all rows to choose markers, or through the selected markers only, and send it the rows around the same dimension
+     * @param request Request number, echoed so that the page can drop outdated pages
+     * @param active Whether markers are being chosen
+     * @param rowBegin First visible row, in the previous numbering of the page
+     * @param rowEnd One past the last visible row, in the previous numbering of the page
+     */
+    void js_setMarkerSelectionMode(int request, bool active, int rowBegin, int rowEnd);
+
+    /**
+     * Set the dimension a paged page sorts the clusters by; every page carries the values of it
+     * @param dimension Dimension index (-1 for none)
+     */
+    void js_setSortDimension(int dimension);
+
+    /**
+     * Color map the cells in the given display order into image tiles and send them to the page
+     * @param request Request number, echoed so that the page can drop outdated tiles
+     * @param columns Cluster shown in each column
+     * @param rows Row shown in each row of the tiles
+     * @param colors Color map as packed 0xRRGGBBAA colors of even bins of [minimum, maximum]
+     * @param minimum Lower end of the color map
+     * @param maximum Upper end of the color map
+     */
+    void js_requestTiles(int request, const QVariantList& columns, const QVariantList& rows, const QVariantList& colors, double minimum, double maximum);
+
+    /**
+     * Add the stages the page took to show data revision \p revision to the stage trace
+     * @param revision Data revision the page showed
+     * @param stages List of [name, begin, end] with wall clock times in milliseconds since the epoch, in order
+     */
+    void js_reportTimings(int revision, const QVariantList& stages);
+
+    /**
+     * Ask to split the super-cluster of \p column into its two children
+     * @param column Column index
+     */
+    void js_expandColumn(int column);
+
+    /**
+     * Ask to merge the super-cluster of \p column, and the columns of its siblings, into its parent
+     * @param column Column index
+     */
+    void js_collapseColumn(int column);
 
 private slots:
     void initWebPage() override;
@@ -72,6 +373,50 @@ private:
 
     unsigned int _numClusters;
 
+    /** Element type of the floating point matrices sent to the web page */
+    heatmap::HeatMapPayload::ValueType _payloadFloatType;
+
+    /** Name of the statistic the heatmap is colored by */
+    QString _colorBy;
+
+    /** How the cells are drawn */
+    heatmap::CellRendering _cellRendering;
+
+    std::vector<std::string>    _clusterNames;      /** Cluster names */
+    std::vector<std::uint64_t>  _clusterSizes;      /** Number of points per cluster */
+    std::vector<heatmap::ColumnGroup> _columnGroups;    /** Super-cluster per column (empty when every column is a cluster) */
+    std::vector<std::string>    _dimensionNames;    /** Names of all dimensions */
+    std::vector<std::uint32_t>  _rowDimensions;     /** Dimension shown in every row (empty for the order of the dataset) */
+    std::vector<std::uint32_t>  _dimensionRows;     /** Row of every dimension, the inverse of _rowDimensions */
+    std::vector<heatmap::DendrogramMerge> _rowMerges;   /** Hierarchical clustering of the dimensions, shown as row dendrogram */
+    std::shared_ptr<const heatmap::StatisticsMatrix> _means;    /** Clusters x dimensions means (shared with the plugin) */
+    std::shared_ptr<const heatmap::StatisticsMatrix> _stddevs;  /** Clusters x dimensions standard deviations (shared with the plugin) */
+    std::shared_ptr<const heatmap::StatisticsMatrix> _fractions;        /** Clusters x dimensions fractions of expressing points (shared with the plugin) */
+    std::shared_ptr<const heatmap::StatisticsMatrix> _expressingMeans;  /** Clusters x dimensions means of the expressing values (shared with the plugin) */
+
+    /** Quantiles and histograms of all clusters and dimensions (if computed) */
+    std::shared_ptr<const heatmap::ClusterDistributions> _distributions;
+
+    heatmap::ValueTransform     _valueTransform;    /** Transform applied before color mapping */
+    std::map<heatmap::ValueTransform, TransformedStatistics> _transformedStatistics;   /** Transformed statistics of the current data per transform */
+
+    std::pair<float, float>     _valueRange;        /** Range of the finite colored statistics of all cells */
+    bool                        _rasterize;         /** Whether the page draws the cells as image tiles */
+    std::size_t                 _pageBegin;         /** First row sent to a paged page (see getPageRowDimension) */
+    std::size_t                 _pageEnd;           /** One past the last row sent to a paged page */
+    std::vector<std::uint8_t>   _markerSelection;   /** Whether every dimension is a selected marker of a paged panel */
+    bool                        _isMarkerSelectionActive;   /** Whether a paged page is choosing markers, and scrolls through all rows */
+    std::vector<std::uint32_t>  _pagedDimensions;   /** Dimensions a paged page scrolls through, in row order */
+    int                         _sortDimension;     /** Dimension a paged page sorts the clusters by (-1 for none) */
+    std::uint64_t               _dataRevision;      /** Incremented with every setData, so pages can tell new data from pages */
+    std::uint64_t               _selectionCount;    /** Number of points selected in linked views */
+    std::vector<float>          _selectionMeans;    /** Per-dimension means of the selected points */
+    std::vector<float>          _selectionStddevs;  /** Per-dimension standard deviations of the selected points */
+
+    std::shared_ptr<heatmap::StageTrace> _stageTrace;   /** Timings of the update stages */
+    std::int64_t                _dataSentAt;        /** Trace time at which the last data was handed to the web channel */
+    QVariantList                _selectionOverlap;  /** Selected fraction of every cluster */
+
     /** Whether the web view has loaded and web-functions are ready to be called. */
     bool loaded;
     /** Temporary storage for added data options until webview is loaded */
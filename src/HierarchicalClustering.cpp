@@ -0,0 +1,309 @@
+#include "HierarchicalClustering.h"
+
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <utility>
+
+namespace heatmap
+{
+
+namespace
+{
+    /** Index of d(i, j), i < j, in a condensed distance matrix of \p numItems items */
+    inline std::size_t condensedIndex(std::size_t numItems, std::size_t i, std::size_t j)
+    {
+        return numItems * i - i * (i + 1) / 2 + j - i - 1;
+    }
+
+    /**
+     * Normalize (and for correlation first center) the feature vectors so that the distance is one minus their dot product
+     * @param features Row-major feature vectors
+     * @param numItems Number of items
+     * @param numFeatures Number of features per item
+     * @param center Whether to subtract the mean of each vector first
+     * @return Normalized feature vectors (zero vectors stay zero)
+     */
+    std::vector<float> normalizeFeatures(const float* features, std::size_t numItems, std::size_t numFeatures, bool center)
+    {
+        std::vector<float> normalized(features, features + numItems * numFeatures);
+
+        parallelFor(numItems, [&](std::size_t item) -> void {
+            auto row = normalized.data() + item * numFeatures;
+
+            if (center && numFeatures > 0) {
+                const auto mean = std::accumulate(row, row + numFeatures, 0.0) / static_cast<double>(numFeatures);
+
+                for (std::size_t f = 0; f < numFeatures; ++f)
+                    row[f] = static_cast<float>(row[f] - mean);
+            }
+
+            double squaredNorm = 0.0;
+
+            for (std::size_t f = 0; f < numFeatures; ++f)
+                squaredNorm += static_cast<double>(row[f]) * row[f];
+
+            const auto scale = squaredNorm > 0.0 ? static_cast<float>(1.0 / std::sqrt(squaredNorm)) : 0.0f;
+
+            for (std::size_t f = 0; f < numFeatures; ++f)
+                row[f] *= scale;
+        });
+
+        return normalized;
+    }
+
+    /**
+     * Lance-Williams update of the distance between cluster k and the merge of clusters i and j
+     * @param linkage Linkage
+     * @param distanceKI Distance between k and i
+     * @param distanceKJ Distance between k and j
+     * @param distanceIJ Distance between i and j
+     * @param sizeI Number of items in i
+     * @param sizeJ Number of items in j
+     * @param sizeK Number of items in k
+     * @return Distance between k and the merged cluster
+     */
+    inline double updateDistance(Linkage linkage, double distanceKI, double distanceKJ, double distanceIJ, double sizeI, double sizeJ, double sizeK)
+    {
+        switch (linkage)
+        {
+            case Linkage::Single:
+                return std::min(distanceKI, distanceKJ);
+
+            case Linkage::Complete:
+                return std::max(distanceKI, distanceKJ);
+
+            case Linkage::Average:
+                return (sizeI * distanceKI + sizeJ * distanceKJ) / (sizeI + sizeJ);
+
+            case Linkage::Ward:
+            {
+                const auto squared = ((sizeI + sizeK) * distanceKI * distanceKI + (sizeJ + sizeK) * distanceKJ * distanceKJ - sizeK * distanceIJ * distanceIJ) / (sizeI + sizeJ + sizeK);
+
+                return std::sqrt(std::max(0.0, squared));
+            }
+        }
+
+        return distanceKI;
+    }
+}
+
+std::vector<float> computeDistanceMatrix(const float* features, std::size_t numItems, std::size_t numFeatures, DistanceMetric metric, std::stop_token stopToken)
+{
+    std::vector<float> distances(numItems > 1 ? numItems * (numItems - 1) / 2 : 0);
+
+    if (distances.empty())
+        return distances;
+
+    std::vector<float> normalized;
+
+    if (metric == DistanceMetric::Cosine || metric == DistanceMetric::Correlation) {
+        normalized  = normalizeFeatures(features, numItems, numFeatures, metric == DistanceMetric::Correlation);
+        features    = normalized.data();
+    }
+
+    // Row i holds numItems - 1 - i distances, so rows are handed out dynamically
+    parallelFor(numItems - 1, [&](std::size_t i) -> void {
+        if (stopToken.stop_requested())
+            return;
+
+        const auto rowI     = features + i * numFeatures;
+        auto output         = distances.data() + condensedIndex(numItems, i, i + 1);
+
+        for (auto j = i + 1; j < numItems; ++j) {
+            const auto rowJ = features + j * numFeatures;
+
+            float accumulated = 0.0f;
+
+            switch (metric)
+            {
+                case DistanceMetric::Euclidean:
+                {
+                    for (std::size_t f = 0; f < numFeatures; ++f) {
+                        const auto difference = rowI[f] - rowJ[f];
+
+                        accumulated += difference * difference;
+                    }
+
+                    accumulated = std::sqrt(accumulated);
+                    break;
+                }
+
+                case DistanceMetric::Manhattan:
+                {
+                    for (std::size_t f = 0; f < numFeatures; ++f)
+                        accumulated += std::abs(rowI[f] - rowJ[f]);
+
+                    break;
+                }
+
+                case DistanceMetric::Cosine:
+                case DistanceMetric::Correlation:
+                {
+                    for (std::size_t f = 0; f < numFeatures; ++f)
+                        accumulated += rowI[f] * rowJ[f];
+
+                    accumulated = std::max(0.0f, 1.0f - accumulated);
+                    break;
+                }
+            }
+
+            *output++ = accumulated;
+        }
+    });
+
+    return distances;
+}
+
+std::vector<DendrogramMerge> clusterHierarchically(const float* features, std::size_t numItems, std::size_t numFeatures, Linkage linkage, DistanceMetric metric, std::stop_token stopToken)
+{
+    if (numItems < 2)
+        return {};
+
+    auto distances = computeDistanceMatrix(features, numItems, numFeatures, metric, stopToken);
+
+    if (stopToken.stop_requested())
+        return {};
+
+    return clusterDistanceMatrix(std::move(distances), numItems, linkage, stopToken);
+}
+
+std::vector<DendrogramMerge> clusterDistanceMatrix(std::vector<float> distances, std::size_t numItems, Linkage linkage, std::stop_token stopToken)
+{
+    if (numItems < 2 || distances.size() != numItems * (numItems - 1) / 2)
+        return {};
+
+    // Statistics of data with NaNs give NaN distances, which never compare as nearest; they count as the largest distance
+    float maxDistance = 0.f;
+
+    for (const auto itemDistance : distances)
+        if (std::isfinite(itemDistance))
+            maxDistance = std::max(maxDistance, itemDistance);
+
+    for (auto& itemDistance : distances)
+        if (!std::isfinite(itemDistance))
+            itemDistance = maxDistance;
+
+    const auto distance = [&](std::size_t i, std::size_t j) -> float& {
+        return i < j ? distances[condensedIndex(numItems, i, j)] : distances[condensedIndex(numItems, j, i)];
+    };
+
+    // Every merge is stored in the slot of one of its clusters, the other slot is deactivated
+    std::vector<std::uint32_t> sizes(numItems, 1);
+    std::vector<std::uint32_t> activeSlots(numItems);
+    std::vector<std::uint32_t> chain;
+
+    std::iota(activeSlots.begin(), activeSlots.end(), 0);
+
+    struct SlotMerge
+    {
+        std::uint32_t   slotA;      /** Slot of the deactivated cluster */
+        std::uint32_t   slotB;      /** Slot that holds the merge */
+        float           height;     /** Linkage distance */
+    };
+
+    std::vector<SlotMerge> slotMerges;
+
+    slotMerges.reserve(numItems - 1);
+    chain.reserve(numItems);
+
+    while (activeSlots.size() > 1) {
+        if (stopToken.stop_requested())
+            return {};
+
+        if (chain.empty())
+            chain.push_back(activeSlots.front());
+
+        // Grow the chain of nearest neighbours until its last two clusters are reciprocal nearest neighbours
+        while (true) {
+            const auto slot = chain.back();
+
+            // Preferring the previous chain element on ties guarantees that the chain terminates
+            std::uint32_t nearest   = chain.size() > 1 ? chain[chain.size() - 2] : slot;
+            float nearestDistance   = nearest != slot ? distance(slot, nearest) : std::numeric_limits<float>::infinity();
+
+            for (const auto candidate : activeSlots) {
+                if (candidate == slot)
+                    continue;
+
+                const auto candidateDistance = distance(slot, candidate);
+
+                // A cluster is never merged with itself, whatever the distances
+                if (candidateDistance < nearestDistance || nearest == slot) {
+                    nearest         = candidate;
+                    nearestDistance = candidateDistance;
+                }
+            }
+
+            if (chain.size() > 1 && nearest == chain[chain.size() - 2])
+                break;
+
+            chain.push_back(nearest);
+        }
+
+        const auto slotA = chain.back();
+
+        chain.pop_back();
+
+        const auto slotB = chain.back();
+
+        chain.pop_back();
+
+        const auto distanceAB = static_cast<double>(distance(slotA, slotB));
+
+        slotMerges.push_back({ slotA, slotB, static_cast<float>(distanceAB) });
+
+        std::erase(activeSlots, slotA);
+
+        for (const auto slot : activeSlots)
+            if (slot != slotB)
+                distance(slot, slotB) = static_cast<float>(updateDistance(linkage, distance(slot, slotA), distance(slot, slotB), distanceAB, sizes[slotA], sizes[slotB], sizes[slot]));
+
+        sizes[slotB] += sizes[slotA];
+    }
+
+    // Order the merges by height and number the nodes like SciPy, tracking the node of each slot with a union-find
+    std::stable_sort(slotMerges.begin(), slotMerges.end(), [](const SlotMerge& lhs, const SlotMerge& rhs) {
+        return lhs.height < rhs.height;
+    });
+
+    std::vector<std::uint32_t> parents(2 * numItems - 1);
+    std::vector<std::uint32_t> nodeSizes(2 * numItems - 1, 1);
+
+    std::iota(parents.begin(), parents.end(), 0);
+
+    const auto findRoot = [&parents](std::uint32_t node) -> std::uint32_t {
+        auto root = node;
+
+        while (parents[root] != root)
+            root = parents[root];
+
+        while (parents[node] != root)
+            node = std::exchange(parents[node], root);
+
+        return root;
+    };
+
+    std::vector<DendrogramMerge> merges;
+
+    merges.reserve(slotMerges.size());
+
+    for (const auto& slotMerge : slotMerges) {
+        const auto left     = findRoot(slotMerge.slotA);
+        const auto right    = findRoot(slotMerge.slotB);
+        const auto node     = static_cast<std::uint32_t>(numItems + merges.size());
+
+        nodeSizes[node] = nodeSizes[left] + nodeSizes[right];
+        parents[left]   = node;
+        parents[right]  = node;
+
+        merges.push_back({ std::min(left, right), std::max(left, right), slotMerge.height, nodeSizes[node] });
+    }
+
+    return merges;
+}
+
+}
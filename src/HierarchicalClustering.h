@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <stop_token>
+#include <vector>
+
+namespace heatmap
+{
+
+/** Rule for the distance between two groups of items */
+enum class Linkage
+{
+    Average,    /** Mean of the pairwise distances (UPGMA) */
+    Complete,   /** Largest pairwise distance */
+    Single,     /** Smallest pairwise distance */
+    Ward        /** Increase in within-group variance (meant for Euclidean distances) */
+};
+
+/** Distance between two feature vectors */
+enum class DistanceMetric
+{
+    Euclidean,      /** Square root of the summed squared differences */
+    Manhattan,      /** Summed absolute differences */
+    Cosine,         /** One minus the cosine of the angle between the vectors */
+    Correlation     /** One minus the Pearson correlation of the vectors */
+};
+
+/** One merge of a hierarchical clustering, in the numbering of SciPy's linkage matrix */
+struct DendrogramMerge
+{
+    std::uint32_t   left;       /** First merged node: items are 0 ... n - 1, the node created by merge k is n + k */
+    std::uint32_t   right;      /** Second merged node */
+    float           height;     /** Linkage distance of the merge */
+    std::uint32_t   size;       /** Number of items in the new node */
+};
+
+/**
+ * Compute the condensed pairwise distance matrix of \p numItems feature vectors
+ *
+ * Rows are computed in parallel; cosine and correlation distances are evaluated as a dot product
+ * of vectors that are normalized (and centered) once up front.
+ *
+ * @param features Row-major feature vectors (numItems x numFeatures)
+ * @param numItems Number of items
+ * @param numFeatures Number of features per item
+ * @param metric Distance metric
+ * @param stopToken Token to cancel the computation with; the result is incomplete when stop was requested
+ * @return Distances d(i, j) for i < j, row by row (numItems * (numItems - 1) / 2 values)
+ */
+std::vector<float> computeDistanceMatrix(const float* features, std::size_t numItems, std::size_t numFeatures, DistanceMetric metric, std::stop_token stopToken = {});
+
+/**
+ * Cluster \p numItems feature vectors agglomeratively
+ *
+ * Uses the nearest-neighbour chain algorithm with Lance-Williams updates on the condensed
+ * distance matrix: O(n^2) time and memory for all supported linkages (instead of O(n^3) for the
+ * naive algorithm). The merges are returned in order of increasing height.
+ *
+ * @param features Row-major feature vectors (numItems x numFeatures)
+ * @param numItems Number of items
+ * @param numFeatures Number of features per item
+ * @param linkage Linkage
+ * @param metric Distance metric
+ * @param stopToken Token to cancel the computation with; the result is empty when stop was requested
+ * @return numItems - 1 merges (none for fewer than two items)
+ */
+std::vector<DendrogramMerge> clusterHierarchically(const float* features, std::size_t numItems, std::size_t numFeatures, Linkage linkage, DistanceMetric metric, std::stop_token stopToken = {});
+
+/**
+ * Cluster \p numItems items agglomeratively from their pairwise distances (see clusterHierarchically)
+ * @param distances Condensed distance matrix (see computeDistanceMatrix), overwritten by the Lance-Williams updates; non-finite distances count as the largest distance
+ * @param numItems Number of items
+ * @param linkage Linkage
+ * @param stopToken Token to cancel the computation with; the result is empty when stop was requested
+ * @return numItems - 1 merges (none for fewer than two items)
+ */
+std::vector<DendrogramMerge> clusterDistanceMatrix(std::vector<float> distances, std::size_t numItems, Linkage linkage, std::stop_token stopToken = {});
+
+}
@@ -0,0 +1,146 @@
+#include "MarkerRanking.h"
+
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace heatmap
+{
+
+namespace
+{
+    /** Number of dimensions scored by a single task */
+    constexpr std::size_t dimensionBlockSize = 512;
+
+    /** Merged moments of one side (group or rest) for a block of dimensions */
+    struct SideMoments
+    {
+        explicit SideMoments(std::size_t blockSize) :
+            mean(blockSize, 0.0),
+            m2(blockSize, 0.0),
+            positive(blockSize, 0.0)
+        {
+        }
+
+        /**
+         * Merge dimensions [dimensionBegin, dimensionBegin + blockSize) of \p moments (Chan's update)
+         * @param moments Moments of a cluster
+         * @param dimensionBegin First dimension of the block
+         */
+        void merge(const ClusterMoments& moments, std::size_t dimensionBegin)
+        {
+            const auto otherN   = static_cast<double>(moments.count);
+            const auto totalN   = count + otherN;
+
+            for (std::size_t d = 0; d < mean.size(); ++d) {
+                const auto delta = moments.mean[dimensionBegin + d] - mean[d];
+
+                mean[d]     += delta * otherN / totalN;
+                m2[d]       += moments.m2[dimensionBegin + d] + delta * delta * count * otherN / totalN;
+                positive[d] += static_cast<double>(moments.positive[dimensionBegin + d]);
+            }
+
+            count = totalN;
+        }
+
+        double              count = 0.0;    /** Number of points */
+        std::vector<double> mean;           /** Per-dimension mean */
+        std::vector<double> m2;             /** Per-dimension sum of squared deviations from the mean */
+        std::vector<double> positive;       /** Per-dimension number of positive values */
+    };
+
+    float getScore(const MarkerScore& score, MarkerRankingMetric metric)
+    {
+        switch (metric)
+        {
+            case MarkerRankingMetric::EffectSize:
+                return score.effectSize;
+
+            case MarkerRankingMetric::LogFoldChange:
+                return score.logFoldChange;
+
+            case MarkerRankingMetric::FractionDifference:
+                return score.fractionDifference;
+        }
+
+        return score.effectSize;
+    }
+}
+
+std::vector<MarkerScore> rankMarkers(std::span<const ClusterMoments* const> moments, std::span<const std::uint32_t> group, MarkerRankingMetric metric, std::size_t numMarkers)
+{
+    if (moments.empty() || moments.front() == nullptr)
+        return {};
+
+    const auto numDimensions = moments.front()->getNumDimensions();
+
+    std::vector<bool> isInGroup(moments.size(), false);
+
+    for (const auto clusterIndex : group)
+        if (clusterIndex < moments.size())
+            isInGroup[clusterIndex] = true;
+
+    std::vector<MarkerScore> scores(numDimensions);
+
+    const auto numBlocks = (numDimensions + dimensionBlockSize - 1) / dimensionBlockSize;
+
+    parallelFor(numBlocks, [&](std::size_t blockIndex) -> void {
+        const auto dimensionBegin   = blockIndex * dimensionBlockSize;
+        const auto blockSize        = std::min(dimensionBlockSize, numDimensions - dimensionBegin);
+
+        SideMoments groupMoments(blockSize), restMoments(blockSize);
+
+        for (std::size_t clusterIndex = 0; clusterIndex < moments.size(); ++clusterIndex) {
+            const auto clusterMoments = moments[clusterIndex];
+
+            if (clusterMoments == nullptr || clusterMoments->count == 0 || clusterMoments->getNumDimensions() != numDimensions)
+                continue;
+
+            (isInGroup[clusterIndex] ? groupMoments : restMoments).merge(*clusterMoments, dimensionBegin);
+        }
+
+        if (groupMoments.count == 0.0 || restMoments.count == 0.0)
+            return;
+
+        const auto degreesOfFreedom = groupMoments.count + restMoments.count - 2.0;
+
+        for (std::size_t d = 0; d < blockSize; ++d) {
+            auto& score = scores[dimensionBegin + d];
+
+            const auto difference       = groupMoments.mean[d] - restMoments.mean[d];
+            const auto pooledVariance   = degreesOfFreedom > 0.0 ? (groupMoments.m2[d] + restMoments.m2[d]) / degreesOfFreedom : 0.0;
+
+            score.effectSize            = pooledVariance > 0.0 ? static_cast<float>(difference / std::sqrt(pooledVariance)) : 0.f;
+            score.logFoldChange         = static_cast<float>(std::log2((std::max(0.0, groupMoments.mean[d]) + 1.0) / (std::max(0.0, restMoments.mean[d]) + 1.0)));
+            score.fractionDifference    = static_cast<float>(groupMoments.positive[d] / groupMoments.count - restMoments.positive[d] / restMoments.count);
+        }
+    });
+
+    for (std::size_t dimension = 0; dimension < numDimensions; ++dimension)
+        scores[dimension].dimension = static_cast<std::uint32_t>(dimension);
+
+    // Highest scores first, non-finite scores last and ties in dimension order
+    const auto isBetter = [metric](const MarkerScore& lhs, const MarkerScore& rhs) -> bool {
+        const auto lhsScore = getScore(lhs, metric);
+        const auto rhsScore = getScore(rhs, metric);
+
+        if (std::isfinite(lhsScore) != std::isfinite(rhsScore))
+            return std::isfinite(lhsScore);
+
+        if (lhsScore != rhsScore && std::isfinite(lhsScore))
+            return lhsScore > rhsScore;
+
+        return lhs.dimension < rhs.dimension;
+    };
+
+    numMarkers = std::min(numMarkers, scores.size());
+
+    std::partial_sort(scores.begin(), scores.begin() + numMarkers, scores.end(), isBetter);
+
+    scores.resize(numMarkers);
+
+    return scores;
+}
+
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "ClusterStatistics.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace heatmap
+{
+
+/** Effect size by which markers of a group of clusters are ranked */
+enum class MarkerRankingMetric
+{
+    EffectSize,         /** Standardized mean difference (Cohen's d with pooled standard deviation) */
+    LogFoldChange,      /** Log2 ratio of the means plus one (means below zero count as zero) */
+    FractionDifference  /** Difference of the fractions of positive (expressing) points */
+};
+
+/** One-vs-rest effect sizes of a dimension */
+struct MarkerScore
+{
+    std::uint32_t   dimension = 0;              /** Dimension index */
+    float           effectSize = 0.f;           /** Standardized mean difference of group and rest */
+    float           logFoldChange = 0.f;        /** Log2 fold change of the group mean over the rest mean */
+    float           fractionDifference = 0.f;   /** Positive fraction of the group minus that of the rest */
+};
+
+/**
+ * Rank the dimensions that distinguish a group of clusters from the other clusters
+ *
+ * The group and the rest are formed by merging the cached moments of their clusters, so no pass
+ * over the points is needed: the cost is O(clusters x dimensions), split over the worker threads
+ * by dimension blocks, plus a partial sort of the scores. Clusters are assumed to be disjoint.
+ *
+ * @param moments Moments per cluster (all with the same number of dimensions)
+ * @param group Indices of the clusters in the group (out of range indices are ignored)
+ * @param metric Effect size to rank by (descending, i.e. markers up in the group first)
+ * @param numMarkers Maximum number of markers to return
+ * @return Scores of the top markers, best first
+ */
+std::vector<MarkerScore> rankMarkers(std::span<const ClusterMoments* const> moments, std::span<const std::uint32_t> group, MarkerRankingMetric metric, std::size_t numMarkers);
+
+}
@@ -0,0 +1,68 @@
+#include "Parallel.h"
+
+#include <utility>
+
+namespace heatmap
+{
+
+ThreadPool& ThreadPool::getInstance()
+{
+    static ThreadPool threadPool(getNumWorkerThreads() - 1);
+
+    return threadPool;
+}
+
+ThreadPool::ThreadPool(std::size_t numWorkers) :
+    _mutex(),
+    _queued(),
+    _tasks(),
+    _workers()
+{
+    _workers.reserve(numWorkers);
+
+    for (std::size_t workerIndex = 0; workerIndex < numWorkers; ++workerIndex)
+        _workers.emplace_back([this](std::stop_token stopToken) -> void { work(stopToken); });
+}
+
+ThreadPool::~ThreadPool()
+{
+    for (auto& worker : _workers)
+        worker.request_stop();
+
+    _queued.notify_all();
+
+    _workers.clear();
+}
+
+void ThreadPool::submit(std::function<void()> task)
+{
+    {
+        const std::lock_guard lock(_mutex);
+
+        _tasks.push_back(std::move(task));
+    }
+
+    _queued.notify_one();
+}
+
+void ThreadPool::work(std::stop_token stopToken)
+{
+    while (true) {
+        std::function<void()> task;
+
+        {
+            std::unique_lock lock(_mutex);
+
+            if (!_queued.wait(lock, stopToken, [this]() { return !_tasks.empty(); }))
+                return;
+
+            task = std::move(_tasks.front());
+
+            _tasks.pop_front();
+        }
+
+        task();
+    }
+}
+
+}
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace heatmap
+{
+
+/**
+ * Get the number of worker threads used by the heatmap computations
+ * @return Number of hardware threads (at least one)
+ */
+inline std::size_t getNumWorkerThreads()
+{
+    return std::max<std::size_t>(1, std::thread::hardware_concurrency());
+}
+
+/**
+ * Thread pool
+ *
+ * Process-wide set of worker threads with a task queue, created on first use, so that the many
+ * short parallel loops of an update (gathering statistics, transforms, distance rows, selection
+ * updates while brushing) do not create and join threads every time. There is one worker less
+ * than there are hardware threads, since the thread that calls parallelFor works along.
+ */
+class ThreadPool
+{
+public:
+
+    /** Get the pool of the process */
+    static ThreadPool& getInstance();
+
+    /**
+     * Construct with \p numWorkers worker threads
+     * @param numWorkers Number of worker threads
+     */
+    explicit ThreadPool(std::size_t numWorkers);
+
+    /** Stop the workers; queued tasks that did not start are dropped */
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /** Get the number of worker threads */
+    std::size_t getNumWorkers() const {
+        return _workers.size();
+    }
+
+    /**
+     * Queue \p task to run on a worker thread
+     * @param task Task, must not throw
+     */
+    void submit(std::function<void()> task);
+
+private:
+
+    /** Run queued tasks until stop is requested */
+    void work(std::stop_token stopToken);
+
+private:
+    std::mutex                          _mutex;         /** Guards the queue */
+    std::condition_variable_any         _queued;        /** Notified when a task was queued */
+    std::deque<std::function<void()>>   _tasks;         /** Queued tasks */
+    std::vector<std::jthread>           _workers;       /** Worker threads */
+};
+
+/**
+ * Invoke \p task for every index in [0, \p count) on the workers of the thread pool
+ *
+ * Indices are handed out dynamically, so tasks of uneven cost balance out over the
+ * workers. The calling thread participates in the work and the call returns when all
+ * tasks are done. Workers that only get to the loop after the calling thread ran out of
+ * indices skip it, so nested loops never wait for busy workers. Tasks must not throw.
+ *
+ * @param count Number of tasks
+ * @param task Callable taking the task index
+ * @param maxThreads Maximum number of threads to use (zero for all hardware threads)
+ */
+template <typename Task>
+void parallelFor(std::size_t count, Task&& task, std::size_t maxThreads = 0)
+{
+    const auto numThreads = std::min(count, maxThreads > 0 ? maxThreads : getNumWorkerThreads());
+
+    auto& pool = ThreadPool::getInstance();
+
+    if (numThreads <= 1 || pool.getNumWorkers() == 0) {
+        for (std::size_t index = 0; index < count; ++index)
+            task(index);
+
+        return;
+    }
+
+    // Shared with the queued helpers, which may only run after this call returned
+    struct Loop
+    {
+        std::atomic<std::size_t>    nextIndex = 0;      /** Next index to hand out */
+        std::mutex                  mutex;              /** Guards the members below */
+        std::condition_variable     finished;           /** Notified when a helper finished */
+        std::size_t                 numActive = 0;      /** Number of helpers working on the loop */
+        bool                        isClosed = false;   /** Whether all indices are handed out, so helpers that did not start skip the loop */
+    };
+
+    const auto loop = std::make_shared<Loop>();
+
+    const auto work = [&task, count](Loop& loop) -> void {
+        for (auto index = loop.nextIndex.fetch_add(1, std::memory_order_relaxed); index < count; index = loop.nextIndex.fetch_add(1, std::memory_order_relaxed))
+            task(index);
+    };
+
+    for (std::size_t helperIndex = 1; helperIndex < std::min(numThreads, pool.getNumWorkers() + 1); ++helperIndex) {
+        pool.submit([loop, &work]() -> void {
+            {
+                const std::lock_guard lock(loop->mutex);
+
+                if (loop->isClosed)
+                    return;
+
+                ++loop->numActive;
+            }
+
+            work(*loop);
+
+            const std::lock_guard lock(loop->mutex);
+
+            --loop->numActive;
+
+            loop->finished.notify_all();
+        });
+    }
+
+    work(*loop);
+
+    std::unique_lock lock(loop->mutex);
+
+    loop->isClosed = true;
+
+    loop->finished.wait(lock, [&loop]() { return loop->numActive == 0; });
+}
+
+}
@@ -0,0 +1,68 @@
+#include "PointClusterLabels.h"
+
+namespace heatmap
+{
+
+PointClusterLabels::PointClusterLabels(std::size_t numPoints, const std::vector<std::span<const std::uint32_t>>& clusterIndices) :
+    _labels(numPoints, unassigned)
+{
+    // Label every point with its first cluster, marking points that are in more than one cluster
+    constexpr auto multiple = unassigned - 1;
+
+    std::size_t numMultiple = 0;
+
+    for (std::uint32_t clusterIndex = 0; clusterIndex < clusterIndices.size(); ++clusterIndex) {
+        for (const auto pointIndex : clusterIndices[clusterIndex]) {
+            if (pointIndex >= numPoints)
+                continue;
+
+            auto& label = _labels[pointIndex];
+
+            if (label == unassigned) {
+                label = clusterIndex;
+            }
+            else if (label != multiple) {
+                label = multiple;
+                ++numMultiple;
+            }
+        }
+    }
+
+    if (numMultiple == 0)
+        return;
+
+    // Give every point in several clusters an overflow slot and count its clusters
+    std::vector<std::uint32_t> counts;
+
+    counts.reserve(numMultiple);
+
+    for (auto& label : _labels) {
+        if (label == multiple) {
+            label = overflowFlag | static_cast<std::uint32_t>(counts.size());
+            counts.push_back(0);
+        }
+    }
+
+    for (const auto& indices : clusterIndices)
+        for (const auto pointIndex : indices)
+            if (pointIndex < numPoints && (_labels[pointIndex] & overflowFlag))
+                ++counts[_labels[pointIndex] & ~overflowFlag];
+
+    _overflowOffsets.resize(counts.size() + 1, 0);
+
+    for (std::size_t slot = 0; slot < counts.size(); ++slot)
+        _overflowOffsets[slot + 1] = _overflowOffsets[slot] + counts[slot];
+
+    _overflowClusters.resize(_overflowOffsets.back());
+
+    // Reuse the counts as fill positions
+    for (std::size_t slot = 0; slot < counts.size(); ++slot)
+        counts[slot] = _overflowOffsets[slot];
+
+    for (std::uint32_t clusterIndex = 0; clusterIndex < clusterIndices.size(); ++clusterIndex)
+        for (const auto pointIndex : clusterIndices[clusterIndex])
+            if (pointIndex < numPoints && (_labels[pointIndex] & overflowFlag))
+                _overflowClusters[counts[_labels[pointIndex] & ~overflowFlag]++] = clusterIndex;
+}
+
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <vector>
+
+namespace heatmap
+{
+
+/**
+ * Point cluster labels
+ *
+ * Inverted index from points to the clusters that contain them. Most points are in at most one
+ * cluster, so every point stores a single 32-bit label; points in several clusters refer to a
+ * compact overflow list instead.
+ */
+class PointClusterLabels
+{
+public:
+
+    /** Label of points that are in no cluster */
+    static constexpr std::uint32_t unassigned = std::numeric_limits<std::uint32_t>::max();
+
+public:
+    PointClusterLabels() = default;
+
+    /**
+     * Build the labels of \p numPoints points from the point indices of each cluster
+     * @param numPoints Number of points
+     * @param clusterIndices Point indices per cluster (out of range indices are ignored)
+     */
+    PointClusterLabels(std::size_t numPoints, const std::vector<std::span<const std::uint32_t>>& clusterIndices);
+
+    /** Get the number of points */
+    std::size_t getNumPoints() const {
+        return _labels.size();
+    }
+
+    /** Get whether some points are in more than one cluster */
+    bool hasOverlap() const {
+        return !_overflowOffsets.empty();
+    }
+
+    /**
+     * Invoke \p function with the index of every cluster that contains \p pointIndex
+     * @param pointIndex Point index
+     * @param function Callable taking a cluster index
+     */
+    template <typename Function>
+    void forEachCluster(std::size_t pointIndex, Function&& function) const
+    {
+        const auto label = _labels[pointIndex];
+
+        if (label == unassigned)
+            return;
+
+        if ((label & overflowFlag) == 0) {
+            function(label);
+            return;
+        }
+
+        const auto slot = label & ~overflowFlag;
+
+        for (auto position = _overflowOffsets[slot]; position < _overflowOffsets[slot + 1]; ++position)
+            function(_overflowClusters[position]);
+    }
+
+private:
+
+    /** Set in labels that refer to an overflow list */
+    static constexpr std::uint32_t overflowFlag = 0x80000000u;
+
+private:
+    std::vector<std::uint32_t>  _labels;            /** Cluster index, unassigned, or overflow flag with overflow slot per point */
+    std::vector<std::uint32_t>  _overflowOffsets;   /** Start of each overflow list in the overflow clusters (one extra entry at the end) */
+    std::vector<std::uint32_t>  _overflowClusters;  /** Cluster indices of the points that are in several clusters */
+};
+
+}
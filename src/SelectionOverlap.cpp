@@ -0,0 +1,66 @@
+#include "SelectionOverlap.h"
+
+#include "Parallel.h"
+
+#include <algorithm>
+#include <bit>
+
+namespace heatmap
+{
+
+namespace
+{
+    /** Minimum number of bitset words intersected by a single task */
+    constexpr std::size_t minWordBlockSize = 1024;
+}
+
+std::vector<float> computeSelectionOverlap(const PointClusterLabels& labels, std::span<const std::uint64_t> clusterSizes, std::span<const std::uint32_t> selectionIndices)
+{
+    const auto numClusters  = clusterSizes.size();
+    const auto numPoints    = labels.getNumPoints();
+
+    std::vector<float> fractions(numClusters, 0.f);
+
+    if (numClusters == 0 || numPoints == 0 || selectionIndices.empty())
+        return fractions;
+
+    std::vector<std::uint64_t> selected((numPoints + 63) / 64, 0);
+
+    for (const auto pointIndex : selectionIndices)
+        if (pointIndex < numPoints)
+            selected[pointIndex / 64] |= std::uint64_t(1) << (pointIndex % 64);
+
+    // Every task counts into its own row, so no synchronization is needed until the rows are summed; the
+    // number of tasks is bounded so that the rows stay small for many clusters
+    const auto numBlocks        = std::min(4 * getNumWorkerThreads(), (selected.size() + minWordBlockSize - 1) / minWordBlockSize);
+    const auto wordBlockSize    = (selected.size() + numBlocks - 1) / numBlocks;
+
+    std::vector<std::uint64_t> blockCounts(numBlocks * numClusters, 0);
+
+    parallelFor(numBlocks, [&](std::size_t blockIndex) -> void {
+        const auto wordBegin    = blockIndex * wordBlockSize;
+        const auto wordEnd      = std::min(wordBegin + wordBlockSize, selected.size());
+        const auto counts       = blockCounts.data() + blockIndex * numClusters;
+
+        for (auto wordIndex = wordBegin; wordIndex < wordEnd; ++wordIndex) {
+            for (auto word = selected[wordIndex]; word != 0; word &= word - 1) {
+                labels.forEachCluster(wordIndex * 64 + std::countr_zero(word), [&](std::uint32_t clusterIndex) -> void {
+                    if (clusterIndex < numClusters)
+                        ++counts[clusterIndex];
+                });
+            }
+        }
+    });
+
+    for (std::size_t blockIndex = 1; blockIndex < numBlocks; ++blockIndex)
+        for (std::size_t clusterIndex = 0; clusterIndex < numClusters; ++clusterIndex)
+            blockCounts[clusterIndex] += blockCounts[blockIndex * numClusters + clusterIndex];
+
+    for (std::size_t clusterIndex = 0; clusterIndex < numClusters; ++clusterIndex)
+        if (clusterSizes[clusterIndex] > 0)
+            fractions[clusterIndex] = std::min(1.f, static_cast<float>(static_cast<double>(blockCounts[clusterIndex]) / clusterSizes[clusterIndex]));
+
+    return fractions;
+}
+
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "PointClusterLabels.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace heatmap
+{
+
+/**
+ * Compute the fraction of the points of each cluster that is selected
+ *
+ * The selection is first turned into a bitset over all points, which also makes duplicate
+ * selection indices harmless. Blocks of the bitset are then intersected with the point cluster
+ * labels in parallel: empty words are skipped and only the set bits are looked up, so the cost
+ * is O(points / 64 + selected points) regardless of the number of clusters.
+ *
+ * @param labels Point cluster labels of the clusters
+ * @param clusterSizes Number of points per cluster (clusters of size zero get fraction zero)
+ * @param selectionIndices Indices of the selected points (out of range indices are ignored)
+ * @return Selected fraction per cluster, in [0, 1]
+ */
+std::vector<float> computeSelectionOverlap(const PointClusterLabels& labels, std::span<const std::uint64_t> clusterSizes, std::span<const std::uint32_t> selectionIndices);
+
+}
@@ -0,0 +1,81 @@
+#include "SelectionStatistics.h"
+
+#include <bit>
+#include <cmath>
+
+namespace heatmap
+{
+
+void SelectionStatistics::reset(std::size_t numPoints, std::size_t numDimensions)
+{
+    _numPoints  = numPoints;
+    _count      = 0;
+
+    _selected.assign((numPoints + 63) / 64, 0);
+    _nextSelected.assign(_selected.size(), 0);
+    _changed.clear();
+
+    _shift.assign(numDimensions, 0.0);
+    _sum.assign(numDimensions, 0.0);
+    _sumOfSquares.assign(numDimensions, 0.0);
+}
+
+float SelectionStatistics::getMean(std::size_t dimension) const
+{
+    return _count > 0 ? static_cast<float>(_shift[dimension] + _sum[dimension] / static_cast<double>(_count)) : 0.0f;
+}
+
+float SelectionStatistics::getStandardDeviation(std::size_t dimension) const
+{
+    if (_count == 0)
+        return 0.0f;
+
+    const auto count = static_cast<double>(_count);
+    const auto m2    = _sumOfSquares[dimension] - _sum[dimension] * _sum[dimension] / count;
+
+    return static_cast<float>(std::sqrt(std::max(0.0, m2) / count));
+}
+
+std::size_t SelectionStatistics::diffSelection(std::span<const std::uint32_t> selectionIndices)
+{
+    std::fill(_nextSelected.begin(), _nextSelected.end(), 0);
+
+    for (const auto pointIndex : selectionIndices)
+        if (pointIndex < _numPoints)
+            _nextSelected[pointIndex / 64] |= std::uint64_t(1) << (pointIndex % 64);
+
+    _changed.clear();
+
+    // Empty words are skipped, so the diff costs O(points / 64 + changed points)
+    const auto collect = [this](auto&& bits) -> void {
+        for (std::size_t wordIndex = 0; wordIndex < _selected.size(); ++wordIndex)
+            for (auto word = bits(wordIndex); word != 0; word &= word - 1)
+                _changed.push_back(static_cast<std::uint32_t>(wordIndex * 64 + std::countr_zero(word)));
+    };
+
+    collect([this](std::size_t wordIndex) { return _nextSelected[wordIndex] & ~_selected[wordIndex]; });
+
+    const auto numAdded = _changed.size();
+
+    collect([this](std::size_t wordIndex) { return _selected[wordIndex] & ~_nextSelected[wordIndex]; });
+
+    _count = _count + numAdded - (_changed.size() - numAdded);
+
+    std::swap(_selected, _nextSelected);
+
+    return numAdded;
+}
+
+void SelectionStatistics::rebuildSelected()
+{
+    std::fill(_sum.begin(), _sum.end(), 0.0);
+    std::fill(_sumOfSquares.begin(), _sumOfSquares.end(), 0.0);
+
+    _changed.clear();
+
+    for (std::size_t wordIndex = 0; wordIndex < _selected.size(); ++wordIndex)
+        for (auto word = _selected[wordIndex]; word != 0; word &= word - 1)
+            _changed.push_back(static_cast<std::uint32_t>(wordIndex * 64 + std::countr_zero(word)));
+}
+
+}
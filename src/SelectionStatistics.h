@@ -0,0 +1,155 @@
+#pragma once
+
+#include "ClusterStatistics.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace heatmap
+{
+
+/**
+ * Selection statistics
+ *
+ * Per-dimension mean and standard deviation of a point selection that changes in small steps,
+ * like while brushing. The selection is kept as a bitset, and every update only reads the
+ * values of the points that were added or removed since the previous selection: their shifted
+ * values are added to or subtracted from running sums, so removal does not rescan the rest of
+ * the selection. When most of the selection changed, the sums are rebuilt from scratch instead,
+ * which is cheaper and also discards the rounding error accumulated by the subtractions.
+ */
+class SelectionStatistics
+{
+public:
+    SelectionStatistics() = default;
+
+    /**
+     * Clear the selection and size the statistics for \p numPoints points of \p numDimensions dimensions
+     * @param numPoints Number of points
+     * @param numDimensions Number of dimensions
+     */
+    void reset(std::size_t numPoints, std::size_t numDimensions);
+
+    /** Get the number of points */
+    std::size_t getNumPoints() const {
+        return _numPoints;
+    }
+
+    /** Get the number of dimensions */
+    std::size_t getNumDimensions() const {
+        return _sum.size();
+    }
+
+    /** Get the number of selected points */
+    std::uint64_t getCount() const {
+        return _count;
+    }
+
+    /**
+     * Get the mean of the selected points in dimension \p dimension (zero for an empty selection)
+     * @param dimension Dimension index
+     */
+    float getMean(std::size_t dimension) const;
+
+    /**
+     * Get the (population) standard deviation of the selected points in dimension \p dimension
+     * @param dimension Dimension index
+     */
+    float getStandardDeviation(std::size_t dimension) const;
+
+    /**
+     * Update the statistics to the points in \p selectionIndices
+     * @param values Row-major point values (numPoints x numDimensions)
+     * @param selectionIndices Indices of the selected points (duplicates and out of range indices are ignored)
+     * @return Number of points whose values were read
+     */
+    template <typename ElementType>
+    std::size_t update(const ElementType* values, std::span<const std::uint32_t> selectionIndices)
+    {
+        const auto numAdded = diffSelection(selectionIndices);
+
+        if (_changed.empty() || values == nullptr)
+            return 0;
+
+        // Rebuilding reads every selected point once, patching reads every changed point once
+        if (_changed.size() >= _count) {
+            rebuildSelected();
+            accumulate(values, _changed.size());
+        }
+        else {
+            accumulate(values, numAdded);
+        }
+
+        return _changed.size();
+    }
+
+private:
+
+    /**
+     * Replace the selection bitset by \p selectionIndices and collect the added points followed by the removed points in the changed points
+     * @param selectionIndices Indices of the selected points
+     * @return Number of added points
+     */
+    std::size_t diffSelection(std::span<const std::uint32_t> selectionIndices);
+
+    /** Clear the sums and make the changed points all selected points */
+    void rebuildSelected();
+
+    /**
+     * Add the first \p numAdded changed points to the sums and subtract the others
+     * @param values Row-major point values (numPoints x numDimensions)
+     * @param numAdded Number of added points at the front of the changed points
+     */
+    template <typename ElementType>
+    void accumulate(const ElementType* values, std::size_t numAdded)
+    {
+        const auto numDimensions = getNumDimensions();
+
+        // Only a rebuild adds all selected points; its sums are taken relative to its first point, which keeps the squares small
+        if (_count == numAdded && numAdded > 0) {
+            const auto row = values + static_cast<std::size_t>(_changed.front()) * numDimensions;
+
+            std::transform(row, row + numDimensions, _shift.begin(), [](ElementType value) { return static_cast<double>(kernels::widen(value)); });
+        }
+
+        const auto numBlocks = (numDimensions + dimensionBlockSize - 1) / dimensionBlockSize;
+
+        parallelFor(numBlocks, [&](std::size_t blockIndex) -> void {
+            const auto dimensionBegin   = blockIndex * dimensionBlockSize;
+            const auto dimensionEnd     = std::min(dimensionBegin + dimensionBlockSize, numDimensions);
+
+            for (std::size_t position = 0; position < _changed.size(); ++position) {
+                const auto row  = values + static_cast<std::size_t>(_changed[position]) * numDimensions;
+                const auto sign = position < numAdded ? 1.0 : -1.0;
+
+                for (auto d = dimensionBegin; d < dimensionEnd; ++d) {
+                    const auto shifted = static_cast<double>(kernels::widen(row[d])) - _shift[d];
+
+                    _sum[d]           += sign * shifted;
+                    _sumOfSquares[d]  += sign * shifted * shifted;
+                }
+            }
+        });
+    }
+
+private:
+
+    /** Number of dimensions updated by a single task */
+    static constexpr std::size_t dimensionBlockSize = 256;
+
+private:
+    std::size_t                 _numPoints = 0;     /** Number of points */
+    std::uint64_t               _count = 0;         /** Number of selected points */
+    std::vector<std::uint64_t>  _selected;          /** Bitset of the selected points */
+    std::vector<std::uint64_t>  _nextSelected;      /** Bitset of the next selection (kept to avoid reallocation) */
+    std::vector<std::uint32_t>  _changed;           /** Added points followed by removed points of the last update */
+    std::vector<double>         _shift;             /** Per-dimension value the sums are relative to */
+    std::vector<double>         _sum;               /** Per-dimension sum of shifted values */
+    std::vector<double>         _sumOfSquares;      /** Per-dimension sum of squared shifted values */
+};
+
+}
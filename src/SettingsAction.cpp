@@ -0,0 +1,252 @@
+#include "SettingsAction.h"
+
+#include "ClusterDistributions.h"
+
+#include <QStringList>
+
+#include <algorithm>
+
+using namespace mv::gui;
+
+SettingsAction::SettingsAction(QObject* parent, const QString& title) :
+    GroupAction(parent, title),
+    _clusteringAction(this, "Clusters"),
+    _precisionAction(this, "Precision", { "Single (fast)", "Double (precise)" }, "Double (precise)"),
+    _transferPrecisionAction(this, "Transfer", { "Float32", "Float16" }, "Float32"),
+    _expressionThresholdAction(this, "Expressing above", -1000.f, 1000.f, 0.f, 2),
+    _memoryBudgetAction(this, "Memory budget", 64, 65536, 1024),
+    _sharedCacheBudgetAction(this, "Shared cache", 0, 65536, 2048),
+    _distributionsAction(this, "Distributions", false),
+    _numHistogramBinsAction(this, "Histogram bins", 4, 256, 32),
+    _quantilesAction(this, "Quantiles", "0.1, 0.25, 0.75, 0.9"),
+    _colorByAction(this, "Color by", { "Mean" }, "Mean"),
+    _colorByLevels(),
+    _transformAction(this, "Transform", { "None", "Log1p", "Z-score", "Min-max", "Percentile (1-99)" }, "None"),
+    _cellRenderingAction(this, "Cells", { "Automatic", "Vector", "Image tiles", "Dot plot" }, "Automatic"),
+    _maxColumnsAction(this, "Max columns", 10, 2000, 200),
+    _markerRankingAction(this, "Rank markers by", { "Effect size", "Log fold change", "Expressing fraction" }, "Effect size"),
+    _numRankedMarkersAction(this, "Top markers", 1, 500, 20),
+    _publishStatisticsAction(this, "Publish statistics", false),
+    _linkageAction(this, "Linkage", { "Average", "Complete", "Single", "Ward" }, "Average"),
+    _distanceMetricAction(this, "Distance", { "Euclidean", "Manhattan", "Cosine", "Correlation" }, "Euclidean"),
+    _rowOrderAction(this, "Row order", { "Dataset", "Co-expression" }, "Dataset"),
+    _rowLinkageAction(this, "Row linkage", { "Average", "Complete", "Single", "Ward" }, "Average"),
+    _timingsAction(this, "Timings"),
+    _exportTraceAction(this, "Export trace...")
+{
+    setIconByName("cog");
+
+    _clusteringAction.setToolTip("Clusters dataset shown in the heatmap; the statistics of all added clusters datasets are computed in one pass, so switching does not recompute");
+
+    _precisionAction.setToolTip("Numeric precision used to accumulate the cluster statistics: single precision is faster, double precision is more accurate for large clusters");
+
+    _transferPrecisionAction.setToolTip("Precision of the statistics sent to the heatmap page: float16 halves the transfer size at about three significant digits");
+
+    _expressionThresholdAction.setToolTip("Point values above this threshold count as expressing: the dot plot sizes its dots by the fraction of expressing points and colors them by their mean");
+
+    _memoryBudgetAction.setSuffix(" MB");
+    _memoryBudgetAction.setToolTip("Maximum amount of point values that is extracted at a time for proxy data");
+
+    _sharedCacheBudgetAction.setSuffix(" MB");
+    _sharedCacheBudgetAction.setToolTip("Memory the cluster statistics cached for all heatmap views together may take; views of the same data and settings share one computation and its result, and the least recently used statistics that no view shows are evicted beyond this budget");
+
+    _distributionsAction.setToolTip("Compute the median, quantiles and a histogram per cluster and dimension (binned, accurate to about 1/2000 of the value range)");
+
+    _numHistogramBinsAction.setToolTip("Number of histogram bins per cluster and dimension sent to the heatmap");
+
+    _quantilesAction.setToolTip("Comma separated quantile levels between 0 and 1; the median is always computed");
+
+    _colorByAction.setToolTip("Statistic that determines the color of the heatmap cells");
+
+    _transformAction.setToolTip("Transform of the statistics before they are colored: sign preserving log(1 + x), or per dimension over the clusters a z-score, min-max scaling or scaling of the 1st to 99th percentile to [0, 1]");
+
+    _cellRenderingAction.setToolTip("Draw the cells as animated vector shapes, or as image tiles that stay fast for many clusters and dimensions (no variation glyphs); automatic uses tiles from 20000 cells on. A dot plot sizes a dot per cell by the fraction of expressing points and colors it by their mean");
+
+    _maxColumnsAction.setToolTip("Clusterings with more clusters are shown as super-clusters of a hierarchy of the clusters, at most this many columns; expand or collapse a column from its context menu or by double clicking it");
+
+    _markerRankingAction.setToolTip("Effect size of the selected clusters versus all other clusters by which markers are ranked: standardized mean difference, log2 fold change of the means, or difference of the fractions of positive values");
+
+    _numRankedMarkersAction.setToolTip("Number of top ranked markers that are selected when ranking the markers of the selected clusters");
+
+    _publishStatisticsAction.setToolTip("Publish the means, standard deviations, expressing fractions and expressing means of the clusters as points datasets (clusters x dimensions) below the clusters dataset, for other views; they are updated in place with every computation");
+
+    _linkageAction.setToolTip("Linkage of the hierarchical clustering shown in the dendrogram (Ward is meant for euclidean distances)");
+
+    _distanceMetricAction.setToolTip("Distance between clusters in the hierarchical clustering, over the active markers");
+
+    _rowOrderAction.setToolTip("Order of the rows: as in the dataset, or by co-expression, clustering the dimensions by the correlation of their means over the columns and ordering the leaves so that neighboring rows correlate most; unpaged panels show the clustering as a row dendrogram");
+
+    _rowLinkageAction.setToolTip("Linkage of the clustering of the dimensions the rows are ordered by co-expression; the correlations are cached, so changing it only clusters again");
+
+    _timingsAction.setDefaultWidgetFlags(StringAction::Label);
+    _timingsAction.setToolTip("Time spent in every stage of the last update, from the statistics computation to the frame painted by the heatmap page");
+
+    _exportTraceAction.setToolTip("Save the timings of the recent updates as a trace file for chrome://tracing or Perfetto");
+
+    addAction(&_clusteringAction);
+    addAction(&_precisionAction);
+    addAction(&_transferPrecisionAction);
+    addAction(&_expressionThresholdAction);
+    addAction(&_memoryBudgetAction);
+    addAction(&_sharedCacheBudgetAction);
+    addAction(&_distributionsAction);
+    addAction(&_numHistogramBinsAction);
+    addAction(&_quantilesAction);
+    addAction(&_colorByAction);
+    addAction(&_transformAction);
+    addAction(&_cellRenderingAction);
+    addAction(&_maxColumnsAction);
+    addAction(&_markerRankingAction);
+    addAction(&_numRankedMarkersAction);
+    addAction(&_publishStatisticsAction);
+    addAction(&_linkageAction);
+    addAction(&_distanceMetricAction);
+    addAction(&_rowOrderAction);
+    addAction(&_rowLinkageAction);
+    addAction(&_timingsAction);
+    addAction(&_exportTraceAction);
+
+    const auto updateDistributionActions = [this]() -> void {
+        _numHistogramBinsAction.setEnabled(_distributionsAction.isChecked());
+        _quantilesAction.setEnabled(_distributionsAction.isChecked());
+
+        updateColorByOptions();
+    };
+
+    connect(&_distributionsAction, &ToggleAction::toggled, this, updateDistributionActions);
+    connect(&_quantilesAction, &StringAction::stringChanged, this, &SettingsAction::updateColorByOptions);
+
+    updateDistributionActions();
+}
+
+heatmap::AccumulationPrecision SettingsAction::getAccumulationPrecision() const
+{
+    return _precisionAction.getCurrentIndex() == 0 ? heatmap::AccumulationPrecision::Single : heatmap::AccumulationPrecision::Double;
+}
+
+heatmap::HeatMapPayload::ValueType SettingsAction::getTransferFloatType() const
+{
+    return _transferPrecisionAction.getCurrentIndex() == 1 ? heatmap::HeatMapPayload::ValueType::Float16 : heatmap::HeatMapPayload::ValueType::Float32;
+}
+
+float SettingsAction::getExpressionThreshold() const
+{
+    return _expressionThresholdAction.getValue();
+}
+
+std::size_t SettingsAction::getMemoryBudget() const
+{
+    return static_cast<std::size_t>(_memoryBudgetAction.getValue()) * 1024 * 1024;
+}
+
+std::size_t SettingsAction::getSharedCacheBudget() const
+{
+    return static_cast<std::size_t>(_sharedCacheBudgetAction.getValue()) * 1024 * 1024;
+}
+
+bool SettingsAction::getComputeDistributions() const
+{
+    return _distributionsAction.isChecked();
+}
+
+std::size_t SettingsAction::getNumHistogramBins() const
+{
+    return static_cast<std::size_t>(_numHistogramBinsAction.getValue());
+}
+
+std::vector<float> SettingsAction::getQuantileLevels() const
+{
+    std::vector<float> levels;
+
+    for (const auto& text : _quantilesAction.getString().split(",", Qt::SkipEmptyParts)) {
+        bool isNumber = false;
+
+        const auto level = text.trimmed().toFloat(&isNumber);
+
+        if (isNumber && level > 0.0f && level < 1.0f)
+            levels.push_back(level);
+    }
+
+    return levels;
+}
+
+QString SettingsAction::getColorBy() const
+{
+    const auto optionIndex = _colorByAction.getCurrentIndex();
+
+    if (optionIndex <= 0 || optionIndex > static_cast<int>(_colorByLevels.size()))
+        return "mean";
+
+    return QString::fromStdString(heatmap::getQuantileName(_colorByLevels[optionIndex - 1]));
+}
+
+heatmap::ValueTransform SettingsAction::getValueTransform() const
+{
+    return static_cast<heatmap::ValueTransform>(std::max(0, _transformAction.getCurrentIndex()));
+}
+
+heatmap::CellRendering SettingsAction::getCellRendering() const
+{
+    return static_cast<heatmap::CellRendering>(std::max(0, _cellRenderingAction.getCurrentIndex()));
+}
+
+std::size_t SettingsAction::getMaxColumns() const
+{
+    return static_cast<std::size_t>(_maxColumnsAction.getValue());
+}
+
+heatmap::MarkerRankingMetric SettingsAction::getMarkerRankingMetric() const
+{
+    return static_cast<heatmap::MarkerRankingMetric>(std::max(0, _markerRankingAction.getCurrentIndex()));
+}
+
+std::size_t SettingsAction::getNumRankedMarkers() const
+{
+    return static_cast<std::size_t>(_numRankedMarkersAction.getValue());
+}
+
+bool SettingsAction::getPublishStatistics() const
+{
+    return _publishStatisticsAction.isChecked();
+}
+
+heatmap::Linkage SettingsAction::getLinkage() const
+{
+    // Options are in the order of the enum
+    return static_cast<heatmap::Linkage>(std::max(0, _linkageAction.getCurrentIndex()));
+}
+
+heatmap::DistanceMetric SettingsAction::getDistanceMetric() const
+{
+    return static_cast<heatmap::DistanceMetric>(std::max(0, _distanceMetricAction.getCurrentIndex()));
+}
+
+heatmap::RowOrder SettingsAction::getRowOrder() const
+{
+    return static_cast<heatmap::RowOrder>(std::max(0, _rowOrderAction.getCurrentIndex()));
+}
+
+heatmap::Linkage SettingsAction::getRowLinkage() const
+{
+    return static_cast<heatmap::Linkage>(std::max(0, _rowLinkageAction.getCurrentIndex()));
+}
+
+void SettingsAction::updateColorByOptions()
+{
+    const auto currentOption = _colorByAction.getCurrentText();
+
+    QStringList options = { "Mean" };
+
+    _colorByLevels.clear();
+
+    if (_distributionsAction.isChecked()) {
+        // Same normalization (sorted, unique, with median) as the computed distributions
+        _colorByLevels = heatmap::ClusterDistributionEngine(1, getQuantileLevels()).getLevels();
+
+        for (const auto level : _colorByLevels)
+            options << (level == 0.5f ? QString("Median") : QString("Quantile %1").arg(level));
+    }
+
+    _colorByAction.setOptions(options);
+    _colorByAction.setCurrentText(options.contains(currentOption) ? currentOption : options.first());
+}
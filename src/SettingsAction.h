@@ -0,0 +1,152 @@
+#pragma once
+
+#include <actions/DecimalAction.h>
+#include <actions/GroupAction.h>
+#include <actions/IntegralAction.h>
+#include <actions/OptionAction.h>
+#include <actions/StringAction.h>
+#include <actions/ToggleAction.h>
+#include <actions/TriggerAction.h>
+
+#include "ClusterStatistics.h"
+#include "DimensionSeriation.h"
+#include "HeatMapPayload.h"
+#include "HeatMapRaster.h"
+#include "HierarchicalClustering.h"
+#include "MarkerRanking.h"
+#include "ValueTransform.h"
+
+#include <vector>
+
+/**
+ * Settings action
+ *
+ * Groups the settings that control how the heatmap computes its cluster statistics
+ *
+ * @author Julian Thijssen
+ */
+class SettingsAction : public mv::gui::GroupAction
+{
+    Q_OBJECT
+
+public:
+
+    /**
+     * Construct with \p parent and \p title
+     * @param parent Pointer to parent object
+     * @param title Title of the action
+     */
+    SettingsAction(QObject* parent, const QString& title);
+
+    /** Get the accumulation precision selected in the precision action */
+    heatmap::AccumulationPrecision getAccumulationPrecision() const;
+
+    /** Get the element type of the floating point matrices sent to the web page */
+    heatmap::HeatMapPayload::ValueType getTransferFloatType() const;
+
+    /** Get the threshold above which point values count as expressing (dot plot fractions and means) */
+    float getExpressionThreshold() const;
+
+    /** Get the maximum number of bytes of extracted point values held at a time */
+    std::size_t getMemoryBudget() const;
+
+    /** Get the maximum number of bytes of the statistics cached for all heatmap views */
+    std::size_t getSharedCacheBudget() const;
+
+    /** Get whether the per-cluster distributions (quantiles and histograms) are computed */
+    bool getComputeDistributions() const;
+
+    /** Get the number of histogram bins per cluster and dimension */
+    std::size_t getNumHistogramBins() const;
+
+    /** Get the quantile levels entered in the quantiles action (without the median, which is always computed) */
+    std::vector<float> getQuantileLevels() const;
+
+    /** Get the name of the statistic the heatmap is colored by ("mean" or a quantile name) */
+    QString getColorBy() const;
+
+    /** Get the transform applied to the statistics before they are color mapped */
+    heatmap::ValueTransform getValueTransform() const;
+
+    /** Get how the heatmap cells are drawn */
+    heatmap::CellRendering getCellRendering() const;
+
+    /** Get the maximum number of heatmap columns; clusterings with more clusters are shown as super-clusters */
+    std::size_t getMaxColumns() const;
+
+    /** Get the effect size markers are ranked by */
+    heatmap::MarkerRankingMetric getMarkerRankingMetric() const;
+
+    /** Get the number of markers selected by a marker ranking */
+    std::size_t getNumRankedMarkers() const;
+
+    /** Get whether the cluster statistics are published as points datasets */
+    bool getPublishStatistics() const;
+
+    /** Get the linkage of the column dendrogram */
+    heatmap::Linkage getLinkage() const;
+
+    /** Get the distance metric of the column dendrogram */
+    heatmap::DistanceMetric getDistanceMetric() const;
+
+    /** Get the order of the heatmap rows (dimensions) */
+    heatmap::RowOrder getRowOrder() const;
+
+    /** Get the linkage of the clustering of the dimensions the rows are ordered by */
+    heatmap::Linkage getRowLinkage() const;
+
+private:
+
+    /** Offer the mean and, when distributions are computed, the median and quantiles in the color by action */
+    void updateColorByOptions();
+
+public: // Action getters
+
+    mv::gui::OptionAction& getClusteringAction() { return _clusteringAction; }
+    mv::gui::OptionAction& getPrecisionAction() { return _precisionAction; }
+    mv::gui::OptionAction& getTransferPrecisionAction() { return _transferPrecisionAction; }
+    mv::gui::DecimalAction& getExpressionThresholdAction() { return _expressionThresholdAction; }
+    mv::gui::IntegralAction& getMemoryBudgetAction() { return _memoryBudgetAction; }
+    mv::gui::IntegralAction& getSharedCacheBudgetAction() { return _sharedCacheBudgetAction; }
+    mv::gui::ToggleAction& getDistributionsAction() { return _distributionsAction; }
+    mv::gui::IntegralAction& getNumHistogramBinsAction() { return _numHistogramBinsAction; }
+    mv::gui::StringAction& getQuantilesAction() { return _quantilesAction; }
+    mv::gui::OptionAction& getColorByAction() { return _colorByAction; }
+    mv::gui::OptionAction& getTransformAction() { return _transformAction; }
+    mv::gui::OptionAction& getCellRenderingAction() { return _cellRenderingAction; }
+    mv::gui::IntegralAction& getMaxColumnsAction() { return _maxColumnsAction; }
+    mv::gui::OptionAction& getMarkerRankingAction() { return _markerRankingAction; }
+    mv::gui::IntegralAction& getNumRankedMarkersAction() { return _numRankedMarkersAction; }
+    mv::gui::ToggleAction& getPublishStatisticsAction() { return _publishStatisticsAction; }
+    mv::gui::OptionAction& getLinkageAction() { return _linkageAction; }
+    mv::gui::OptionAction& getDistanceMetricAction() { return _distanceMetricAction; }
+    mv::gui::OptionAction& getRowOrderAction() { return _rowOrderAction; }
+    mv::gui::OptionAction& getRowLinkageAction() { return _rowLinkageAction; }
+    mv::gui::StringAction& getTimingsAction() { return _timingsAction; }
+    mv::gui::TriggerAction& getExportTraceAction() { return _exportTraceAction; }
+
+private:
+    mv::gui::OptionAction   _clusteringAction;          /** Clusters dataset shown out of the clusterings computed together */
+    mv::gui::OptionAction   _precisionAction;           /** Accumulation precision of the cluster statistics */
+    mv::gui::OptionAction   _transferPrecisionAction;   /** Precision of the statistics sent to the web page */
+    mv::gui::DecimalAction  _expressionThresholdAction; /** Values above this threshold count as expressing */
+    mv::gui::IntegralAction _memoryBudgetAction;        /** Memory budget (in megabytes) for streaming point values */
+    mv::gui::IntegralAction _sharedCacheBudgetAction;   /** Memory budget (in megabytes) of the statistics shared by all views */
+    mv::gui::ToggleAction   _distributionsAction;       /** Whether to compute medians, quantiles and histograms */
+    mv::gui::IntegralAction _numHistogramBinsAction;    /** Number of histogram bins per cluster and dimension */
+    mv::gui::StringAction   _quantilesAction;           /** Comma separated quantile levels */
+    mv::gui::OptionAction   _colorByAction;             /** Statistic the heatmap is colored by */
+    std::vector<float>      _colorByLevels;             /** Quantile level per color by option (the first option is the mean) */
+    mv::gui::OptionAction   _transformAction;           /** Transform of the statistics before color mapping */
+    mv::gui::OptionAction   _cellRenderingAction;       /** Whether cells are drawn as vector shapes or image tiles */
+    mv::gui::IntegralAction _maxColumnsAction;          /** Maximum number of columns before clusters are shown as super-clusters */
+    mv::gui::OptionAction   _markerRankingAction;       /** Effect size markers are ranked by */
+    mv::gui::IntegralAction _numRankedMarkersAction;    /** Number of markers selected by a marker ranking */
+    mv::gui::ToggleAction   _publishStatisticsAction;   /** Whether the cluster statistics are published as points datasets */
+    mv::gui::OptionAction   _linkageAction;             /** Linkage of the column dendrogram */
+    mv::gui::OptionAction   _distanceMetricAction;      /** Distance metric of the column dendrogram */
+    mv::gui::OptionAction   _rowOrderAction;            /** Order of the heatmap rows */
+    mv::gui::OptionAction   _rowLinkageAction;          /** Linkage of the clustering of the dimensions the rows are ordered by */
+    mv::gui::StringAction   _timingsAction;             /** Stage durations of the last update */
+    mv::gui::TriggerAction  _exportTraceAction;         /** Saves the stage trace as a Chrome trace file */
+};
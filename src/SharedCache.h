@@ -0,0 +1,228 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <stop_token>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+namespace heatmap
+{
+
+/**
+ * Shared cache
+ *
+ * Thread-safe cache of immutable values by key, meant to be shared by all views of a process.
+ *
+ * - Concurrent requests for the same key share one computation (single-flight): the first caller
+ *   computes the value while the others wait for it. When that computation is cancelled, one of
+ *   the waiting callers takes over.
+ * - Values are handed out as shared pointers. A value that is still referenced outside the cache
+ *   is never evicted, since evicting it would not free its memory.
+ * - When the values take more memory than the budget, unreferenced values are evicted in least
+ *   recently used order.
+ *
+ * @tparam Value Value type
+ */
+template <typename Value>
+class SharedCache
+{
+public:
+
+    /** Shared, immutable value */
+    using ValuePointer = std::shared_ptr<const Value>;
+
+    /** Computes a value; returns nullptr when the computation was cancelled. Must not throw */
+    using ComputeFunction = std::function<ValuePointer()>;
+
+    /** Gets the number of bytes a value takes */
+    using MemorySizeFunction = std::function<std::size_t(const Value&)>;
+
+public:
+
+    /**
+     * Construct with \p memoryBudget
+     * @param memorySize Gets the number of bytes a value takes
+     * @param memoryBudget Number of bytes the cached values may take
+     */
+    SharedCache(MemorySizeFunction memorySize, std::size_t memoryBudget) :
+        _memorySize(std::move(memorySize)),
+        _memoryBudget(memoryBudget)
+    {
+    }
+
+    /**
+     * Get the value of \p key, computing it with \p compute unless it is cached or being computed already
+     * @param key Key that identifies the value (its inputs)
+     * @param compute Computes the value when it is not cached
+     * @param stopToken Token to stop computing or waiting with
+     * @return Value, or nullptr when stopped
+     */
+    ValuePointer get(const std::string& key, const ComputeFunction& compute, std::stop_token stopToken = {})
+    {
+        std::unique_lock lock(_mutex);
+
+        const auto isSettled = [this, &key]() -> bool {
+            const auto it = _entries.find(key);
+
+            return it == _entries.end() || !it->second.isComputing;
+        };
+
+        while (true) {
+            const auto it = _entries.find(key);
+
+            if (it == _entries.end())
+                break;
+
+            if (!it->second.isComputing) {
+                _recentlyUsed.splice(_recentlyUsed.begin(), _recentlyUsed, it->second.recentlyUsed);
+
+                return it->second.value;
+            }
+
+            // Another caller computes the value; a cancelled computation removes the entry, so then this caller computes it
+            if (!_settled.wait(lock, stopToken, isSettled))
+                return nullptr;
+        }
+
+        _entries.emplace(key, Entry());
+
+        lock.unlock();
+
+        auto value = compute();
+
+        lock.lock();
+
+        if (value == nullptr) {
+            _entries.erase(key);
+            _settled.notify_all();
+
+            return nullptr;
+        }
+
+        auto& entry = _entries[key];
+
+        entry.value         = value;
+        entry.memorySize    = _memorySize(*value);
+        entry.isComputing   = false;
+        entry.recentlyUsed  = _recentlyUsed.insert(_recentlyUsed.begin(), key);
+
+        _memoryUsage += entry.memorySize;
+
+        evict();
+
+        _settled.notify_all();
+
+        return value;
+    }
+
+    /**
+     * Remove the cached values whose key matches \p predicate, e.g. those of data that changed since
+     *
+     * Values still in use stay alive with their users; computations in progress are left alone.
+     *
+     * @param predicate Takes a key and returns whether to remove its value
+     */
+    template <typename Predicate>
+    void removeIf(Predicate predicate)
+    {
+        const std::lock_guard lock(_mutex);
+
+        for (auto it = _entries.begin(); it != _entries.end();) {
+            if (it->second.isComputing || !predicate(it->first)) {
+                ++it;
+                continue;
+            }
+
+            _memoryUsage -= it->second.memorySize;
+
+            _recentlyUsed.erase(it->second.recentlyUsed);
+
+            it = _entries.erase(it);
+        }
+    }
+
+    /**
+     * Set the number of bytes the cached values may take, and evict values beyond it
+     * @param memoryBudget Memory budget in bytes
+     */
+    void setMemoryBudget(std::size_t memoryBudget)
+    {
+        const std::lock_guard lock(_mutex);
+
+        _memoryBudget = memoryBudget;
+
+        evict();
+    }
+
+    /** Get the number of bytes the cached values may take */
+    std::size_t getMemoryBudget() const
+    {
+        const std::lock_guard lock(_mutex);
+
+        return _memoryBudget;
+    }
+
+    /** Get the number of bytes the cached values take */
+    std::size_t getMemoryUsage() const
+    {
+        const std::lock_guard lock(_mutex);
+
+        return _memoryUsage;
+    }
+
+    /** Get the number of cached values (computations in progress included) */
+    std::size_t size() const
+    {
+        const std::lock_guard lock(_mutex);
+
+        return _entries.size();
+    }
+
+private:
+
+    /** Cached value, or a value that is being computed */
+    struct Entry
+    {
+        ValuePointer                            value;                  /** Value (nullptr while computing) */
+        std::size_t                             memorySize = 0;         /** Number of bytes the value takes */
+        bool                                    isComputing = true;     /** Whether the value is being computed */
+        typename std::list<std::string>::iterator recentlyUsed;         /** Position in the recently used list */
+    };
+
+    /** Evict unreferenced values, least recently used first, until the values fit the memory budget (with the lock held) */
+    void evict()
+    {
+        for (auto it = _recentlyUsed.end(); it != _recentlyUsed.begin() && _memoryUsage > _memoryBudget;) {
+            --it;
+
+            const auto entry = _entries.find(*it);
+
+            // Values in use stay, their memory is held by their users anyway
+            if (entry->second.value.use_count() > 1)
+                continue;
+
+            _memoryUsage -= entry->second.memorySize;
+
+            _entries.erase(entry);
+
+            it = _recentlyUsed.erase(it);
+        }
+    }
+
+private:
+    MemorySizeFunction                          _memorySize;            /** Gets the number of bytes a value takes */
+    std::size_t                                 _memoryBudget;          /** Number of bytes the cached values may take */
+    std::size_t                                 _memoryUsage = 0;       /** Number of bytes the cached values take */
+    std::unordered_map<std::string, Entry>      _entries;               /** Cached values and computations in progress by key */
+    std::list<std::string>                      _recentlyUsed;          /** Keys of the cached values, most recently used first */
+    mutable std::mutex                          _mutex;                 /** Guards all members */
+    std::condition_variable_any                 _settled;               /** Notified when a computation finished or was cancelled */
+};
+
+}
@@ -0,0 +1,121 @@
+#include "StageTrace.h"
+
+#include "HeatMapPayload.h"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace heatmap
+{
+
+StageTrace::StageTrace() :
+    _mutex(),
+    _spans(),
+    _threads(),
+    _update(0),
+    _start(std::chrono::steady_clock::now()),
+    _systemStart(std::chrono::system_clock::now())
+{
+}
+
+std::uint64_t StageTrace::beginUpdate()
+{
+    std::lock_guard lock(_mutex);
+
+    return ++_update;
+}
+
+std::uint64_t StageTrace::getCurrentUpdate() const
+{
+    std::lock_guard lock(_mutex);
+
+    return _update;
+}
+
+std::int64_t StageTrace::now() const
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - _start).count();
+}
+
+std::int64_t StageTrace::fromSystemTime(double millisecondsSinceEpoch) const
+{
+    const auto systemStart = std::chrono::duration<double, std::milli>(_systemStart.time_since_epoch()).count();
+
+    return static_cast<std::int64_t>((millisecondsSinceEpoch - systemStart) * 1000.0);
+}
+
+void StageTrace::addSpan(std::string name, std::string category, std::uint64_t update, std::int64_t begin, std::int64_t end)
+{
+    std::lock_guard lock(_mutex);
+
+    std::uint32_t thread = 0;
+
+    if (category != "page")
+        thread = _threads.try_emplace(std::this_thread::get_id(), static_cast<std::uint32_t>(_threads.size() + 1)).first->second;
+
+    _spans.push_back({ std::move(name), std::move(category), update, begin, std::max<std::int64_t>(0, end - begin), thread });
+
+    if (_spans.size() > maxSpans)
+        _spans.pop_front();
+}
+
+std::vector<std::pair<std::string, double>> StageTrace::getStageDurations(std::uint64_t update) const
+{
+    std::lock_guard lock(_mutex);
+
+    std::vector<std::pair<std::string, double>> durations;
+
+    for (const auto& span : _spans) {
+        if (span.update != update)
+            continue;
+
+        auto stage = std::find_if(durations.begin(), durations.end(), [&span](const auto& duration) { return duration.first == span.name; });
+
+        if (stage == durations.end())
+            stage = durations.insert(durations.end(), { span.name, 0.0 });
+
+        stage->second += span.duration / 1000.0;
+    }
+
+    return durations;
+}
+
+std::string StageTrace::getSummary(std::uint64_t update) const
+{
+    std::string summary;
+
+    for (const auto& [name, milliseconds] : getStageDurations(update)) {
+        char duration[32];
+
+        std::snprintf(duration, sizeof(duration), " %.1f ms", milliseconds);
+
+        summary += (summary.empty() ? "" : ", ") + name + duration;
+    }
+
+    return summary;
+}
+
+std::string StageTrace::toChromeTrace() const
+{
+    std::lock_guard lock(_mutex);
+
+    // Complete ("X") events; the plugin and the page are shown as two processes
+    std::string json = "{\"traceEvents\":[";
+
+    json += "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"HeatMap plugin\"}},";
+    json += "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":2,\"tid\":0,\"args\":{\"name\":\"HeatMap page\"}}";
+
+    for (const auto& span : _spans) {
+        json += ",{\"name\":" + HeatMapPayload::toJsonString(span.name) +
+            ",\"cat\":" + HeatMapPayload::toJsonString(span.category) +
+            ",\"ph\":\"X\",\"ts\":" + std::to_string(span.begin) +
+            ",\"dur\":" + std::to_string(span.duration) +
+            ",\"pid\":" + (span.category == "page" ? "2" : "1") +
+            ",\"tid\":" + std::to_string(span.thread) +
+            ",\"args\":{\"update\":" + std::to_string(span.update) + "}}";
+    }
+
+    return json + "],\"displayTimeUnit\":\"ms\"}";
+}
+
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace heatmap
+{
+
+/** Timed stage of an update */
+struct TraceSpan
+{
+    std::string     name;           /** Stage name */
+    std::string     category;       /** "plugin" for stages in the plugin, "page" for stages reported by the web page */
+    std::uint64_t   update = 0;     /** Update the stage belongs to */
+    std::int64_t    begin = 0;      /** Start in microseconds since the trace was created */
+    std::int64_t    duration = 0;   /** Duration in microseconds */
+    std::uint32_t   thread = 0;     /** Small thread number (page stages are all on thread zero) */
+};
+
+/**
+ * Stage trace
+ *
+ * Collects timing spans of the stages of every heatmap update (snapshot, statistics, payload,
+ * transfer and the page's decode, layout and render), from any thread. Spans are grouped by
+ * update, so that the stage durations of an update can be summarized, and the whole trace can be
+ * exported in the Chrome trace event format (chrome://tracing, Perfetto). Only the most recent
+ * spans are kept.
+ */
+class StageTrace
+{
+public:
+
+    /** Maximum number of spans kept; older spans are dropped first */
+    static constexpr std::size_t maxSpans = 65536;
+
+    /** Times a stage from construction to destruction */
+    class Scope
+    {
+    public:
+
+        /**
+         * Start timing stage \p name of \p update
+         * @param trace Trace to add the span to
+         * @param name Stage name
+         * @param update Update the stage belongs to
+         */
+        Scope(StageTrace& trace, std::string name, std::uint64_t update) :
+            _trace(trace),
+            _name(std::move(name)),
+            _update(update),
+            _begin(trace.now())
+        {
+        }
+
+        ~Scope()
+        {
+            _trace.addSpan(std::move(_name), "plugin", _update, _begin, _trace.now());
+        }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        StageTrace&     _trace;     /** Trace to add the span to */
+        std::string     _name;      /** Stage name */
+        std::uint64_t   _update;    /** Update the stage belongs to */
+        std::int64_t    _begin;     /** Start in microseconds since the trace was created */
+    };
+
+public:
+    StageTrace();
+
+    /** Start a new update and make it the current one */
+    std::uint64_t beginUpdate();
+
+    /** Get the most recently started update */
+    std::uint64_t getCurrentUpdate() const;
+
+    /** Get the current time in microseconds since the trace was created */
+    std::int64_t now() const;
+
+    /**
+     * Convert a wall clock time, as reported by the web page (performance.timeOrigin + performance.now()), to trace time
+     * @param millisecondsSinceEpoch Milliseconds since the Unix epoch
+     * @return Microseconds since the trace was created
+     */
+    std::int64_t fromSystemTime(double millisecondsSinceEpoch) const;
+
+    /**
+     * Add a span that ran on the calling thread (or on the page for the "page" category)
+     * @param name Stage name
+     * @param category "plugin" or "page"
+     * @param update Update the stage belongs to
+     * @param begin Start in microseconds since the trace was created
+     * @param end End in microseconds since the trace was created
+     */
+    void addSpan(std::string name, std::string category, std::uint64_t update, std::int64_t begin, std::int64_t end);
+
+    /**
+     * Get the total duration of every stage of \p update, in order of first occurrence
+     * @param update Update
+     * @return Pairs of stage name and milliseconds
+     */
+    std::vector<std::pair<std::string, double>> getStageDurations(std::uint64_t update) const;
+
+    /**
+     * Get a one line summary of the stage durations of \p update, e.g. "moments 120.5 ms, payload 3.1 ms"
+     * @param update Update
+     */
+    std::string getSummary(std::uint64_t update) const;
+
+    /** Get all spans as a Chrome trace event JSON document */
+    std::string toChromeTrace() const;
+
+private:
+    mutable std::mutex                                  _mutex;         /** Guards the spans and thread numbers */
+    std::deque<TraceSpan>                               _spans;         /** Most recent spans in order of completion */
+    std::unordered_map<std::thread::id, std::uint32_t>  _threads;       /** Small number per thread that added spans */
+    std::uint64_t                                       _update;        /** Most recently started update */
+    std::chrono::steady_clock::time_point               _start;         /** Creation time */
+    std::chrono::system_clock::time_point               _systemStart;   /** Wall clock time at creation */
+};
+
+}
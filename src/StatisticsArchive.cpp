@@ -0,0 +1,222 @@
+#include "StatisticsArchive.h"
+
+#include "Parallel.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <limits>
+
+namespace heatmap
+{
+
+namespace
+{
+    /** Identifies statistics archives ("HMSA") and their layout version */
+    constexpr std::uint32_t archiveMagic    = 0x41534d48u;
+    constexpr std::uint32_t archiveVersion  = 2;
+
+    /** Bytes of the archive header: magic, version, fingerprint, number of clusters and dimensions */
+    constexpr std::size_t headerSize = 2 * sizeof(std::uint32_t) + 3 * sizeof(std::uint64_t);
+
+    /** Maximum number of sampled points and dimensions of a fingerprint */
+    constexpr std::size_t numSampledPoints      = 512;
+    constexpr std::size_t numSampledDimensions  = 8;
+
+    /** SplitMix64 finalizer */
+    std::uint64_t mix(std::uint64_t value)
+    {
+        value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ull;
+        value = (value ^ (value >> 27)) * 0x94d049bb133111ebull;
+
+        return value ^ (value >> 31);
+    }
+
+    /** Combine \p value into the order-dependent hash \p hash */
+    std::uint64_t combine(std::uint64_t hash, std::uint64_t value)
+    {
+        return mix(hash ^ (value + 0x9e3779b97f4a7c15ull + (hash << 6) + (hash >> 2)));
+    }
+
+    /** Evenly spread indices in [0, count), including the first and last */
+    std::vector<std::size_t> spread(std::size_t count, std::size_t maximum)
+    {
+        std::vector<std::size_t> indices;
+
+        if (count <= maximum) {
+            for (std::size_t index = 0; index < count; ++index)
+                indices.push_back(index);
+
+            return indices;
+        }
+
+        for (std::size_t sample = 0; sample < maximum; ++sample)
+            indices.push_back(sample * (count - 1) / (maximum - 1));
+
+        return indices;
+    }
+
+    /** Bytes of the moments of one cluster in the archive */
+    std::size_t getClusterSize(std::size_t numDimensions)
+    {
+        return sizeof(std::uint64_t) + numDimensions * (3 * sizeof(double) + sizeof(std::uint32_t));
+    }
+
+    template <typename T>
+    char* write(char* destination, const T& value)
+    {
+        std::memcpy(destination, &value, sizeof(T));
+
+        return destination + sizeof(T);
+    }
+
+    template <typename T>
+    const char* read(const char* source, T& value)
+    {
+        std::memcpy(&value, source, sizeof(T));
+
+        return source + sizeof(T);
+    }
+}
+
+FingerprintSample getFingerprintSample(std::size_t numPoints, std::size_t numDimensions)
+{
+    return { spread(numPoints, numSampledPoints), spread(numDimensions, numSampledDimensions) };
+}
+
+std::uint64_t fingerprintStatisticsInput(std::size_t numPoints, std::size_t numDimensions, std::span<const float> sampleValues, const std::vector<std::span<const std::uint32_t>>& clusterIndices, std::uint64_t seed)
+{
+    std::vector<std::uint64_t> clusterHashes(clusterIndices.size());
+
+    parallelFor(clusterIndices.size(), [&](std::size_t clusterIndex) -> void {
+        clusterHashes[clusterIndex] = hashIndices(clusterIndices[clusterIndex]);
+    });
+
+    auto fingerprint = mix(seed);
+
+    fingerprint = combine(fingerprint, numPoints);
+    fingerprint = combine(fingerprint, numDimensions);
+    fingerprint = combine(fingerprint, sampleValues.size());
+
+    for (const auto value : sampleValues)
+        fingerprint = combine(fingerprint, std::bit_cast<std::uint32_t>(value));
+
+    fingerprint = combine(fingerprint, clusterIndices.size());
+
+    for (const auto clusterHash : clusterHashes)
+        fingerprint = combine(fingerprint, clusterHash);
+
+    return fingerprint;
+}
+
+std::vector<char> encodeStatisticsArchive(std::uint64_t fingerprint, std::span<const ClusterMomentsCache::MomentsPointer> moments)
+{
+    const std::size_t numDimensions = !moments.empty() && moments.front() ? moments.front()->getNumDimensions() : 0;
+
+    for (const auto& clusterMoments : moments)
+        if (!clusterMoments || clusterMoments->getNumDimensions() != numDimensions)
+            return {};
+
+    const auto clusterSize = getClusterSize(numDimensions);
+
+    std::vector<char> archive(headerSize + moments.size() * clusterSize);
+
+    auto destination = archive.data();
+
+    destination = write(destination, archiveMagic);
+    destination = write(destination, archiveVersion);
+    destination = write(destination, fingerprint);
+    destination = write(destination, static_cast<std::uint64_t>(moments.size()));
+    destination = write(destination, static_cast<std::uint64_t>(numDimensions));
+
+    parallelFor(moments.size(), [&](std::size_t clusterIndex) -> void {
+        const auto& clusterMoments = *moments[clusterIndex];
+
+        auto clusterDestination = write(destination + clusterIndex * clusterSize, clusterMoments.count);
+
+        std::memcpy(clusterDestination, clusterMoments.mean.data(), numDimensions * sizeof(double));
+        clusterDestination += numDimensions * sizeof(double);
+
+        std::memcpy(clusterDestination, clusterMoments.m2.data(), numDimensions * sizeof(double));
+        clusterDestination += numDimensions * sizeof(double);
+
+        std::memcpy(clusterDestination, clusterMoments.positiveSum.data(), numDimensions * sizeof(double));
+        clusterDestination += numDimensions * sizeof(double);
+
+        for (const auto positive : clusterMoments.positive)
+            clusterDestination = write(clusterDestination, static_cast<std::uint32_t>(std::min<std::uint64_t>(positive, std::numeric_limits<std::uint32_t>::max())));
+    });
+
+    return archive;
+}
+
+bool readStatisticsArchiveHeader(std::span<const char> archive, StatisticsArchiveHeader& header)
+{
+    if (archive.size() < headerSize)
+        return false;
+
+    std::uint32_t magic = 0, version = 0;
+
+    auto source = archive.data();
+
+    source = read(source, magic);
+    source = read(source, version);
+    source = read(source, header.fingerprint);
+    source = read(source, header.numClusters);
+    source = read(source, header.numDimensions);
+
+    if (magic != archiveMagic || version != archiveVersion)
+        return false;
+
+    // Guard the size computation against corrupt counts
+    const auto maximumDimensions = (std::numeric_limits<std::size_t>::max() - sizeof(std::uint64_t)) / (3 * sizeof(double) + sizeof(std::uint32_t));
+
+    if (header.numDimensions > maximumDimensions)
+        return false;
+
+    const auto clusterSize = getClusterSize(header.numDimensions);
+
+    return header.numClusters <= (archive.size() - headerSize) / clusterSize && archive.size() == headerSize + header.numClusters * clusterSize;
+}
+
+bool decodeStatisticsArchive(std::span<const char> archive, std::vector<ClusterMomentsCache::MomentsPointer>& moments)
+{
+    StatisticsArchiveHeader header;
+
+    if (!readStatisticsArchiveHeader(archive, header))
+        return false;
+
+    const std::size_t numDimensions = header.numDimensions;
+    const auto clusterSize          = getClusterSize(numDimensions);
+    const auto clusters             = archive.data() + headerSize;
+
+    moments.assign(header.numClusters, nullptr);
+
+    parallelFor(moments.size(), [&](std::size_t clusterIndex) -> void {
+        auto clusterMoments = std::make_shared<ClusterMoments>(numDimensions);
+
+        auto source = read(clusters + clusterIndex * clusterSize, clusterMoments->count);
+
+        std::memcpy(clusterMoments->mean.data(), source, numDimensions * sizeof(double));
+        source += numDimensions * sizeof(double);
+
+        std::memcpy(clusterMoments->m2.data(), source, numDimensions * sizeof(double));
+        source += numDimensions * sizeof(double);
+
+        std::memcpy(clusterMoments->positiveSum.data(), source, numDimensions * sizeof(double));
+        source += numDimensions * sizeof(double);
+
+        for (auto& positive : clusterMoments->positive) {
+            std::uint32_t value = 0;
+
+            source      = read(source, value);
+            positive    = value;
+        }
+
+        moments[clusterIndex] = std::move(clusterMoments);
+    });
+
+    return true;
+}
+
+}
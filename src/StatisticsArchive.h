@@ -0,0 +1,112 @@
+#pragma once
+
+#include "ClusterMomentsCache.h"
+#include "ClusterStatistics.h"
+#include "ClusterStatisticsKernels.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace heatmap
+{
+
+/**
+ * Points and dimensions whose values are part of the fingerprint of a statistics input
+ *
+ * Validating saved statistics must not rescan the point values, so only a fixed grid of
+ * values (evenly spread points times evenly spread dimensions) is hashed.
+ */
+struct FingerprintSample
+{
+    std::vector<std::size_t>    points;         /** Sampled point indices */
+    std::vector<std::size_t>    dimensions;     /** Sampled dimension indices */
+};
+
+/**
+ * Get the values sampled for the fingerprint of a \p numPoints x \p numDimensions matrix
+ * @param numPoints Number of points
+ * @param numDimensions Number of dimensions
+ * @return At most 512 points times at most 8 dimensions, including the first and last of both
+ */
+FingerprintSample getFingerprintSample(std::size_t numPoints, std::size_t numDimensions);
+
+/**
+ * Read the sampled values of row-major point values
+ * @param values Row-major point values (numPoints x numDimensions)
+ * @param numDimensions Number of dimensions
+ * @param sample Sampled points and dimensions
+ * @return Sampled values, dimension by dimension
+ */
+template <typename ElementType>
+std::vector<float> readFingerprintSample(const ElementType* values, std::size_t numDimensions, const FingerprintSample& sample)
+{
+    std::vector<float> sampleValues;
+
+    if (values == nullptr)
+        return sampleValues;
+
+    sampleValues.reserve(sample.dimensions.size() * sample.points.size());
+
+    for (const auto dimension : sample.dimensions)
+        for (const auto point : sample.points)
+            sampleValues.push_back(static_cast<float>(kernels::widen(values[point * numDimensions + dimension])));
+
+    return sampleValues;
+}
+
+/**
+ * Fingerprint the input of a statistics computation
+ *
+ * Combines the matrix size, the sampled values and the hashes of the cluster index sets (in
+ * cluster order), so a saved computation can be validated in O(points) index hashing without
+ * reading the point values.
+ *
+ * @param numPoints Number of points
+ * @param numDimensions Number of dimensions
+ * @param sampleValues Values of getFingerprintSample(numPoints, numDimensions), dimension by dimension
+ * @param clusterIndices Point indices per cluster
+ * @param seed Seed that identifies the computation settings (e.g. the accumulation precision)
+ * @return Fingerprint
+ */
+std::uint64_t fingerprintStatisticsInput(std::size_t numPoints, std::size_t numDimensions, std::span<const float> sampleValues, const std::vector<std::span<const std::uint32_t>>& clusterIndices, std::uint64_t seed = 0);
+
+/** Header of a statistics archive */
+struct StatisticsArchiveHeader
+{
+    std::uint64_t   fingerprint = 0;        /** Fingerprint of the input the statistics were computed from */
+    std::uint64_t   numClusters = 0;        /** Number of clusters */
+    std::uint64_t   numDimensions = 0;      /** Number of dimensions */
+};
+
+/**
+ * Encode cluster moments as a statistics archive
+ *
+ * The archive is a header followed by, per cluster, the point count, the means, the sums
+ * of squared deviations and the sums of the expressing values (all double precision, so cached
+ * moments merge as before) and the 32-bit expressing counts, all in native byte order.
+ *
+ * @param fingerprint Fingerprint of the input the moments were computed from
+ * @param moments Moments per cluster (all with the same number of dimensions)
+ * @return Archive bytes
+ */
+std::vector<char> encodeStatisticsArchive(std::uint64_t fingerprint, std::span<const ClusterMomentsCache::MomentsPointer> moments);
+
+/**
+ * Read the header of statistics archive \p archive
+ * @param archive Archive bytes
+ * @param header Receives the header
+ * @return Whether \p archive is a complete archive of a known version
+ */
+bool readStatisticsArchiveHeader(std::span<const char> archive, StatisticsArchiveHeader& header);
+
+/**
+ * Decode the cluster moments of statistics archive \p archive
+ * @param archive Archive bytes
+ * @param moments Receives the moments per cluster
+ * @return Whether \p archive is a complete archive of a known version
+ */
+bool decodeStatisticsArchive(std::span<const char> archive, std::vector<ClusterMomentsCache::MomentsPointer>& moments);
+
+}
@@ -0,0 +1,52 @@
+#include "StatisticsMatrix.h"
+
+#include "Parallel.h"
+
+namespace heatmap
+{
+
+StatisticsMatrix::StatisticsMatrix(std::size_t numRows, std::size_t numColumns, float value) :
+    _numRows(numRows),
+    _numColumns(numColumns),
+    _values(numRows * numColumns, value)
+{
+}
+
+StatisticsMatrix gatherMomentStatistic(std::span<const std::shared_ptr<const ClusterMoments>> moments, std::size_t numDimensions, MomentStatistic statistic)
+{
+    StatisticsMatrix matrix(moments.size(), numDimensions);
+
+    parallelFor(moments.size(), [&](std::size_t clusterIndex) -> void {
+        const auto& clusterMoments = moments[clusterIndex];
+
+        if (clusterMoments == nullptr || clusterMoments->getNumDimensions() != numDimensions)
+            return;
+
+        auto row = matrix.getRow(clusterIndex);
+
+        for (std::size_t dimension = 0; dimension < numDimensions; ++dimension) {
+            switch (statistic)
+            {
+                case MomentStatistic::Mean:
+                    row[dimension] = clusterMoments->getMean(dimension);
+                    break;
+
+                case MomentStatistic::StandardDeviation:
+                    row[dimension] = clusterMoments->getStandardDeviation(dimension);
+                    break;
+
+                case MomentStatistic::PositiveFraction:
+                    row[dimension] = clusterMoments->getPositiveFraction(dimension);
+                    break;
+
+                case MomentStatistic::ExpressingMean:
+                    row[dimension] = clusterMoments->getExpressingMean(dimension);
+                    break;
+            }
+        }
+    });
+
+    return matrix;
+}
+
+}
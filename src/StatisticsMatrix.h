@@ -0,0 +1,199 @@
+#pragma once
+
+#include "ClusterStatistics.h"
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <span>
+#include <vector>
+
+namespace heatmap
+{
+
+/**
+ * Allocator of storage aligned to \p Alignment bytes
+ * @tparam T Element type
+ * @tparam Alignment Alignment in bytes (a power of two)
+ */
+template <typename T, std::size_t Alignment>
+struct AlignedAllocator
+{
+    using value_type = T;
+
+    template <typename U>
+    struct rebind
+    {
+        using other = AlignedAllocator<U, Alignment>;
+    };
+
+    AlignedAllocator() = default;
+
+    template <typename U>
+    AlignedAllocator(const AlignedAllocator<U, Alignment>&)
+    {
+    }
+
+    T* allocate(std::size_t count)
+    {
+        return static_cast<T*>(::operator new(count * sizeof(T), std::align_val_t(Alignment)));
+    }
+
+    void deallocate(T* pointer, std::size_t)
+    {
+        ::operator delete(pointer, std::align_val_t(Alignment));
+    }
+
+    template <typename U>
+    bool operator==(const AlignedAllocator<U, Alignment>&) const {
+        return true;
+    }
+};
+
+/** Strided view of one column of a row-major matrix */
+template <typename T>
+class ColumnView
+{
+public:
+
+    /**
+     * Construct a view of \p size elements \p stride elements apart
+     * @param first First element of the column
+     * @param size Number of elements (rows)
+     * @param stride Distance between consecutive elements (the number of columns)
+     */
+    ColumnView(T* first, std::size_t size, std::size_t stride) :
+        _first(first),
+        _size(size),
+        _stride(stride)
+    {
+    }
+
+    /** Get the number of elements */
+    std::size_t size() const {
+        return _size;
+    }
+
+    /** Get element \p index */
+    T& operator[](std::size_t index) const {
+        return _first[index * _stride];
+    }
+
+private:
+    T*          _first;     /** First element of the column */
+    std::size_t _size;      /** Number of elements */
+    std::size_t _stride;    /** Distance between consecutive elements */
+};
+
+/**
+ * Statistics matrix
+ *
+ * Contiguous, row-major clusters x dimensions matrix of single precision statistics, aligned to
+ * a cache line. It is built once per computation and then shared read-only by the plugin and
+ * the heatmap widget, so sorting, transforms and encoding work on the same values without copies.
+ */
+class StatisticsMatrix
+{
+public:
+
+    /** Alignment of the values in bytes */
+    static constexpr std::size_t alignment = 64;
+
+public:
+
+    /** Construct an empty matrix */
+    StatisticsMatrix() = default;
+
+    /**
+     * Construct a \p numRows x \p numColumns matrix filled with \p value
+     * @param numRows Number of rows (clusters)
+     * @param numColumns Number of columns (dimensions)
+     * @param value Initial value
+     */
+    StatisticsMatrix(std::size_t numRows, std::size_t numColumns, float value = 0.f);
+
+    /** Get the number of rows (clusters) */
+    std::size_t getNumRows() const {
+        return _numRows;
+    }
+
+    /** Get the number of columns (dimensions) */
+    std::size_t getNumColumns() const {
+        return _numColumns;
+    }
+
+    /** Get the number of values */
+    std::size_t size() const {
+        return _values.size();
+    }
+
+    /** Get whether the matrix has no values */
+    bool empty() const {
+        return _values.empty();
+    }
+
+    /** Get the row-major values */
+    const float* data() const {
+        return _values.data();
+    }
+
+    /** Get the row-major values */
+    float* data() {
+        return _values.data();
+    }
+
+    /** Get the value of dimension \p column of cluster \p row */
+    float operator()(std::size_t row, std::size_t column) const {
+        return _values[row * _numColumns + column];
+    }
+
+    /** Get the value of dimension \p column of cluster \p row */
+    float& operator()(std::size_t row, std::size_t column) {
+        return _values[row * _numColumns + column];
+    }
+
+    /** Get the values of cluster \p row */
+    std::span<const float> getRow(std::size_t row) const {
+        return { _values.data() + row * _numColumns, _numColumns };
+    }
+
+    /** Get the values of cluster \p row */
+    std::span<float> getRow(std::size_t row) {
+        return { _values.data() + row * _numColumns, _numColumns };
+    }
+
+    /** Get the values of dimension \p column of all clusters */
+    ColumnView<const float> getColumn(std::size_t column) const {
+        return { _values.data() + column, _numRows, _numColumns };
+    }
+
+    /** Get the values of dimension \p column of all clusters */
+    ColumnView<float> getColumn(std::size_t column) {
+        return { _values.data() + column, _numRows, _numColumns };
+    }
+
+private:
+    std::size_t                                                 _numRows = 0;       /** Number of rows (clusters) */
+    std::size_t                                                 _numColumns = 0;    /** Number of columns (dimensions) */
+    std::vector<float, AlignedAllocator<float, alignment>>      _values;            /** Row-major values */
+};
+
+/** Statistic of cluster moments gathered into a statistics matrix */
+enum class MomentStatistic
+{
+    Mean,               /** Per-dimension mean */
+    StandardDeviation,  /** Per-dimension (population) standard deviation */
+    PositiveFraction,   /** Per-dimension fraction of positive (expressing) values */
+    ExpressingMean      /** Per-dimension mean of the positive (expressing) values */
+};
+
+/**
+ * Gather a statistic of the moments of every cluster into a clusters x dimensions matrix (in parallel)
+ * @param moments Moments per cluster (missing moments or moments of another number of dimensions give zero rows)
+ * @param numDimensions Number of dimensions
+ * @param statistic Statistic to gather
+ * @return Statistics matrix
+ */
+StatisticsMatrix gatherMomentStatistic(std::span<const std::shared_ptr<const ClusterMoments>> moments, std::size_t numDimensions, MomentStatistic statistic);
+
+}
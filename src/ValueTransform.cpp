@@ -0,0 +1,225 @@
+#include "ValueTransform.h"
+
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace heatmap
+{
+
+namespace
+{
+    /** Number of dimensions fitted by a single task */
+    constexpr std::size_t dimensionBlockSize = 64;
+
+    /** Percentiles mapped to 0 and 1 by the percentile transform */
+    constexpr double lowerPercentile = 0.01;
+    constexpr double upperPercentile = 0.99;
+
+    /**
+     * Get the (linearly interpolated) quantile \p level of \p values
+     * @param values Values, reordered in place
+     * @param level Quantile level in [0, 1]
+     */
+    double getQuantile(std::vector<float>& values, double level)
+    {
+        const auto position = level * static_cast<double>(values.size() - 1);
+        const auto lower    = static_cast<std::size_t>(position);
+        const auto fraction = position - static_cast<double>(lower);
+
+        std::nth_element(values.begin(), values.begin() + lower, values.end());
+
+        const double lowerValue = values[lower];
+
+        if (fraction == 0.0 || lower + 1 >= values.size())
+            return lowerValue;
+
+        const double upperValue = *std::min_element(values.begin() + lower + 1, values.end());
+
+        return lowerValue + fraction * (upperValue - lowerValue);
+    }
+}
+
+const char* getValueTransformName(ValueTransform transform)
+{
+    switch (transform)
+    {
+        case ValueTransform::None:
+            return "none";
+
+        case ValueTransform::Log1p:
+            return "log1p";
+
+        case ValueTransform::ZScore:
+            return "zscore";
+
+        case ValueTransform::MinMax:
+            return "minmax";
+
+        case ValueTransform::Percentile:
+            return "percentile";
+    }
+
+    return "none";
+}
+
+ValueTransformer::ValueTransformer(ValueTransform transform, const float* values, std::size_t numRows, std::size_t numDimensions) :
+    _transform(transform),
+    _offsets(),
+    _scales()
+{
+    if (transform == ValueTransform::None || transform == ValueTransform::Log1p)
+        return;
+
+    _offsets.assign(numDimensions, 0.f);
+    _scales.assign(numDimensions, 1.f);
+
+    if (values == nullptr || numRows == 0)
+        return;
+
+    const auto numBlocks = (numDimensions + dimensionBlockSize - 1) / dimensionBlockSize;
+
+    parallelFor(numBlocks, [&](std::size_t blockIndex) -> void {
+        const auto dimensionBegin   = blockIndex * dimensionBlockSize;
+        const auto dimensionEnd     = std::min(dimensionBegin + dimensionBlockSize, numDimensions);
+
+        std::vector<float> column;
+
+        column.reserve(numRows);
+
+        for (auto dimension = dimensionBegin; dimension < dimensionEnd; ++dimension) {
+            column.clear();
+
+            for (std::size_t row = 0; row < numRows; ++row)
+                if (const auto value = values[row * numDimensions + dimension]; std::isfinite(value))
+                    column.push_back(value);
+
+            if (column.empty())
+                continue;
+
+            // Dimensions without variation over the clusters map to zero
+            double offset = 0.0, range = 0.0;
+
+            switch (transform)
+            {
+                case ValueTransform::ZScore:
+                {
+                    double mean = 0.0, m2 = 0.0;
+
+                    for (std::size_t index = 0; index < column.size(); ++index) {
+                        const auto delta = column[index] - mean;
+
+                        mean    += delta / static_cast<double>(index + 1);
+                        m2      += delta * (column[index] - mean);
+                    }
+
+                    offset  = mean;
+                    range   = std::sqrt(m2 / static_cast<double>(column.size()));
+                    break;
+                }
+
+                case ValueTransform::MinMax:
+                {
+                    const auto [minimum, maximum] = std::minmax_element(column.begin(), column.end());
+
+                    offset  = *minimum;
+                    range   = static_cast<double>(*maximum) - *minimum;
+                    break;
+                }
+
+                case ValueTransform::Percentile:
+                {
+                    offset  = getQuantile(column, lowerPercentile);
+                    range   = getQuantile(column, upperPercentile) - offset;
+                    break;
+                }
+
+                default:
+                    break;
+            }
+
+            _offsets[dimension] = static_cast<float>(offset);
+            _scales[dimension]  = range > 0.0 ? static_cast<float>(1.0 / range) : 0.f;
+        }
+    });
+}
+
+void ValueTransformer::transformValues(const float* values, float* result, std::size_t numRows, std::size_t numColumns, std::size_t dimensionBegin) const
+{
+    parallelFor(numRows, [&](std::size_t row) -> void {
+        const auto rowValues    = values + row * numColumns;
+        const auto rowResult    = result + row * numColumns;
+
+        switch (_transform)
+        {
+            case ValueTransform::None:
+            {
+                if (rowResult != rowValues)
+                    std::copy_n(rowValues, numColumns, rowResult);
+
+                break;
+            }
+
+            case ValueTransform::Log1p:
+            {
+                for (std::size_t column = 0; column < numColumns; ++column)
+                    rowResult[column] = std::copysign(std::log1p(std::abs(rowValues[column])), rowValues[column]);
+
+                break;
+            }
+
+            default:
+            {
+                const auto offsets  = _offsets.data() + dimensionBegin;
+                const auto scales   = _scales.data() + dimensionBegin;
+
+                for (std::size_t column = 0; column < numColumns; ++column)
+                    rowResult[column] = (rowValues[column] - offsets[column]) * scales[column];
+
+                break;
+            }
+        }
+    });
+}
+
+void ValueTransformer::transformSpreads(const float* values, const float* spreads, float* result, std::size_t numRows, std::size_t numColumns, std::size_t dimensionBegin) const
+{
+    parallelFor(numRows, [&](std::size_t row) -> void {
+        const auto rowValues    = values + row * numColumns;
+        const auto rowSpreads   = spreads + row * numColumns;
+        const auto rowResult    = result + row * numColumns;
+
+        switch (_transform)
+        {
+            case ValueTransform::None:
+            {
+                if (rowResult != rowSpreads)
+                    std::copy_n(rowSpreads, numColumns, rowResult);
+
+                break;
+            }
+
+            case ValueTransform::Log1p:
+            {
+                // First order propagation: the derivative of log(1 + |x|) is 1 / (1 + |x|)
+                for (std::size_t column = 0; column < numColumns; ++column)
+                    rowResult[column] = rowSpreads[column] / (1.f + std::abs(rowValues[column]));
+
+                break;
+            }
+
+            default:
+            {
+                const auto scales = _scales.data() + dimensionBegin;
+
+                for (std::size_t column = 0; column < numColumns; ++column)
+                    rowResult[column] = rowSpreads[column] * scales[column];
+
+                break;
+            }
+        }
+    });
+}
+
+}
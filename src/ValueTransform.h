@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace heatmap
+{
+
+/** Transform of the cluster statistics before they are color mapped */
+enum class ValueTransform
+{
+    None,           /** Statistics as computed */
+    Log1p,          /** Sign preserving log(1 + |x|) */
+    ZScore,         /** Per dimension, minus the mean and divided by the standard deviation over the clusters */
+    MinMax,         /** Per dimension, the minimum over the clusters to 0 and the maximum to 1 */
+    Percentile      /** Per dimension, the 1st percentile over the clusters to 0 and the 99th to 1 (robust to outlier clusters) */
+};
+
+/**
+ * Get the name of \p transform as sent to the web page
+ * @param transform Value transform
+ * @return "none", "log1p", "zscore", "minmax" or "percentile"
+ */
+const char* getValueTransformName(ValueTransform transform);
+
+/**
+ * Value transformer
+ *
+ * A value transform fitted to a clusters x dimensions statistics matrix. The per-dimension
+ * transforms are affine, with an offset and scale per dimension taken over the clusters, so they
+ * apply unchanged to other statistics of the same dimensions (quantiles, the selection column).
+ * Spreads (standard deviations) are scaled along; under the log transform they are propagated to
+ * first order, i.e. divided by 1 + |x|.
+ */
+class ValueTransformer
+{
+public:
+
+    /** Construct the identity transform */
+    ValueTransformer() = default;
+
+    /**
+     * Fit \p transform to the columns of a row-major statistics matrix
+     * @param transform Value transform
+     * @param values Row-major statistics (numRows x numDimensions), non-finite values are ignored
+     * @param numRows Number of rows (clusters)
+     * @param numDimensions Number of dimensions
+     */
+    ValueTransformer(ValueTransform transform, const float* values, std::size_t numRows, std::size_t numDimensions);
+
+    /** Get the transform */
+    ValueTransform getTransform() const {
+        return _transform;
+    }
+
+    /**
+     * Transform dimensions [dimensionBegin, dimensionBegin + numColumns) of \p numRows rows
+     * @param values Row-major values (numRows x numColumns)
+     * @param result Receives the transformed values (may be \p values)
+     * @param numRows Number of rows
+     * @param numColumns Number of columns (dimensions) per row
+     * @param dimensionBegin Dimension of the first column
+     */
+    void transformValues(const float* values, float* result, std::size_t numRows, std::size_t numColumns, std::size_t dimensionBegin = 0) const;
+
+    /**
+     * Transform the spreads around \p values like transformValues transforms the values
+     * @param values Row-major (untransformed) values the spreads are around (numRows x numColumns)
+     * @param spreads Row-major spreads (numRows x numColumns)
+     * @param result Receives the transformed spreads (may be \p spreads)
+     * @param numRows Number of rows
+     * @param numColumns Number of columns (dimensions) per row
+     * @param dimensionBegin Dimension of the first column
+     */
+    void transformSpreads(const float* values, const float* spreads, float* result, std::size_t numRows, std::size_t numColumns, std::size_t dimensionBegin = 0) const;
+
+private:
+    ValueTransform      _transform = ValueTransform::None;  /** Value transform */
+    std::vector<float>  _offsets;                           /** Per-dimension offset of the affine transforms */
+    std::vector<float>  _scales;                            /** Per-dimension scale of the affine transforms */
+};
+
+}